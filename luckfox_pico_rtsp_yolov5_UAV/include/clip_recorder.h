@@ -0,0 +1,159 @@
+#ifndef CLIP_RECORDER_H
+#define CLIP_RECORDER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sample_comm.h"
+#include "ts_mux.h"
+
+#define CLIP_RECORDER_MAX_FRAMES 4096       // Access units indexed by the ring
+#define CLIP_RECORDER_FRAME_MAX (1024 * 1024)
+#define CLIP_RECORDER_RING_SLACK_MS 2000    // Ring margin beyond the pre-event time
+#define CLIP_RECORDER_SEGMENT_MS 10000
+#define CLIP_RECORDER_WRITE_BUF (256 * 1024)
+#define CLIP_RECORDER_IDLE_MS 1000          // No frames for this long ends a clip
+#define CLIP_RECORDER_PARAM_SETS_MAX 512
+
+/**
+ * @brief Recorder counters
+ */
+typedef struct {
+    uint64_t frames;            // Access units stored in the ring
+    uint64_t bytes;
+    uint64_t evicted;           // Access units pushed out of the ring
+    uint64_t oversize;          // Access units larger than the ring, not stored
+    uint64_t triggers;
+    uint64_t clips;             // Clips started
+    uint64_t segments;          // Files written
+    uint64_t written_frames;
+    uint64_t written_bytes;     // Transport stream bytes
+    uint64_t overruns;          // Frames evicted before the writer got to them
+    uint64_t write_errors;
+} clip_recorder_stats_t;
+
+/**
+ * @brief One access unit held in the ring
+ */
+typedef struct {
+    uint64_t offset;            // Ring position (monotonic, modulo the ring size)
+    uint32_t len;
+    uint64_t pts_us;
+    bool key;
+} clip_recorder_frame_t;
+
+/**
+ * @brief Pre-event recorder: encoded video kept in memory, written on detection
+ *
+ * Fed from the VENC drain as a venc_sink consumer. Complete access units go
+ * into a byte ring sized for the pre-event time at the peak bitrate. A
+ * trigger starts a clip at the last key frame at least pre_ms before it (or
+ * at the first frame of the pre_ms window, with the cached parameter sets in
+ * front, when the stream uses intra refresh instead of IDRs) and extends it
+ * until post_ms after the latest trigger. A background thread muxes the clip to MPEG-TS
+ * segment files with preallocated extents; neither the frame loop nor the
+ * VENC drain touches the filesystem.
+ */
+typedef struct {
+    char dir[128];
+    bool hevc;
+    uint32_t pre_ms;
+    uint32_t post_ms;
+    uint32_t segment_ms;
+    size_t prealloc;            // Extent reserved per segment file
+
+    uint8_t* ring;
+    size_t ring_size;
+    uint64_t ring_head;         // Bytes ever stored, including a frame in progress
+    uint64_t ring_tail;         // Oldest byte still valid
+    uint64_t frame_start;       // Ring position of the frame being gathered
+    bool frame_drop;            // Frame being gathered is too large
+    bool frame_key;             // Frame being gathered is a random access point
+
+    clip_recorder_frame_t frames[CLIP_RECORDER_MAX_FRAMES];
+    uint64_t frame_head;        // Sequence number of the next access unit
+    uint64_t frame_tail;        // Oldest access unit in the ring
+
+    uint8_t param_sets[CLIP_RECORDER_PARAM_SETS_MAX];   // Latest seen, for intra refresh clips
+    size_t param_sets_len;
+
+    // Clip state, shared with the writer under lock
+    bool active;
+    uint64_t cursor;            // Next access unit to write
+    uint64_t clip_end_us;       // Last trigger plus post_ms
+    uint64_t last_frame_us;     // Monotonic arrival of the newest access unit
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    volatile int running;
+
+    // Writer thread only
+    int fd;
+    int clip_no;
+    int segment_no;
+    char clip_name[64];
+    uint64_t segment_start_us;
+    ts_mux_t mux;
+    uint8_t* copy;              // Access unit copied out of the ring
+    uint8_t* wbuf;              // Transport packets waiting for write()
+    size_t wbuf_len;
+    size_t segment_bytes;
+
+    clip_recorder_stats_t stats;
+} clip_recorder_t;
+
+/**
+ * @brief Allocate the ring and start the writer thread
+ *
+ * @param rec Recorder state
+ * @param dir Directory for the clip files (created if missing)
+ * @param hevc Stream is H.265
+ * @param pre_ms Video kept from before a trigger
+ * @param post_ms Video recorded after the latest trigger
+ * @param max_kbps Peak stream bitrate, sizes the ring and the file extents
+ * @return int 0 on success, -1 on failure
+ */
+int clip_recorder_start(clip_recorder_t* rec, const char* dir, bool hevc,
+                        uint32_t pre_ms, uint32_t post_ms, uint32_t max_kbps);
+
+/**
+ * @brief venc_sink consumer storing every encoded packet (user = recorder)
+ */
+void clip_recorder_venc_consumer(const VENC_PACK_S* pack, const uint8_t* data,
+                                 uint32_t len, void* user);
+
+/**
+ * @brief Record around this moment; cheap, safe to call every frame
+ *
+ * @param rec Recorder
+ * @param pts_us Time of the detection on the VENC PTS clock
+ */
+void clip_recorder_trigger(clip_recorder_t* rec, uint64_t pts_us);
+
+/**
+ * @brief Print the recorder counters
+ */
+void clip_recorder_print_stats(clip_recorder_t* rec);
+
+/**
+ * @brief Finish the clip in progress, stop the writer and free the ring
+ */
+void clip_recorder_stop(clip_recorder_t* rec);
+
+/**
+ * @brief Record synthetic triggered clips and check the files
+ *
+ * Feeds a synthetic stream (key frames every 30 frames, or none with intra
+ * refresh) through the consumer at several times real-time speed with a few
+ * triggers, parses the MPEG-TS files back and checks that every frame of each
+ * clip window is present byte for byte, starts on a decodable frame and that
+ * the producer side never waited on I/O.
+ *
+ * @param dir Scratch directory for the clips
+ * @return int 0 on success, -1 on failure
+ */
+int clip_recorder_selftest(const char* dir);
+
+#endif // CLIP_RECORDER_H
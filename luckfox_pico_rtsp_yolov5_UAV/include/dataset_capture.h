@@ -0,0 +1,184 @@
+#ifndef DATASET_CAPTURE_H
+#define DATASET_CAPTURE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sample_comm.h"
+#include "mavlink_comm.h"
+
+#define DATASET_VENC_CHN 3              // 0 = live, 1 = --hires, 2 = snapshots
+#define DATASET_QFACTOR 90
+#define DATASET_QUEUE 4                 // Frames waiting for the encoder
+#define DATASET_POOL_BLOCKS (DATASET_QUEUE + 1)
+#define DATASET_MAX_LABELS 64
+#define DATASET_WRITE_BUF (1024 * 1024) // Archive bytes gathered per write()
+#define DATASET_FLUSH_MS 5000           // Longest a sample waits in the write buffer
+#define DATASET_SYNC_BYTES (8 * 1024 * 1024)    // Written between fdatasync()s
+#define DATASET_ARCHIVE_MB 256          // Archive size before a new one is started
+#define DATASET_DEFAULT_RATE_KB 1024    // Write rate limit, KB/s
+#define DATASET_WRITER_NICE 10
+#define DATASET_TAR_BLOCK 512
+
+/**
+ * @brief Confidence bands frames are sampled by
+ *
+ * A frame falls in the band of its least confident detection, so frames the
+ * model is unsure about are the ones sampled most often.
+ */
+typedef enum {
+    DATASET_BAND_EMPTY = 0,     // No detections (negatives)
+    DATASET_BAND_LOW,           // 0.25 - 0.50
+    DATASET_BAND_MID,           // 0.50 - 0.75
+    DATASET_BAND_HIGH,          // 0.75 - 1.00
+    DATASET_BAND_COUNT
+} dataset_band_t;
+
+/**
+ * @brief Capture counters
+ */
+typedef struct {
+    uint64_t captured[DATASET_BAND_COUNT];  // Frames copied, per band
+    uint64_t dropped_queue;     // Sampled, but the queue was full
+    uint64_t dropped_buffer;    // Sampled, but every frame buffer was in use
+    uint64_t samples;           // Image + label pairs in the archives
+    uint64_t labels;
+    uint64_t jpeg_bytes;
+    uint64_t written_bytes;     // Archive bytes, headers and padding included
+    uint64_t writes;            // Buffer flushes, one write() each
+    uint64_t throttle_us;       // Writer held back by the rate limit
+    uint64_t archives;
+    uint64_t copy_errors;       // RGA failures (frame loop)
+    uint64_t errors;            // VENC or file failures (writer)
+    uint64_t fence_wait_sum_us; // Frame loop waiting for its copy to finish
+    uint32_t fence_wait_max_us;
+    uint32_t depth;             // Frames queued or encoding now
+    uint32_t depth_max;
+} dataset_stats_t;
+
+/**
+ * @brief One sampled frame with its pseudo-labels
+ */
+typedef struct {
+    MB_BLK mb;
+    int fence;                  // RGA release fence, -1 once the copy is done
+    int band;
+    uint64_t pts_us;
+    int label_count;
+    mavlink_target_t labels[DATASET_MAX_LABELS];
+} dataset_job_t;
+
+/**
+ * @brief Training data harvested from the live pipeline
+ *
+ * Frames are sampled per confidence band, each band at most once per its
+ * interval. A sampled frame is copied by RGA, asynchronously, from the camera
+ * buffer into a block of a small MB pool, and the frame loop only collects
+ * the copy's fence before it gives the camera frame back. A low-priority
+ * worker encodes the clean NV12 copy (no overlay) to JPEG on its own MJPEG
+ * VENC channel and appends the image and a YOLO label file to a tar archive
+ * (images/NAME.jpg, labels/NAME.txt). Archive bytes are gathered into
+ * DATASET_WRITE_BUF and leave in large sequential write()s under a byte rate
+ * limit; when the writer falls behind, the queue fills and frames are not
+ * sampled rather than waited for.
+ */
+typedef struct {
+    char dir[128];
+    int chn;
+    int width;
+    int height;
+    uint32_t rate;              // Bytes per second
+    MB_POOL pool;
+    size_t block_size;
+
+    uint64_t last_sample_us[DATASET_BAND_COUNT];
+
+    dataset_job_t pending;      // Copy started on the current frame
+    bool has_pending;
+
+    dataset_job_t queue[DATASET_QUEUE];
+    uint32_t queue_head;
+    uint32_t queue_tail;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    volatile int running;
+
+    // Writer thread only
+    int fd;
+    int archive_no;
+    char session[32];           // Start time, names the archives and samples
+    uint32_t sample_no;
+    uint64_t archive_bytes;
+    uint64_t unsynced_bytes;
+    uint8_t* wbuf;
+    size_t wbuf_len;
+    uint64_t wbuf_since_us;     // When the oldest buffered byte arrived
+    double tokens;              // Rate limit bucket, bytes
+    uint64_t tokens_us;
+
+    uint64_t rate_samples;      // Counters at the last print
+    uint64_t rate_bytes;
+    uint64_t rate_us;
+
+    dataset_stats_t stats;
+} dataset_capture_t;
+
+/**
+ * @brief Create the JPEG channel and the frame pool, start the writer
+ *
+ * @param ds Capture state
+ * @param dir Directory for the archives (created if missing)
+ * @param width Camera frame width
+ * @param height Camera frame height
+ * @param rate_kb Write rate limit in KB/s
+ * @return int 0 on success, -1 on failure
+ */
+int dataset_capture_start(dataset_capture_t* ds, const char* dir, int width, int height,
+                          uint32_t rate_kb);
+
+/**
+ * @brief Sample this frame if its band is due; never blocks
+ *
+ * @param ds Capture state
+ * @param frame Camera frame (NV12), held until dataset_capture_frame_done()
+ * @param targets Detections in frame pixels
+ * @param count Number of detections
+ * @param pts_us Capture time of the frame
+ */
+void dataset_capture_offer(dataset_capture_t* ds, MB_BLK frame,
+                           const mavlink_target_t* targets, int count, uint64_t pts_us);
+
+/**
+ * @brief Collect this frame's copy and queue it for the writer
+ *
+ * Call before the camera frame is released.
+ */
+void dataset_capture_frame_done(dataset_capture_t* ds);
+
+/**
+ * @brief Print samples per band, write rate, queue depth and drops
+ */
+void dataset_capture_print_stats(dataset_capture_t* ds);
+
+/**
+ * @brief Write out what is queued, close the archive, free the channel and pool
+ */
+void dataset_capture_stop(dataset_capture_t* ds);
+
+/**
+ * @brief Check the archive writer without the camera or the encoder
+ *
+ * Appends synthetic images with labels through the rate-limited writer,
+ * reads the tar archive back and checks every header checksum, name, size
+ * and byte, the YOLO label values, the achieved write rate against the
+ * limit and the average write() size.
+ *
+ * @param dir Scratch directory for the archive
+ * @return int 0 on success, -1 on failure
+ */
+int dataset_capture_selftest(const char* dir);
+
+#endif // DATASET_CAPTURE_H
@@ -0,0 +1,145 @@
+#ifndef DETECTION_SEI_H
+#define DETECTION_SEI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mavlink_comm.h"
+
+// Targets carried per frame; more are dropped from the SEI (not from telemetry)
+#define DETECTION_SEI_MAX_TARGETS 64
+#define DETECTION_SEI_VERSION 1
+
+// Header: version, count, frame width/height, capture PTS
+#define DETECTION_SEI_HEADER_LEN 14
+// Per target: x, y, width, height (uint16), confidence, class_id, target_num
+#define DETECTION_SEI_TARGET_LEN 11
+#define DETECTION_SEI_MAX_PAYLOAD (DETECTION_SEI_HEADER_LEN + DETECTION_SEI_MAX_TARGETS * DETECTION_SEI_TARGET_LEN)
+
+// Worst case NAL: start code, header (two bytes in H.265), type/size bytes, UUID, payload with an
+// emulation prevention byte every two bytes, trailing bits
+#define DETECTION_SEI_MAX_NAL (4 + 2 + 1 + 4 + (16 + DETECTION_SEI_MAX_PAYLOAD) * 3 / 2 + 1)
+
+/**
+ * @brief UUID identifying our user_data_unregistered SEI
+ */
+extern const uint8_t detection_sei_uuid[16];
+
+/**
+ * @brief One frame's detections as decoded from an SEI
+ */
+typedef struct {
+    uint64_t pts;               // Capture PTS (board CLOCK_MONOTONIC us)
+    int frame_width;
+    int frame_height;
+    int count;
+    mavlink_target_t targets[DETECTION_SEI_MAX_TARGETS];
+} detection_sei_frame_t;
+
+/**
+ * @brief Build an Annex-B H.264 SEI NAL (type 6) holding one
+ *        user_data_unregistered message
+ *
+ * @param uuid 16-byte UUID of the message
+ * @param payload User data following the UUID
+ * @param len Payload length
+ * @param out Output buffer (start code included)
+ * @param out_size Output capacity
+ * @return int NAL length in bytes, or -1 if out is too small
+ */
+int h264_sei_build_user_data(const uint8_t uuid[16], const uint8_t* payload, size_t len,
+                             uint8_t* out, size_t out_size);
+
+/**
+ * @brief Same as h264_sei_build_user_data() as an H.265 prefix SEI NAL (type 39)
+ */
+int h265_sei_build_user_data(const uint8_t uuid[16], const uint8_t* payload, size_t len,
+                             uint8_t* out, size_t out_size);
+
+/**
+ * @brief Called for every user_data_unregistered SEI with a matching UUID
+ */
+typedef void (*h264_sei_user_data_fn)(const uint8_t* data, size_t len, void* user);
+
+/**
+ * @brief Scan an Annex-B elementary stream for user_data_unregistered SEIs
+ *
+ * @param stream Elementary stream bytes
+ * @param len Stream length
+ * @param uuid UUID to match
+ * @param fn Callback receiving the unescaped data after the UUID
+ * @param user Opaque pointer for fn
+ * @return int Number of matching SEI messages
+ */
+int h264_sei_scan(const uint8_t* stream, size_t len, const uint8_t uuid[16],
+                  h264_sei_user_data_fn fn, void* user);
+
+/**
+ * @brief h264_sei_scan() for H.265 streams (prefix and suffix SEI NALs)
+ */
+int h265_sei_scan(const uint8_t* stream, size_t len, const uint8_t uuid[16],
+                  h264_sei_user_data_fn fn, void* user);
+
+/**
+ * @brief Serialise a frame's detections (pixel coordinates, little endian)
+ *
+ * @return int Payload length in bytes
+ */
+int detection_sei_encode(uint64_t pts, const mavlink_target_t* targets, int count,
+                         int frame_width, int frame_height,
+                         uint8_t* out, size_t out_size);
+
+/**
+ * @brief Parse a payload produced by detection_sei_encode()
+ *
+ * @return int 0 on success, -1 if the payload is malformed
+ */
+int detection_sei_decode(const uint8_t* data, size_t len, detection_sei_frame_t* frame);
+
+/**
+ * @brief Hand a frame's detections to the encoder thread, keyed by PTS
+ *
+ * Called from the frame loop before the frame is sent to VENC.
+ */
+void detection_sei_publish(uint64_t pts, const mavlink_target_t* targets, int count,
+                           int frame_width, int frame_height);
+
+/**
+ * @brief Build H.265 prefix SEIs instead of H.264 ones from now on
+ */
+void detection_sei_set_codec(bool hevc);
+
+/**
+ * @brief venc_sink prefix callback: the SEI NAL published for pts
+ *
+ * @param pts PTS of the frame about to be streamed
+ * @param out Output buffer, at least DETECTION_SEI_MAX_NAL bytes
+ * @param out_size Output capacity
+ * @param user Unused
+ * @return int NAL length, or 0 if nothing was published for pts
+ */
+int detection_sei_prefix(uint64_t pts, uint8_t* out, size_t out_size, void* user);
+
+/**
+ * @brief Print every detection SEI found in a recorded H.264 or H.265 stream
+ *
+ * @param path Annex-B elementary stream file
+ * @return int Number of SEI frames found, or -1 if the file cannot be read
+ */
+int detection_sei_dump(const char* path);
+
+/**
+ * @brief Round-trip self-test
+ *
+ * For H.264 and then H.265, writes a synthetic elementary stream (random
+ * slices containing start code lookalikes, each frame preceded by a
+ * detection SEI) to path, reads it back with the codec's scanner and checks
+ * every frame decodes unchanged and the other codec's scanner finds nothing.
+ *
+ * @param path Scratch file for the stream
+ * @param frames Number of frames to generate
+ * @return int 0 on success, -1 on mismatch
+ */
+int detection_sei_selftest(const char* path, int frames);
+
+#endif // DETECTION_SEI_H
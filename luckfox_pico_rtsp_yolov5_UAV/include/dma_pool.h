@@ -0,0 +1,181 @@
+#ifndef DMA_POOL_H
+#define DMA_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <vector>
+
+#include "im2d.hpp"
+#include "rk_mpi_mb.h"
+
+/**
+ * @brief Allocator backing a DmaPool
+ */
+typedef enum {
+    DMA_POOL_BACKEND_HEAP = 0,  // rk-dma-heap CMA (dma_alloc.cpp)
+    DMA_POOL_BACKEND_DRM,       // DRM dumb buffers (drm_alloc.cpp)
+    DMA_POOL_BACKEND_MB,        // Rockit MPI MMZ blocks (usable as VENC input)
+    DMA_POOL_BACKEND_COUNT
+} dma_pool_backend_t;
+
+/**
+ * @brief One pooled buffer: allocated, mapped and imported into RGA once
+ */
+typedef struct {
+    int fd;                     // dma-buf file descriptor
+    void* va;                   // CPU mapping
+    size_t size;                // Mapped size in bytes
+    int format;                 // RK_FORMAT_* the buffer was sized for
+    rga_buffer_handle_t handle; // RGA handle from importbuffer_fd
+    MB_BLK mb;                  // MB backend only
+    int drm_handle;             // DRM backend only
+    int bucket;                 // Owning pool key, -1 when unpooled
+} dma_pool_buf_t;
+
+class DmaPool;
+
+/**
+ * @brief RAII lease on a pooled buffer, returned to its pool on destruction
+ *
+ * Leases are move-only. The pool must outlive every lease it hands out.
+ */
+class DmaLease {
+public:
+    DmaLease();
+    ~DmaLease();
+
+    DmaLease(DmaLease&& other);
+    DmaLease& operator=(DmaLease&& other);
+    DmaLease(const DmaLease&) = delete;
+    DmaLease& operator=(const DmaLease&) = delete;
+
+    bool valid() const { return buf_ != NULL; }
+    int fd() const { return buf_ ? buf_->fd : -1; }
+    void* va() const { return buf_ ? buf_->va : NULL; }
+    size_t size() const { return buf_ ? buf_->size : 0; }
+    MB_BLK mb() const { return buf_ ? buf_->mb : NULL; }
+    rga_buffer_handle_t handle() const { return buf_ ? buf_->handle : 0; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    /**
+     * @brief Describe the leased buffer to RGA using its cached handle
+     */
+    rga_buffer_t rga() const;
+
+    /**
+     * @brief Make CPU writes visible to the device (RGA, VENC, NPU)
+     */
+    void sync_for_device() const;
+
+    /**
+     * @brief Make device writes visible to the CPU
+     */
+    void sync_for_cpu() const;
+
+    /**
+     * @brief Return the buffer to the pool early
+     */
+    void release();
+
+private:
+    friend class DmaPool;
+    DmaLease(DmaPool* pool, dma_pool_buf_t* buf, int width, int height);
+
+    DmaPool* pool_;
+    dma_pool_buf_t* buf_;
+    int width_;
+    int height_;
+};
+
+/**
+ * @brief Pool of DMA buffers keyed by byte size and pixel format
+ *
+ * Buffers stay allocated, mapped and imported into RGA for the lifetime of
+ * the pool, so acquire() on a warm pool is a free-list pop under a mutex.
+ */
+class DmaPool {
+public:
+    /**
+     * @param backend Allocator used for new buffers
+     * @param max_per_key Upper bound of buffers per (size, format) key
+     */
+    explicit DmaPool(dma_pool_backend_t backend, int max_per_key = 4);
+    ~DmaPool();
+
+    DmaPool(const DmaPool&) = delete;
+    DmaPool& operator=(const DmaPool&) = delete;
+
+    /**
+     * @brief Lease a buffer able to hold a width x height image of format
+     *
+     * @return DmaLease Invalid lease if the key is exhausted or allocation fails
+     */
+    DmaLease acquire(int width, int height, int format);
+
+    /**
+     * @brief Pre-allocate buffers for a key so the hot path never allocates
+     *
+     * @return int Number of free buffers for the key, or -1 on error
+     */
+    int reserve(int width, int height, int format, int count);
+
+    dma_pool_backend_t backend() const { return backend_; }
+
+    /**
+     * @brief Allocate, map and RGA-import one buffer, bypassing the pool
+     */
+    static int alloc_buffer(dma_pool_backend_t backend, size_t size, int format,
+                            dma_pool_buf_t* buf);
+
+    /**
+     * @brief Undo alloc_buffer()
+     */
+    static void free_buffer(dma_pool_backend_t backend, dma_pool_buf_t* buf);
+
+private:
+    friend class DmaLease;
+
+    struct Bucket {
+        size_t size;
+        int format;
+        int total;
+        std::vector<dma_pool_buf_t*> free_list;
+    };
+
+    int find_bucket(size_t size, int format);
+    void put_back(dma_pool_buf_t* buf);
+
+    dma_pool_backend_t backend_;
+    int max_per_key_;
+    pthread_mutex_t lock_;
+    std::vector<Bucket> buckets_;
+    std::vector<dma_pool_buf_t*> all_;
+};
+
+/**
+ * @brief Byte size of a width x height image of an RK_FORMAT_* format
+ */
+size_t dma_pool_image_size(int width, int height, int format);
+
+/**
+ * @brief Human-readable backend name
+ */
+const char* dma_pool_backend_name(dma_pool_backend_t backend);
+
+/**
+ * @brief Compare allocation and first-touch cost of every backend
+ *
+ * Prints, per backend: one-shot alloc+map+import+free, pooled acquire/release,
+ * and a first memset on a fresh vs a warm buffer. The MB backend needs
+ * RK_MPI_SYS_Init() to have been called.
+ *
+ * @param width Image width
+ * @param height Image height
+ * @param format RK_FORMAT_* of the test image
+ * @param iterations Repetitions per measurement
+ */
+void dma_pool_benchmark(int width, int height, int format, int iterations);
+
+#endif // DMA_POOL_H
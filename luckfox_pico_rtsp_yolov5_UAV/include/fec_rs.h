@@ -0,0 +1,62 @@
+#ifndef FEC_RS_H
+#define FEC_RS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FEC_RS_MAX_SHARDS 255       // Data plus parity per block, GF(2^8)
+#define FEC_RS_MAX_PARITY 64        // Parity shards per block
+
+/**
+ * @brief Multiply two GF(2^8) elements (polynomial 0x11D)
+ */
+uint8_t fec_gf_mul(uint8_t a, uint8_t b);
+
+/**
+ * @brief dst ^= c * src over GF(2^8), the kernel of encode and decode
+ *
+ * Uses NEON nibble-table lookups (16 bytes per step) when built for NEON,
+ * a 256-entry product row per byte otherwise.
+ */
+void fec_rs_mul_add(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len);
+
+/**
+ * @brief Systematic Reed-Solomon encode of one block
+ *
+ * Parity row j is a Cauchy matrix row, so any k of the k + m shards
+ * rebuild the data.
+ *
+ * @param k Data shards (1..FEC_RS_MAX_SHARDS - m)
+ * @param m Parity shards (0..FEC_RS_MAX_PARITY)
+ * @param data k shards of len bytes
+ * @param parity m output shards of len bytes
+ * @param len Shard length
+ * @return int 0 on success, -1 if k or m is out of range
+ */
+int fec_rs_encode(int k, int m, const uint8_t* const* data, uint8_t* const* parity, size_t len);
+
+/**
+ * @brief Rebuild the missing data shards of one block
+ *
+ * shards[0..k) are the data shards, shards[k..k+m) the parity. Missing
+ * data shards are written in place; parity shards used for the repair are
+ * overwritten with scratch values.
+ *
+ * @param k Data shards
+ * @param m Parity shards
+ * @param shards k + m shard buffers, all writable, len bytes each
+ * @param present Which of the k + m shards arrived
+ * @param len Shard length
+ * @return int Data shards rebuilt, -1 if fewer than k shards arrived
+ */
+int fec_rs_decode(int k, int m, uint8_t* const* shards, const bool* present, size_t len);
+
+/**
+ * @brief Compare the per-byte log/exp, table and NEON kernels and time a
+ *        video-sized encode and decode, printing MB/s
+ *
+ * @param bytes Data volume per measurement
+ */
+void fec_rs_benchmark(size_t bytes);
+
+#endif // FEC_RS_H
@@ -0,0 +1,113 @@
+#ifndef FEC_VIDEO_H
+#define FEC_VIDEO_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "fec_video_rx.h"
+#include "sample_comm.h"
+
+#define FEC_VIDEO_DEFAULT_PORT 5600
+#define FEC_VIDEO_DEFAULT_RATIO 25  // Parity shards per 100 data shards
+
+/**
+ * @brief Sender counters
+ */
+typedef struct {
+    uint64_t frames;            // Access units sent
+    uint64_t bytes_in;          // Encoded bytes
+    uint64_t datagrams;         // Data and parity shards handed to the socket
+    uint64_t parity;            // Parity shards among them
+    uint64_t bytes;
+    uint64_t syscalls;          // sendmmsg calls
+    uint64_t dropped;           // Datagrams the socket had no room for
+    uint64_t oversize;          // Frames above FEC_VIDEO_FRAME_MAX, not sent
+    uint64_t encode_us;         // Time spent computing parity
+} fec_video_tx_stats_t;
+
+/**
+ * @brief UDP video output with Reed-Solomon parity per frame
+ *
+ * Slices are gathered until the frame ends, then the frame is cut into
+ * shards, grouped into blocks of up to FEC_VIDEO_MAX_K, protected with
+ * parity and sent with one sendmmsg(), blocks interleaved so a burst of
+ * losses is spread over several of them. fec_video_rx is the ground side.
+ */
+typedef struct {
+    int fd;
+    struct sockaddr_in dest;
+    uint16_t shard_len;
+    int ratio;                  // 0 sends the data shards only
+    uint8_t flags;
+    uint32_t frame_id;
+
+    uint8_t* frame;             // Access unit being gathered, padded to whole shards
+    size_t frame_len;
+    uint64_t frame_pts;
+    bool overflow;              // Current frame outgrew the buffer
+
+    uint8_t* parity;            // Block b's parity at the offset of its data
+    uint8_t (*headers)[FEC_VIDEO_HEADER_LEN];
+    struct mmsghdr* msgs;
+    struct iovec* iov;          // Header and shard per datagram
+    int max_datagrams;
+
+    fec_video_tx_stats_t stats;
+} fec_video_tx_t;
+
+/**
+ * @brief Open the FEC video output
+ *
+ * @param tx Sender state
+ * @param ip Destination address (the radio's video input or the ground)
+ * @param port Destination UDP port
+ * @param shard_len Shard payload bytes (FEC_VIDEO_SHARD_MIN..FEC_VIDEO_SHARD_MAX)
+ * @param ratio Parity shards per 100 data shards (0..100), at least one per block if > 0
+ * @param hevc Stream is H.265
+ * @return int 0 on success, -1 on failure
+ */
+int fec_video_tx_open(fec_video_tx_t* tx, const char* ip, int port, int shard_len,
+                      int ratio, bool hevc);
+
+/**
+ * @brief Add encoded bytes; the frame leaves when frame_end is set
+ *
+ * @return int Datagrams sent, 0 while the frame is still being gathered
+ */
+int fec_video_tx_send(fec_video_tx_t* tx, const uint8_t* data, size_t len,
+                      uint64_t pts_us, bool frame_end);
+
+/**
+ * @brief venc_sink consumer forwarding every encoded packet (user = sender)
+ */
+void fec_video_venc_consumer(const VENC_PACK_S* pack, const uint8_t* data,
+                             uint32_t len, void* user);
+
+/**
+ * @brief Print the sender counters
+ */
+void fec_video_tx_print_stats(const fec_video_tx_t* tx);
+
+/**
+ * @brief Close the socket and release the buffers
+ */
+void fec_video_tx_close(fec_video_tx_t* tx);
+
+/**
+ * @brief Loss recovery test through a packet-dropping shim on localhost
+ *
+ * Sends synthetic frames from fec_video_tx to a relay on port that drops
+ * datagrams (independently, or in bursts with a Gilbert-Elliott model) and
+ * forwards the rest to an fec_video_rx on port + 1, which checks every frame
+ * byte for byte. Each run reports how many frames lost at least one data
+ * shard and how many of those parity brought back.
+ *
+ * @param port Shim port; the receiver listens on port + 1
+ * @param frames Frames per run
+ * @return int 0 on success, -1 on a corrupted frame or a run without recovery
+ */
+int fec_video_selftest(int port, int frames);
+
+#endif // FEC_VIDEO_H
@@ -0,0 +1,160 @@
+#ifndef FEC_VIDEO_RX_H
+#define FEC_VIDEO_RX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Wire format, big-endian. Every datagram carries one shard of one frame:
+//   0  magic "FV"           2  version            3  flags (FEC_VIDEO_FLAG_*)
+//   4  frame id (u32)       8  PTS in us (u64)    16 frame length (u32)
+//   20 block                21 blocks             22 k (data shards)
+//   23 m (parity shards)    24 shard index        25 reserved
+//   26 shard length (u16)   28 shard bytes
+// A frame of L bytes is cut into T = ceil(L / S) shards of S bytes (the last
+// zero-padded) and dealt evenly over the blocks: block b holds T / B shards,
+// one more for b < T % B. Shard indices 0..k-1 are data, k..k+m-1 parity.
+#define FEC_VIDEO_MAGIC 0x4656
+#define FEC_VIDEO_VERSION 1
+#define FEC_VIDEO_HEADER_LEN 28
+#define FEC_VIDEO_SHARD_MAX 1400    // Header plus shard fit a 1500-byte MTU
+#define FEC_VIDEO_SHARD_MIN 256
+#define FEC_VIDEO_MAX_K 64          // Data shards per block
+#define FEC_VIDEO_MAX_BLOCKS 255
+#define FEC_VIDEO_FRAME_MAX (1024 * 1024)
+#define FEC_VIDEO_DATAGRAM_MAX (FEC_VIDEO_HEADER_LEN + FEC_VIDEO_SHARD_MAX)
+
+#define FEC_VIDEO_FLAG_HEVC 0x01
+
+#define FEC_VIDEO_RX_SLOTS 4        // Frames reassembled at once
+#define FEC_VIDEO_RX_RESYNC 256     // Frame id jump taken as a sender restart
+
+/**
+ * @brief Decoded datagram header
+ */
+typedef struct {
+    uint8_t flags;
+    uint32_t frame_id;
+    uint64_t pts_us;
+    uint32_t frame_len;
+    uint8_t block;
+    uint8_t blocks;
+    uint8_t k;
+    uint8_t m;
+    uint8_t index;
+    uint16_t shard_len;
+} fec_video_header_t;
+
+/**
+ * @brief Write a datagram header
+ *
+ * @param out FEC_VIDEO_HEADER_LEN bytes
+ */
+void fec_video_header_write(uint8_t* out, const fec_video_header_t* h);
+
+/**
+ * @brief Parse and sanity-check a datagram header
+ *
+ * @return bool false if the datagram is not a valid FEC video shard
+ */
+bool fec_video_header_read(const uint8_t* pkt, size_t len, fec_video_header_t* h);
+
+/**
+ * @brief First data shard and data shard count of a block
+ */
+void fec_video_block_layout(uint32_t frame_len, uint16_t shard_len, int blocks, int block,
+                            int* first, int* k);
+
+/**
+ * @brief One frame being reassembled
+ */
+typedef struct {
+    bool used;
+    bool done;                  // Delivered; later shards are ignored
+    uint32_t frame_id;
+    uint64_t pts_us;
+    uint32_t frame_len;
+    uint16_t shard_len;
+    uint8_t blocks;
+    uint8_t flags;
+    int blocks_ready;           // Blocks with at least k shards
+    bool recovered;             // Parity was needed
+
+    uint8_t* data;              // Data shards in frame order
+    uint8_t* parity;            // Block b's parity at the offset of its data
+    uint8_t* have;              // Per shard position: bit 0 data, bit 1 parity
+    uint8_t block_count[FEC_VIDEO_MAX_BLOCKS];  // Distinct shards received
+    uint8_t block_m[FEC_VIDEO_MAX_BLOCKS];      // Parity shards sent
+} fec_video_slot_t;
+
+/**
+ * @brief Receiver counters
+ */
+typedef struct {
+    uint64_t datagrams;
+    uint64_t invalid;           // Not FEC video or inconsistent with the frame
+    uint64_t duplicates;
+    uint64_t surplus;           // Shards of frames already delivered
+    uint64_t late;              // Shards of frames already given up on
+    uint64_t frames;            // Frames delivered
+    uint64_t recovered_frames;  // Delivered only thanks to parity
+    uint64_t recovered_shards;  // Data shards rebuilt
+    uint64_t lost_frames;       // Frames that never became complete
+} fec_video_rx_stats_t;
+
+/**
+ * @brief Called for every complete frame, in completion order
+ *
+ * @param frame Annex-B bytes as the encoder produced them
+ * @param len Frame length
+ * @param pts_us Capture time on the air side
+ * @param frame_id Sender frame counter; gaps are lost frames
+ * @param user Opaque pointer given to fec_video_rx_init()
+ */
+typedef void (*fec_video_frame_fn)(const uint8_t* frame, size_t len, uint64_t pts_us,
+                                   uint32_t frame_id, void* user);
+
+/**
+ * @brief Ground-side receiver for the FEC video stream
+ *
+ * Feed it every datagram received on the video port. It depends only on
+ * libc and fec_rs, so it builds on the ground station as is.
+ */
+typedef struct {
+    fec_video_slot_t slots[FEC_VIDEO_RX_SLOTS];
+    size_t frame_cap;
+    bool have_newest;
+    uint32_t newest;            // Highest frame id seen
+    fec_video_frame_fn fn;
+    void* user;
+    fec_video_rx_stats_t stats;
+} fec_video_rx_t;
+
+/**
+ * @brief Allocate the reassembly slots
+ *
+ * @param rx Receiver
+ * @param frame_cap Largest frame accepted (at most FEC_VIDEO_FRAME_MAX)
+ * @param fn Frame callback
+ * @param user Opaque pointer for fn
+ * @return int 0 on success, -1 on allocation failure
+ */
+int fec_video_rx_init(fec_video_rx_t* rx, size_t frame_cap, fec_video_frame_fn fn, void* user);
+
+/**
+ * @brief Feed one datagram
+ *
+ * @return int 1 if it completed a frame, 0 otherwise
+ */
+int fec_video_rx_push(fec_video_rx_t* rx, const uint8_t* pkt, size_t len);
+
+/**
+ * @brief Give up on every incomplete frame (end of stream)
+ */
+void fec_video_rx_flush(fec_video_rx_t* rx);
+
+/**
+ * @brief Release the slots
+ */
+void fec_video_rx_free(fec_video_rx_t* rx);
+
+#endif // FEC_VIDEO_RX_H
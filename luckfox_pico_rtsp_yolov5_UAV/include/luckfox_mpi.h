@@ -17,6 +17,7 @@
 #include <vector>
 
 #include "sample_comm.h"
+#include "venc_profile.h"
 
 #define TEST_ARGB32_PIX_SIZE 4
 #define TEST_ARGB32_RED 0xFF0000FF
@@ -32,7 +33,9 @@ RK_S32 rgn_overlay_release(int group);
 
 int vi_dev_init();
 int vi_chn_init(int channelId, int width, int height);
+int vi_chn_init_bound(int channelId, int width, int height, int buf_cnt);
 int vpss_init(int VpssChn, int width, int height);
-int venc_init(int chnId, int width, int height, RK_CODEC_ID_E enType);
+int venc_init(int chnId, int width, int height, RK_CODEC_ID_E enType,
+              const venc_profile_t *profile);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,146 @@
+#ifndef MAVLINK_CODEC_H
+#define MAVLINK_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// MAVLink v2 framing
+#define MAVLINK_STX_V2 0xFD
+#define MAVLINK_HEADER_LEN 10           // magic .. msgid
+#define MAVLINK_CHECKSUM_LEN 2
+#define MAVLINK_SIGNATURE_LEN 13
+#define MAVLINK_MAX_PAYLOAD_LEN 255
+#define MAVLINK_MAX_FRAME_LEN (MAVLINK_HEADER_LEN + MAVLINK_MAX_PAYLOAD_LEN + MAVLINK_CHECKSUM_LEN + MAVLINK_SIGNATURE_LEN)
+#define MAVLINK_IFLAG_SIGNED 0x01
+
+// Message IDs known to the codec
+#define MAVLINK_MSG_ID_HEARTBEAT 0
+#define MAVLINK_MSG_ID_PARAM_REQUEST_READ 20
+#define MAVLINK_MSG_ID_PARAM_REQUEST_LIST 21
+#define MAVLINK_MSG_ID_PARAM_VALUE 22
+#define MAVLINK_MSG_ID_PARAM_SET 23
+#define MAVLINK_MSG_ID_ATTITUDE 30
+#define MAVLINK_MSG_ID_TIMESYNC 111
+#define MAVLINK_MSG_ID_UAV_DETECTION 9000        // Custom: one target
+#define MAVLINK_MSG_ID_UAV_DETECTION_BATCH 9001  // Custom: all targets of a frame
+
+/**
+ * @brief CRC-16/MCRF4XX lookup table (reflected polynomial 0x8408)
+ */
+extern const uint16_t mavlink_crc_table[256];
+
+/**
+ * @brief Fold one byte into a running MAVLink checksum
+ */
+static inline uint16_t mavlink_crc_accumulate(uint8_t data, uint16_t crc)
+{
+    return (crc >> 8) ^ mavlink_crc_table[(crc ^ data) & 0xFF];
+}
+
+/**
+ * @brief Fold a buffer into a running MAVLink checksum
+ */
+uint16_t mavlink_crc_accumulate_buffer(uint16_t crc, const uint8_t* data, size_t length);
+
+/**
+ * @brief MAVLink checksum of a buffer (initial value 0xFFFF)
+ */
+uint16_t mavlink_crc_calculate(const uint8_t* data, size_t length);
+
+/**
+ * @brief Bit-at-a-time reference checksum, kept for the benchmark
+ */
+uint16_t mavlink_crc_calculate_bitwise(const uint8_t* data, size_t length);
+
+/**
+ * @brief One field of a message definition, in wire order
+ *
+ * type is the C type name as mavgen spells it ("uint8_t", "float", ...);
+ * array_len is 0 for scalars.
+ */
+struct mavlink_field_def {
+    const char* type;
+    const char* name;
+    uint8_t array_len;
+};
+
+// Compile-time twin of mavlink_crc_accumulate()
+constexpr uint16_t mavlink_crc_step(uint16_t crc, uint8_t data)
+{
+    uint8_t tmp = data ^ (uint8_t)(crc & 0xFF);
+    tmp ^= (uint8_t)(tmp << 4);
+    return (uint16_t)((crc >> 8) ^ (tmp << 8) ^ (tmp << 3) ^ (tmp >> 4));
+}
+
+constexpr uint16_t mavlink_crc_string(uint16_t crc, const char* s)
+{
+    while (*s)
+        crc = mavlink_crc_step(crc, (uint8_t)*s++);
+    return crc;
+}
+
+/**
+ * @brief CRC_EXTRA seed of a message, evaluated at compile time
+ *
+ * Same algorithm as mavgen: checksum "NAME " then "type name " per base
+ * field (extensions excluded), plus the length byte of array fields, and
+ * fold the result to 8 bits.
+ */
+template <size_t N>
+constexpr uint8_t mavlink_crc_extra(const char* msg_name, const mavlink_field_def (&fields)[N])
+{
+    uint16_t crc = mavlink_crc_string(0xFFFF, msg_name);
+    crc = mavlink_crc_step(crc, ' ');
+    for (size_t i = 0; i < N; i++) {
+        crc = mavlink_crc_string(crc, fields[i].type);
+        crc = mavlink_crc_step(crc, ' ');
+        crc = mavlink_crc_string(crc, fields[i].name);
+        crc = mavlink_crc_step(crc, ' ');
+        if (fields[i].array_len)
+            crc = mavlink_crc_step(crc, fields[i].array_len);
+    }
+    return (uint8_t)((crc & 0xFF) ^ (crc >> 8));
+}
+
+/**
+ * @brief CRC_EXTRA seed and maximum payload length of a message
+ *
+ * @param msgid Message ID
+ * @param crc_extra Output seed folded into the checksum
+ * @param max_len Output full (untruncated) payload length
+ * @return int 0 if the message is known, -1 otherwise
+ */
+int mavlink_msg_lookup(uint32_t msgid, uint8_t* crc_extra, uint8_t* max_len);
+
+/**
+ * @brief Turn a payload already placed at frame + MAVLINK_HEADER_LEN into a
+ *        complete frame
+ *
+ * Trailing zero bytes of the payload are truncated (keeping at least one),
+ * then the header and the CRC_EXTRA-seeded checksum are written around it.
+ * frame must have room for MAVLINK_HEADER_LEN + payload_len + 2 bytes.
+ *
+ * @return int Frame length in bytes, or -1 if msgid is unknown or the
+ *         payload is longer than the message allows
+ */
+int mavlink_finalize(uint8_t* frame, uint8_t seq, uint8_t sysid, uint8_t compid,
+                     uint32_t msgid, uint8_t payload_len);
+
+/**
+ * @brief Serialise a payload into a complete frame in out
+ *
+ * @return int Frame length in bytes, or -1 on error
+ */
+int mavlink_serialize(uint8_t* out, size_t out_size,
+                      uint8_t seq, uint8_t sysid, uint8_t compid,
+                      uint32_t msgid, const void* payload, uint8_t payload_len);
+
+/**
+ * @brief Compare the table-driven and bitwise checksums and time the
+ *        serializer
+ *
+ * @param bytes Amount of data to checksum per variant
+ */
+void mavlink_codec_benchmark(size_t bytes);
+
+#endif // MAVLINK_CODEC_H
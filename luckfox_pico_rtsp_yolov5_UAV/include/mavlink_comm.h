@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 
+#include "mavlink_parser.h"
+#include "udp_link.h"
+
 // MAVLink packet structure
 #pragma pack(push, 1)
 typedef struct {
@@ -22,7 +25,7 @@ typedef struct {
 
 // Detection payload structure
 typedef struct {
-    uint64_t time_usec;         // Timestamp (microseconds since system boot)
+    uint64_t time_usec;         // Send time (autopilot us when time-synced, else board monotonic us)
     float x;                    // X coordinate (normalized -1 to 1, 0 is center)
     float y;                    // Y coordinate (normalized -1 to 1, 0 is center)
     float width;                // Bounding box width (normalized 0 to 1)
@@ -31,8 +34,172 @@ typedef struct {
     uint8_t target_num;         // Target number (for multiple detections)
     uint8_t class_id;           // Object class ID
 } mavlink_detection_payload_t;
+
+// Largest number of targets one batch message can carry
+#define MAVLINK_BATCH_MAX_TARGETS 22
+
+// One target inside a batch message (11 bytes, quantised)
+typedef struct {
+    int16_t x;                  // X coordinate (normalized -1 to 1, scaled by 32767)
+    int16_t y;                  // Y coordinate (normalized -1 to 1, scaled by 32767)
+    int16_t width;              // Bounding box width (normalized 0 to 1, scaled by 32767)
+    int16_t height;             // Bounding box height (normalized 0 to 1, scaled by 32767)
+    uint8_t confidence;         // Detection confidence (0 to 255)
+    uint8_t class_id;           // Object class ID
+    uint8_t target_num;         // Target number
+} mavlink_batch_target_t;
+
+// Batch payload: every target of one frame behind a single timestamp.
+// Unused trailing targets are zero and removed by MAVLink v2 truncation.
+typedef struct {
+    uint64_t time_usec;         // Capture time (autopilot us when time-synced, else board monotonic us)
+    uint8_t count;              // Number of valid targets
+    mavlink_batch_target_t targets[MAVLINK_BATCH_MAX_TARGETS];
+} mavlink_detection_batch_payload_t;
+
+// HEARTBEAT (#0) payload, wire order
+typedef struct {
+    uint32_t custom_mode;       // Autopilot-specific flight mode
+    uint8_t type;               // MAV_TYPE
+    uint8_t autopilot;          // MAV_AUTOPILOT
+    uint8_t base_mode;          // MAV_MODE_FLAG bitmap
+    uint8_t system_status;      // MAV_STATE
+    uint8_t mavlink_version;    // Protocol version
+} mavlink_heartbeat_t;
+
+// ATTITUDE (#30) payload, wire order
+typedef struct {
+    uint32_t time_boot_ms;      // Autopilot time since boot (ms)
+    float roll;                 // Roll angle (rad)
+    float pitch;                // Pitch angle (rad)
+    float yaw;                  // Yaw angle (rad)
+    float rollspeed;            // Roll rate (rad/s)
+    float pitchspeed;           // Pitch rate (rad/s)
+    float yawspeed;             // Yaw rate (rad/s)
+} mavlink_attitude_t;
+
+// PARAM_REQUEST_READ (#20) payload, wire order
+typedef struct {
+    int16_t param_index;        // Index, or -1 to look up by param_id
+    uint8_t target_system;
+    uint8_t target_component;
+    char param_id[16];          // Name, not terminated when 16 chars long
+} mavlink_param_request_read_t;
+
+// PARAM_REQUEST_LIST (#21) payload, wire order
+typedef struct {
+    uint8_t target_system;
+    uint8_t target_component;
+} mavlink_param_request_list_t;
+
+// PARAM_VALUE (#22) payload, wire order
+typedef struct {
+    float param_value;
+    uint16_t param_count;
+    uint16_t param_index;
+    char param_id[16];
+    uint8_t param_type;         // MAV_PARAM_TYPE
+} mavlink_param_value_t;
+
+// PARAM_SET (#23) payload, wire order
+typedef struct {
+    float param_value;
+    uint8_t target_system;
+    uint8_t target_component;
+    char param_id[16];
+    uint8_t param_type;         // MAV_PARAM_TYPE
+} mavlink_param_set_t;
+
+// TIMESYNC (#111) payload, wire order
+typedef struct {
+    int64_t tc1;                // Responder time (ns), 0 in a request
+    int64_t ts1;                // Requester time (ns)
+    uint8_t target_system;      // Extension: addressed system
+    uint8_t target_component;   // Extension: addressed component
+} mavlink_timesync_t;
 #pragma pack(pop)
 
+// Pixel-space detection handed to the batch API
+typedef struct {
+    int x;                      // Box top-left X in pixels
+    int y;                      // Box top-left Y in pixels
+    int width;                  // Box width in pixels
+    int height;                 // Box height in pixels
+    float confidence;           // Detection confidence (0.0 to 1.0)
+    uint8_t class_id;           // Object class ID
+    uint8_t target_num;         // Target number
+} mavlink_target_t;
+
+/**
+ * @brief System ID this companion sends as
+ */
+uint8_t mavlink_system_id(void);
+
+/**
+ * @brief Component ID this companion sends as
+ */
+uint8_t mavlink_component_id(void);
+
+/**
+ * @brief Where serialised frames go
+ *
+ * A transport either lends a slot to serialise into (reserve, then commit
+ * or abort) or takes a finished frame with send. reserve may return NULL,
+ * and may be NULL itself, in which case the frame is built on the stack
+ * and sent. flush (may be NULL) pushes out anything the transport batches.
+ */
+typedef struct {
+    const char* name;
+    void* ctx;
+    uint8_t* (*reserve)(void* ctx);
+    int (*commit)(void* ctx, size_t length);
+    void (*abort)(void* ctx);
+    int (*send)(void* ctx, const uint8_t* data, size_t length);
+    int (*flush)(void* ctx);
+} mavlink_transport_t;
+
+/**
+ * @brief UART transport: the transmit queue when it runs on uart_fd,
+ *        otherwise synchronous writes
+ */
+void mavlink_transport_uart(mavlink_transport_t* transport, int uart_fd);
+
+/**
+ * @brief UDP transport: frames are batched in link and leave on
+ *        mavlink_transport_flush() with one sendmmsg()
+ */
+void mavlink_transport_udp(mavlink_transport_t* transport, udp_link_t* link);
+
+/**
+ * @brief Push out whatever the transport has batched
+ *
+ * @return int Packets sent, 0 for unbatched transports, or -1 on error
+ */
+int mavlink_transport_flush(const mavlink_transport_t* transport);
+
+/**
+ * @brief Send any message known to the codec on a transport
+ *
+ * @return int Number of bytes sent or batched, or -1 on error
+ */
+int mavlink_send_message_on(const mavlink_transport_t* transport, uint32_t msgid,
+                            const void* payload, uint8_t payload_len);
+
+/**
+ * @brief Send any message known to the codec via UART
+ * 
+ * The frame is serialised straight into the UART transmit ring when the
+ * queue runs on uart_fd, otherwise written synchronously.
+ * 
+ * @param uart_fd UART file descriptor
+ * @param msgid Message ID (must have a mavlink_codec entry)
+ * @param payload Wire-order payload
+ * @param payload_len Full payload length; trailing zeros are truncated
+ * @return int Number of bytes sent, or -1 on error
+ */
+int mavlink_send_message(int uart_fd, uint32_t msgid,
+                         const void* payload, uint8_t payload_len);
+
 /**
  * @brief Pack detection data into MAVLink format
  * 
@@ -78,4 +245,133 @@ int mavlink_send_detection(
     int frame_width, int frame_height
 );
 
+/**
+ * @brief Pack up to MAVLINK_BATCH_MAX_TARGETS detections into one message
+ * 
+ * Coordinates are quantised to int16 and confidence to uint8. Trailing zero
+ * bytes of the payload are truncated as allowed by MAVLink v2.
+ * 
+ * @param targets Detections in pixel coordinates
+ * @param count Number of detections (extra ones are ignored)
+ * @param frame_width Frame width in pixels (for normalization)
+ * @param frame_height Frame height in pixels (for normalization)
+ * @param capture_us VI capture PTS (CLOCK_MONOTONIC us), 0 for now
+ * @param buffer Output buffer for MAVLink message
+ * @param buffer_size Size of output buffer
+ * @return int Number of bytes written, or -1 on error
+ */
+int mavlink_pack_detection_batch(
+    const mavlink_target_t* targets, int count,
+    int frame_width, int frame_height, uint64_t capture_us,
+    uint8_t* buffer, int buffer_size
+);
+
+/**
+ * @brief Send all detections of one frame as batch messages via UART
+ * 
+ * Frames with more than MAVLINK_BATCH_MAX_TARGETS detections are split over
+ * several messages that share one timestamp. A frame without detections
+ * sends nothing. The timestamp is the frame's capture time, mapped to the
+ * autopilot's clock once TIMESYNC has converged.
+ * 
+ * @param uart_fd UART file descriptor
+ * @param targets Detections in pixel coordinates
+ * @param count Number of detections
+ * @param frame_width Frame width in pixels
+ * @param frame_height Frame height in pixels
+ * @param capture_us VI capture PTS (CLOCK_MONOTONIC us), 0 for now
+ * @return int Number of bytes sent, or -1 on error
+ */
+int mavlink_send_detection_batch(
+    int uart_fd,
+    const mavlink_target_t* targets, int count,
+    int frame_width, int frame_height, uint64_t capture_us
+);
+
+/**
+ * @brief mavlink_send_detection_batch() on any transport
+ * 
+ * Several transports may carry the same frame (e.g. a budgeted subset on
+ * the UART and every target over UDP).
+ * 
+ * @return int Number of bytes sent or batched, or -1 on error
+ */
+int mavlink_send_detection_batch_on(
+    const mavlink_transport_t* transport,
+    const mavlink_target_t* targets, int count,
+    int frame_width, int frame_height, uint64_t capture_us
+);
+
+/**
+ * @brief Send detection batches to a loopback receiver and report rates
+ * 
+ * Compares one sendmmsg() per video frame against one sendto() per
+ * message; the receiver validates every datagram with the MAVLink parser.
+ * 
+ * @param port Loopback UDP port to use
+ * @param seconds Duration of each phase
+ * @return int 0 if every received datagram parsed, -1 otherwise
+ */
+int mavlink_udp_benchmark(int port, double seconds);
+
+/**
+ * @brief Latest autopilot state received over MAVLink
+ */
+typedef struct {
+    uint64_t heartbeats;        // HEARTBEAT messages received
+    uint64_t heartbeat_time_us; // Local time of the last HEARTBEAT, 0 if none
+    uint8_t sysid;              // System that sent the last HEARTBEAT
+    uint8_t compid;             // Component that sent the last HEARTBEAT
+    mavlink_heartbeat_t heartbeat;
+
+    uint64_t attitude_time_us;  // Local time of the last ATTITUDE, 0 if none
+    mavlink_attitude_t attitude;
+
+    uint64_t timesync_time_us;  // Local time of the last TIMESYNC response, 0 if none
+    mavlink_timesync_t timesync;
+    int timesync_synced;        // Set once a round trip has been measured
+    int64_t timesync_offset_ns; // Autopilot clock minus board monotonic clock
+    uint32_t timesync_rtt_us;   // Last accepted round trip
+} mavlink_vehicle_state_t;
+
+/**
+ * @brief Register the HEARTBEAT, ATTITUDE and TIMESYNC handlers on a parser
+ * 
+ * The handlers keep the latest copy of each message for
+ * mavlink_get_vehicle_state(). TIMESYNC requests from the autopilot are
+ * answered on uart_fd; responses to mavlink_timesync_request() update the
+ * clock offset.
+ * 
+ * @param parser Parser that will receive the autopilot's traffic
+ * @param uart_fd UART file descriptor for TIMESYNC replies
+ * @return int 0 on success, -1 on failure
+ */
+int mavlink_comm_attach(mavlink_parser_t* parser, int uart_fd);
+
+/**
+ * @brief Send a TIMESYNC request stamped with the board clock
+ * 
+ * Call periodically (about 1 Hz); each response refines the offset used by
+ * mavlink_board_to_autopilot_us().
+ * 
+ * @param uart_fd UART file descriptor
+ * @return int Number of bytes sent, or -1 on error
+ */
+int mavlink_timesync_request(int uart_fd);
+
+/**
+ * @brief Map a board CLOCK_MONOTONIC time to the autopilot's clock
+ * 
+ * @param board_us Board time in microseconds
+ * @return uint64_t Autopilot time, or board_us unchanged until synced
+ */
+uint64_t mavlink_board_to_autopilot_us(uint64_t board_us);
+
+/**
+ * @brief Snapshot the latest autopilot state
+ * 
+ * @param state Output state
+ */
+void mavlink_get_vehicle_state(mavlink_vehicle_state_t* state);
+
 #endif // MAVLINK_COMM_H
@@ -0,0 +1,135 @@
+#ifndef MOTION_GATE_H
+#define MOTION_GATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sample_comm.h"
+#include "im2d.hpp"
+
+#define MOTION_GATE_IVS_CHN 0
+#define MOTION_GATE_MD_SENSITIVITY 3    // IVS u32MDSensibility: 1 low, 2 mid, 3 high
+#define MOTION_GATE_MARGIN_PCT 50       // Context added around the moving area for a focus crop
+#define MOTION_GATE_DEFAULT_SAD 40      // MOT_SAD
+#define MOTION_GATE_DEFAULT_AREA 1      // MOT_MIN_AREA, per mille of the frame
+#define MOTION_GATE_DEFAULT_HOLD_MS 2000
+#define MOTION_GATE_DEFAULT_KEEPALIVE_MS 1000
+
+/**
+ * @brief What the NPU does with a frame
+ */
+typedef enum {
+    MOTION_GATE_FULL = 0,       // Letterboxed full frame (and tiles)
+    MOTION_GATE_FOCUS,          // Zoomed crop around the motion only
+    MOTION_GATE_SKIP,           // Nothing: no motion, nothing tracked
+    MOTION_GATE_DECISIONS
+} motion_gate_decision_t;
+
+/**
+ * @brief Gate counters
+ */
+typedef struct {
+    uint64_t frames;
+    uint64_t decisions[MOTION_GATE_DECISIONS];
+    uint64_t motion_frames;     // Motion results over MOT_MIN_AREA
+    uint64_t keepalives;        // Full frames run only because MOT_KEEPALIVE_MS was due
+    uint64_t ivs_errors;        // SendFrame / GetResults failures
+    uint64_t npu_us;            // Preprocess + inference time
+} motion_gate_stats_t;
+
+/**
+ * @brief Counters and sensors at the start of a report window
+ */
+typedef struct {
+    uint64_t us;
+    uint64_t frames;
+    uint64_t decisions[MOTION_GATE_DECISIONS];
+    uint64_t motion_frames;
+    uint64_t keepalives;
+    uint64_t npu_us;
+    uint64_t cpu_busy;          // /proc/stat jiffies
+    uint64_t cpu_total;
+} motion_gate_window_t;
+
+/**
+ * @brief Motion-gated inference on the IVS motion detector
+ *
+ * Every camera frame also goes to an IVS channel in motion detection mode,
+ * which reports moving rectangles a frame or so later. While the sky is still
+ * and nothing has been detected for MOT_HOLD_MS, the NPU is not run at all,
+ * except for a full frame every MOT_KEEPALIVE_MS so a target hovering in
+ * place is still found. Motion wakes it: when the moving area is small and
+ * nothing is tracked, only a crop around it is inferred, zoomed over the
+ * model input, and once something is detected full frames run until the hold
+ * runs out. Disabled (MOT_GATE 0), every frame is a full frame. The IVS
+ * channel is created the first time the gate is enabled.
+ */
+typedef struct {
+    int width;
+    int height;
+    int focus_w;                // Largest region a focus crop covers
+    int focus_h;
+    bool ivs_started;
+    bool ivs_failed;            // Do not retry a channel the driver refused
+    int sad;                    // MOT_SAD applied to the channel
+
+    // Latest motion result
+    int rect_count;
+    uint32_t area_permille;
+    bool moving;                // Over MOT_MIN_AREA
+    im_rect bbox;               // Union of the moving rectangles
+    uint64_t detection_us;      // Last frame with a detection
+    uint64_t full_us;           // Last full frame
+
+    motion_gate_stats_t stats;
+    motion_gate_window_t window;
+    int temp_start_mc;          // SoC temperature when the gate was set up
+} motion_gate_t;
+
+/**
+ * @brief Prepare the gate; the IVS channel is created on first use
+ *
+ * @param mg Gate state
+ * @param width Camera frame width
+ * @param height Camera frame height
+ * @param focus_w Focus crop width (the model's aspect ratio)
+ * @param focus_h Focus crop height
+ */
+void motion_gate_init(motion_gate_t* mg, int width, int height, int focus_w, int focus_h);
+
+/**
+ * @brief Feed the frame to IVS and decide what the NPU does with it
+ *
+ * @param mg Gate state
+ * @param frame Camera frame (NV12)
+ * @param now_us Capture time
+ * @param focus Region to infer for MOTION_GATE_FOCUS
+ * @return motion_gate_decision_t The decision
+ */
+motion_gate_decision_t motion_gate_decide(motion_gate_t* mg, VIDEO_FRAME_INFO_S* frame,
+                                          uint64_t now_us, im_rect* focus);
+
+/**
+ * @brief Report the outcome of the frame's decision
+ *
+ * @param mg Gate state
+ * @param decision What ran
+ * @param detections Detections found
+ * @param npu_us Preprocess + inference time spent on the frame
+ * @param now_us Capture time
+ */
+void motion_gate_done(motion_gate_t* mg, motion_gate_decision_t decision, int detections,
+                      uint64_t npu_us, uint64_t now_us);
+
+/**
+ * @brief Print decisions, FPS, NPU duty, CPU load, SoC temperature and power
+ *        over the window since the previous call
+ */
+void motion_gate_print_stats(motion_gate_t* mg);
+
+/**
+ * @brief Destroy the IVS channel
+ */
+void motion_gate_stop(motion_gate_t* mg);
+
+#endif // MOTION_GATE_H
@@ -0,0 +1,90 @@
+#ifndef PARAM_STORE_H
+#define PARAM_STORE_H
+
+#include <stdint.h>
+
+#include "mavlink_parser.h"
+
+#define PARAM_NAME_LEN 16           // MAVLink param_id length
+
+// MAV_PARAM_TYPE values used by the store
+#define PARAM_TYPE_INT32 6
+#define PARAM_TYPE_REAL32 9
+
+/**
+ * @brief Runtime-tunable parameters
+ */
+typedef enum {
+    PARAM_DET_NMS_THRESH = 0,   // NMS IoU threshold
+    PARAM_DET_BOX_THRESH,       // Box confidence threshold
+    PARAM_DET_MAX_OBJ,          // Detections kept per frame (<= OBJ_NUMB_MAX_SIZE)
+    PARAM_DET_MODEL_SIZE,       // Model input size (read-only, set by the model)
+    PARAM_OVL_BOX_COLOR,        // Overlay box colour, 0xRRGGBB
+    PARAM_OVL_BOX_THICK,        // Overlay box thickness in pixels
+    PARAM_ENC_ROI_QP,           // Relative QP of target ROIs, 0 disables ROI
+    PARAM_ENC_PROFILE,          // Encoder profile (venc_profile_id_t), switched live
+    PARAM_DET_TILES,            // Zoomed tiles inferred per frame, 0 disables tiling
+    PARAM_MOT_GATE,             // Skip inference on frames without motion (1) or not (0)
+    PARAM_MOT_SAD,              // IVS motion detection SAD threshold
+    PARAM_MOT_MIN_AREA,         // Moving share of the frame that counts as motion, per mille
+    PARAM_MOT_HOLD_MS,          // Keep inferring full frames this long after a detection
+    PARAM_MOT_KEEPALIVE_MS,     // Infer the full frame at least this often, 0 = never
+    PARAM_COUNT
+} param_id_t;
+
+/**
+ * @brief Load defaults, then any values persisted in path
+ *
+ * @param path File holding "NAME value" lines (may not exist yet)
+ */
+void param_store_init(const char* path);
+
+/**
+ * @brief Read a REAL32 parameter (one atomic load)
+ */
+float param_get_float(param_id_t id);
+
+/**
+ * @brief Read an INT32 parameter (one atomic load)
+ */
+int32_t param_get_int(param_id_t id);
+
+/**
+ * @brief Set a parameter from its MAVLink float representation
+ *
+ * INT32 values travel C-cast in PARAM_VALUE/PARAM_SET. Values outside the
+ * parameter's range are rejected.
+ *
+ * @param id Parameter
+ * @param value New value
+ * @param remote Reject read-only parameters when set from a ground station
+ * @return int 0 on success, -1 if rejected
+ */
+int param_set(param_id_t id, float value, bool remote);
+
+/**
+ * @brief Find a parameter by MAVLink name (up to 16 chars, not terminated)
+ *
+ * @return int Parameter index, or -1 if unknown
+ */
+int param_find(const char* name);
+
+/**
+ * @brief Write every parameter to the file given to param_store_init()
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int param_save(void);
+
+/**
+ * @brief Serve PARAM_REQUEST_LIST, PARAM_REQUEST_READ and PARAM_SET
+ *
+ * Replies with PARAM_VALUE on uart_fd. Accepted PARAM_SETs are persisted.
+ *
+ * @param parser Parser receiving the ground station's traffic
+ * @param uart_fd UART file descriptor for the replies
+ * @return int 0 on success, -1 on failure
+ */
+int param_mavlink_attach(mavlink_parser_t* parser, int uart_fd);
+
+#endif // PARAM_STORE_H
@@ -3,8 +3,54 @@
 
 #include "opencv2/core/core.hpp"
 #include "yolov5.h"
+#include "im2d.hpp"
+#include "rk_mpi_mb.h"
 #include <stdint.h>
 
+#define RGA_HANDLE_CACHE_BASE 12    // VI frames, overlay block, model input and spares
+#define RGA_HANDLE_CACHE_MAX 64
+
+/**
+ * @brief Get the RGA handle of an MPI MB block, importing it on first use
+ *
+ * The block's dma-buf fd is imported with importbuffer_fd once and the handle
+ * is cached under RK_MPI_MB_Handle2UniqueId, so VI, VENC and pool blocks that
+ * recycle every frame are never re-pinned by the RGA driver.
+ *
+ * @param mb MB block handle
+ * @return rga_buffer_handle_t Cached handle, or 0 on failure
+ */
+rga_buffer_handle_t rga_handle_from_mb(MB_BLK mb);
+
+/**
+ * @brief Get the RGA handle of a dma-buf fd, importing it on first use
+ *
+ * Used for buffers that are not MB blocks, e.g. rknn_tensor_mem.
+ *
+ * @param fd dma-buf file descriptor
+ * @param size Buffer size in bytes
+ * @return rga_buffer_handle_t Cached handle, or 0 on failure
+ */
+rga_buffer_handle_t rga_handle_from_fd(int fd, int size);
+
+/**
+ * @brief Make room in the handle cache for n more buffers
+ *
+ * Call when creating a pool whose blocks go through rga_handle_from_mb(), so
+ * they keep their imports instead of evicting each other (or a handle an
+ * asynchronous job still reads).
+ *
+ * @param n Number of blocks in the pool
+ */
+void rga_handle_cache_reserve(int n);
+
+/**
+ * @brief Release every cached RGA handle
+ *
+ * Call before the underlying buffers are freed.
+ */
+void rga_handle_cache_release();
+
 /**
  * @brief Hardware-accelerated image resize using RGA
  * 
@@ -19,9 +65,10 @@ void rga_resize(const cv::Mat& src, cv::Mat& dst, int dst_w, int dst_h);
  * @brief Direct NV12 → RGB888 → Resize → Letterbox → RKNN DMA input
  * 
  * Performs color conversion, resize, and letterbox padding in one RGA operation
- * directly into the RKNN model's input buffer.
+ * directly into the RKNN model's input buffer. Both buffers are addressed by
+ * cached RGA handles; the padding is only refilled when the geometry changes.
  * 
- * @param nv12_ptr Pointer to NV12 format image data
+ * @param nv12_blk MB block holding the NV12 image (e.g. a VI frame)
  * @param src_w Source width
  * @param src_h Source height
  * @param ctx RKNN application context containing input memory
@@ -32,7 +79,7 @@ void rga_resize(const cv::Mat& src, cv::Mat& dst, int dst_w, int dst_h);
  * @param top_pad Output parameter for top padding
  */
 void rga_letterbox_nv12_to_rknn(
-    void* nv12_ptr,
+    MB_BLK nv12_blk,
     int src_w, int src_h,
     rknn_app_context_t* ctx,
     int dst_w, int dst_h,
@@ -41,10 +88,33 @@ void rga_letterbox_nv12_to_rknn(
     int* top_pad
 );
 
+/**
+ * @brief NV12 crop → RGB888 → Resize → RKNN DMA input
+ *
+ * Scales one region of the frame over the whole model input, for tiled
+ * inference. The next rga_letterbox_nv12_to_rknn() repaints its padding.
+ *
+ * @param nv12_blk MB block holding the NV12 image (e.g. a VI frame)
+ * @param src_w Source width
+ * @param src_h Source height
+ * @param crop Source region, even coordinates; its aspect ratio should match
+ *        the model input's
+ * @param ctx RKNN application context containing input memory
+ * @param dst_w Destination (model input) width
+ * @param dst_h Destination (model input) height
+ */
+void rga_crop_nv12_to_rknn(
+    MB_BLK nv12_blk,
+    int src_w, int src_h,
+    im_rect crop,
+    rknn_app_context_t* ctx,
+    int dst_w, int dst_h
+);
+
 /**
  * @brief Draw a box using hardware-accelerated RGA
  * 
- * @param buf RGB888 buffer pointer
+ * @param blk MB block holding the RGB888 image
  * @param w Buffer width
  * @param h Buffer height
  * @param x Box top-left x coordinate
@@ -54,17 +124,17 @@ void rga_letterbox_nv12_to_rknn(
  * @param color_rgb RGB color (0xRRGGBB format)
  * @param thickness Line thickness in pixels (default 2)
  */
-void draw_box_rga(void* buf, int w, int h,
+void draw_box_rga(MB_BLK blk, int w, int h,
                   int x, int y, int box_w, int box_h,
                   uint32_t color_rgb, int thickness = 3);
 
 /**
  * @brief Clear frame buffer to black using RGA
  * 
- * @param buf RGB888 buffer pointer
+ * @param blk MB block holding the RGB888 image
  * @param w Buffer width
  * @param h Buffer height
  */
-void clear_frame(void* buf, int w, int h);
+void clear_frame(MB_BLK blk, int w, int h);
 
 #endif // RGA_HW_ACCEL_H
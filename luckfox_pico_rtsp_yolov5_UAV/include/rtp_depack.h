@@ -0,0 +1,83 @@
+#ifndef RTP_DEPACK_H
+#define RTP_DEPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RTP_HEADER_LEN 12
+
+/**
+ * @brief Video payload formats carried over RTP
+ */
+typedef enum {
+    RTP_CODEC_H264 = 0,         // RFC 6184, packetization-mode=1
+    RTP_CODEC_H265,             // RFC 7798
+} rtp_codec_t;
+
+/**
+ * @brief Reassembles RTP packets into Annex-B access units
+ *
+ * Ground-side counterpart of rtsp_server: single NAL, STAP-A and FU-A
+ * packets for H.264, single NAL and FU packets for H.265. A frame ends at
+ * the marker bit or when the timestamp changes.
+ */
+typedef struct {
+    rtp_codec_t codec;
+    uint8_t* frame;             // Annex-B access unit being assembled
+    size_t frame_len;
+    size_t frame_cap;
+    uint32_t frame_ts;          // RTP timestamp of the frame
+    bool frame_damaged;         // A packet of this frame was lost or invalid
+    bool in_fu;                 // Inside a fragmented NAL
+
+    bool have_seq;
+    uint16_t next_seq;
+
+    // Counters
+    uint64_t packets;
+    uint64_t lost;              // Gaps in the sequence numbers
+    uint64_t frames;            // Frames completed
+    uint64_t damaged_frames;    // Frames completed with a gap or bad packet
+} rtp_depack_t;
+
+/**
+ * @brief Prepare a depacketiser
+ *
+ * @param d Depacketiser
+ * @param codec Payload format
+ * @param frame_cap Largest access unit accepted, in bytes
+ * @return int 0 on success, -1 if the buffer cannot be allocated
+ */
+int rtp_depack_init(rtp_depack_t* d, rtp_codec_t codec, size_t frame_cap);
+
+/**
+ * @brief Release the frame buffer
+ */
+void rtp_depack_free(rtp_depack_t* d);
+
+/**
+ * @brief Called for every completed access unit
+ *
+ * @param frame Annex-B bytes (4-byte start codes)
+ * @param len Frame length
+ * @param ts RTP timestamp
+ * @param damaged True if a packet of the frame was lost
+ * @param user Opaque pointer given to rtp_depack_push()
+ */
+typedef void (*rtp_depack_frame_fn)(const uint8_t* frame, size_t len, uint32_t ts,
+                                    bool damaged, void* user);
+
+/**
+ * @brief Feed one RTP packet
+ *
+ * @param d Depacketiser
+ * @param pkt RTP packet (header included)
+ * @param len Packet length
+ * @param fn Frame callback
+ * @param user Opaque pointer for fn
+ * @return int Frames completed by this packet (0, 1 or 2)
+ */
+int rtp_depack_push(rtp_depack_t* d, const uint8_t* pkt, size_t len,
+                    rtp_depack_frame_fn fn, void* user);
+
+#endif // RTP_DEPACK_H
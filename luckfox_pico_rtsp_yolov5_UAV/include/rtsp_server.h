@@ -0,0 +1,189 @@
+#ifndef RTSP_SERVER_H
+#define RTSP_SERVER_H
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "rtp_depack.h"
+#include "sample_comm.h"
+
+#define RTSP_SERVER_MAX_CLIENTS 8
+#define RTSP_RX_BUF 4096                    // Largest RTSP request accepted
+#define RTSP_TCP_BACKLOG (512 * 1024)       // Per-client bytes held for a slow TCP reader
+#define RTSP_SESSION_TIMEOUT 60             // Seconds, advertised in Session
+
+#define RTP_PAYLOAD_MAX 1400                // Fits a 1500-byte MTU with IP/UDP/RTP
+#define RTP_PT_VIDEO 96
+#define RTP_ARENA_PACKETS 512               // Packets per send; larger frames flush early
+#define RTP_SLOT_SIZE (RTP_HEADER_LEN + RTP_PAYLOAD_MAX)
+#define RTP_PARAM_SET_MAX 256               // Cached VPS/SPS/PPS size
+
+/**
+ * @brief Per-client delivery counters
+ */
+typedef struct {
+    uint64_t packets;           // RTP packets handed to the socket (or TCP backlog)
+    uint64_t bytes;
+    uint64_t syscalls;          // sendmmsg/sendmsg calls
+    uint64_t dropped_packets;   // Packets the socket or backlog had no room for
+    uint64_t dropped_sends;     // Sends that lost at least one packet
+    uint32_t queue_bytes;       // Bytes waiting: TCP backlog plus socket send queue
+    uint32_t queue_max;         // Largest queue_bytes seen
+} rtsp_client_stats_t;
+
+typedef enum {
+    RTSP_CLIENT_FREE = 0,
+    RTSP_CLIENT_CONNECTED,      // Control connection only
+    RTSP_CLIENT_READY,          // SETUP done
+    RTSP_CLIENT_PLAYING,
+} rtsp_client_state_t;
+
+/**
+ * @brief One RTSP control connection and its RTP destination
+ */
+typedef struct {
+    rtsp_client_state_t state;
+    bool dead;                          // Closed by the control thread on its next pass
+    int fd;                             // RTSP control (and interleaved media) socket
+    struct sockaddr_in peer;
+    uint32_t session;
+
+    bool tcp;                           // RTP interleaved on the control socket
+    uint8_t channel;                    // Interleaved RTP channel
+    struct sockaddr_in rtp_dest;        // UDP destination
+
+    char rx[RTSP_RX_BUF];
+    size_t rx_len;
+
+    uint8_t* backlog;                   // TCP bytes the socket did not take yet
+    size_t backlog_off;
+    size_t backlog_len;
+
+    rtsp_client_stats_t stats;
+} rtsp_client_t;
+
+/**
+ * @brief Server-wide counters
+ */
+typedef struct {
+    uint64_t frames;            // Access units sent (frame end seen)
+    uint64_t sends;             // rtsp_server_send() calls with clients playing
+    uint64_t packets;           // RTP packets built
+    uint64_t arena_flushes;     // Frames too large for the arena, sent in parts
+    uint64_t sessions;          // PLAY requests served
+} rtsp_server_stats_t;
+
+/**
+ * @brief RTSP/RTP server for one H.264 or H.265 stream
+ *
+ * RTSP control runs on its own thread. Media is packetised once per send
+ * into a preallocated arena (RTP header and payload in one slot, shared by
+ * every client) and leaves with one sendmmsg() per UDP client or one
+ * sendmsg() per TCP-interleaved client.
+ */
+typedef struct {
+    int listen_fd;
+    int rtp_fd;                         // UDP source of all RTP packets
+    int rtcp_fd;                        // Receiver reports, drained and ignored
+    int port;
+    int rtp_port;
+    rtp_codec_t codec;
+    char path[64];
+
+    pthread_mutex_t lock;               // Clients, arena and stats
+    pthread_t thread;
+    volatile int running;
+
+    rtsp_client_t clients[RTSP_SERVER_MAX_CLIENTS];
+
+    uint8_t (*arena)[RTP_SLOT_SIZE];
+    uint16_t arena_len[RTP_ARENA_PACKETS];
+    int arena_count;
+    struct mmsghdr* msgs;               // sendmmsg scratch, RTP_ARENA_PACKETS entries
+    struct iovec* iov;                  // sendmsg scratch, two per packet
+    uint8_t (*prefix)[4];               // Interleaved frame headers
+
+    uint16_t seq;                       // Shared by every client
+    uint32_t ssrc;
+    uint32_t ts_offset;
+
+    // Latest parameter sets, for sprop-* in the SDP
+    uint8_t vps[RTP_PARAM_SET_MAX], sps[RTP_PARAM_SET_MAX], pps[RTP_PARAM_SET_MAX];
+    size_t vps_len, sps_len, pps_len;
+
+    void (*on_play)(void* user);        // New viewer; e.g. request an IDR
+    void* on_play_user;
+
+    rtsp_server_stats_t stats;
+} rtsp_server_t;
+
+/**
+ * @brief Listen for RTSP on port and serve the stream at path
+ *
+ * RTP over UDP is sent from port + 2 (RTCP on port + 3).
+ *
+ * @param srv Server state
+ * @param port RTSP TCP port
+ * @param path Stream path, e.g. "/live/0"
+ * @param codec Payload format
+ * @return int 0 on success, -1 on failure
+ */
+int rtsp_server_start(rtsp_server_t* srv, int port, const char* path, rtp_codec_t codec);
+
+/**
+ * @brief Called (on the server thread) whenever a client starts playing
+ */
+void rtsp_server_set_play_callback(rtsp_server_t* srv, void (*fn)(void* user), void* user);
+
+/**
+ * @brief Packetise an Annex-B buffer and send it to every playing client
+ *
+ * Whole frames or single slices may be passed; the RTP marker is set on the
+ * last packet only when frame_end is true. Large NAL units are split into
+ * FU-A (H.264) or FU (H.265) fragments.
+ *
+ * @param srv Server
+ * @param data Annex-B bytes
+ * @param len Length
+ * @param pts_us Capture time (us), mapped to the 90 kHz RTP clock
+ * @param frame_end Last buffer of the access unit
+ * @return int RTP packets built, 0 if nobody is playing
+ */
+int rtsp_server_send(rtsp_server_t* srv, const uint8_t* data, size_t len,
+                     uint64_t pts_us, bool frame_end);
+
+/**
+ * @brief venc_sink consumer forwarding every encoded packet (user = server)
+ */
+void rtsp_server_venc_consumer(const VENC_PACK_S* pack, const uint8_t* data,
+                               uint32_t len, void* user);
+
+/**
+ * @brief Print server counters and one line per client
+ */
+void rtsp_server_print_stats(rtsp_server_t* srv);
+
+/**
+ * @brief Stop the control thread and close every connection
+ */
+void rtsp_server_stop(rtsp_server_t* srv);
+
+/**
+ * @brief Loopback test of both transports and both codecs
+ *
+ * Starts a server on port, plays it with a minimal RTSP client over UDP and
+ * over TCP-interleaved, streams synthetic frames (NAL units from a few bytes
+ * to several MTUs, some sent as separate slices), depacketises them with
+ * rtp_depack and checks every frame arrives byte-identical. Reports packets
+ * per second and the client queue statistics.
+ *
+ * @param port RTSP port for the test server
+ * @param frames Frames per run
+ * @return int 0 on success, -1 on mismatch or loss
+ */
+int rtsp_server_selftest(int port, int frames);
+
+#endif // RTSP_SERVER_H
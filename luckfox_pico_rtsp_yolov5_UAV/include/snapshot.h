@@ -0,0 +1,161 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sample_comm.h"
+#include "im2d.hpp"
+#include "mavlink_comm.h"
+
+#define SNAPSHOT_VENC_CHN 2             // 0 = live stream, 1 = --hires
+#define SNAPSHOT_WIDTH 320              // Encoded crop size; targets are scaled to fit
+#define SNAPSHOT_HEIGHT 320
+#define SNAPSHOT_QFACTOR 85
+#define SNAPSHOT_QUEUE 8                // Crops waiting for the encoder
+#define SNAPSHOT_MAX_PER_FRAME 4        // Crops started by one frame
+#define SNAPSHOT_POOL_BLOCKS (SNAPSHOT_QUEUE + SNAPSHOT_MAX_PER_FRAME)
+#define SNAPSHOT_MARGIN_PCT 25          // Context added on each side of the box
+#define SNAPSHOT_MIN_CROP 40            // Smallest source region (RGA upscale limit)
+#define SNAPSHOT_MAX_TRACKS 32
+#define SNAPSHOT_TRACK_TTL_MS 500       // Unseen for this long ends a track
+#define SNAPSHOT_COOLDOWN_MS 2000       // Least time between two snapshots of a track
+#define SNAPSHOT_CONF_STEP 0.1f         // Confidence gain that earns a better snapshot
+#define SNAPSHOT_DEFAULT_CONF 0.6f
+
+/**
+ * @brief Snapshot counters
+ */
+typedef struct {
+    uint64_t tracks;            // Tracks started
+    uint64_t crops;             // RGA crops submitted
+    uint64_t written;           // JPEG files written
+    uint64_t bytes;
+    uint64_t dropped_queue;     // Wanted, but the queue was full
+    uint64_t dropped_buffer;    // Wanted, but every crop buffer was in use
+    uint64_t errors;            // RGA, VENC or file failures
+    uint64_t fence_wait_sum_us; // Frame loop waiting for its crops to finish
+    uint32_t fence_wait_max_us;
+    uint64_t latency_sum_us;    // Capture -> JPEG on disk
+    uint32_t latency_max_us;
+    uint32_t depth;             // Crops queued or encoding now
+    uint32_t depth_max;
+} snapshot_stats_t;
+
+/**
+ * @brief What a snapshot shows, kept next to its crop
+ */
+typedef struct {
+    uint32_t track_id;
+    uint8_t class_id;
+    float confidence;
+    uint64_t pts_us;            // Capture time of the source frame
+    im_rect rect;               // Cropped region of the source frame
+} snapshot_info_t;
+
+/**
+ * @brief One crop buffer on its way to the encoder
+ */
+typedef struct {
+    MB_BLK mb;
+    int fence;                  // RGA release fence, -1 once the crop is done
+    snapshot_info_t info;
+} snapshot_job_t;
+
+/**
+ * @brief Snapshot history of one tracker ID
+ */
+typedef struct {
+    uint32_t id;                // target_num, 0 = free slot
+    uint64_t last_seen_us;
+    uint64_t last_shot_us;      // 0 = never
+    float shot_conf;            // Confidence of the latest snapshot
+} snapshot_track_t;
+
+/**
+ * @brief JPEG snapshots of detections on a dedicated encoder channel
+ *
+ * Picks targets with a new tracker ID, and tracked targets whose confidence
+ * has risen past the threshold, and has RGA crop the box plus a margin out of
+ * the NV12 camera frame, converted to RGB888 and scaled to SNAPSHOT_WIDTH x
+ * SNAPSHOT_HEIGHT, into a block from a small MB pool. The crop runs
+ * asynchronously; the frame loop only collects its fence before it gives the
+ * camera frame back. A worker thread feeds the blocks to an MJPEG VENC channel
+ * and writes the JPEGs. When the queue or the pool is full the snapshot is
+ * dropped, never waited for.
+ */
+typedef struct {
+    char dir[128];
+    float conf;                 // Confidence worth a snapshot
+    int chn;
+    MB_POOL pool;
+    size_t block_size;
+
+    snapshot_track_t tracks[SNAPSHOT_MAX_TRACKS];
+
+    // Crops started on the current frame, fences not yet collected
+    snapshot_job_t pending[SNAPSHOT_MAX_PER_FRAME];
+    int pending_count;
+
+    // Crops done, waiting for the worker
+    snapshot_job_t queue[SNAPSHOT_QUEUE];
+    uint32_t queue_head;
+    uint32_t queue_tail;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    volatile int running;
+    uint32_t file_no;
+
+    uint64_t rate_crops;        // Counters at the last print
+    uint64_t rate_us;
+
+    snapshot_stats_t stats;
+} snapshot_t;
+
+/**
+ * @brief Create the JPEG channel and the crop pool, start the worker
+ *
+ * @param snap State to initialise
+ * @param dir Directory for the JPEG files (created if missing)
+ * @param conf Confidence a detection needs for a snapshot
+ * @return int 0 on success, -1 on failure
+ */
+int snapshot_start(snapshot_t* snap, const char* dir, float conf);
+
+/**
+ * @brief Start crops of the detections worth a snapshot; never blocks
+ *
+ * @param snap Snapshot state
+ * @param frame Camera frame (NV12), held until snapshot_frame_done()
+ * @param width Frame width
+ * @param height Frame height
+ * @param targets Detections in frame pixels, target_num set by
+ *        target_tracker_update(); untracked ones (0) are skipped
+ * @param count Number of detections
+ * @param pts_us Capture time of the frame
+ */
+void snapshot_offer(snapshot_t* snap, MB_BLK frame, int width, int height,
+                    const mavlink_target_t* targets, int count, uint64_t pts_us);
+
+/**
+ * @brief Collect this frame's crops and queue them for the encoder
+ *
+ * Call before the camera frame is released. The crops are small and were
+ * started earlier in the frame, so their fences have normally signalled.
+ */
+void snapshot_frame_done(snapshot_t* snap);
+
+/**
+ * @brief Print crops per second, queue depth and the counters
+ */
+void snapshot_print_stats(snapshot_t* snap);
+
+/**
+ * @brief Stop the worker, destroy the channel and the pool
+ */
+void snapshot_stop(snapshot_t* snap);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,155 @@
+#ifndef TARGET_TRACKER_H
+#define TARGET_TRACKER_H
+
+#include <stdint.h>
+
+#include "mavlink_comm.h"
+
+#define TRACKER_MAX_TRACKS 64
+#define TRACKER_MAX_DETECTIONS 128      // OBJ_NUMB_MAX_SIZE
+#define TRACKER_HIGH_CONF 0.5f          // Detections that may start a track
+#define TRACKER_MATCH_IOU 0.2f          // Tracked/lost tracks vs confident detections
+#define TRACKER_LOW_MATCH_IOU 0.5f      // Tracked tracks vs weak detections
+#define TRACKER_NEW_MATCH_IOU 0.3f      // Tentative tracks vs confident detections
+#define TRACKER_CONFIRM_HITS 2          // Matches before a track gets reported
+#define TRACKER_MAX_LOST_MS 1000        // Lost for this long ends a track
+
+/**
+ * @brief Track life cycle
+ */
+typedef enum {
+    TRACK_FREE = 0,
+    TRACK_TENTATIVE,            // Started, not yet confirmed; not reported
+    TRACK_CONFIRMED,            // Matched this frame
+    TRACK_LOST,                 // Confirmed, unmatched since last_seen_us
+} track_state_t;
+
+/**
+ * @brief Constant-velocity Kalman filter for one box coordinate
+ *
+ * State is position (px) and velocity (px/s); p00, p01, p11 are the
+ * covariance terms.
+ */
+typedef struct {
+    float p;
+    float v;
+    float p00;
+    float p01;
+    float p11;
+} tracker_axis_t;
+
+/**
+ * @brief One followed target
+ */
+typedef struct {
+    uint8_t state;              // track_state_t
+    uint8_t id;                 // Sent as target_num, 1-255
+    uint8_t class_id;
+    tracker_axis_t kf[4];       // Centre x, centre y, width, height
+    float confidence;           // Latest matched detection
+    uint32_t hits;              // Frames matched
+    uint64_t start_us;          // PTS of the first detection
+    uint64_t last_seen_us;      // PTS of the latest match
+} tracker_track_t;
+
+/**
+ * @brief Track-detection candidate of one association stage
+ */
+typedef struct {
+    float iou;
+    int16_t track;
+    int16_t det;
+} tracker_pair_t;
+
+/**
+ * @brief Tracker counters
+ */
+typedef struct {
+    uint64_t frames;
+    uint64_t detections;
+    uint64_t matched_high;      // Confident detections continuing a track
+    uint64_t matched_low;       // Weak detections keeping a track alive
+    uint64_t started;           // Tracks created
+    uint64_t confirmed;         // Tracks that reached TRACKER_CONFIRM_HITS
+    uint64_t recovered;         // Lost tracks matched again, ID kept
+    uint64_t ended;             // Tracks dropped (lost too long or never confirmed)
+    uint64_t table_full;        // Confident detections without a free slot
+    uint64_t update_sum_ns;     // Time spent in update()
+    uint32_t update_max_ns;
+    uint32_t active;            // Confirmed tracks after the latest frame
+} tracker_stats_t;
+
+/**
+ * @brief Multi-object tracker giving detections IDs that persist
+ *
+ * ByteTrack-style association on a Kalman-predicted box per track:
+ * confirmed and lost tracks first take the confident detections
+ * (>= TRACKER_HIGH_CONF) by IoU, confirmed tracks left over then take the
+ * weak ones, so a target whose score dips through an occlusion keeps its ID,
+ * and tentative tracks get what confident detections remain. Each stage is a
+ * greedy best-IoU-first assignment with class gating. Unmatched confident
+ * detections start tentative tracks; lost tracks keep their ID for
+ * TRACKER_MAX_LOST_MS. The table is fixed; update() allocates nothing.
+ */
+typedef struct {
+    tracker_track_t tracks[TRACKER_MAX_TRACKS];
+    uint8_t next_id;
+    uint64_t last_us;           // PTS of the previous update
+
+    // Per update scratch
+    tracker_pair_t pairs[TRACKER_MAX_TRACKS * TRACKER_MAX_DETECTIONS];
+    int16_t det_track[TRACKER_MAX_DETECTIONS];     // Track index per detection, -1 if none
+    int16_t track_det[TRACKER_MAX_TRACKS];         // Detection index per track, -1 if none
+    int det_count;
+
+    tracker_stats_t stats;
+} target_tracker_t;
+
+/**
+ * @brief Empty the track table
+ */
+void target_tracker_init(target_tracker_t* trk);
+
+/**
+ * @brief Associate a frame's detections and set their target_num
+ *
+ * Detections of confirmed tracks get the track ID; the rest get 0.
+ *
+ * @param trk Tracker
+ * @param targets Detections in pixel coordinates, target_num overwritten
+ * @param count Number of detections (at most TRACKER_MAX_DETECTIONS are tracked)
+ * @param pts_us Capture time of the frame
+ * @return int Number of confirmed tracks
+ */
+int target_tracker_update(target_tracker_t* trk, mavlink_target_t* targets, int count,
+                          uint64_t pts_us);
+
+/**
+ * @brief Track behind detection index i of the latest update()
+ *
+ * @return const tracker_track_t* The track (velocity in kf[0].v, kf[1].v,
+ *         age from start_us), or NULL if the detection has no confirmed track
+ */
+const tracker_track_t* target_tracker_track_of(const target_tracker_t* trk, int i);
+
+/**
+ * @brief Print the counters, update cost and the confirmed tracks
+ */
+void target_tracker_print_stats(target_tracker_t* trk);
+
+/**
+ * @brief Time update() on replayed detections
+ *
+ * Without a path, replays a synthetic scene (targets crossing at constant
+ * velocity, missed detections, confidence dips and false positives) with
+ * known identities and reports ID switches and coverage besides the cost.
+ * With a path, replays the detection SEIs of a recorded H.264 or H.265
+ * stream.
+ *
+ * @param path Recorded elementary stream, or NULL for the synthetic scene
+ * @param frames Synthetic frames to run
+ * @return int 0 on success, -1 if the file cannot be read or IDs are unstable
+ */
+int target_tracker_benchmark(const char* path, int frames);
+
+#endif // TARGET_TRACKER_H
@@ -0,0 +1,105 @@
+#ifndef TELEMETRY_SCHED_H
+#define TELEMETRY_SCHED_H
+
+#include <stdint.h>
+
+#include "mavlink_comm.h"
+
+#define TELEM_MAX_TRACKS 64
+
+/**
+ * @brief Per-target send history, keyed by the target_tracker ID
+ *
+ * Only used to rank and coalesce telemetry.
+ */
+typedef struct {
+    uint8_t in_use;
+    uint8_t id;                 // target_num of the detections, 0 = untracked
+    uint8_t class_id;
+    uint32_t age;               // Consecutive frames seen
+    uint32_t last_frame;        // Frame the track was last matched
+    int cx, cy, w, h;           // Latest box, centre + size in pixels
+
+    uint64_t sent_us;           // Last time the track went out, 0 if never
+    int sent_cx, sent_cy, sent_w, sent_h;
+} telem_track_t;
+
+/**
+ * @brief Scheduler counters
+ */
+typedef struct {
+    uint64_t frames;            // Frames submitted
+    uint64_t offered;           // Detections submitted
+    uint64_t sent;              // Detections transmitted
+    uint64_t coalesced;         // Skipped: barely moved since last sent
+    uint64_t shed;              // Skipped: over the byte budget
+    uint64_t bytes;             // Telemetry bytes transmitted
+    float utilisation;          // Whole-link utilisation, last second (0..1)
+    uint32_t queue_age_us;      // Oldest packet waiting in the UART queue
+} telemetry_sched_stats_t;
+
+/**
+ * @brief Byte-budgeted detection telemetry for one serial link
+ */
+typedef struct {
+    int uart_fd;
+    uint32_t line_bytes_per_s;  // Raw link capacity (baud / 10)
+    float budget_bytes_per_s;   // Share granted to detection telemetry
+    float burst_bytes;          // Token bucket depth
+    float tokens;
+    uint64_t refill_us;
+
+    uint32_t coalesce_ms;       // Resend a slow target at least this often
+    float coalesce_move;        // Move threshold, fraction of box size
+
+    telem_track_t tracks[TELEM_MAX_TRACKS];
+    uint32_t frame;
+
+    uint64_t util_start_us;     // Utilisation window
+    uint64_t util_start_bytes;
+
+    telemetry_sched_stats_t stats;
+} telemetry_sched_t;
+
+/**
+ * @brief Prepare a scheduler for a UART
+ *
+ * @param sched Scheduler state to initialise
+ * @param uart_fd UART carrying the telemetry
+ * @param baud_rate Link speed (8N1, 10 bits per byte)
+ * @param share Fraction of the link given to detections; the rest is left
+ *        for PARAM, TIMESYNC and other replies
+ */
+void telemetry_sched_init(telemetry_sched_t* sched, int uart_fd, int baud_rate, float share);
+
+/**
+ * @brief Send the most valuable detections of a frame within the budget
+ *
+ * Targets are ranked by confidence, track age and distance from the image
+ * centre. Tracked targets that moved less than coalesce_move of their size
+ * are resent only every coalesce_ms. What does not fit in the token bucket
+ * is shed, lowest priority first. The survivors go out as one batch
+ * stamped with capture_us.
+ *
+ * @param sched Scheduler
+ * @param targets Detections in pixel coordinates, target_num set by
+ *        target_tracker_update()
+ * @param count Number of detections
+ * @param frame_width Frame width in pixels
+ * @param frame_height Frame height in pixels
+ * @param capture_us VI capture PTS (CLOCK_MONOTONIC us)
+ * @return int Number of detections sent, or -1 on error
+ */
+int telemetry_sched_submit(telemetry_sched_t* sched,
+                           const mavlink_target_t* targets, int count,
+                           int frame_width, int frame_height, uint64_t capture_us);
+
+/**
+ * @brief Snapshot the counters, refreshing utilisation and queue age
+ *
+ * @param sched Scheduler
+ * @param stats Output counters
+ */
+void telemetry_sched_get_stats(telemetry_sched_t* sched, telemetry_sched_stats_t* stats);
+
+#endif // TELEMETRY_SCHED_H
@@ -0,0 +1,135 @@
+#ifndef TILE_INFER_H
+#define TILE_INFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "im2d.hpp"
+#include "rk_mpi_mb.h"
+#include "yolov5.h"
+
+#define TILE_INFER_MAX 16               // Tiles in a frame's layout
+#define TILE_INFER_DEFAULT_SIZE 320     // Source tile side; 2x zoom into a 640 model
+#define TILE_INFER_MIN_SIZE 160
+#define TILE_INFER_MIN_OVERLAP_PCT 20   // Least overlap between neighbouring tiles
+#define TILE_INFER_HOT_WEIGHT 2         // Schedule weight of tiles that found new targets
+#define TILE_INFER_MERGE_IOS 0.7f       // Overlap of the smaller box that marks a duplicate
+#define TILE_INFER_MAX_CANDIDATES (OBJ_NUMB_MAX_SIZE * 4)
+
+/**
+ * @brief Tiled inference counters
+ */
+typedef struct {
+    uint64_t frames;            // Frames with at least one tile
+    uint64_t tile_runs;
+    uint64_t tile_detections;   // Tile detections before merging
+    uint64_t frame_detections;  // Full-frame detections before merging
+    uint64_t added;             // Merged detections only a tile found
+    uint64_t added_height_sum;  // Their box heights, pixels
+    uint64_t merged;            // Duplicates removed by the cross-tile NMS
+    uint64_t dropped;           // Candidates over TILE_INFER_MAX_CANDIDATES
+    uint64_t tile_sum_us;       // Crop + NPU + post-process, all tiles
+    uint32_t tile_max_us;       // Slowest frame's tiles
+} tile_infer_stats_t;
+
+/**
+ * @brief One region of the frame's tile layout
+ */
+typedef struct {
+    im_rect rect;               // Source region, even aligned
+    uint32_t last_frame;        // Frame the tile last ran
+    uint32_t runs;
+    uint32_t found;             // New targets in its latest run
+} tile_t;
+
+/**
+ * @brief One detection on its way through the cross-tile NMS
+ */
+typedef struct {
+    object_detect_result det;   // Frame coordinates
+    int tile;                   // Tile index, -1 for the full frame
+    bool suppressed;
+} tile_candidate_t;
+
+/**
+ * @brief Small-target recall from overlapping zoomed tiles
+ *
+ * The full frame is letterboxed into the model as before; on top, RGA crops
+ * square tiles out of the NV12 frame and scales each over the whole model
+ * input, so a target a few pixels wide reaches the stride-8 head several
+ * times larger. Tiles cost an NPU run each, so only max_tiles run per frame.
+ * The rest wait their turn: tiles are picked by frames since they last ran,
+ * weighted by TILE_INFER_HOT_WEIGHT for a tile whose last run found a
+ * target the full frame missed. Tile and full-frame detections are merged in
+ * frame coordinates by a class-aware NMS that also drops a box mostly inside
+ * a more confident one, as a target cut by a tile edge is.
+ */
+typedef struct {
+    int frame_w;
+    int frame_h;
+    int model_w;
+    int model_h;
+    int size;                   // Tile side in source pixels
+    int count;                  // Tiles in the layout
+    int cols;
+    int rows;
+    tile_t tiles[TILE_INFER_MAX];
+    uint32_t frame;
+
+    // Per frame scratch
+    object_detect_result_list tile_results;
+    tile_candidate_t cand[TILE_INFER_MAX_CANDIDATES];
+
+    tile_infer_stats_t stats;
+} tile_infer_t;
+
+/**
+ * @brief Lay out overlapping square tiles over the frame
+ *
+ * @param ti Tiler state
+ * @param frame_w Frame width
+ * @param frame_h Frame height
+ * @param size Tile side in source pixels (TILE_INFER_MIN_SIZE up to the
+ *        smaller frame side)
+ * @param model_w Model input width
+ * @param model_h Model input height
+ * @return int 0 on success, -1 if size does not fit the frame or the layout
+ *         needs more than TILE_INFER_MAX tiles
+ */
+int tile_infer_init(tile_infer_t* ti, int frame_w, int frame_h, int size,
+                    int model_w, int model_h);
+
+/**
+ * @brief Map detections of a crop scaled over the model input (see
+ *        rga_crop_nv12_to_rknn()) back to frame coordinates
+ *
+ * @param rect Source region the model saw
+ * @param model_w Model input width
+ * @param model_h Model input height
+ * @param results Detections in model input coordinates, mapped in place
+ */
+void tile_infer_map_results(const im_rect* rect, int model_w, int model_h,
+                            object_detect_result_list* results);
+
+/**
+ * @brief Run this frame's share of tiles and merge them into the results
+ *
+ * Overwrites the model input; call after the full-frame inference.
+ *
+ * @param ti Tiler state
+ * @param nv12 Camera frame (NV12)
+ * @param ctx RKNN context the full frame ran on
+ * @param max_tiles Tiles to run this frame
+ * @param results Full-frame detections in frame coordinates, replaced by the
+ *        merged detections
+ * @return int Tiles run
+ */
+int tile_infer_run(tile_infer_t* ti, MB_BLK nv12, rknn_app_context_t* ctx, int max_tiles,
+                   object_detect_result_list* results);
+
+/**
+ * @brief Print the layout, tile runs, detections added and tile cost
+ */
+void tile_infer_print_stats(tile_infer_t* ti);
+
+#endif // TILE_INFER_H
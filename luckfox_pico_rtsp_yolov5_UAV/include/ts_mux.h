@@ -0,0 +1,75 @@
+#ifndef TS_MUX_H
+#define TS_MUX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One program with a single video elementary stream
+#define TS_PACKET_LEN 188
+#define TS_PID_PMT 0x1000
+#define TS_PID_VIDEO 0x0100
+#define TS_STREAM_TYPE_H264 0x1B
+#define TS_STREAM_TYPE_H265 0x24
+// Timestamps start here so the PCR can run ahead of the first PTS
+#define TS_CLOCK_START 90000
+#define TS_PCR_LEAD 9000            // PCR this many 90 kHz ticks before the PTS
+
+/**
+ * @brief Receives every 188-byte transport packet in stream order
+ */
+typedef void (*ts_mux_write_fn)(const uint8_t* packet, void* user);
+
+/**
+ * @brief MPEG-TS multiplexer state
+ */
+typedef struct {
+    bool hevc;
+    uint8_t cc_pat;             // Continuity counters per PID
+    uint8_t cc_pmt;
+    uint8_t cc_video;
+    bool have_base;
+    uint64_t base_us;           // PTS of the first frame, mapped to TS_CLOCK_START
+    ts_mux_write_fn write;
+    void* user;
+} ts_mux_t;
+
+/**
+ * @brief Start a new transport stream
+ *
+ * @param mux Multiplexer state
+ * @param hevc Video is H.265 (stream type 0x24), else H.264 (0x1B)
+ * @param write Packet sink
+ * @param user Opaque pointer for write
+ */
+void ts_mux_init(ts_mux_t* mux, bool hevc, ts_mux_write_fn write, void* user);
+
+/**
+ * @brief Emit the PAT and PMT
+ */
+void ts_mux_tables(ts_mux_t* mux);
+
+/**
+ * @brief Emit one access unit as a PES packet
+ *
+ * An access unit delimiter is added when the frame does not start with one.
+ * Key frames are preceded by the PAT/PMT and flagged random access, and
+ * every frame carries a PCR, so any segment can be played from its start.
+ *
+ * @param mux Multiplexer state
+ * @param prefix Annex-B NAL units to insert in front of the frame (e.g. cached
+ *               parameter sets), may be NULL
+ * @param prefix_len Prefix length
+ * @param au Annex-B access unit
+ * @param len Access unit length
+ * @param pts_us Presentation time in microseconds
+ * @param key Frame is a random access point
+ */
+void ts_mux_frame(ts_mux_t* mux, const uint8_t* prefix, size_t prefix_len,
+                  const uint8_t* au, size_t len, uint64_t pts_us, bool key);
+
+/**
+ * @brief MPEG-2 CRC-32 of the PSI sections
+ */
+uint32_t ts_crc32(const uint8_t* data, size_t len);
+
+#endif // TS_MUX_H
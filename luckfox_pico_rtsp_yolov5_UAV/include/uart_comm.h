@@ -2,6 +2,10 @@
 #define UART_COMM_H
 
 #include <cstddef>
+#include <stdint.h>
+
+// Largest packet the transmit queue carries (one MAVLink v2 frame)
+#define UART_TX_SLOT_SIZE 280
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,6 +33,8 @@ int uart_printf(int fd, const char *format, ...);
 /**
  * @brief Send raw data over UART
  * 
+ * Waits for the tty to accept all bytes, also when the fd is non-blocking.
+ * 
  * @param fd File descriptor of the serial port
  * @param data Pointer to data buffer
  * @param length Number of bytes to send
@@ -36,6 +42,97 @@ int uart_printf(int fd, const char *format, ...);
  */
 int uart_write(int fd, const void *data, size_t length);
 
+/**
+ * @brief Transmit queue counters
+ */
+typedef struct {
+    uint64_t enqueued;          // Packets accepted into the queue
+    uint64_t sent_packets;      // Packets fully written to the tty
+    uint64_t sent_bytes;        // Bytes written to the tty
+    uint64_t dropped_oldest;    // Packets evicted because the queue was full
+    uint64_t dropped_invalid;   // Packets rejected (empty or oversized)
+    uint64_t write_errors;      // writev() failures other than EAGAIN
+    uint64_t dropped_stopped;   // Packets abandoned because the queue stopped while the tty was full
+    uint32_t depth;             // Packets currently queued
+    uint32_t high_water;        // Largest depth seen
+    uint32_t queued_bytes;      // Bytes currently queued
+    uint32_t oldest_age_us;     // Time the oldest queued packet has waited
+    uint32_t max_wait_us;       // Longest wait before the writer took a packet
+} uart_tx_stats_t;
+
+/**
+ * @brief Start the non-blocking transmit queue on an open UART
+ *
+ * Switches the fd to O_NONBLOCK and spawns a writer thread that drains a
+ * bounded ring of packets with poll()/writev(). When the ring is full the
+ * oldest packet is dropped, so producers never wait on the serial link.
+ *
+ * @param fd File descriptor returned by uart_init()
+ * @param capacity Ring size in packets
+ * @return int 0 on success, -1 on failure
+ */
+int uart_tx_start(int fd, int capacity);
+
+/**
+ * @brief Queue one packet for transmission
+ *
+ * @param data Packet bytes (copied into the ring)
+ * @param length Packet length, at most UART_TX_SLOT_SIZE
+ * @return int Number of bytes queued, or -1 on failure
+ */
+int uart_tx_enqueue(const void *data, size_t length);
+
+/**
+ * @brief Claim the next ring slot to serialise a packet in place
+ *
+ * Evicts the oldest packet if the ring is full. The queue lock is held
+ * until uart_tx_commit() or uart_tx_abort(), so fill the slot without
+ * calling back into the queue and keep it short.
+ *
+ * @param fd File descriptor the packet is for
+ * @return uint8_t* Slot of UART_TX_SLOT_SIZE bytes, or NULL if no queue
+ *         runs on fd (send with uart_write() instead)
+ */
+uint8_t *uart_tx_reserve(int fd);
+
+/**
+ * @brief Publish the slot returned by uart_tx_reserve()
+ *
+ * @param length Bytes written into the slot, at most UART_TX_SLOT_SIZE
+ * @return int Number of bytes queued, or -1 if length is invalid
+ */
+int uart_tx_commit(size_t length);
+
+/**
+ * @brief Release a reserved slot without queuing anything
+ */
+void uart_tx_abort(void);
+
+/**
+ * @brief Send a packet on fd, through the queue if it runs on that fd
+ *
+ * Falls back to a direct uart_write() when no queue was started for fd.
+ *
+ * @return int Number of bytes queued or written, or -1 on failure
+ */
+int uart_tx_send(int fd, const void *data, size_t length);
+
+/**
+ * @brief Snapshot the transmit queue counters
+ *
+ * @param stats Output counters
+ */
+void uart_tx_get_stats(uart_tx_stats_t *stats);
+
+/**
+ * @brief Stop the writer thread, flushing what it already dequeued
+ *
+ * Once stopping, a batch the tty cannot take (EAGAIN) is abandoned rather than
+ * waited on, so the join returns within one poll period; its packets count
+ * as dropped_stopped.
+ */
+void uart_tx_stop(void);
+
 /**
  * @brief Close UART serial port
  * 
@@ -0,0 +1,92 @@
+#ifndef UDP_LINK_H
+#define UDP_LINK_H
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest datagram the link batches (one MAVLink v2 frame)
+#define UDP_LINK_SLOT_SIZE 280
+// Datagrams handed to the kernel per sendmmsg()
+#define UDP_LINK_BATCH 32
+
+/**
+ * @brief UDP link counters
+ */
+typedef struct {
+    uint64_t datagrams;         // Datagrams accepted by the kernel
+    uint64_t bytes;             // Payload bytes accepted by the kernel
+    uint64_t syscalls;          // sendmmsg()/sendto() calls
+    uint64_t errors;            // Datagrams the kernel refused
+} udp_link_stats_t;
+
+/**
+ * @brief Datagram socket with a batch of pending packets
+ *
+ * Packets are serialised straight into the batch and leave together on
+ * udp_link_flush() with a single sendmmsg(). A full batch is flushed
+ * automatically before the next packet is reserved.
+ */
+typedef struct {
+    int fd;
+    struct sockaddr_in dest;
+    uint8_t slots[UDP_LINK_BATCH][UDP_LINK_SLOT_SIZE];
+    uint16_t lens[UDP_LINK_BATCH];
+    int pending;
+    pthread_mutex_t lock;
+    udp_link_stats_t stats;
+} udp_link_t;
+
+/**
+ * @brief Open a UDP socket towards a destination
+ *
+ * @param link Link state to initialise
+ * @param dest_ip Destination IPv4 address (e.g. "192.168.1.10")
+ * @param dest_port Destination port (14550 for a GCS)
+ * @param local_port Port to bind for replies, 0 for any
+ * @return int 0 on success, -1 on failure
+ */
+int udp_link_open(udp_link_t* link, const char* dest_ip, int dest_port, int local_port);
+
+/**
+ * @brief Claim the next batch slot to serialise a packet in place
+ *
+ * The link lock is held until udp_link_commit() or udp_link_abort().
+ *
+ * @return uint8_t* Slot of UDP_LINK_SLOT_SIZE bytes
+ */
+uint8_t* udp_link_reserve(udp_link_t* link);
+
+/**
+ * @brief Add the reserved slot to the batch
+ *
+ * @return int Number of bytes batched, or -1 if length is invalid
+ */
+int udp_link_commit(udp_link_t* link, size_t length);
+
+/**
+ * @brief Release a reserved slot without batching anything
+ */
+void udp_link_abort(udp_link_t* link);
+
+/**
+ * @brief Send one datagram immediately, bypassing the batch
+ *
+ * @return int Number of bytes sent, or -1 on failure
+ */
+int udp_link_send(udp_link_t* link, const void* data, size_t length);
+
+/**
+ * @brief Send every batched packet with one sendmmsg()
+ *
+ * @return int Number of datagrams sent, or -1 on failure
+ */
+int udp_link_flush(udp_link_t* link);
+
+/**
+ * @brief Close the socket, dropping anything still batched
+ */
+void udp_link_close(udp_link_t* link);
+
+#endif // UDP_LINK_H
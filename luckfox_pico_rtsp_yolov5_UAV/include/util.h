@@ -0,0 +1,25 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief write() until all of data is out, retrying on EINTR
+ *
+ * @param fd File descriptor
+ * @param data Bytes to write
+ * @param len Number of bytes
+ * @return int 0 on success, -1 on error (errno set)
+ */
+int write_all(int fd, const void* data, size_t len);
+
+/**
+ * @brief xorshift32 generator for the deterministic self-tests
+ *
+ * @param state Generator state, updated; must not be 0
+ * @return uint32_t Next value
+ */
+uint32_t selftest_rand(uint32_t* state);
+
+#endif // UTIL_H
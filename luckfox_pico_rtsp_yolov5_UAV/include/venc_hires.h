@@ -0,0 +1,92 @@
+#ifndef VENC_HIRES_H
+#define VENC_HIRES_H
+
+#include <stdint.h>
+
+#include "sample_comm.h"
+#include "venc_sink.h"
+
+#define VENC_HIRES_VI_CHN 0             // ISP main path: the only one at full sensor size
+#define VENC_HIRES_VENC_CHN 1
+#define VENC_HIRES_VI_BUFS 3
+#define VENC_HIRES_DEFAULT_WIDTH 2304   // SC3336 full frame
+#define VENC_HIRES_DEFAULT_HEIGHT 1296
+#define VENC_HIRES_DEFAULT_KBPS 10240
+#define VENC_HIRES_GOP 60
+
+/**
+ * @brief Encoder load sampled for one channel
+ */
+typedef struct {
+    uint64_t frames;            // Frames at the last sample
+    uint64_t bytes;
+    uint64_t sample_us;
+    uint32_t backlog_max;       // Most pictures seen queued for the encoder
+} venc_hires_load_t;
+
+/**
+ * @brief Full-resolution recording channel bound VI -> VENC
+ *
+ * The ISP main path delivers the sensor's full frame to its own VI channel,
+ * which is bound to a VENC channel with RK_MPI_SYS_Bind, so frames reach
+ * the encoder without the CPU or RGA touching them. The inference and live
+ * stream keep the scaled VI channel. Encoded packets are drained by a
+ * venc_sink with no RTSP session; its consumers (e.g. the clip recorder)
+ * get the high-resolution stream.
+ */
+typedef struct {
+    int vi_chn;
+    int venc_chn;
+    int width;
+    int height;
+    uint32_t kbps;
+    RK_CODEC_ID_E codec;
+    bool bound;
+
+    venc_sink_t sink;
+
+    size_t mem_estimate;        // VI buffers, stream buffer and reference frames
+    long mem_used_kb;           // MemAvailable drop across venc_hires_init()
+
+    venc_hires_load_t load;
+    venc_hires_load_t live_load;
+} venc_hires_t;
+
+/**
+ * @brief Create the VI channel and the VENC channel and bind them
+ *
+ * Register the consumers on hires->sink afterwards, then call
+ * venc_hires_start(). VI must already be initialised with vi_dev_init().
+ *
+ * @param hires State to initialise
+ * @param width Frame width (at most the sensor's)
+ * @param height Frame height
+ * @param codec RK_VIDEO_ID_AVC or RK_VIDEO_ID_HEVC
+ * @param kbps Average bitrate (VBR, peak 1.5x)
+ * @return int 0 on success, -1 on failure
+ */
+int venc_hires_init(venc_hires_t* hires, int width, int height, RK_CODEC_ID_E codec,
+                    uint32_t kbps);
+
+/**
+ * @brief Start draining the encoder
+ */
+int venc_hires_start(venc_hires_t* hires);
+
+/**
+ * @brief Print frame rate, bitrate, encoder backlog and memory of both channels
+ *
+ * @param hires High-resolution channel
+ * @param live_chn Live stream VENC channel
+ * @param live Live stream sink counters
+ * @param live_pixels Live stream width * height
+ */
+void venc_hires_print_stats(venc_hires_t* hires, int live_chn, const venc_sink_stats_t* live,
+                            int live_pixels);
+
+/**
+ * @brief Stop the sink, unbind and destroy both channels
+ */
+void venc_hires_stop(venc_hires_t* hires);
+
+#endif // VENC_HIRES_H
@@ -0,0 +1,163 @@
+#ifndef VENC_PROFILE_H
+#define VENC_PROFILE_H
+
+#include <stdint.h>
+
+#include "sample_comm.h"
+#include "venc_sink.h"
+
+/**
+ * @brief Named encoder profiles, also the ENC_PROFILE parameter values
+ */
+typedef enum {
+    VENC_PROFILE_LOW_LATENCY = 0,   // P-frames, gradual intra refresh, sliced
+    VENC_PROFILE_LOW_BANDWIDTH,     // Long GOP, AVBR for a thin radio link
+    VENC_PROFILE_ARCHIVAL,          // High VBR bitrate, short GOP for seeking
+    VENC_PROFILE_COUNT
+} venc_profile_id_t;
+
+typedef enum {
+    VENC_PROFILE_RC_CBR = 0,
+    VENC_PROFILE_RC_VBR,
+    VENC_PROFILE_RC_AVBR,
+} venc_profile_rc_t;
+
+/**
+ * @brief Encoder settings of one profile
+ */
+typedef struct {
+    const char* name;
+    venc_profile_rc_t rc;
+    uint32_t bitrate_kbps;      // Target (CBR) or average (VBR/AVBR)
+    uint32_t max_kbps;          // VBR/AVBR ceiling
+    uint32_t min_kbps;          // VBR/AVBR floor
+    uint32_t gop;               // Frames between IDRs
+    uint32_t refresh_rows;      // Macroblock rows intra-refreshed per frame, 0 = off
+    uint32_t slices;            // Slices per frame, 1 = whole frames
+    uint32_t stream_buf_cnt;    // Encoded output buffers (fixed at channel creation)
+} venc_profile_t;
+
+/**
+ * @brief Per-profile bitrate and latency, accumulated while it was active
+ */
+typedef struct {
+    uint64_t frames;            // Frames encoded (with a valid capture PTS)
+    uint64_t bytes;             // Encoded bytes
+    uint64_t active_us;         // Time the profile was in use
+    uint64_t latency_sum_us;    // Capture->encoded, summed over frames
+    uint32_t latency_peak_us;   // Worst sample-window average
+} venc_profile_stats_t;
+
+/**
+ * @brief Profile control for one VENC channel
+ */
+typedef struct {
+    int chn;
+    RK_CODEC_ID_E codec;
+    int width;
+    int height;
+    int active;                         // venc_profile_id_t in use
+    uint32_t switches;                  // Successful runtime switches
+    uint32_t errors;                    // Failed MPI calls
+    venc_profile_stats_t stats[VENC_PROFILE_COUNT];
+
+    // Sink counters at the last sample, to take deltas from
+    uint64_t last_us;
+    uint64_t last_bytes;
+    uint64_t last_frames;
+    uint64_t last_latency_sum_us;
+} venc_profile_ctl_t;
+
+/**
+ * @brief Profile settings by id
+ *
+ * @return const venc_profile_t* Profile, or NULL if id is out of range
+ */
+const venc_profile_t* venc_profile_get(int id);
+
+/**
+ * @brief Look a profile up by name ("low-latency", "low-bandwidth", "archival")
+ *
+ * @return int Profile id, or -1 if unknown
+ */
+int venc_profile_find(const char* name);
+
+/**
+ * @brief Fill the rate control and buffer fields of a channel's attributes
+ *
+ * Used by venc_init() before RK_MPI_VENC_CreateChn() and on every switch.
+ * stVencAttr.enType must already be set.
+ */
+void venc_profile_fill_attr(const venc_profile_t* profile, VENC_CHN_ATTR_S* attr);
+
+/**
+ * @brief Use slices slices per frame in every profile (1 = whole frames)
+ *
+ * For the slice-level streaming mode; call before venc_init(). Slices are
+ * whole macroblock (CTU) rows, so the last one may be shorter.
+ */
+void venc_profile_override_slices(int slices);
+
+/**
+ * @brief Slices per frame a profile is encoded with, after any override
+ */
+int venc_profile_slices(const venc_profile_t* profile);
+
+/**
+ * @brief Apply the settings that cannot go through the channel attributes
+ *
+ * Intra refresh and slice split; call once the channel exists. Rows are
+ * macroblock rows for H.264 and CTU rows for H.265.
+ *
+ * @return int 0 on success, -1 if an MPI call failed
+ */
+int venc_profile_apply_extras(int chn, RK_CODEC_ID_E codec, int width, int height,
+                              const venc_profile_t* profile);
+
+/**
+ * @brief Start tracking a channel created with venc_init() and profile id
+ */
+void venc_profile_ctl_init(venc_profile_ctl_t* ctl, int chn, RK_CODEC_ID_E codec,
+                           int width, int height, int id);
+
+/**
+ * @brief Switch the running channel to another profile
+ *
+ * GOP, rate control, intra refresh and slice split change in place through
+ * SetChnAttr/SetIntraRefresh/SetSliceSplit, then an IDR is requested so
+ * clients resync at once. The channel keeps receiving and the RTSP session
+ * stays up. The output buffer count only changes on the next start.
+ *
+ * @param ctl Profile control
+ * @param id New profile
+ * @param sink Sink counters, to close the old profile's statistics
+ * @return int 0 on success (or already active), -1 on failure
+ */
+int venc_profile_switch(venc_profile_ctl_t* ctl, int id, const venc_sink_stats_t* sink);
+
+/**
+ * @brief Charge the sink's traffic since the last sample to the active profile
+ */
+void venc_profile_sample(venc_profile_ctl_t* ctl, const venc_sink_stats_t* sink);
+
+/**
+ * @brief Print bitrate and capture->encoded latency of every profile used
+ */
+void venc_profile_print(const venc_profile_ctl_t* ctl);
+
+/**
+ * @brief Compare H.264 and H.265 bitrates at the same fixed QPs
+ *
+ * Creates VENC channels 1 (H.264) and 2 (H.265) with fixed-QP rate control
+ * and feeds both the same frames from VI channel vi_chn, so the only
+ * difference is the codec. For each QP prints bytes per frame, the bitrate
+ * at 30 fps and the H.265/H.264 size ratio. VI must be running; VENC
+ * channels 1 and 2 must be free.
+ *
+ * @param vi_chn VI channel delivering YUV420SP frames of width x height
+ * @param frames Frames encoded per QP
+ * @return int 0 on success, -1 on failure
+ */
+int venc_codec_compare(int vi_chn, int width, int height, int frames);
+
+#endif // VENC_PROFILE_H
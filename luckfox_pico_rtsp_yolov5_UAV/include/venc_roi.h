@@ -0,0 +1,61 @@
+#ifndef VENC_ROI_H
+#define VENC_ROI_H
+
+#include <stdint.h>
+
+#include "mavlink_comm.h"
+#include "sample_comm.h"
+
+#define VENC_ROI_MAX 8                  // Regions the encoder supports
+#define VENC_ROI_ALIGN 16               // Macroblock size
+#define VENC_ROI_MOVE 16                // Edge movement (px) that triggers an update
+#define VENC_ROI_HOLD_FRAMES 10         // Keep regions this long after targets vanish
+
+/**
+ * @brief ROI update counters
+ */
+typedef struct {
+    uint64_t frames;            // venc_roi_update() calls
+    uint64_t updates;           // Times the regions were pushed to the encoder
+    uint64_t set_calls;         // RK_MPI_VENC_SetRoiAttr calls
+    uint64_t errors;            // Failed SetRoiAttr calls
+    uint32_t active;            // Regions currently enabled
+} venc_roi_stats_t;
+
+/**
+ * @brief Detection-driven ROI state for one VENC channel
+ */
+typedef struct {
+    int chn;
+    int width;
+    int height;
+    RECT_S rects[VENC_ROI_MAX];         // Regions currently applied
+    int count;
+    int qp;                             // Relative QP currently applied
+    uint32_t idle_frames;               // Consecutive frames without targets
+    venc_roi_stats_t stats;
+} venc_roi_t;
+
+/**
+ * @brief Prepare ROI control for a VENC channel (no regions enabled)
+ */
+void venc_roi_init(venc_roi_t* roi, int chn, int width, int height);
+
+/**
+ * @brief Point the encoder's ROIs at a frame's detections
+ *
+ * The most confident VENC_ROI_MAX targets get a macroblock-aligned region
+ * with a margin around the box and a relative QP of qp, so the CBR rate
+ * control spends the bits on them and coarsens the background. Regions are
+ * only re-applied when an edge moves by VENC_ROI_MOVE pixels or more, the
+ * set of targets changes, or qp changes. Call before the frame is sent.
+ *
+ * @param roi ROI state
+ * @param targets Detections in pixel coordinates
+ * @param count Number of detections
+ * @param qp Relative QP for targets (negative), 0 disables ROI
+ * @return int 1 if the encoder was updated, 0 otherwise
+ */
+int venc_roi_update(venc_roi_t* roi, const mavlink_target_t* targets, int count, int qp);
+
+#endif // VENC_ROI_H
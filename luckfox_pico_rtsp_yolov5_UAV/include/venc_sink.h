@@ -0,0 +1,188 @@
+#ifndef VENC_SINK_H
+#define VENC_SINK_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "rtsp_demo.h"
+#include "sample_comm.h"
+
+#define VENC_SINK_MAX_CONSUMERS 8
+// Room reserved for a per-frame prefix (e.g. an SEI NAL)
+#define VENC_SINK_PREFIX_MAX 2048
+// Wait for the next slice of a frame already started, instead of polling
+#define VENC_SINK_SLICE_WAIT_MS 5
+// Room for the stream's parameter sets (VPS/SPS/PPS) handed to librtsp
+#define VENC_SINK_CODEC_DATA_MAX 512
+
+/**
+ * @brief Called from the sink thread for every encoded packet
+ *
+ * @param pack Packet descriptor (PTS, frame end flag, NAL type)
+ * @param data Packet payload (Annex-B elementary stream), preceded by the
+ *             sink prefix on the first packet of a frame
+ * @param len Payload length in bytes
+ * @param user Opaque pointer given at registration
+ */
+typedef void (*venc_sink_consumer_fn)(const VENC_PACK_S* pack,
+                                      const uint8_t* data, uint32_t len,
+                                      void* user);
+
+/**
+ * @brief Produce NAL units to stream in front of a frame
+ *
+ * Called on the sink thread for the first packet of every frame.
+ *
+ * @param pts PTS of the frame
+ * @param out Output buffer of VENC_SINK_PREFIX_MAX bytes
+ * @param size Output capacity
+ * @param user Opaque pointer given at registration
+ * @return int Bytes written (Annex-B, start code included), 0 for none
+ */
+typedef int (*venc_sink_prefix_fn)(uint64_t pts, uint8_t* out, size_t size, void* user);
+
+/**
+ * @brief Counters maintained by the sink thread
+ */
+typedef struct {
+    uint64_t packets;           // Packets drained from VENC
+    uint64_t bytes;             // Payload bytes drained
+    uint64_t rtsp_events;       // rtsp_do_event calls
+    uint64_t wakeups;           // poll() wakeups with data ready
+
+    // Capture-to-encoded latency: frame-end packet arrival minus its PTS
+    uint64_t latency_frames;    // Frames measured
+    uint64_t latency_sum_us;    // Sum over all measured frames
+    uint32_t latency_last_us;   // Most recent frame
+    uint32_t latency_max_us;    // Worst frame since start
+
+    // Per-slice timing; a frame's first packet is when its first byte leaves
+    uint64_t sliced_frames;         // Frames that arrived as more than one packet
+    uint64_t slices;                // Packets of those frames
+    uint64_t first_slice_sum_us;    // Capture to first packet, summed per frame
+    uint32_t first_slice_last_us;
+    uint64_t slice_span_sum_us;     // First to last packet of a sliced frame, summed
+    uint32_t slice_gap_max_us;      // Longest wait between two slices of a frame
+    uint32_t slices_last;           // Packets in the most recent frame
+
+    uint64_t codec_data_updates;    // Parameter set changes pushed to the RTSP session
+} venc_sink_stats_t;
+
+/**
+ * @brief Encoder drain thread state
+ */
+typedef struct {
+    int chn;                            // VENC channel to drain
+    int event_period_ms;                // rtsp_do_event cadence
+    rtsp_demo_handle rtsp_demo;         // May be NULL
+    rtsp_session_handle rtsp_session;   // May be NULL
+    bool hevc;                          // Stream is H.265
+
+    uint8_t codec_data[VENC_SINK_CODEC_DATA_MAX];   // Parameter sets last given to rtsp_set_video
+    size_t codec_data_len;
+
+    venc_sink_consumer_fn consumers[VENC_SINK_MAX_CONSUMERS];
+    void* consumer_user[VENC_SINK_MAX_CONSUMERS];
+    int consumer_count;
+
+    venc_sink_prefix_fn prefix;
+    void* prefix_user;
+    uint8_t* scratch;                   // Prefix + packet, when a prefix is set
+    size_t scratch_size;
+    bool mid_frame;                     // Last packet did not end a frame
+    uint64_t frame_first_us;            // Arrival of the current frame's first packet
+    uint64_t frame_last_us;             // Arrival of its latest packet
+    uint32_t frame_packets;
+
+    volatile int running;
+    pthread_t thread;
+    venc_sink_stats_t stats;            // Written by the sink thread, read with venc_sink_get_stats()
+    pthread_mutex_t stats_lock;
+} venc_sink_t;
+
+/**
+ * @brief Prepare a sink for a VENC channel
+ *
+ * @param sink Sink state to initialise
+ * @param chn VENC channel id
+ * @param rtsp_demo RTSP server serviced on the sink thread (may be NULL)
+ * @param rtsp_session Session that receives every packet (may be NULL)
+ * @param event_period_ms How often rtsp_do_event runs when no packet arrives
+ */
+void venc_sink_init(venc_sink_t* sink, int chn,
+                    rtsp_demo_handle rtsp_demo,
+                    rtsp_session_handle rtsp_session,
+                    int event_period_ms);
+
+/**
+ * @brief Select the stream codec (H.264 by default)
+ *
+ * The sink keeps the RTSP session's codec data in step with the parameter
+ * sets (SPS/PPS, plus VPS for H.265) found in front of key frames, so the
+ * SDP always describes the stream being sent. Must be called before
+ * venc_sink_start().
+ */
+void venc_sink_set_codec(venc_sink_t* sink, bool hevc);
+
+/**
+ * @brief Collect the parameter sets in front of a frame's first slice
+ *
+ * Walks the Annex-B NAL units up to the first slice and copies SPS/PPS
+ * (H.264) or VPS/SPS/PPS (H.265) to sets, each with a 4-byte start code.
+ *
+ * @param data First packet of a frame
+ * @param len Packet length
+ * @param hevc Stream is H.265
+ * @param sets Output buffer
+ * @param size Output capacity
+ * @param key Set if the frame is an IDR (H.265: any IRAP) picture; may be NULL
+ * @return int Bytes written to sets, -1 if they do not fit
+ */
+int venc_sink_parameter_sets(const uint8_t* data, uint32_t len, bool hevc,
+                             uint8_t* sets, size_t size, bool* key);
+
+/**
+ * @brief Register an extra consumer, called after the RTSP push
+ *
+ * Must be called before venc_sink_start().
+ *
+ * @return int 0 on success, -1 if the consumer table is full
+ */
+int venc_sink_add_consumer(venc_sink_t* sink, venc_sink_consumer_fn fn, void* user);
+
+/**
+ * @brief Insert the prefix's NAL units before each frame's data
+ *
+ * The prefix and the frame go to RTSP and to the consumers as one buffer,
+ * so they share the frame's PTS and RTP timestamp. Must be called before
+ * venc_sink_start().
+ */
+void venc_sink_set_prefix(venc_sink_t* sink, venc_sink_prefix_fn fn, void* user);
+
+/**
+ * @brief Start the drain thread
+ *
+ * The thread waits on RK_MPI_VENC_GetFd() with poll(), forwards each packet
+ * as soon as the encoder completes it and runs rtsp_do_event on its own
+ * cadence, independent of the frame loop. When the encoder splits frames
+ * into slices, each slice goes to RTSP as soon as it is out, and the thread
+ * keeps waiting in GetStream until the frame's last slice.
+ *
+ * @return int 0 on success, -1 on failure
+ */
+int venc_sink_start(venc_sink_t* sink);
+
+/**
+ * @brief Stop and join the drain thread
+ */
+void venc_sink_stop(venc_sink_t* sink);
+
+/**
+ * @brief Copy the counters the sink thread updates
+ *
+ * @param sink Sink state
+ * @param stats Output snapshot
+ */
+void venc_sink_get_stats(venc_sink_t* sink, venc_sink_stats_t* stats);
+
+#endif // VENC_SINK_H
@@ -0,0 +1,684 @@
+#include "clip_recorder.h"
+#include "luckfox_mpi.h"
+#include "venc_sink.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static void* writer_thread(void* arg);
+
+int clip_recorder_start(clip_recorder_t* rec, const char* dir, bool hevc,
+                        uint32_t pre_ms, uint32_t post_ms, uint32_t max_kbps) {
+    memset(rec, 0, sizeof(*rec));
+    rec->fd = -1;
+    snprintf(rec->dir, sizeof(rec->dir), "%s", dir);
+    rec->hevc = hevc;
+    rec->pre_ms = pre_ms;
+    rec->post_ms = post_ms;
+    rec->segment_ms = CLIP_RECORDER_SEGMENT_MS;
+
+    // Bytes per millisecond at the peak bitrate is kbps / 8
+    rec->ring_size = (size_t)(pre_ms + CLIP_RECORDER_RING_SLACK_MS) * max_kbps / 8;
+    if (rec->ring_size < 2 * CLIP_RECORDER_FRAME_MAX) {
+        rec->ring_size = 2 * CLIP_RECORDER_FRAME_MAX;
+    }
+    rec->prealloc = (size_t)rec->segment_ms * max_kbps / 8 * 5 / 4;
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "clip_recorder: mkdir %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    rec->ring = (uint8_t*)malloc(rec->ring_size);
+    rec->copy = (uint8_t*)malloc(CLIP_RECORDER_FRAME_MAX);
+    rec->wbuf = (uint8_t*)malloc(CLIP_RECORDER_WRITE_BUF);
+    if (!rec->ring || !rec->copy || !rec->wbuf) {
+        fprintf(stderr, "clip_recorder: out of memory for a %zu-byte ring\n", rec->ring_size);
+        clip_recorder_stop(rec);
+        return -1;
+    }
+
+    pthread_mutex_init(&rec->lock, NULL);
+    pthread_cond_init(&rec->cond, NULL);
+    rec->running = 1;
+    if (pthread_create(&rec->thread, NULL, writer_thread, rec) != 0) {
+        perror("clip_recorder: pthread_create");
+        rec->running = 0;
+        clip_recorder_stop(rec);
+        return -1;
+    }
+
+    printf("clip_recorder: %s, %u ms before / %u ms after a detection, %zu KB ring\n",
+           dir, pre_ms, post_ms, rec->ring_size / 1024);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Producer side (VENC drain and frame loop): memory only
+// ---------------------------------------------------------------------------
+
+// Drop the oldest access unit; called with the lock held
+static void evict_oldest(clip_recorder_t* rec) {
+    rec->frame_tail++;
+    rec->ring_tail = rec->frame_tail < rec->frame_head
+                         ? rec->frames[rec->frame_tail % CLIP_RECORDER_MAX_FRAMES].offset
+                         : rec->frame_start;
+    rec->stats.evicted++;
+}
+
+static void ring_write(clip_recorder_t* rec, const uint8_t* data, size_t len) {
+    size_t pos = rec->ring_head % rec->ring_size;
+    size_t first = rec->ring_size - pos < len ? rec->ring_size - pos : len;
+    memcpy(rec->ring + pos, data, first);
+    memcpy(rec->ring, data + first, len - first);
+    rec->ring_head += len;
+}
+
+void clip_recorder_venc_consumer(const VENC_PACK_S* pack, const uint8_t* data,
+                                 uint32_t len, void* user) {
+    clip_recorder_t* rec = (clip_recorder_t*)user;
+    bool first = rec->ring_head == rec->frame_start;
+
+    if (rec->frame_drop) {
+        if (pack->bFrameEnd) {
+            rec->frame_drop = false;
+        }
+        return;
+    }
+    uint64_t frame_len = rec->ring_head - rec->frame_start + len;
+    if (frame_len > CLIP_RECORDER_FRAME_MAX) {
+        rec->ring_head = rec->frame_start;
+        rec->frame_drop = !pack->bFrameEnd;
+        rec->stats.oversize++;
+        return;
+    }
+
+    bool key = false;
+    uint8_t sets[CLIP_RECORDER_PARAM_SETS_MAX];
+    int sets_len = 0;
+    if (first) {
+        sets_len = venc_sink_parameter_sets(data, len, rec->hevc, sets, sizeof(sets), &key);
+        rec->frame_key = key;
+    }
+
+    // Make room by whole access units; the bytes are copied outside the lock,
+    // the writer only reads units that are still indexed after its copy
+    pthread_mutex_lock(&rec->lock);
+    while (rec->ring_head + len - rec->ring_tail > rec->ring_size &&
+           rec->frame_tail < rec->frame_head) {
+        evict_oldest(rec);
+    }
+    if (sets_len > 0) {
+        memcpy(rec->param_sets, sets, sets_len);
+        rec->param_sets_len = sets_len;
+    }
+    pthread_mutex_unlock(&rec->lock);
+
+    ring_write(rec, data, len);
+    if (!pack->bFrameEnd) {
+        return;
+    }
+
+    pthread_mutex_lock(&rec->lock);
+    if (rec->frame_head - rec->frame_tail == CLIP_RECORDER_MAX_FRAMES) {
+        evict_oldest(rec);
+    }
+    clip_recorder_frame_t* f = &rec->frames[rec->frame_head % CLIP_RECORDER_MAX_FRAMES];
+    f->offset = rec->frame_start;
+    f->len = (uint32_t)(rec->ring_head - rec->frame_start);
+    f->pts_us = pack->u64PTS;
+    f->key = rec->frame_key;
+    rec->frame_head++;
+    rec->frame_start = rec->ring_head;
+    rec->stats.frames++;
+    rec->stats.bytes += f->len;
+    rec->last_frame_us = TEST_COMM_GetNowUs();
+    if (rec->active) {
+        pthread_cond_signal(&rec->cond);
+    }
+    pthread_mutex_unlock(&rec->lock);
+}
+
+// First access unit of a clip for a trigger at pts_us: the newest key frame
+// no older than pre_ms plus the ring slack, else the first frame of the
+// pre-event window (intra refresh streams rebuild the picture from there)
+static uint64_t clip_start(const clip_recorder_t* rec, uint64_t pts_us) {
+    uint64_t pre = (uint64_t)rec->pre_ms * 1000;
+    uint64_t target = pts_us > pre ? pts_us - pre : 0;
+    uint64_t oldest_key = target > CLIP_RECORDER_RING_SLACK_MS * 1000ULL
+                              ? target - CLIP_RECORDER_RING_SLACK_MS * 1000ULL : 0;
+
+    uint64_t window = rec->frame_head;
+    for (uint64_t seq = rec->frame_head; seq-- > rec->frame_tail;) {
+        const clip_recorder_frame_t* f = &rec->frames[seq % CLIP_RECORDER_MAX_FRAMES];
+        if (f->pts_us >= target) {
+            window = seq;
+        }
+        if (f->key && f->pts_us <= target) {
+            return f->pts_us >= oldest_key ? seq : window;
+        }
+        if (f->pts_us < oldest_key) {
+            break;
+        }
+    }
+    return window;
+}
+
+void clip_recorder_trigger(clip_recorder_t* rec, uint64_t pts_us) {
+    uint64_t end = pts_us + (uint64_t)rec->post_ms * 1000;
+
+    pthread_mutex_lock(&rec->lock);
+    rec->stats.triggers++;
+    if (!rec->active) {
+        rec->cursor = clip_start(rec, pts_us);
+        rec->clip_end_us = end;
+        rec->active = true;
+        rec->stats.clips++;
+        pthread_cond_signal(&rec->cond);
+    } else if (end > rec->clip_end_us) {
+        rec->clip_end_us = end;
+    }
+    pthread_mutex_unlock(&rec->lock);
+}
+
+// ---------------------------------------------------------------------------
+// Writer thread
+// ---------------------------------------------------------------------------
+
+static void flush_wbuf(clip_recorder_t* rec) {
+    size_t done = 0;
+    while (done < rec->wbuf_len && rec->fd >= 0) {
+        ssize_t n = write(rec->fd, rec->wbuf + done, rec->wbuf_len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            rec->stats.write_errors++;
+            break;
+        }
+        done += n;
+    }
+    rec->wbuf_len = 0;
+}
+
+static void put_packet(const uint8_t* packet, void* user) {
+    clip_recorder_t* rec = (clip_recorder_t*)user;
+    if (rec->wbuf_len + TS_PACKET_LEN > CLIP_RECORDER_WRITE_BUF) {
+        flush_wbuf(rec);
+    }
+    memcpy(rec->wbuf + rec->wbuf_len, packet, TS_PACKET_LEN);
+    rec->wbuf_len += TS_PACKET_LEN;
+    rec->segment_bytes += TS_PACKET_LEN;
+    rec->stats.written_bytes += TS_PACKET_LEN;
+}
+
+static void close_segment(clip_recorder_t* rec) {
+    if (rec->fd < 0) {
+        return;
+    }
+    flush_wbuf(rec);
+    // Give back the part of the extent the segment did not use
+    if (ftruncate(rec->fd, rec->segment_bytes) != 0 || fdatasync(rec->fd) != 0) {
+        rec->stats.write_errors++;
+    }
+    close(rec->fd);
+    rec->fd = -1;
+}
+
+static int open_segment(clip_recorder_t* rec, uint64_t pts_us) {
+    if (rec->segment_no == 0) {
+        time_t now = time(NULL);
+        struct tm tm;
+        localtime_r(&now, &tm);
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+        rec->clip_no++;
+        snprintf(rec->clip_name, sizeof(rec->clip_name), "clip%03d_%s", rec->clip_no, stamp);
+    }
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s_%03d.ts", rec->dir, rec->clip_name, rec->segment_no);
+    rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (rec->fd < 0) {
+        fprintf(stderr, "clip_recorder: %s: %s\n", path, strerror(errno));
+        rec->stats.write_errors++;
+        return -1;
+    }
+    // Reserve the whole segment up front so appends do not allocate blocks;
+    // file systems without fallocate() just grow the file as usual
+    fallocate(rec->fd, FALLOC_FL_KEEP_SIZE, 0, rec->prealloc);
+
+    rec->segment_no++;
+    rec->segment_start_us = pts_us;
+    rec->segment_bytes = 0;
+    rec->stats.segments++;
+    ts_mux_init(&rec->mux, rec->hevc, put_packet, rec);
+    printf("clip_recorder: writing %s\n", path);
+    return 0;
+}
+
+static void write_frame(clip_recorder_t* rec, const clip_recorder_frame_t* f,
+                        const uint8_t* sets, size_t sets_len) {
+    uint64_t span = (uint64_t)rec->segment_ms * 1000;
+    if (rec->fd >= 0 && f->pts_us >= rec->segment_start_us &&
+        ((f->key && f->pts_us - rec->segment_start_us >= span) ||
+         f->pts_us - rec->segment_start_us >= 2 * span)) {
+        close_segment(rec);
+    }
+
+    bool opened = false;
+    if (rec->fd < 0) {
+        if (open_segment(rec, f->pts_us) != 0) {
+            return;
+        }
+        opened = true;
+    }
+
+    // A segment opening on a non-IDR frame needs the parameter sets up front
+    uint8_t own[CLIP_RECORDER_PARAM_SETS_MAX];
+    bool prefix = opened && !f->key &&
+                  venc_sink_parameter_sets(rec->copy, f->len, rec->hevc, own, sizeof(own), NULL) == 0;
+    ts_mux_frame(&rec->mux, prefix ? sets : NULL, prefix ? sets_len : 0,
+                 rec->copy, f->len, f->pts_us, f->key);
+    rec->stats.written_frames++;
+}
+
+static void end_clip(clip_recorder_t* rec) {
+    close_segment(rec);
+    rec->segment_no = 0;
+}
+
+static void* writer_thread(void* arg) {
+    clip_recorder_t* rec = (clip_recorder_t*)arg;
+    uint8_t sets[CLIP_RECORDER_PARAM_SETS_MAX];
+
+    pthread_mutex_lock(&rec->lock);
+    while (rec->running || (rec->active && rec->cursor < rec->frame_head)) {
+        if (!rec->active) {
+            pthread_cond_wait(&rec->cond, &rec->lock);
+            continue;
+        }
+        if (rec->cursor < rec->frame_tail) {
+            rec->stats.overruns += rec->frame_tail - rec->cursor;
+            rec->cursor = rec->frame_tail;
+        }
+
+        if (rec->cursor == rec->frame_head) {
+            // Caught up: wait for the next frame, or end the clip if the
+            // stream stopped
+            if (!rec->running || TEST_COMM_GetNowUs() - rec->last_frame_us > CLIP_RECORDER_IDLE_MS * 1000ULL) {
+                rec->active = false;
+                pthread_mutex_unlock(&rec->lock);
+                end_clip(rec);
+                pthread_mutex_lock(&rec->lock);
+                continue;
+            }
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 100 * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&rec->cond, &rec->lock, &ts);
+            continue;
+        }
+
+        uint64_t seq = rec->cursor;
+        clip_recorder_frame_t f = rec->frames[seq % CLIP_RECORDER_MAX_FRAMES];
+        if (f.pts_us > rec->clip_end_us) {
+            rec->active = false;
+            pthread_mutex_unlock(&rec->lock);
+            end_clip(rec);
+            pthread_mutex_lock(&rec->lock);
+            continue;
+        }
+        size_t sets_len = rec->param_sets_len;
+        memcpy(sets, rec->param_sets, sets_len);
+        pthread_mutex_unlock(&rec->lock);
+
+        size_t pos = f.offset % rec->ring_size;
+        size_t first = rec->ring_size - pos < f.len ? rec->ring_size - pos : f.len;
+        memcpy(rec->copy, rec->ring + pos, first);
+        memcpy(rec->copy + first, rec->ring, f.len - first);
+
+        pthread_mutex_lock(&rec->lock);
+        if (seq < rec->frame_tail) {
+            continue;               // Overwritten while copying, counted above
+        }
+        rec->cursor = seq + 1;
+        pthread_mutex_unlock(&rec->lock);
+
+        write_frame(rec, &f, sets, sets_len);
+        pthread_mutex_lock(&rec->lock);
+    }
+    pthread_mutex_unlock(&rec->lock);
+
+    end_clip(rec);
+    return NULL;
+}
+
+void clip_recorder_print_stats(clip_recorder_t* rec) {
+    pthread_mutex_lock(&rec->lock);
+    clip_recorder_stats_t st = rec->stats;
+    double held_s = 0;
+    if (rec->frame_head > rec->frame_tail) {
+        const clip_recorder_frame_t* a = &rec->frames[rec->frame_tail % CLIP_RECORDER_MAX_FRAMES];
+        const clip_recorder_frame_t* b = &rec->frames[(rec->frame_head - 1) % CLIP_RECORDER_MAX_FRAMES];
+        held_s = (b->pts_us - a->pts_us) / 1e6;
+    }
+    bool active = rec->active;
+    pthread_mutex_unlock(&rec->lock);
+
+    printf("Recorder: %.1f s in ring, triggers=%llu clips=%llu%s segments=%llu written=%llu frames/%llu KB "
+           "overruns=%llu oversize=%llu errors=%llu\n",
+           held_s, (unsigned long long)st.triggers, (unsigned long long)st.clips,
+           active ? " (recording)" : "", (unsigned long long)st.segments,
+           (unsigned long long)st.written_frames, (unsigned long long)(st.written_bytes / 1024),
+           (unsigned long long)st.overruns, (unsigned long long)st.oversize,
+           (unsigned long long)st.write_errors);
+}
+
+void clip_recorder_stop(clip_recorder_t* rec) {
+    if (rec->running) {
+        pthread_mutex_lock(&rec->lock);
+        rec->running = 0;
+        pthread_cond_signal(&rec->cond);
+        pthread_mutex_unlock(&rec->lock);
+        pthread_join(rec->thread, NULL);
+        pthread_mutex_destroy(&rec->lock);
+        pthread_cond_destroy(&rec->cond);
+    }
+    free(rec->ring);
+    free(rec->copy);
+    free(rec->wbuf);
+    rec->ring = rec->copy = rec->wbuf = NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Self-test
+// ---------------------------------------------------------------------------
+
+#define SELFTEST_FRAME_US 40000     // 25 fps
+#define SELFTEST_GOP 25
+#define SELFTEST_FRAMES 600
+#define SELFTEST_PRE_MS 2000
+#define SELFTEST_POST_MS 1000
+
+typedef struct {
+    int clip;                   // Triggered at trigger_a (and trigger_b) frames
+    int first;                  // Expected first and last frame
+    int last;
+} selftest_clip_t;
+
+// Deterministic synthetic access unit for frame idx
+static size_t selftest_frame(int idx, bool hevc, bool intra_refresh, uint8_t* out) {
+    uint32_t seed = 0x9E3779B9u * (idx + 1) + (hevc ? 7 : 0);
+    bool key = idx == 0 || (!intra_refresh && idx % SELFTEST_GOP == 0);
+    size_t n = 0;
+
+    if (key) {
+        const uint8_t* sets;
+        static const uint8_t h264_sets[] = { 0, 0, 0, 1, 0x67, 0x64, 0x00, 0x1F, 0xAC,
+                                             0, 0, 0, 1, 0x68, 0xEE, 0x3C, 0x80 };
+        static const uint8_t h265_sets[] = { 0, 0, 0, 1, 0x40, 0x01, 0x0C, 0x01,
+                                             0, 0, 0, 1, 0x42, 0x01, 0x01, 0x01,
+                                             0, 0, 0, 1, 0x44, 0x01, 0xC1, 0x72 };
+        sets = hevc ? h265_sets : h264_sets;
+        size_t len = hevc ? sizeof(h265_sets) : sizeof(h264_sets);
+        memcpy(out, sets, len);
+        n = len;
+    }
+    out[n++] = 0; out[n++] = 0; out[n++] = 0; out[n++] = 1;
+    if (hevc) {
+        out[n++] = key ? 19 << 1 : 1 << 1;
+        out[n++] = 1;
+    } else {
+        out[n++] = key ? 0x65 : 0x41;
+    }
+
+    seed = seed * 1103515245 + 12345;
+    size_t body = key ? 30000 + (seed >> 8) % 30000 : 2000 + (seed >> 8) % 13000;
+    for (size_t i = 0; i < body; i++) {
+        seed = seed * 1103515245 + 12345;
+        out[n++] = (uint8_t)(1 + (seed >> 16) % 255);    // No start code lookalikes
+    }
+    return n;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp((const char*)a, (const char*)b);
+}
+
+// Segment files of clip number clip, in order; returns the count
+static int selftest_list(const char* dir, int clip, char names[][64], int max) {
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "clip%03d_", clip);
+    DIR* d = opendir(dir);
+    if (!d) {
+        return 0;
+    }
+    int count = 0;
+    struct dirent* e;
+    while ((e = readdir(d)) && count < max) {
+        if (strncmp(e->d_name, prefix, strlen(prefix)) == 0) {
+            snprintf(names[count++], 64, "%.63s", e->d_name);
+        }
+    }
+    closedir(d);
+    qsort(names, count, sizeof(names[0]), compare_names);
+    return count;
+}
+
+typedef struct {
+    bool hevc;
+    bool intra_refresh;
+    int next;                   // Next expected frame
+    int last;
+    uint8_t* expect;
+    int errors;
+    int frames;
+    bool segment_start;
+} selftest_check_t;
+
+static void selftest_pes(selftest_check_t* ck, const uint8_t* pes, size_t len) {
+    if (len < 9 || pes[0] != 0 || pes[1] != 0 || pes[2] != 1 || len < 9u + pes[8]) {
+        ck->errors++;
+        return;
+    }
+    const uint8_t* payload = pes + 9 + pes[8];
+    size_t plen = len - 9 - pes[8];
+
+    size_t n = selftest_frame(ck->next, ck->hevc, ck->intra_refresh, ck->expect);
+    bool key = ck->next == 0 || (!ck->intra_refresh && ck->next % SELFTEST_GOP == 0);
+    if (ck->next > ck->last || plen < n || memcmp(payload + plen - n, ck->expect, n) != 0) {
+        ck->errors++;
+    } else if (ck->segment_start && !key) {
+        // Must be decodable from here: parameter sets ahead of the slice
+        uint8_t sets[CLIP_RECORDER_PARAM_SETS_MAX];
+        if (venc_sink_parameter_sets(payload, (uint32_t)plen, ck->hevc, sets, sizeof(sets), NULL) <= 0) {
+            ck->errors++;
+        }
+    }
+    ck->segment_start = false;
+    ck->next++;
+    ck->frames++;
+}
+
+static int selftest_parse(const char* path, selftest_check_t* ck) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        return -1;
+    }
+    static uint8_t pes[2 * CLIP_RECORDER_FRAME_MAX];
+    size_t pes_len = 0;
+    bool in_pes = false;
+    int cc[2] = { -1, -1 };
+    uint8_t pkt[TS_PACKET_LEN];
+    ck->segment_start = true;
+
+    size_t got;
+    while ((got = fread(pkt, 1, sizeof(pkt), fp)) == sizeof(pkt)) {
+        int pid = ((pkt[1] & 0x1F) << 8) | pkt[2];
+        if (pkt[0] != 0x47) {
+            ck->errors++;
+            break;
+        }
+        if (pid != TS_PID_VIDEO) {
+            continue;
+        }
+        int c = pkt[3] & 0x0F;
+        if (cc[0] >= 0 && c != ((cc[0] + 1) & 0x0F)) {
+            ck->errors++;
+        }
+        cc[0] = c;
+
+        size_t off = 4;
+        if (pkt[3] & 0x20) {
+            off += 1 + pkt[4];
+        }
+        if (pkt[1] & 0x40) {
+            if (in_pes) {
+                selftest_pes(ck, pes, pes_len);
+            }
+            in_pes = true;
+            pes_len = 0;
+        }
+        if (in_pes && off < TS_PACKET_LEN && pes_len + TS_PACKET_LEN <= sizeof(pes)) {
+            memcpy(pes + pes_len, pkt + off, TS_PACKET_LEN - off);
+            pes_len += TS_PACKET_LEN - off;
+        }
+    }
+    if (got != 0) {
+        ck->errors++;           // Not a whole number of packets
+    }
+    if (in_pes) {
+        selftest_pes(ck, pes, pes_len);
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int selftest_run(const char* dir, bool hevc, bool intra_refresh) {
+    DIR* d = opendir(dir);
+    if (d) {
+        struct dirent* e;
+        char path[512];
+        while ((e = readdir(d))) {
+            if (strncmp(e->d_name, "clip", 4) == 0) {
+                snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+                unlink(path);
+            }
+        }
+        closedir(d);
+    }
+
+    static clip_recorder_t rec;
+    if (clip_recorder_start(&rec, dir, hevc, SELFTEST_PRE_MS, SELFTEST_POST_MS, 4000) != 0) {
+        return -1;
+    }
+    rec.segment_ms = 1000;
+
+    // Frame indices: two triggers merge into one clip, then a separate one
+    const int trig_a = 160, trig_b = 170, trig_c = 455;
+    int pre = SELFTEST_PRE_MS * 1000 / SELFTEST_FRAME_US;
+    int post = SELFTEST_POST_MS * 1000 / SELFTEST_FRAME_US;
+    selftest_clip_t clips[2];
+    for (int i = 0; i < 2; i++) {
+        int target = (i == 0 ? trig_a : trig_c) - pre;
+        clips[i].clip = i + 1;
+        clips[i].first = intra_refresh ? target : target / SELFTEST_GOP * SELFTEST_GOP;
+        clips[i].last = (i == 0 ? trig_b : trig_c) + post;
+    }
+
+    uint8_t* frame = (uint8_t*)malloc(CLIP_RECORDER_FRAME_MAX);
+    uint64_t worst_us = 0;
+    uint64_t base = 1000000;
+    for (int f = 0; f < SELFTEST_FRAMES; f++) {
+        size_t len = selftest_frame(f, hevc, intra_refresh, frame);
+        VENC_PACK_S pack;
+        memset(&pack, 0, sizeof(pack));
+        pack.u64PTS = base + (uint64_t)f * SELFTEST_FRAME_US;
+
+        // Two slices per frame
+        uint64_t t0 = TEST_COMM_GetNowUs();
+        pack.bFrameEnd = RK_FALSE;
+        clip_recorder_venc_consumer(&pack, frame, (uint32_t)(len / 2), &rec);
+        pack.bFrameEnd = RK_TRUE;
+        clip_recorder_venc_consumer(&pack, frame + len / 2, (uint32_t)(len - len / 2), &rec);
+        if (f == trig_a || f == trig_b || f == trig_c) {
+            clip_recorder_trigger(&rec, pack.u64PTS);
+        }
+        uint64_t spent = TEST_COMM_GetNowUs() - t0;
+        if (spent > worst_us) {
+            worst_us = spent;
+        }
+
+        // Let the first clip end before the last trigger
+        if (f == trig_c - 1) {
+            for (int w = 0; w < 200; w++) {
+                pthread_mutex_lock(&rec.lock);
+                bool active = rec.active;
+                pthread_mutex_unlock(&rec.lock);
+                if (!active) {
+                    break;
+                }
+                usleep(10000);
+            }
+        }
+        usleep(2000);
+    }
+    clip_recorder_stop(&rec);
+
+    int errors = 0;
+    int segments = 0;
+    for (int i = 0; i < 2; i++) {
+        char names[64][64];
+        int count = selftest_list(dir, clips[i].clip, names, 64);
+        selftest_check_t ck;
+        memset(&ck, 0, sizeof(ck));
+        ck.hevc = hevc;
+        ck.intra_refresh = intra_refresh;
+        ck.next = clips[i].first;
+        ck.last = clips[i].last;
+        ck.expect = frame;
+        for (int s = 0; s < count; s++) {
+            char path[256];
+            snprintf(path, sizeof(path), "%.127s/%s", dir, names[s]);
+            if (selftest_parse(path, &ck) != 0) {
+                ck.errors++;
+            }
+        }
+        int want = clips[i].last - clips[i].first + 1;
+        if (ck.frames != want) {
+            ck.errors++;
+        }
+        printf("  clip %d: frames %d-%d expected, %d in %d segment(s), %d error(s)\n",
+               clips[i].clip, clips[i].first, clips[i].last, ck.frames, count, ck.errors);
+        errors += ck.errors;
+        segments += count;
+    }
+    free(frame);
+
+    bool pass = errors == 0 && rec.stats.clips == 2 && rec.stats.overruns == 0 &&
+                rec.stats.write_errors == 0 && worst_us < 10000;
+    printf("Recorder self-test %s%s: %llu clips, %d files, %llu KB written, producer worst %llu us: %s\n",
+           hevc ? "H.265" : "H.264", intra_refresh ? " intra refresh" : " GOP 25",
+           (unsigned long long)rec.stats.clips, segments,
+           (unsigned long long)(rec.stats.written_bytes / 1024), (unsigned long long)worst_us,
+           pass ? "PASS" : "FAIL");
+    return pass ? 0 : -1;
+}
+
+int clip_recorder_selftest(const char* dir) {
+    int failed = 0;
+    failed += selftest_run(dir, false, false) != 0;
+    failed += selftest_run(dir, true, true) != 0;
+    return failed ? -1 : 0;
+}
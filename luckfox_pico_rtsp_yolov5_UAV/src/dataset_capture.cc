@@ -0,0 +1,729 @@
+#include "dataset_capture.h"
+#include "luckfox_mpi.h"
+#include "rga_hw_accel.h"
+#include "util.h"
+#include "im2d.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Least time between two samples of a band
+static const struct {
+    const char* name;
+    uint32_t interval_ms;
+} band_defs[DATASET_BAND_COUNT] = {
+    { "empty",     30000 },
+    { "0.25-0.50", 500 },
+    { "0.50-0.75", 2000 },
+    { "0.75-1.00", 10000 },
+};
+
+static void* writer_thread(void* arg);
+
+int dataset_capture_start(dataset_capture_t* ds, const char* dir, int width, int height,
+                          uint32_t rate_kb) {
+    memset(ds, 0, sizeof(*ds));
+    snprintf(ds->dir, sizeof(ds->dir), "%s", dir);
+    ds->chn = DATASET_VENC_CHN;
+    ds->width = width;
+    ds->height = height;
+    ds->rate = rate_kb * 1024;
+    ds->fd = -1;
+    ds->block_size = (size_t)width * height * 3 / 2;
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "dataset: mkdir %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(ds->session, sizeof(ds->session), "%Y%m%d-%H%M%S", &tm);
+
+    ds->wbuf = (uint8_t*)malloc(DATASET_WRITE_BUF);
+    if (!ds->wbuf) {
+        fprintf(stderr, "dataset: out of memory for the write buffer\n");
+        return -1;
+    }
+
+    // One block per queued frame plus the one being copied
+    MB_POOL_CONFIG_S pool_cfg;
+    memset(&pool_cfg, 0, sizeof(pool_cfg));
+    pool_cfg.u64MBSize = ds->block_size;
+    pool_cfg.u32MBCnt = DATASET_POOL_BLOCKS;
+    pool_cfg.enAllocType = MB_ALLOC_TYPE_DMA;
+    ds->pool = RK_MPI_MB_CreatePool(&pool_cfg);
+    if (ds->pool == MB_INVALID_POOLID) {
+        fprintf(stderr, "dataset: MB pool of %u x %zu bytes failed\n",
+                pool_cfg.u32MBCnt, ds->block_size);
+        free(ds->wbuf);
+        return -1;
+    }
+    rga_handle_cache_reserve(DATASET_POOL_BLOCKS);
+
+    // The camera's NV12 goes to the encoder as is, at fixed quality
+    VENC_CHN_ATTR_S attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.stVencAttr.enType = RK_VIDEO_ID_MJPEG;
+    attr.stVencAttr.enPixelFormat = RK_FMT_YUV420SP;
+    attr.stVencAttr.u32PicWidth = width;
+    attr.stVencAttr.u32PicHeight = height;
+    attr.stVencAttr.u32VirWidth = width;
+    attr.stVencAttr.u32VirHeight = height;
+    attr.stVencAttr.u32BufSize = width * height;
+    attr.stVencAttr.u32StreamBufCnt = 2;
+    attr.stRcAttr.enRcMode = VENC_RC_MODE_MJPEGFIXQP;
+    attr.stRcAttr.stMjpegFixQp.u32Qfactor = DATASET_QFACTOR;
+    if (RK_MPI_VENC_CreateChn(ds->chn, &attr) != RK_SUCCESS) {
+        fprintf(stderr, "dataset: CreateChn %d failed\n", ds->chn);
+        RK_MPI_MB_DestroyPool(ds->pool);
+        free(ds->wbuf);
+        return -1;
+    }
+    VENC_RECV_PIC_PARAM_S recv;
+    memset(&recv, 0, sizeof(recv));
+    recv.s32RecvPicNum = -1;
+    RK_MPI_VENC_StartRecvFrame(ds->chn, &recv);
+
+    ds->tokens = DATASET_WRITE_BUF;
+    ds->tokens_us = TEST_COMM_GetNowUs();
+    ds->rate_us = ds->tokens_us;
+
+    pthread_mutex_init(&ds->lock, NULL);
+    pthread_cond_init(&ds->cond, NULL);
+    ds->running = 1;
+    if (pthread_create(&ds->thread, NULL, writer_thread, ds) != 0) {
+        perror("dataset: pthread_create");
+        ds->running = 0;
+        RK_MPI_VENC_StopRecvFrame(ds->chn);
+        RK_MPI_VENC_DestroyChn(ds->chn);
+        RK_MPI_MB_DestroyPool(ds->pool);
+        free(ds->wbuf);
+        return -1;
+    }
+
+    printf("dataset: %dx%d JPEG on VENC chn %d, up to %u KB/s into %s/dataset_%s_NNN.tar\n",
+           width, height, ds->chn, rate_kb, dir, ds->session);
+    return 0;
+}
+
+static int band_of(const mavlink_target_t* targets, int count) {
+    if (count == 0) {
+        return DATASET_BAND_EMPTY;
+    }
+    float lowest = 1.0f;
+    for (int i = 0; i < count; i++) {
+        if (targets[i].confidence < lowest) {
+            lowest = targets[i].confidence;
+        }
+    }
+    if (lowest < 0.5f) {
+        return DATASET_BAND_LOW;
+    }
+    return lowest < 0.75f ? DATASET_BAND_MID : DATASET_BAND_HIGH;
+}
+
+void dataset_capture_offer(dataset_capture_t* ds, MB_BLK frame,
+                           const mavlink_target_t* targets, int count, uint64_t pts_us) {
+    if (ds->has_pending) {
+        return;
+    }
+    int band = band_of(targets, count);
+    uint64_t last = ds->last_sample_us[band];
+    if (last && pts_us - last < band_defs[band].interval_ms * 1000ULL) {
+        return;
+    }
+    ds->last_sample_us[band] = pts_us;
+
+    pthread_mutex_lock(&ds->lock);
+    uint32_t depth = ds->queue_head - ds->queue_tail;
+    pthread_mutex_unlock(&ds->lock);
+    if (depth >= DATASET_QUEUE) {
+        ds->stats.dropped_queue++;
+        return;
+    }
+    MB_BLK mb = RK_MPI_MB_GetMB(ds->pool, ds->block_size, RK_FALSE);
+    if (mb == NULL) {
+        ds->stats.dropped_buffer++;
+        return;
+    }
+
+    dataset_job_t* job = &ds->pending;
+    job->mb = mb;
+    job->fence = -1;
+    job->band = band;
+    job->pts_us = pts_us;
+    job->label_count = count < DATASET_MAX_LABELS ? count : DATASET_MAX_LABELS;
+    memcpy(job->labels, targets, job->label_count * sizeof(mavlink_target_t));
+
+    // Clean copy of the camera frame; the overlay only exists in RGB888
+    rga_buffer_t src = wrapbuffer_handle(rga_handle_from_mb(frame), ds->width, ds->height,
+                                         RK_FORMAT_YCbCr_420_SP);
+    rga_buffer_t dst = wrapbuffer_handle(rga_handle_from_mb(mb), ds->width, ds->height,
+                                         RK_FORMAT_YCbCr_420_SP);
+    rga_buffer_t pat;
+    memset(&pat, 0, sizeof(pat));
+    im_rect rect = { 0, 0, ds->width, ds->height };
+    im_rect prect;
+    memset(&prect, 0, sizeof(prect));
+    IM_STATUS st = improcess(src, dst, pat, rect, rect, prect, -1, &job->fence, NULL, IM_ASYNC);
+    if (st != IM_STATUS_SUCCESS && st != IM_STATUS_NOERROR) {
+        fprintf(stderr, "dataset: RGA copy failed: %s\n", imStrError(st));
+        RK_MPI_MB_ReleaseMB(mb);
+        ds->stats.copy_errors++;
+        return;
+    }
+    ds->has_pending = true;
+    ds->stats.captured[band]++;
+}
+
+void dataset_capture_frame_done(dataset_capture_t* ds) {
+    if (!ds->has_pending) {
+        return;
+    }
+
+    // imsync() waits for the job and closes the fence
+    uint64_t t0 = TEST_COMM_GetNowUs();
+    if (ds->pending.fence >= 0 && imsync(ds->pending.fence) != IM_STATUS_SUCCESS) {
+        ds->stats.copy_errors++;
+    }
+    ds->pending.fence = -1;
+    uint32_t wait = (uint32_t)(TEST_COMM_GetNowUs() - t0);
+    ds->stats.fence_wait_sum_us += wait;
+    if (wait > ds->stats.fence_wait_max_us) {
+        ds->stats.fence_wait_max_us = wait;
+    }
+
+    pthread_mutex_lock(&ds->lock);
+    ds->queue[ds->queue_head % DATASET_QUEUE] = ds->pending;
+    ds->queue_head++;
+    uint32_t depth = ds->queue_head - ds->queue_tail;
+    ds->stats.depth = depth;
+    if (depth > ds->stats.depth_max) {
+        ds->stats.depth_max = depth;
+    }
+    pthread_cond_signal(&ds->cond);
+    pthread_mutex_unlock(&ds->lock);
+    ds->has_pending = false;
+}
+
+// ---------------------------------------------------------------------------
+// Archive writer
+// ---------------------------------------------------------------------------
+
+// Wait until the token bucket covers len bytes; bursts up to one buffer
+static void throttle(dataset_capture_t* ds, size_t len) {
+    uint64_t now = TEST_COMM_GetNowUs();
+    ds->tokens += (double)(now - ds->tokens_us) * ds->rate / 1e6;
+    if (ds->tokens > DATASET_WRITE_BUF) {
+        ds->tokens = DATASET_WRITE_BUF;
+    }
+    ds->tokens_us = now;
+    if (ds->tokens < len) {
+        uint64_t wait = (uint64_t)((len - ds->tokens) * 1e6 / ds->rate);
+        usleep(wait);
+        ds->stats.throttle_us += wait;
+        ds->tokens = len;
+        ds->tokens_us = TEST_COMM_GetNowUs();
+    }
+    ds->tokens -= len;
+}
+
+static void flush(dataset_capture_t* ds) {
+    if (ds->wbuf_len == 0 || ds->fd < 0) {
+        ds->wbuf_len = 0;
+        return;
+    }
+    throttle(ds, ds->wbuf_len);
+    ds->stats.writes++;
+    if (write_all(ds->fd, ds->wbuf, ds->wbuf_len) != 0) {
+        fprintf(stderr, "dataset: write: %s\n", strerror(errno));
+        ds->stats.errors++;
+    } else {
+        ds->stats.written_bytes += ds->wbuf_len;
+        ds->unsynced_bytes += ds->wbuf_len;
+    }
+    ds->wbuf_len = 0;
+
+    // Written samples leave the page cache instead of crowding out the model
+    if (ds->unsynced_bytes >= DATASET_SYNC_BYTES) {
+        fdatasync(ds->fd);
+        posix_fadvise(ds->fd, 0, 0, POSIX_FADV_DONTNEED);
+        ds->unsynced_bytes = 0;
+    }
+}
+
+static void append(dataset_capture_t* ds, const uint8_t* data, size_t len) {
+    if (ds->wbuf_len == 0) {
+        ds->wbuf_since_us = TEST_COMM_GetNowUs();
+    }
+    while (len > 0) {
+        size_t n = DATASET_WRITE_BUF - ds->wbuf_len;
+        if (n > len) {
+            n = len;
+        }
+        if (data) {
+            memcpy(ds->wbuf + ds->wbuf_len, data, n);
+            data += n;
+        } else {
+            memset(ds->wbuf + ds->wbuf_len, 0, n);
+        }
+        ds->wbuf_len += n;
+        ds->archive_bytes += n;
+        len -= n;
+        if (ds->wbuf_len == DATASET_WRITE_BUF) {
+            flush(ds);
+            ds->wbuf_since_us = TEST_COMM_GetNowUs();
+        }
+    }
+}
+
+static void close_archive(dataset_capture_t* ds) {
+    if (ds->fd < 0) {
+        return;
+    }
+    append(ds, NULL, 2 * DATASET_TAR_BLOCK);    // End-of-archive marker
+    flush(ds);
+    fdatasync(ds->fd);
+    close(ds->fd);
+    ds->fd = -1;
+}
+
+static int open_archive(dataset_capture_t* ds) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/dataset_%s_%03d.tar", ds->dir, ds->session, ds->archive_no++);
+    ds->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (ds->fd < 0) {
+        fprintf(stderr, "dataset: open %s: %s\n", path, strerror(errno));
+        ds->stats.errors++;
+        return -1;
+    }
+    ds->archive_bytes = 0;
+    ds->unsynced_bytes = 0;
+    ds->stats.archives++;
+    return 0;
+}
+
+// ustar member header; the archive extracts with a plain "tar x"
+static void begin_member(dataset_capture_t* ds, const char* name, size_t size) {
+    uint8_t h[DATASET_TAR_BLOCK];
+    memset(h, 0, sizeof(h));
+    snprintf((char*)h, 100, "%s", name);
+    memcpy(h + 100, "0000644", 8);
+    memcpy(h + 108, "0000000", 8);
+    memcpy(h + 116, "0000000", 8);
+    snprintf((char*)h + 124, 12, "%011llo", (unsigned long long)size);
+    snprintf((char*)h + 136, 12, "%011llo", (unsigned long long)time(NULL));
+    h[156] = '0';
+    memcpy(h + 257, "ustar", 6);
+    memcpy(h + 263, "00", 2);
+
+    memset(h + 148, ' ', 8);
+    unsigned sum = 0;
+    for (int i = 0; i < DATASET_TAR_BLOCK; i++) {
+        sum += h[i];
+    }
+    snprintf((char*)h + 148, 7, "%06o", sum);
+    h[155] = ' ';
+    append(ds, h, sizeof(h));
+}
+
+static void end_member(dataset_capture_t* ds, size_t size) {
+    size_t pad = (DATASET_TAR_BLOCK - size % DATASET_TAR_BLOCK) % DATASET_TAR_BLOCK;
+    append(ds, NULL, pad);
+}
+
+// YOLO: "class cx cy w h", normalised to the frame, boxes clipped to it
+static size_t format_labels(const mavlink_target_t* labels, int count, int width, int height,
+                            char* out, size_t size) {
+    size_t len = 0;
+    for (int i = 0; i < count && len < size; i++) {
+        const mavlink_target_t* t = &labels[i];
+        int x0 = t->x < 0 ? 0 : t->x;
+        int y0 = t->y < 0 ? 0 : t->y;
+        int x1 = t->x + t->width > width ? width : t->x + t->width;
+        int y1 = t->y + t->height > height ? height : t->y + t->height;
+        if (x1 <= x0 || y1 <= y0) {
+            continue;
+        }
+        int n = snprintf(out + len, size - len, "%u %.6f %.6f %.6f %.6f\n", t->class_id,
+                         (x0 + x1) / 2.0 / width, (y0 + y1) / 2.0 / height,
+                         (double)(x1 - x0) / width, (double)(y1 - y0) / height);
+        if (n < 0 || (size_t)n >= size - len) {
+            break;
+        }
+        len += n;
+    }
+    return len;
+}
+
+// Image and label file of one sample; the image comes in pieces (VENC packs)
+static void add_sample(dataset_capture_t* ds, const char* base, const uint8_t* const* pieces,
+                       const size_t* piece_len, int piece_count,
+                       const mavlink_target_t* labels, int label_count) {
+    if (ds->fd >= 0 && ds->archive_bytes >= DATASET_ARCHIVE_MB * 1024ULL * 1024) {
+        close_archive(ds);
+    }
+    if (ds->fd < 0 && open_archive(ds) != 0) {
+        return;
+    }
+
+    size_t size = 0;
+    for (int i = 0; i < piece_count; i++) {
+        size += piece_len[i];
+    }
+    char name[100];
+    snprintf(name, sizeof(name), "images/%s.jpg", base);
+    begin_member(ds, name, size);
+    for (int i = 0; i < piece_count; i++) {
+        append(ds, pieces[i], piece_len[i]);
+    }
+    end_member(ds, size);
+
+    char text[DATASET_MAX_LABELS * 48];
+    size_t text_len = format_labels(labels, label_count, ds->width, ds->height, text, sizeof(text));
+    snprintf(name, sizeof(name), "labels/%s.txt", base);
+    begin_member(ds, name, text_len);
+    append(ds, (const uint8_t*)text, text_len);
+    end_member(ds, text_len);
+
+    ds->stats.samples++;
+    ds->stats.labels += label_count;
+    ds->stats.jpeg_bytes += size;
+}
+
+static void encode_job(dataset_capture_t* ds, const dataset_job_t* job) {
+    VIDEO_FRAME_INFO_S frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.stVFrame.pMbBlk = job->mb;
+    frame.stVFrame.u32Width = ds->width;
+    frame.stVFrame.u32Height = ds->height;
+    frame.stVFrame.u32VirWidth = ds->width;
+    frame.stVFrame.u32VirHeight = ds->height;
+    frame.stVFrame.enPixelFormat = RK_FMT_YUV420SP;
+    frame.stVFrame.u32TimeRef = ds->sample_no;
+    frame.stVFrame.u64PTS = job->pts_us;
+    if (RK_MPI_VENC_SendFrame(ds->chn, &frame, 1000) != RK_SUCCESS) {
+        fprintf(stderr, "dataset: SendFrame to VENC chn %d failed\n", ds->chn);
+        ds->stats.errors++;
+        return;
+    }
+
+    VENC_STREAM_S stream;
+    VENC_PACK_S packs[4];
+    memset(&stream, 0, sizeof(stream));
+    stream.pstPack = packs;
+    if (RK_MPI_VENC_GetStream(ds->chn, &stream, 1000) != RK_SUCCESS) {
+        fprintf(stderr, "dataset: no JPEG from VENC chn %d\n", ds->chn);
+        ds->stats.errors++;
+        return;
+    }
+
+    // Straight from the stream buffers into the archive buffer
+    const uint8_t* pieces[4];
+    size_t piece_len[4];
+    int count = stream.u32PackCount ? (int)stream.u32PackCount : 1;
+    if (count > 4) {
+        count = 4;
+    }
+    for (int i = 0; i < count; i++) {
+        pieces[i] = (const uint8_t*)RK_MPI_MB_Handle2VirAddr(packs[i].pMbBlk);
+        piece_len[i] = packs[i].u32Len;
+    }
+    char base[64];
+    snprintf(base, sizeof(base), "%s_%06u_%s", ds->session, ds->sample_no++,
+             band_defs[job->band].name);
+    add_sample(ds, base, pieces, piece_len, count, job->labels, job->label_count);
+    RK_MPI_VENC_ReleaseStream(ds->chn, &stream);
+}
+
+static void* writer_thread(void* arg) {
+    dataset_capture_t* ds = (dataset_capture_t*)arg;
+
+    // Encoding and writing yield the CPU to the frame loop
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), DATASET_WRITER_NICE);
+
+    pthread_mutex_lock(&ds->lock);
+    for (;;) {
+        if (ds->queue_head == ds->queue_tail) {
+            if (!ds->running) {
+                break;
+            }
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += 1;
+            pthread_cond_timedwait(&ds->cond, &ds->lock, &ts);
+
+            // A quiet spell must not leave samples sitting in memory
+            if (ds->queue_head == ds->queue_tail && ds->wbuf_len &&
+                TEST_COMM_GetNowUs() - ds->wbuf_since_us >= DATASET_FLUSH_MS * 1000ULL) {
+                pthread_mutex_unlock(&ds->lock);
+                flush(ds);
+                pthread_mutex_lock(&ds->lock);
+            }
+            continue;
+        }
+        dataset_job_t* job = &ds->queue[ds->queue_tail % DATASET_QUEUE];
+        pthread_mutex_unlock(&ds->lock);
+
+        encode_job(ds, job);
+        RK_MPI_MB_ReleaseMB(job->mb);
+
+        pthread_mutex_lock(&ds->lock);
+        ds->queue_tail++;
+        ds->stats.depth = ds->queue_head - ds->queue_tail;
+    }
+    pthread_mutex_unlock(&ds->lock);
+
+    close_archive(ds);
+    return NULL;
+}
+
+void dataset_capture_print_stats(dataset_capture_t* ds) {
+    pthread_mutex_lock(&ds->lock);
+    dataset_stats_t st = ds->stats;
+    pthread_mutex_unlock(&ds->lock);
+
+    uint64_t now = TEST_COMM_GetNowUs();
+    double seconds = (now - ds->rate_us) / 1e6;
+    double per_min = seconds > 0 ? (st.samples - ds->rate_samples) * 60 / seconds : 0;
+    double kbps = seconds > 0 ? (st.written_bytes - ds->rate_bytes) / 1024.0 / seconds : 0;
+    ds->rate_samples = st.samples;
+    ds->rate_bytes = st.written_bytes;
+    ds->rate_us = now;
+
+    printf("Dataset: %.1f samples/min | empty=%llu 0.25-0.50=%llu 0.50-0.75=%llu 0.75-1.00=%llu "
+           "| %llu samples %llu labels in %llu archives | write %.0f KB/s (limit %u) %llu KB/write, "
+           "throttled %llu ms | queue %u (max %u) dropped full=%llu no-buffer=%llu errors=%llu/%llu "
+           "| fence wait max=%u us\n",
+           per_min,
+           (unsigned long long)st.captured[DATASET_BAND_EMPTY],
+           (unsigned long long)st.captured[DATASET_BAND_LOW],
+           (unsigned long long)st.captured[DATASET_BAND_MID],
+           (unsigned long long)st.captured[DATASET_BAND_HIGH],
+           (unsigned long long)st.samples, (unsigned long long)st.labels,
+           (unsigned long long)st.archives, kbps, ds->rate / 1024,
+           (unsigned long long)(st.writes ? st.written_bytes / st.writes / 1024 : 0),
+           (unsigned long long)(st.throttle_us / 1000),
+           st.depth, st.depth_max,
+           (unsigned long long)st.dropped_queue, (unsigned long long)st.dropped_buffer,
+           (unsigned long long)st.copy_errors, (unsigned long long)st.errors,
+           st.fence_wait_max_us);
+}
+
+void dataset_capture_stop(dataset_capture_t* ds) {
+    dataset_capture_frame_done(ds);
+
+    pthread_mutex_lock(&ds->lock);
+    ds->running = 0;
+    pthread_cond_signal(&ds->cond);
+    pthread_mutex_unlock(&ds->lock);
+    pthread_join(ds->thread, NULL);
+
+    RK_MPI_VENC_StopRecvFrame(ds->chn);
+    RK_MPI_VENC_DestroyChn(ds->chn);
+    RK_MPI_MB_DestroyPool(ds->pool);
+    free(ds->wbuf);
+    ds->wbuf = NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Selftest
+// ---------------------------------------------------------------------------
+
+#define SELFTEST_SAMPLES 120
+#define SELFTEST_RATE_KB 4096
+#define SELFTEST_WIDTH 720
+#define SELFTEST_HEIGHT 480
+
+// Deterministic stand-in for sample i: a JPEG-sized payload and some boxes
+static size_t selftest_sample(int i, uint8_t* data, mavlink_target_t* labels, int* label_count) {
+    uint32_t s = 0x9E3779B9u ^ (uint32_t)i;
+    size_t len = 20000 + selftest_rand(&s) % 80000;
+    for (size_t k = 0; k < len; k++) {
+        data[k] = (uint8_t)(selftest_rand(&s) >> 4);
+    }
+    *label_count = i % 4;
+    for (int k = 0; k < *label_count; k++) {
+        mavlink_target_t* t = &labels[k];
+        memset(t, 0, sizeof(*t));
+        t->x = (int)(selftest_rand(&s) % SELFTEST_WIDTH) - 40;
+        t->y = (int)(selftest_rand(&s) % SELFTEST_HEIGHT) - 40;
+        t->width = 20 + selftest_rand(&s) % 200;
+        t->height = 20 + selftest_rand(&s) % 200;
+        t->class_id = selftest_rand(&s) % 80;
+        t->confidence = 0.25f + (selftest_rand(&s) % 75) / 100.0f;
+    }
+    return len;
+}
+
+static int selftest_check_member(const uint8_t* h, const char* name, size_t* size) {
+    if (memcmp(h + 257, "ustar", 5) != 0 || strncmp((const char*)h, name, 100) != 0) {
+        fprintf(stderr, "dataset selftest: expected %s, found \"%.100s\"\n", name, (const char*)h);
+        return -1;
+    }
+    unsigned sum = 0;
+    for (int i = 0; i < DATASET_TAR_BLOCK; i++) {
+        sum += i >= 148 && i < 156 ? ' ' : h[i];
+    }
+    if (strtoul((const char*)h + 148, NULL, 8) != sum) {
+        fprintf(stderr, "dataset selftest: bad header checksum on %s\n", name);
+        return -1;
+    }
+    *size = strtoull((const char*)h + 124, NULL, 8);
+    return 0;
+}
+
+int dataset_capture_selftest(const char* dir) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "dataset selftest: mkdir %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    static dataset_capture_t ds;
+    memset(&ds, 0, sizeof(ds));
+    snprintf(ds.dir, sizeof(ds.dir), "%s", dir);
+    snprintf(ds.session, sizeof(ds.session), "selftest");
+    ds.width = SELFTEST_WIDTH;
+    ds.height = SELFTEST_HEIGHT;
+    ds.rate = SELFTEST_RATE_KB * 1024;
+    ds.fd = -1;
+    ds.wbuf = (uint8_t*)malloc(DATASET_WRITE_BUF);
+    uint8_t* data = (uint8_t*)malloc(100000);
+    uint8_t* expect = (uint8_t*)malloc(100000);
+    if (!ds.wbuf || !data || !expect) {
+        free(ds.wbuf);
+        free(data);
+        free(expect);
+        return -1;
+    }
+    ds.tokens = DATASET_WRITE_BUF;
+    ds.tokens_us = TEST_COMM_GetNowUs();
+
+    // Producer side as the writer thread sees it: one sample after another
+    uint64_t t0 = TEST_COMM_GetNowUs();
+    mavlink_target_t labels[DATASET_MAX_LABELS];
+    int label_count;
+    for (int i = 0; i < SELFTEST_SAMPLES; i++) {
+        size_t len = selftest_sample(i, data, labels, &label_count);
+        const uint8_t* piece[2] = { data, data + len / 3 };
+        size_t piece_len[2] = { len / 3, len - len / 3 };
+        char base[64];
+        snprintf(base, sizeof(base), "selftest_%06d", i);
+        add_sample(&ds, base, piece, piece_len, 2, labels, label_count);
+    }
+    close_archive(&ds);
+    double seconds = (TEST_COMM_GetNowUs() - t0) / 1e6;
+
+    int rc = 0;
+    char path[256];
+    snprintf(path, sizeof(path), "%s/dataset_selftest_000.tar", dir);
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "dataset selftest: %s: %s\n", path, strerror(errno));
+        rc = -1;
+    }
+    int boxes_checked = 0;
+    for (int i = 0; fp && rc == 0 && i < SELFTEST_SAMPLES; i++) {
+        size_t len = selftest_sample(i, expect, labels, &label_count);
+        uint8_t h[DATASET_TAR_BLOCK];
+        char name[100];
+        size_t size;
+
+        snprintf(name, sizeof(name), "images/selftest_%06d.jpg", i);
+        if (fread(h, 1, sizeof(h), fp) != sizeof(h) || selftest_check_member(h, name, &size) != 0 ||
+            size != len || fread(data, 1, size, fp) != size || memcmp(data, expect, size) != 0) {
+            fprintf(stderr, "dataset selftest: image %d wrong (%zu bytes expected)\n", i, len);
+            rc = -1;
+            break;
+        }
+        fseek(fp, (DATASET_TAR_BLOCK - size % DATASET_TAR_BLOCK) % DATASET_TAR_BLOCK, SEEK_CUR);
+
+        snprintf(name, sizeof(name), "labels/selftest_%06d.txt", i);
+        if (fread(h, 1, sizeof(h), fp) != sizeof(h) || selftest_check_member(h, name, &size) != 0 ||
+            size >= 100000 || fread(data, 1, size, fp) != size) {
+            rc = -1;
+            break;
+        }
+        data[size] = 0;
+        fseek(fp, (DATASET_TAR_BLOCK - size % DATASET_TAR_BLOCK) % DATASET_TAR_BLOCK, SEEK_CUR);
+
+        // Every label line must describe the clipped box of its target
+        const char* p = (const char*)data;
+        for (int k = 0; k < label_count; k++) {
+            const mavlink_target_t* t = &labels[k];
+            int x0 = t->x < 0 ? 0 : t->x;
+            int y0 = t->y < 0 ? 0 : t->y;
+            int x1 = t->x + t->width > SELFTEST_WIDTH ? SELFTEST_WIDTH : t->x + t->width;
+            int y1 = t->y + t->height > SELFTEST_HEIGHT ? SELFTEST_HEIGHT : t->y + t->height;
+            if (x1 <= x0 || y1 <= y0) {
+                continue;
+            }
+            unsigned cls;
+            double cx, cy, w, bh;
+            int used;
+            if (sscanf(p, "%u %lf %lf %lf %lf\n%n", &cls, &cx, &cy, &w, &bh, &used) != 5 ||
+                cls != t->class_id ||
+                fabs(cx * SELFTEST_WIDTH - (x0 + x1) / 2.0) > 0.01 ||
+                fabs(cy * SELFTEST_HEIGHT - (y0 + y1) / 2.0) > 0.01 ||
+                fabs(w * SELFTEST_WIDTH - (x1 - x0)) > 0.01 ||
+                fabs(bh * SELFTEST_HEIGHT - (y1 - y0)) > 0.01 ||
+                cx < 0 || cx > 1 || cy < 0 || cy > 1) {
+                fprintf(stderr, "dataset selftest: label %d of sample %d wrong: %.60s\n", k, i, p);
+                rc = -1;
+                break;
+            }
+            p += used;
+            boxes_checked++;
+        }
+        if (rc == 0 && *p) {
+            fprintf(stderr, "dataset selftest: extra label text in sample %d\n", i);
+            rc = -1;
+        }
+    }
+    if (fp && rc == 0) {
+        uint8_t h[2 * DATASET_TAR_BLOCK];
+        uint8_t zero[2 * DATASET_TAR_BLOCK];
+        memset(zero, 0, sizeof(zero));
+        if (fread(h, 1, sizeof(h), fp) != sizeof(h) || memcmp(h, zero, sizeof(h)) != 0 ||
+            fgetc(fp) != EOF) {
+            fprintf(stderr, "dataset selftest: archive does not end with two zero blocks\n");
+            rc = -1;
+        }
+    }
+    if (fp) {
+        fclose(fp);
+    }
+
+    // The first buffer may go out at once; the rest is paced by the limit
+    double rate_kb = ds.stats.written_bytes > DATASET_WRITE_BUF ?
+        (ds.stats.written_bytes - DATASET_WRITE_BUF) / 1024.0 / seconds : 0;
+    double write_kb = ds.stats.writes ? ds.stats.written_bytes / 1024.0 / ds.stats.writes : 0;
+    printf("Dataset selftest: %d samples, %d boxes, %.1f MB in %.2f s: %.0f KB/s (limit %d), "
+           "%llu write()s of %.0f KB on average, throttled %llu ms\n",
+           SELFTEST_SAMPLES, boxes_checked, ds.stats.written_bytes / 1048576.0, seconds, rate_kb,
+           SELFTEST_RATE_KB, (unsigned long long)ds.stats.writes, write_kb,
+           (unsigned long long)(ds.stats.throttle_us / 1000));
+    if (rc == 0 && rate_kb > SELFTEST_RATE_KB * 1.05) {
+        fprintf(stderr, "dataset selftest: rate limit exceeded\n");
+        rc = -1;
+    }
+    if (rc == 0 && write_kb < DATASET_WRITE_BUF / 2 / 1024) {
+        fprintf(stderr, "dataset selftest: writes smaller than half the buffer\n");
+        rc = -1;
+    }
+    printf("Dataset selftest: %s\n", rc == 0 ? "PASS" : "FAIL");
+
+    free(ds.wbuf);
+    free(data);
+    free(expect);
+    return rc;
+}
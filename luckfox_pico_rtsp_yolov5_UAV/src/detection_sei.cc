@@ -0,0 +1,497 @@
+#include "detection_sei.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Random but fixed: "UAV-DET" detections, version 1 layout
+const uint8_t detection_sei_uuid[16] = {
+    0x5a, 0x1c, 0x8e, 0x43, 0x2b, 0x9f, 0x4d, 0x17,
+    0xa6, 0x30, 0x55, 0x41, 0x56, 0x44, 0x45, 0x54
+};
+
+#define H264_NAL_SEI 6
+#define H265_NAL_PREFIX_SEI 39
+#define H265_NAL_SUFFIX_SEI 40
+#define SEI_USER_DATA_UNREGISTERED 5
+
+// Frames published but not yet streamed; the encoder runs a frame or two behind
+#define SEI_PENDING 8
+// Largest SEI NAL the scanner unescapes; slices are skipped without copying
+#define SEI_SCAN_MAX 4096
+
+// ---------------------------------------------------------------------------
+// NAL construction and parsing
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    uint8_t* out;
+    size_t size;
+    size_t pos;
+    int zeros;                  // Consecutive zero bytes written
+    bool overflow;
+} rbsp_writer_t;
+
+// Emit one RBSP byte, inserting emulation_prevention_three_byte when the
+// NAL would otherwise contain 00 00 0x (x <= 3)
+static void rbsp_put(rbsp_writer_t* w, uint8_t b) {
+    if (w->zeros >= 2 && b <= 3) {
+        if (w->pos < w->size) w->out[w->pos] = 0x03;
+        w->pos++;
+        w->zeros = 0;
+    }
+    if (w->pos < w->size) w->out[w->pos] = b;
+    else w->overflow = true;
+    w->pos++;
+    w->zeros = b == 0 ? w->zeros + 1 : 0;
+}
+
+static void rbsp_put_ff_coded(rbsp_writer_t* w, size_t value) {
+    while (value >= 255) {
+        rbsp_put(w, 0xFF);
+        value -= 255;
+    }
+    rbsp_put(w, (uint8_t)value);
+}
+
+// The sei_message() is the same in both codecs; only the NAL header differs
+static int sei_build_user_data(bool hevc, const uint8_t uuid[16], const uint8_t* payload,
+                               size_t len, uint8_t* out, size_t out_size) {
+    if (out_size < 4) {
+        return -1;
+    }
+    out[0] = 0; out[1] = 0; out[2] = 0; out[3] = 1;
+
+    rbsp_writer_t w = { out, out_size, 4, 0, false };
+    if (hevc) {
+        rbsp_put(&w, H265_NAL_PREFIX_SEI << 1);
+        rbsp_put(&w, 1);            // nuh_layer_id 0, nuh_temporal_id_plus1 1
+    } else {
+        rbsp_put(&w, H264_NAL_SEI);
+    }
+    rbsp_put_ff_coded(&w, SEI_USER_DATA_UNREGISTERED);
+    rbsp_put_ff_coded(&w, 16 + len);
+    for (int i = 0; i < 16; i++) {
+        rbsp_put(&w, uuid[i]);
+    }
+    for (size_t i = 0; i < len; i++) {
+        rbsp_put(&w, payload[i]);
+    }
+    rbsp_put(&w, 0x80);             // rbsp_trailing_bits
+
+    return w.overflow || w.pos > out_size ? -1 : (int)w.pos;
+}
+
+int h264_sei_build_user_data(const uint8_t uuid[16], const uint8_t* payload, size_t len,
+                             uint8_t* out, size_t out_size) {
+    return sei_build_user_data(false, uuid, payload, len, out, out_size);
+}
+
+int h265_sei_build_user_data(const uint8_t uuid[16], const uint8_t* payload, size_t len,
+                             uint8_t* out, size_t out_size) {
+    return sei_build_user_data(true, uuid, payload, len, out, out_size);
+}
+
+// Strip emulation prevention bytes
+static size_t rbsp_unescape(const uint8_t* in, size_t len, uint8_t* out) {
+    size_t n = 0;
+    int zeros = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (zeros >= 2 && in[i] == 0x03) {
+            zeros = 0;
+            continue;
+        }
+        out[n++] = in[i];
+        zeros = in[i] == 0 ? zeros + 1 : 0;
+    }
+    return n;
+}
+
+static size_t read_ff_coded(const uint8_t* p, size_t len, size_t* pos, bool* ok) {
+    size_t value = 0;
+    while (*pos < len && p[*pos] == 0xFF) {
+        value += 255;
+        (*pos)++;
+    }
+    if (*pos >= len) {
+        *ok = false;
+        return 0;
+    }
+    return value + p[(*pos)++];
+}
+
+// Walk the sei_message()s of one unescaped SEI NAL (header byte excluded)
+static int parse_sei_rbsp(const uint8_t* p, size_t len, const uint8_t uuid[16],
+                          h264_sei_user_data_fn fn, void* user) {
+    int found = 0;
+    size_t pos = 0;
+
+    // Anything left beyond the trailing 0x80 byte is another message
+    while (pos + 1 < len) {
+        bool ok = true;
+        size_t type = read_ff_coded(p, len, &pos, &ok);
+        size_t size = read_ff_coded(p, len, &pos, &ok);
+        if (!ok || pos + size > len) {
+            break;
+        }
+        if (type == SEI_USER_DATA_UNREGISTERED && size >= 16 &&
+            memcmp(p + pos, uuid, 16) == 0) {
+            fn(p + pos + 16, size - 16, user);
+            found++;
+        }
+        pos += size;
+    }
+    return found;
+}
+
+static int sei_scan(bool hevc, const uint8_t* stream, size_t len, const uint8_t uuid[16],
+                    h264_sei_user_data_fn fn, void* user) {
+    static uint8_t rbsp[SEI_SCAN_MAX];
+    int found = 0;
+    size_t i = 0;
+
+    while (i + 3 <= len) {
+        // Next start code (the 4-byte form is the 3-byte one after a zero)
+        if (!(stream[i] == 0 && stream[i + 1] == 0 && stream[i + 2] == 1)) {
+            i++;
+            continue;
+        }
+        size_t start = i + 3;
+        size_t end = start;
+        while (end + 3 <= len &&
+               !(stream[end] == 0 && stream[end + 1] == 0 && stream[end + 2] <= 1)) {
+            end++;
+        }
+        if (end + 3 > len) {
+            end = len;
+        }
+
+        size_t header = hevc ? 2 : 1;
+        bool sei;
+        if (hevc) {
+            int type = (stream[start] >> 1) & 0x3F;
+            sei = type == H265_NAL_PREFIX_SEI || type == H265_NAL_SUFFIX_SEI;
+        } else {
+            sei = (stream[start] & 0x1F) == H264_NAL_SEI;
+        }
+        if (end > start + header && sei && end - start - header <= SEI_SCAN_MAX) {
+            size_t n = rbsp_unescape(stream + start + header, end - start - header, rbsp);
+            found += parse_sei_rbsp(rbsp, n, uuid, fn, user);
+        }
+        i = end;
+    }
+    return found;
+}
+
+int h264_sei_scan(const uint8_t* stream, size_t len, const uint8_t uuid[16],
+                  h264_sei_user_data_fn fn, void* user) {
+    return sei_scan(false, stream, len, uuid, fn, user);
+}
+
+int h265_sei_scan(const uint8_t* stream, size_t len, const uint8_t uuid[16],
+                  h264_sei_user_data_fn fn, void* user) {
+    return sei_scan(true, stream, len, uuid, fn, user);
+}
+
+// ---------------------------------------------------------------------------
+// Detection payload
+// ---------------------------------------------------------------------------
+
+static void put_u16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static uint16_t get_u16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint16_t clamp_u16(int v) {
+    return v < 0 ? 0 : (v > 0xFFFF ? 0xFFFF : (uint16_t)v);
+}
+
+int detection_sei_encode(uint64_t pts, const mavlink_target_t* targets, int count,
+                         int frame_width, int frame_height,
+                         uint8_t* out, size_t out_size) {
+    if (count > DETECTION_SEI_MAX_TARGETS) {
+        count = DETECTION_SEI_MAX_TARGETS;
+    }
+    size_t len = DETECTION_SEI_HEADER_LEN + (size_t)count * DETECTION_SEI_TARGET_LEN;
+    if (len > out_size) {
+        return -1;
+    }
+
+    out[0] = DETECTION_SEI_VERSION;
+    out[1] = (uint8_t)count;
+    put_u16(out + 2, clamp_u16(frame_width));
+    put_u16(out + 4, clamp_u16(frame_height));
+    for (int i = 0; i < 8; i++) {
+        out[6 + i] = (uint8_t)(pts >> (8 * i));
+    }
+
+    uint8_t* p = out + DETECTION_SEI_HEADER_LEN;
+    for (int i = 0; i < count; i++, p += DETECTION_SEI_TARGET_LEN) {
+        const mavlink_target_t* t = &targets[i];
+        float conf = t->confidence < 0.0f ? 0.0f : (t->confidence > 1.0f ? 1.0f : t->confidence);
+        put_u16(p, clamp_u16(t->x));
+        put_u16(p + 2, clamp_u16(t->y));
+        put_u16(p + 4, clamp_u16(t->width));
+        put_u16(p + 6, clamp_u16(t->height));
+        p[8] = (uint8_t)(conf * 255.0f + 0.5f);
+        p[9] = t->class_id;
+        p[10] = t->target_num;
+    }
+    return (int)len;
+}
+
+int detection_sei_decode(const uint8_t* data, size_t len, detection_sei_frame_t* frame) {
+    if (len < DETECTION_SEI_HEADER_LEN || data[0] != DETECTION_SEI_VERSION) {
+        return -1;
+    }
+    int count = data[1];
+    if (count > DETECTION_SEI_MAX_TARGETS ||
+        len < DETECTION_SEI_HEADER_LEN + (size_t)count * DETECTION_SEI_TARGET_LEN) {
+        return -1;
+    }
+
+    frame->count = count;
+    frame->frame_width = get_u16(data + 2);
+    frame->frame_height = get_u16(data + 4);
+    frame->pts = 0;
+    for (int i = 0; i < 8; i++) {
+        frame->pts |= (uint64_t)data[6 + i] << (8 * i);
+    }
+
+    const uint8_t* p = data + DETECTION_SEI_HEADER_LEN;
+    for (int i = 0; i < count; i++, p += DETECTION_SEI_TARGET_LEN) {
+        mavlink_target_t* t = &frame->targets[i];
+        t->x = get_u16(p);
+        t->y = get_u16(p + 2);
+        t->width = get_u16(p + 4);
+        t->height = get_u16(p + 6);
+        t->confidence = p[8] / 255.0f;
+        t->class_id = p[9];
+        t->target_num = p[10];
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Frame loop -> encoder thread handoff
+// ---------------------------------------------------------------------------
+
+static struct {
+    uint64_t pts;
+    int len;
+    uint8_t payload[DETECTION_SEI_MAX_PAYLOAD];
+} sei_pending[SEI_PENDING];
+static int sei_next;
+static bool sei_hevc;
+static pthread_mutex_t sei_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void detection_sei_set_codec(bool hevc) {
+    pthread_mutex_lock(&sei_lock);
+    sei_hevc = hevc;
+    pthread_mutex_unlock(&sei_lock);
+}
+
+void detection_sei_publish(uint64_t pts, const mavlink_target_t* targets, int count,
+                           int frame_width, int frame_height) {
+    pthread_mutex_lock(&sei_lock);
+    sei_pending[sei_next].pts = pts;
+    sei_pending[sei_next].len = detection_sei_encode(pts, targets, count,
+                                                     frame_width, frame_height,
+                                                     sei_pending[sei_next].payload,
+                                                     DETECTION_SEI_MAX_PAYLOAD);
+    sei_next = (sei_next + 1) % SEI_PENDING;
+    pthread_mutex_unlock(&sei_lock);
+}
+
+int detection_sei_prefix(uint64_t pts, uint8_t* out, size_t out_size, void* user) {
+    int len = 0;
+
+    pthread_mutex_lock(&sei_lock);
+    for (int i = 0; i < SEI_PENDING; i++) {
+        if (sei_pending[i].pts == pts && sei_pending[i].len > 0) {
+            len = sei_build_user_data(sei_hevc, detection_sei_uuid, sei_pending[i].payload,
+                                      sei_pending[i].len, out, out_size);
+            sei_pending[i].len = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sei_lock);
+
+    return len < 0 ? 0 : len;
+}
+
+// ---------------------------------------------------------------------------
+// Host tools
+// ---------------------------------------------------------------------------
+
+static uint8_t* read_file(const char* path, size_t* len) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        perror("detection_sei: fopen");
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    uint8_t* data = (uint8_t*)malloc(size > 0 ? size : 1);
+    if (data && fread(data, 1, size, fp) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    *len = size;
+    return data;
+}
+
+static void print_frame(const uint8_t* data, size_t len, void* user) {
+    detection_sei_frame_t frame;
+    if (detection_sei_decode(data, len, &frame) != 0) {
+        printf("SEI: malformed payload (%zu bytes)\n", len);
+        return;
+    }
+    printf("SEI pts=%llu %dx%d targets=%d\n", (unsigned long long)frame.pts,
+           frame.frame_width, frame.frame_height, frame.count);
+    for (int i = 0; i < frame.count; i++) {
+        const mavlink_target_t* t = &frame.targets[i];
+        printf("  #%u class %u conf %.2f box %d,%d %dx%d\n", t->target_num, t->class_id,
+               t->confidence, t->x, t->y, t->width, t->height);
+    }
+}
+
+int detection_sei_dump(const char* path) {
+    size_t len;
+    uint8_t* data = read_file(path, &len);
+    if (!data) {
+        return -1;
+    }
+    // A UUID match cannot happen by chance, so simply try both codecs
+    const char* codec = "H.264";
+    int found = h264_sei_scan(data, len, detection_sei_uuid, print_frame, NULL);
+    if (found == 0) {
+        codec = "H.265";
+        found = h265_sei_scan(data, len, detection_sei_uuid, print_frame, NULL);
+    }
+    free(data);
+    printf("SEI: %d detection frames in %s (%s)\n", found, path, found ? codec : "no SEI");
+    return found;
+}
+
+typedef struct {
+    detection_sei_frame_t* expected;
+    int frames;
+    int next;
+    int mismatches;
+} selftest_state_t;
+
+static bool same_target(const mavlink_target_t* a, const mavlink_target_t* b) {
+    return a->x == b->x && a->y == b->y && a->width == b->width && a->height == b->height &&
+           a->class_id == b->class_id && a->target_num == b->target_num &&
+           (int)(a->confidence * 255.0f + 0.5f) == (int)(b->confidence * 255.0f + 0.5f);
+}
+
+static void check_frame(const uint8_t* data, size_t len, void* user) {
+    selftest_state_t* st = (selftest_state_t*)user;
+    detection_sei_frame_t got;
+
+    if (st->next >= st->frames || detection_sei_decode(data, len, &got) != 0) {
+        st->mismatches++;
+        return;
+    }
+    const detection_sei_frame_t* want = &st->expected[st->next++];
+    bool ok = got.pts == want->pts && got.count == want->count &&
+              got.frame_width == want->frame_width && got.frame_height == want->frame_height;
+    for (int i = 0; ok && i < got.count; i++) {
+        ok = same_target(&got.targets[i], &want->targets[i]);
+    }
+    if (!ok) {
+        st->mismatches++;
+    }
+}
+
+static int selftest_codec(const char* path, int frames, bool hevc) {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        perror("detection_sei: fopen");
+        return -1;
+    }
+
+    detection_sei_frame_t* expected =
+        (detection_sei_frame_t*)calloc(frames, sizeof(detection_sei_frame_t));
+    static uint8_t slice[64 * 1024];
+    static uint8_t nal[sizeof(slice) * 3 / 2 + 8];
+    uint8_t sei[DETECTION_SEI_MAX_NAL];
+    uint8_t payload[DETECTION_SEI_MAX_PAYLOAD];
+    srand(1234);
+
+    for (int f = 0; f < frames; f++) {
+        detection_sei_frame_t* fr = &expected[f];
+        fr->pts = 1000000ULL + f * 50000ULL + (f % 7 == 0 ? 0x10000ULL : 0);
+        fr->frame_width = 720;
+        fr->frame_height = 480;
+        fr->count = rand() % (DETECTION_SEI_MAX_TARGETS + 1);
+        for (int i = 0; i < fr->count; i++) {
+            mavlink_target_t* t = &fr->targets[i];
+            // Small values put plenty of zero bytes in the payload
+            t->x = rand() % 3 == 0 ? 0 : rand() % 720;
+            t->y = rand() % 3 == 0 ? 1 : rand() % 480;
+            t->width = rand() % 256;
+            t->height = rand() % 4;
+            t->confidence = (rand() % 256) / 255.0f;
+            t->class_id = 0;
+            t->target_num = (uint8_t)i;
+        }
+
+        int plen = detection_sei_encode(fr->pts, fr->targets, fr->count,
+                                        fr->frame_width, fr->frame_height,
+                                        payload, sizeof(payload));
+        int slen = sei_build_user_data(hevc, detection_sei_uuid, payload, plen, sei, sizeof(sei));
+        fwrite(sei, 1, slen, fp);
+
+        // A slice of random RBSP full of zero runs, escaped like an encoder would
+        size_t rlen = 1000 + rand() % (sizeof(slice) - 1000);
+        for (size_t i = 0; i < rlen; i++) {
+            slice[i] = rand() % 4 == 0 ? 0 : (uint8_t)rand();
+        }
+        slice[rlen - 1] = 0x80;
+        rbsp_writer_t w = { nal, sizeof(nal), 4, 0, false };
+        nal[0] = 0; nal[1] = 0; nal[2] = 0; nal[3] = 1;
+        if (hevc) {
+            rbsp_put(&w, f % 30 == 0 ? 19 << 1 : 1 << 1);   // IDR_W_RADL / TRAIL_R
+            rbsp_put(&w, 1);
+        } else {
+            rbsp_put(&w, f % 30 == 0 ? 0x65 : 0x41);
+        }
+        for (size_t i = 0; i < rlen; i++) {
+            rbsp_put(&w, slice[i]);
+        }
+        fwrite(nal, 1, w.pos, fp);
+    }
+    fclose(fp);
+
+    size_t len;
+    uint8_t* data = read_file(path, &len);
+    selftest_state_t st = { expected, frames, 0, 0 };
+    int found = data ? sei_scan(hevc, data, len, detection_sei_uuid, check_frame, &st) : -1;
+    // The other codec's scanner must not mistake these NALs for SEIs
+    int crossed = data ? sei_scan(!hevc, data, len, detection_sei_uuid, check_frame, &st) : 0;
+    free(data);
+    free(expected);
+
+    bool pass = found == frames && st.next == frames && st.mismatches == 0 && crossed == 0;
+    printf("SEI self-test %s: %d frames written, %d found, %d mismatches, %d misparsed (%zu bytes): %s\n",
+           hevc ? "H.265" : "H.264", frames, found, st.mismatches, crossed, len,
+           pass ? "PASS" : "FAIL");
+    return pass ? 0 : -1;
+}
+
+int detection_sei_selftest(const char* path, int frames) {
+    int failed = 0;
+    failed += selftest_codec(path, frames, false) != 0;
+    failed += selftest_codec(path, frames, true) != 0;
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,356 @@
+#include "dma_pool.h"
+#include "dma_alloc.h"
+#include "drm_alloc.h"
+#include "luckfox_mpi.h"
+#include "RgaUtils.h"
+#include "im2d.hpp"
+#include <stdio.h>
+#include <string.h>
+
+// ---------------------------------------------------------------------------
+// DmaLease
+// ---------------------------------------------------------------------------
+
+DmaLease::DmaLease() : pool_(NULL), buf_(NULL), width_(0), height_(0) {}
+
+DmaLease::DmaLease(DmaPool* pool, dma_pool_buf_t* buf, int width, int height)
+    : pool_(pool), buf_(buf), width_(width), height_(height) {}
+
+DmaLease::~DmaLease()
+{
+    release();
+}
+
+DmaLease::DmaLease(DmaLease&& other)
+    : pool_(other.pool_), buf_(other.buf_), width_(other.width_), height_(other.height_)
+{
+    other.pool_ = NULL;
+    other.buf_ = NULL;
+}
+
+DmaLease& DmaLease::operator=(DmaLease&& other)
+{
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        buf_ = other.buf_;
+        width_ = other.width_;
+        height_ = other.height_;
+        other.pool_ = NULL;
+        other.buf_ = NULL;
+    }
+    return *this;
+}
+
+rga_buffer_t DmaLease::rga() const
+{
+    if (!buf_) {
+        rga_buffer_t empty;
+        memset(&empty, 0, sizeof(empty));
+        return empty;
+    }
+    return wrapbuffer_handle(buf_->handle, width_, height_, buf_->format);
+}
+
+void DmaLease::sync_for_device() const
+{
+    if (!buf_)
+        return;
+    if (buf_->mb)
+        RK_MPI_SYS_MmzFlushCache(buf_->mb, RK_FALSE);
+    else
+        dma_sync_cpu_to_device(buf_->fd);
+}
+
+void DmaLease::sync_for_cpu() const
+{
+    if (!buf_)
+        return;
+    if (buf_->mb)
+        RK_MPI_SYS_MmzFlushCache(buf_->mb, RK_TRUE);
+    else
+        dma_sync_device_to_cpu(buf_->fd);
+}
+
+void DmaLease::release()
+{
+    if (pool_ && buf_)
+        pool_->put_back(buf_);
+    pool_ = NULL;
+    buf_ = NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Backends
+// ---------------------------------------------------------------------------
+
+size_t dma_pool_image_size(int width, int height, int format)
+{
+    return (size_t)((float)width * height * get_bpp_from_format(format));
+}
+
+const char* dma_pool_backend_name(dma_pool_backend_t backend)
+{
+    switch (backend) {
+        case DMA_POOL_BACKEND_HEAP: return "dma-heap";
+        case DMA_POOL_BACKEND_DRM:  return "drm";
+        case DMA_POOL_BACKEND_MB:   return "mpi-mb";
+        default:                    return "unknown";
+    }
+}
+
+int DmaPool::alloc_buffer(dma_pool_backend_t backend, size_t size, int format,
+                          dma_pool_buf_t* buf)
+{
+    memset(buf, 0, sizeof(*buf));
+    buf->fd = -1;
+    buf->bucket = -1;
+    buf->size = size;
+    buf->format = format;
+
+    switch (backend) {
+        case DMA_POOL_BACKEND_HEAP:
+            if (dma_buf_alloc(RV1106_CMA_HEAP_PATH, size, &buf->fd, &buf->va) < 0) {
+                printf("DmaPool: dma-heap alloc of %zu bytes failed\n", size);
+                return -1;
+            }
+            break;
+
+        case DMA_POOL_BACKEND_DRM: {
+            // Dumb buffers are described as rows of bytes; round up to whole rows
+            const int row = 4096;
+            int rows = (int)((size + row - 1) / row);
+            size_t actual = 0;
+            buf->va = drm_buf_alloc(row, rows, 8, &buf->fd, &buf->drm_handle, &actual);
+            if (!buf->va) {
+                printf("DmaPool: drm alloc of %zu bytes failed\n", size);
+                return -1;
+            }
+            buf->size = actual;
+            break;
+        }
+
+        case DMA_POOL_BACKEND_MB:
+            if (RK_MPI_SYS_MmzAlloc_Cached(&buf->mb, RK_NULL, RK_NULL, (RK_U32)size) != RK_SUCCESS) {
+                printf("DmaPool: MMZ alloc of %zu bytes failed\n", size);
+                buf->mb = NULL;
+                return -1;
+            }
+            buf->va = RK_MPI_MB_Handle2VirAddr(buf->mb);
+            buf->fd = RK_MPI_MB_Handle2Fd(buf->mb);
+            break;
+
+        default:
+            return -1;
+    }
+
+    buf->handle = importbuffer_fd(buf->fd, (int)buf->size);
+    if (!buf->handle) {
+        printf("DmaPool: importbuffer_fd failed for fd %d\n", buf->fd);
+        free_buffer(backend, buf);
+        return -1;
+    }
+
+    return 0;
+}
+
+void DmaPool::free_buffer(dma_pool_backend_t backend, dma_pool_buf_t* buf)
+{
+    if (buf->handle) {
+        releasebuffer_handle(buf->handle);
+        buf->handle = 0;
+    }
+
+    switch (backend) {
+        case DMA_POOL_BACKEND_HEAP:
+            if (buf->fd >= 0)
+                dma_buf_free(buf->size, &buf->fd, buf->va);
+            break;
+        case DMA_POOL_BACKEND_DRM:
+            if (buf->va)
+                drm_buf_destroy(buf->fd, buf->drm_handle, buf->va, buf->size);
+            break;
+        case DMA_POOL_BACKEND_MB:
+            // The fd belongs to the MB block and is closed by MmzFree
+            if (buf->mb)
+                RK_MPI_SYS_MmzFree(buf->mb);
+            break;
+        default:
+            break;
+    }
+
+    buf->fd = -1;
+    buf->va = NULL;
+    buf->mb = NULL;
+}
+
+// ---------------------------------------------------------------------------
+// DmaPool
+// ---------------------------------------------------------------------------
+
+DmaPool::DmaPool(dma_pool_backend_t backend, int max_per_key)
+    : backend_(backend), max_per_key_(max_per_key)
+{
+    pthread_mutex_init(&lock_, NULL);
+}
+
+DmaPool::~DmaPool()
+{
+    for (size_t i = 0; i < all_.size(); i++) {
+        free_buffer(backend_, all_[i]);
+        delete all_[i];
+    }
+    pthread_mutex_destroy(&lock_);
+}
+
+int DmaPool::find_bucket(size_t size, int format)
+{
+    for (size_t i = 0; i < buckets_.size(); i++) {
+        if (buckets_[i].size == size && buckets_[i].format == format)
+            return (int)i;
+    }
+
+    Bucket b;
+    b.size = size;
+    b.format = format;
+    b.total = 0;
+    b.free_list.reserve(max_per_key_);
+    buckets_.push_back(b);
+    return (int)buckets_.size() - 1;
+}
+
+DmaLease DmaPool::acquire(int width, int height, int format)
+{
+    size_t size = dma_pool_image_size(width, height, format);
+
+    pthread_mutex_lock(&lock_);
+    int key = find_bucket(size, format);
+    Bucket* b = &buckets_[key];
+
+    if (!b->free_list.empty()) {
+        dma_pool_buf_t* buf = b->free_list.back();
+        b->free_list.pop_back();
+        pthread_mutex_unlock(&lock_);
+        return DmaLease(this, buf, width, height);
+    }
+
+    if (b->total >= max_per_key_) {
+        pthread_mutex_unlock(&lock_);
+        return DmaLease();
+    }
+    b->total++;
+    pthread_mutex_unlock(&lock_);
+
+    // Allocate outside the lock; the slot is already accounted for
+    dma_pool_buf_t* buf = new dma_pool_buf_t;
+    if (alloc_buffer(backend_, size, format, buf) < 0) {
+        delete buf;
+        pthread_mutex_lock(&lock_);
+        buckets_[key].total--;
+        pthread_mutex_unlock(&lock_);
+        return DmaLease();
+    }
+    buf->bucket = key;
+
+    pthread_mutex_lock(&lock_);
+    all_.push_back(buf);
+    pthread_mutex_unlock(&lock_);
+
+    return DmaLease(this, buf, width, height);
+}
+
+int DmaPool::reserve(int width, int height, int format, int count)
+{
+    std::vector<DmaLease> leases;
+    for (int i = 0; i < count; i++) {
+        DmaLease l = acquire(width, height, format);
+        if (!l.valid())
+            break;
+        leases.push_back(std::move(l));
+    }
+    int got = (int)leases.size();
+    leases.clear(); // Returns everything to the free list
+
+    if (got < count)
+        printf("DmaPool: reserved %d of %d %s buffers\n", got, count,
+               dma_pool_backend_name(backend_));
+    return got == 0 ? -1 : got;
+}
+
+void DmaPool::put_back(dma_pool_buf_t* buf)
+{
+    pthread_mutex_lock(&lock_);
+    buckets_[buf->bucket].free_list.push_back(buf);
+    pthread_mutex_unlock(&lock_);
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark
+// ---------------------------------------------------------------------------
+
+void dma_pool_benchmark(int width, int height, int format, int iterations)
+{
+    size_t size = dma_pool_image_size(width, height, format);
+
+    printf("DMA allocator benchmark: %dx%d %s (%zu bytes), %d iterations\n",
+           width, height, translate_format_str(format), size, iterations);
+    printf("%-10s %14s %14s %14s %14s\n",
+           "backend", "oneshot(us)", "pooled(us)", "touch-new(us)", "touch-warm(us)");
+
+    for (int b = 0; b < DMA_POOL_BACKEND_COUNT; b++) {
+        dma_pool_backend_t backend = (dma_pool_backend_t)b;
+        RK_U64 oneshot = 0, touch_new = 0, touch_warm = 0, pooled = 0;
+        int ok = 0;
+
+        // Unpooled: what rga_resize used to pay on every call
+        for (int i = 0; i < iterations; i++) {
+            dma_pool_buf_t buf;
+            RK_U64 t0 = TEST_COMM_GetNowUs();
+            if (DmaPool::alloc_buffer(backend, size, format, &buf) < 0)
+                break;
+            RK_U64 t1 = TEST_COMM_GetNowUs();
+            memset(buf.va, 0x80, size);
+            RK_U64 t2 = TEST_COMM_GetNowUs();
+            DmaPool::free_buffer(backend, &buf);
+            RK_U64 t3 = TEST_COMM_GetNowUs();
+
+            oneshot += (t1 - t0) + (t3 - t2);
+            touch_new += t2 - t1;
+            ok++;
+        }
+
+        if (ok == 0) {
+            printf("%-10s %14s\n", dma_pool_backend_name(backend), "unavailable");
+            continue;
+        }
+
+        DmaPool pool(backend, 2);
+        pool.reserve(width, height, format, 1);
+        int warm = 0;
+        for (int i = 0; i < iterations; i++) {
+            RK_U64 t0 = TEST_COMM_GetNowUs();
+            DmaLease lease = pool.acquire(width, height, format);
+            RK_U64 t1 = TEST_COMM_GetNowUs();
+            if (!lease.valid())
+                break;
+            memset(lease.va(), 0x80, size);
+            RK_U64 t2 = TEST_COMM_GetNowUs();
+            lease.release();
+            RK_U64 t3 = TEST_COMM_GetNowUs();
+
+            pooled += (t1 - t0) + (t3 - t2);
+            touch_warm += t2 - t1;
+            warm++;
+        }
+
+        if (warm == 0) {
+            printf("%-10s %14s\n", dma_pool_backend_name(backend), "unavailable");
+            continue;
+        }
+
+        printf("%-10s %14.1f %14.1f %14.1f %14.1f\n",
+               dma_pool_backend_name(backend),
+               (double)oneshot / ok, (double)pooled / warm,
+               (double)touch_new / ok, (double)touch_warm / warm);
+    }
+}
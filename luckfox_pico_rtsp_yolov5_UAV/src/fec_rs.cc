@@ -0,0 +1,382 @@
+#include "fec_rs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FEC_RS_NEON 1
+#endif
+
+// ---------------------------------------------------------------------------
+// GF(2^8)
+// ---------------------------------------------------------------------------
+
+constexpr uint8_t gf_mul_slow(uint8_t a, uint8_t b) {
+    uint8_t p = 0;
+    for (int i = 0; i < 8; i++) {
+        if (b & 1) {
+            p ^= a;
+        }
+        a = (uint8_t)((a << 1) ^ (a & 0x80 ? 0x1D : 0));
+        b >>= 1;
+    }
+    return p;
+}
+
+// mul[c] is the product row of c; lo/hi split it by nibble so a NEON table
+// lookup of 16 entries covers half a byte: c*x = lo[c][x & 15] ^ hi[c][x >> 4]
+struct gf_tables {
+    uint8_t exp[512];
+    uint8_t log[256];
+    uint8_t mul[256][256];
+    uint8_t lo[256][16];
+    uint8_t hi[256][16];
+    constexpr gf_tables() : exp(), log(), mul(), lo(), hi() {
+        uint8_t x = 1;
+        for (int i = 0; i < 255; i++) {
+            exp[i] = exp[i + 255] = x;
+            log[x] = (uint8_t)i;
+            x = gf_mul_slow(x, 2);
+        }
+        for (int c = 0; c < 256; c++) {
+            for (int v = 0; v < 256; v++) {
+                mul[c][v] = c && v ? exp[log[c] + log[v]] : 0;
+            }
+            for (int n = 0; n < 16; n++) {
+                lo[c][n] = mul[c][n];
+                hi[c][n] = mul[c][n << 4];
+            }
+        }
+    }
+};
+
+static constexpr gf_tables gf;
+
+static_assert(gf.mul[0x53][0xCA] == gf_mul_slow(0x53, 0xCA), "GF(2^8) product table");
+
+uint8_t fec_gf_mul(uint8_t a, uint8_t b) {
+    return gf.mul[a][b];
+}
+
+static uint8_t gf_inv(uint8_t a) {
+    return gf.exp[255 - gf.log[a]];
+}
+
+static void mul_add_table(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len) {
+    const uint8_t* row = gf.mul[c];
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        dst[i] ^= row[src[i]];
+        dst[i + 1] ^= row[src[i + 1]];
+        dst[i + 2] ^= row[src[i + 2]];
+        dst[i + 3] ^= row[src[i + 3]];
+    }
+    for (; i < len; i++) {
+        dst[i] ^= row[src[i]];
+    }
+}
+
+#ifdef FEC_RS_NEON
+static void mul_add_neon(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len) {
+    const uint8x16_t mask = vdupq_n_u8(0x0F);
+    size_t i = 0;
+#if defined(__aarch64__)
+    const uint8x16_t lo = vld1q_u8(gf.lo[c]);
+    const uint8x16_t hi = vld1q_u8(gf.hi[c]);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t s = vld1q_u8(src + i);
+        uint8x16_t p = veorq_u8(vqtbl1q_u8(lo, vandq_u8(s, mask)),
+                                vqtbl1q_u8(hi, vshrq_n_u8(s, 4)));
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), p));
+    }
+#else
+    // ARMv7 VTBL looks up 8 lanes at a time from a two-register table
+    uint8x8x2_t lo, hi;
+    lo.val[0] = vld1_u8(gf.lo[c]);
+    lo.val[1] = vld1_u8(gf.lo[c] + 8);
+    hi.val[0] = vld1_u8(gf.hi[c]);
+    hi.val[1] = vld1_u8(gf.hi[c] + 8);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t s = vld1q_u8(src + i);
+        uint8x16_t l = vandq_u8(s, mask);
+        uint8x16_t h = vshrq_n_u8(s, 4);
+        uint8x8_t p0 = veor_u8(vtbl2_u8(lo, vget_low_u8(l)), vtbl2_u8(hi, vget_low_u8(h)));
+        uint8x8_t p1 = veor_u8(vtbl2_u8(lo, vget_high_u8(l)), vtbl2_u8(hi, vget_high_u8(h)));
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), vcombine_u8(p0, p1)));
+    }
+#endif
+    if (i < len) {
+        mul_add_table(dst + i, src + i, c, len - i);
+    }
+}
+#endif
+
+void fec_rs_mul_add(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len) {
+    if (c == 0) {
+        return;
+    }
+#ifdef FEC_RS_NEON
+    mul_add_neon(dst, src, c, len);
+#else
+    mul_add_table(dst, src, c, len);
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Reed-Solomon erasure code
+// ---------------------------------------------------------------------------
+
+// Cauchy element for parity row j and data column i: 1 / (x_j + y_i) with
+// x_j = k + j and y_i = i, all distinct, so every square submatrix inverts
+static uint8_t cauchy(int k, int j, int i) {
+    return gf_inv((uint8_t)((k + j) ^ i));
+}
+
+int fec_rs_encode(int k, int m, const uint8_t* const* data, uint8_t* const* parity, size_t len) {
+    if (k < 1 || m < 0 || m > FEC_RS_MAX_PARITY || k + m > FEC_RS_MAX_SHARDS) {
+        return -1;
+    }
+    for (int j = 0; j < m; j++) {
+        memset(parity[j], 0, len);
+        for (int i = 0; i < k; i++) {
+            fec_rs_mul_add(parity[j], data[i], cauchy(k, j, i), len);
+        }
+    }
+    return 0;
+}
+
+// Gauss-Jordan inverse of an n x n matrix in place; false if singular
+static bool invert(uint8_t* a, int n) {
+    uint8_t inv[FEC_RS_MAX_PARITY * FEC_RS_MAX_PARITY];
+    memset(inv, 0, (size_t)n * n);
+    for (int i = 0; i < n; i++) {
+        inv[i * n + i] = 1;
+    }
+
+    for (int col = 0; col < n; col++) {
+        int pivot = col;
+        while (pivot < n && a[pivot * n + col] == 0) {
+            pivot++;
+        }
+        if (pivot == n) {
+            return false;
+        }
+        if (pivot != col) {
+            for (int c = 0; c < n; c++) {
+                uint8_t t = a[col * n + c];
+                a[col * n + c] = a[pivot * n + c];
+                a[pivot * n + c] = t;
+                t = inv[col * n + c];
+                inv[col * n + c] = inv[pivot * n + c];
+                inv[pivot * n + c] = t;
+            }
+        }
+
+        uint8_t scale = gf_inv(a[col * n + col]);
+        for (int c = 0; c < n; c++) {
+            a[col * n + c] = gf.mul[scale][a[col * n + c]];
+            inv[col * n + c] = gf.mul[scale][inv[col * n + c]];
+        }
+        for (int r = 0; r < n; r++) {
+            uint8_t f = a[r * n + col];
+            if (r == col || f == 0) {
+                continue;
+            }
+            for (int c = 0; c < n; c++) {
+                a[r * n + c] ^= gf.mul[f][a[col * n + c]];
+                inv[r * n + c] ^= gf.mul[f][inv[col * n + c]];
+            }
+        }
+    }
+    memcpy(a, inv, (size_t)n * n);
+    return true;
+}
+
+int fec_rs_decode(int k, int m, uint8_t* const* shards, const bool* present, size_t len) {
+    if (k < 1 || m < 0 || m > FEC_RS_MAX_PARITY || k + m > FEC_RS_MAX_SHARDS) {
+        return -1;
+    }
+
+    int missing[FEC_RS_MAX_PARITY];
+    int rows[FEC_RS_MAX_PARITY];
+    int e = 0;
+    for (int i = 0; i < k; i++) {
+        if (!present[i]) {
+            if (e == m) {
+                return -1;
+            }
+            missing[e++] = i;
+        }
+    }
+    if (e == 0) {
+        return 0;
+    }
+    int r = 0;
+    for (int j = 0; j < m && r < e; j++) {
+        if (present[k + j]) {
+            rows[r++] = j;
+        }
+    }
+    if (r < e) {
+        return -1;
+    }
+
+    // Only the erasures are unknown: subtract the known data from each
+    // parity row used, leaving an e x e Cauchy system
+    for (int a = 0; a < e; a++) {
+        uint8_t* s = shards[k + rows[a]];
+        int next = 0;
+        for (int i = 0; i < k; i++) {
+            if (next < e && missing[next] == i) {
+                next++;
+                continue;
+            }
+            fec_rs_mul_add(s, shards[i], cauchy(k, rows[a], i), len);
+        }
+    }
+
+    uint8_t mat[FEC_RS_MAX_PARITY * FEC_RS_MAX_PARITY];
+    for (int a = 0; a < e; a++) {
+        for (int b = 0; b < e; b++) {
+            mat[a * e + b] = cauchy(k, rows[a], missing[b]);
+        }
+    }
+    if (!invert(mat, e)) {
+        return -1;                  // Cannot happen for a Cauchy submatrix
+    }
+
+    for (int b = 0; b < e; b++) {
+        uint8_t* out = shards[missing[b]];
+        memset(out, 0, len);
+        for (int a = 0; a < e; a++) {
+            fec_rs_mul_add(out, shards[k + rows[a]], mat[b * e + a], len);
+        }
+    }
+    return e;
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark
+// ---------------------------------------------------------------------------
+
+static double elapsed_s(const struct timeval* t0, const struct timeval* t1) {
+    return (t1->tv_sec - t0->tv_sec) + (t1->tv_usec - t0->tv_usec) / 1e6;
+}
+
+// The textbook kernel: two log lookups and an exp lookup per byte
+static void mul_add_logexp(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len) {
+    if (c == 0) {
+        return;
+    }
+    int lc = gf.log[c];
+    for (size_t i = 0; i < len; i++) {
+        if (src[i]) {
+            dst[i] ^= gf.exp[lc + gf.log[src[i]]];
+        }
+    }
+}
+
+typedef void (*mul_add_fn)(uint8_t* dst, const uint8_t* src, uint8_t c, size_t len);
+
+static double time_kernel(mul_add_fn fn, uint8_t* dst, const uint8_t* src, size_t len,
+                          size_t bytes) {
+    struct timeval t0, t1;
+    gettimeofday(&t0, NULL);
+    for (size_t done = 0, n = 0; done < bytes; done += len, n++) {
+        fn(dst, src, (uint8_t)(2 + n % 253), len);
+    }
+    gettimeofday(&t1, NULL);
+    double s = elapsed_s(&t0, &t1);
+    return s > 0 ? bytes / s / 1e6 : 0.0;
+}
+
+void fec_rs_benchmark(size_t bytes) {
+    const int k = 32, m = 8;
+    const size_t len = 1400;        // One UDP video shard
+    uint8_t* buf = (uint8_t*)malloc((size_t)(k + m + 2) * len);
+    if (!buf) {
+        fprintf(stderr, "FEC benchmark: allocation failed\n");
+        return;
+    }
+    uint8_t* shards[k + m];
+    for (int i = 0; i < k + m; i++) {
+        shards[i] = buf + (size_t)i * len;
+    }
+    uint8_t* ref = buf + (size_t)(k + m) * len;
+    uint8_t* out = ref + len;
+
+    unsigned int seed = 1;
+    for (size_t i = 0; i < (size_t)k * len; i++) {
+        buf[i] = (uint8_t)rand_r(&seed);
+    }
+
+    // Every kernel must agree with the log/exp reference
+    bool match = true;
+    for (int c = 0; c < 256; c++) {
+        memset(ref, 0x5A, len);
+        memset(out, 0x5A, len);
+        mul_add_logexp(ref, shards[c % k], (uint8_t)c, len);
+        fec_rs_mul_add(out, shards[c % k], (uint8_t)c, len);
+        match = match && memcmp(ref, out, len) == 0;
+    }
+
+    double logexp = time_kernel(mul_add_logexp, out, shards[0], len, bytes);
+    double table = time_kernel(mul_add_table, out, shards[0], len, bytes);
+#ifdef FEC_RS_NEON
+    double neon = time_kernel(mul_add_neon, out, shards[0], len, bytes);
+    printf("FEC GF(256) multiply-add: log/exp %.1f MB/s, table %.1f MB/s, NEON %.1f MB/s (%s)\n",
+           logexp, table, neon, match ? "match" : "MISMATCH");
+#else
+    printf("FEC GF(256) multiply-add: log/exp %.1f MB/s, table %.1f MB/s, no NEON in this build (%s)\n",
+           logexp, table, match ? "match" : "MISMATCH");
+#endif
+
+    // Whole blocks: data rate through encode, and decode with m erasures
+    size_t block = (size_t)k * len;
+    int blocks = (int)(bytes / block) + 1;
+    struct timeval t0, t1, t2;
+    gettimeofday(&t0, NULL);
+    for (int b = 0; b < blocks; b++) {
+        fec_rs_encode(k, m, shards, shards + k, len);
+    }
+    gettimeofday(&t1, NULL);
+    double s_enc = elapsed_s(&t0, &t1);
+
+    bool present[k + m];
+    uint8_t* saved = (uint8_t*)malloc((size_t)(k + m) * len);
+    if (!saved) {
+        free(buf);
+        return;
+    }
+    memcpy(saved, buf, (size_t)(k + m) * len);
+    bool recovered = true;
+    double s_dec = 0;
+    for (int b = 0; b < blocks; b++) {
+        memcpy(buf + (size_t)k * len, saved + (size_t)k * len, (size_t)m * len);
+        for (int i = 0; i < k + m; i++) {
+            present[i] = true;
+        }
+        // m erasures spread over the data shards
+        for (int e = 0; e < m; e++) {
+            int i = (b * 7 + e * (k / m)) % k;
+            present[i] = false;
+            memset(shards[i], 0, len);
+        }
+        gettimeofday(&t1, NULL);
+        fec_rs_decode(k, m, shards, present, len);
+        gettimeofday(&t2, NULL);
+        s_dec += elapsed_s(&t1, &t2);
+        recovered = recovered && memcmp(buf, saved, block) == 0;
+    }
+
+    printf("FEC RS(%d+%d) x %zu B: encode %.1f MB/s, decode with %d erasures %.1f MB/s (%s)\n",
+           k, m, len,
+           s_enc > 0 ? (double)blocks * block / s_enc / 1e6 : 0.0, m,
+           s_dec > 0 ? (double)blocks * block / s_dec / 1e6 : 0.0,
+           recovered ? "recovered" : "MISMATCH");
+
+    free(saved);
+    free(buf);
+}
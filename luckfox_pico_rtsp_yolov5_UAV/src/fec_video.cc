@@ -0,0 +1,543 @@
+#include "fec_video.h"
+#include "fec_rs.h"
+#include "luckfox_mpi.h"
+#include "util.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int fec_video_tx_open(fec_video_tx_t* tx, const char* ip, int port, int shard_len,
+                      int ratio, bool hevc) {
+    memset(tx, 0, sizeof(*tx));
+    tx->fd = -1;
+
+    if (shard_len < FEC_VIDEO_SHARD_MIN || shard_len > FEC_VIDEO_SHARD_MAX ||
+        ratio < 0 || ratio > 100) {
+        fprintf(stderr, "fec_video: shard length %d or parity ratio %d%% out of range\n",
+                shard_len, ratio);
+        return -1;
+    }
+    tx->shard_len = (uint16_t)shard_len;
+    tx->ratio = ratio;
+    tx->flags = hevc ? FEC_VIDEO_FLAG_HEVC : 0;
+
+    memset(&tx->dest, 0, sizeof(tx->dest));
+    tx->dest.sin_family = AF_INET;
+    tx->dest.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &tx->dest.sin_addr) != 1) {
+        fprintf(stderr, "fec_video: bad address %s\n", ip);
+        return -1;
+    }
+
+    // Parity never outnumbers the data it protects
+    int shards = FEC_VIDEO_FRAME_MAX / shard_len + 1;
+    tx->max_datagrams = 2 * shards;
+    tx->frame = (uint8_t*)calloc(1, (size_t)shards * shard_len);
+    tx->parity = (uint8_t*)malloc((size_t)shards * shard_len);
+    tx->headers = (uint8_t(*)[FEC_VIDEO_HEADER_LEN])malloc((size_t)tx->max_datagrams * FEC_VIDEO_HEADER_LEN);
+    tx->msgs = (struct mmsghdr*)calloc(tx->max_datagrams, sizeof(struct mmsghdr));
+    tx->iov = (struct iovec*)calloc(2 * tx->max_datagrams, sizeof(struct iovec));
+    if (!tx->frame || !tx->parity || !tx->headers || !tx->msgs || !tx->iov) {
+        fprintf(stderr, "fec_video: out of memory\n");
+        fec_video_tx_close(tx);
+        return -1;
+    }
+
+    tx->fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (tx->fd < 0) {
+        perror("fec_video: socket");
+        fec_video_tx_close(tx);
+        return -1;
+    }
+    // An IDR frame with its parity in one go
+    int sndbuf = 1024 * 1024;
+    setsockopt(tx->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    printf("fec_video: %s:%d, %d-byte shards, %d%% Reed-Solomon parity\n",
+           ip, port, shard_len, ratio);
+    return 0;
+}
+
+static int parity_count(const fec_video_tx_t* tx, int k) {
+    if (tx->ratio == 0) {
+        return 0;
+    }
+    int m = (k * tx->ratio + 99) / 100;
+    if (m > k) m = k;
+    if (m > FEC_RS_MAX_PARITY) m = FEC_RS_MAX_PARITY;
+    if (k + m > FEC_RS_MAX_SHARDS) m = FEC_RS_MAX_SHARDS - k;
+    return m;
+}
+
+static int send_frame(fec_video_tx_t* tx) {
+    size_t s = tx->shard_len;
+    int total = (int)((tx->frame_len + s - 1) / s);
+    int blocks = (total + FEC_VIDEO_MAX_K - 1) / FEC_VIDEO_MAX_K;
+
+    // Zero the padding of the last shard: the receiver's parity covers it too
+    memset(tx->frame + tx->frame_len, 0, total * s - tx->frame_len);
+
+    int first[FEC_VIDEO_MAX_BLOCKS], k[FEC_VIDEO_MAX_BLOCKS], m[FEC_VIDEO_MAX_BLOCKS];
+    int rounds = 0;
+    uint64_t t0 = TEST_COMM_GetNowUs();
+    for (int b = 0; b < blocks; b++) {
+        fec_video_block_layout((uint32_t)tx->frame_len, tx->shard_len, blocks, b, &first[b], &k[b]);
+        m[b] = parity_count(tx, k[b]);
+        if (k[b] + m[b] > rounds) {
+            rounds = k[b] + m[b];
+        }
+
+        const uint8_t* data[FEC_RS_MAX_SHARDS];
+        uint8_t* parity[FEC_RS_MAX_PARITY];
+        for (int i = 0; i < k[b]; i++) {
+            data[i] = tx->frame + (first[b] + i) * s;
+        }
+        for (int j = 0; j < m[b]; j++) {
+            parity[j] = tx->parity + (first[b] + j) * s;
+        }
+        fec_rs_encode(k[b], m[b], data, parity, s);
+    }
+    tx->stats.encode_us += TEST_COMM_GetNowUs() - t0;
+
+    // Round-robin over the blocks: a burst costs each block a shard or two
+    fec_video_header_t h;
+    memset(&h, 0, sizeof(h));
+    h.flags = tx->flags;
+    h.frame_id = tx->frame_id;
+    h.pts_us = tx->frame_pts;
+    h.frame_len = (uint32_t)tx->frame_len;
+    h.blocks = (uint8_t)blocks;
+    h.shard_len = tx->shard_len;
+
+    int count = 0, parity_sent = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int b = 0; b < blocks; b++) {
+            if (r >= k[b] + m[b]) {
+                continue;
+            }
+            h.block = (uint8_t)b;
+            h.k = (uint8_t)k[b];
+            h.m = (uint8_t)m[b];
+            h.index = (uint8_t)r;
+            fec_video_header_write(tx->headers[count], &h);
+
+            struct iovec* iov = &tx->iov[2 * count];
+            iov[0].iov_base = tx->headers[count];
+            iov[0].iov_len = FEC_VIDEO_HEADER_LEN;
+            iov[1].iov_base = r < k[b] ? tx->frame + (first[b] + r) * s
+                                       : tx->parity + (first[b] + r - k[b]) * s;
+            iov[1].iov_len = s;
+            parity_sent += r >= k[b];
+
+            memset(&tx->msgs[count], 0, sizeof(tx->msgs[count]));
+            tx->msgs[count].msg_hdr.msg_name = &tx->dest;
+            tx->msgs[count].msg_hdr.msg_namelen = sizeof(tx->dest);
+            tx->msgs[count].msg_hdr.msg_iov = iov;
+            tx->msgs[count].msg_hdr.msg_iovlen = 2;
+            count++;
+        }
+    }
+
+    // A full send buffer takes none of the rest: those datagrams are dropped
+    int sent = 0;
+    while (sent < count) {
+        int n = sendmmsg(tx->fd, tx->msgs + sent, count - sent, MSG_DONTWAIT);
+        tx->stats.syscalls++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = sent; i < sent + n; i++) {
+            tx->stats.bytes += tx->msgs[i].msg_len;
+        }
+        sent += n;
+        if (n == 0) {
+            break;
+        }
+    }
+
+    tx->stats.frames++;
+    tx->stats.bytes_in += tx->frame_len;
+    tx->stats.datagrams += sent;
+    tx->stats.parity += parity_sent;
+    tx->stats.dropped += count - sent;
+    return sent;
+}
+
+int fec_video_tx_send(fec_video_tx_t* tx, const uint8_t* data, size_t len,
+                      uint64_t pts_us, bool frame_end) {
+    if (tx->frame_len == 0) {
+        tx->frame_pts = pts_us;
+    }
+    if (tx->frame_len + len > FEC_VIDEO_FRAME_MAX) {
+        tx->overflow = true;
+    } else {
+        memcpy(tx->frame + tx->frame_len, data, len);
+        tx->frame_len += len;
+    }
+    if (!frame_end) {
+        return 0;
+    }
+
+    int sent = 0;
+    if (tx->overflow) {
+        tx->stats.oversize++;
+    } else if (tx->frame_len > 0) {
+        sent = send_frame(tx);
+    }
+    tx->frame_id++;
+    tx->frame_len = 0;
+    tx->overflow = false;
+    return sent;
+}
+
+void fec_video_venc_consumer(const VENC_PACK_S* pack, const uint8_t* data,
+                             uint32_t len, void* user) {
+    fec_video_tx_send((fec_video_tx_t*)user, data, len, pack->u64PTS, pack->bFrameEnd);
+}
+
+void fec_video_tx_print_stats(const fec_video_tx_t* tx) {
+    const fec_video_tx_stats_t* st = &tx->stats;
+    uint64_t data = st->datagrams - st->parity;
+    printf("FEC video: frames=%llu datagrams=%llu (parity %llu, +%.0f%%) bytes=%llu syscalls=%llu dropped=%llu oversize=%llu encode avg=%llu us\n",
+           (unsigned long long)st->frames,
+           (unsigned long long)st->datagrams,
+           (unsigned long long)st->parity,
+           data ? 100.0 * st->parity / data : 0.0,
+           (unsigned long long)st->bytes,
+           (unsigned long long)st->syscalls,
+           (unsigned long long)st->dropped,
+           (unsigned long long)st->oversize,
+           (unsigned long long)(st->frames ? st->encode_us / st->frames : 0));
+}
+
+void fec_video_tx_close(fec_video_tx_t* tx) {
+    if (tx->fd >= 0) {
+        close(tx->fd);
+        tx->fd = -1;
+    }
+    free(tx->frame);
+    free(tx->parity);
+    free(tx->headers);
+    free(tx->msgs);
+    free(tx->iov);
+    tx->frame = tx->parity = NULL;
+    tx->headers = NULL;
+    tx->msgs = NULL;
+    tx->iov = NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Self-test: sender -> dropping shim -> receiver, all on localhost
+// ---------------------------------------------------------------------------
+
+#define SELFTEST_IN_FLIGHT 4        // Frames the sender may run ahead of the shim
+#define SELFTEST_BATCH 64
+
+typedef struct {
+    int ratio;                  // Parity per 100 data shards
+    int loss_pct;               // Drop probability outside bursts
+    int burst;                  // Mean burst length in datagrams, 0 for independent loss
+} selftest_run_t;
+
+typedef struct {
+    volatile int running;
+    int in_fd, out_fd;
+    struct sockaddr_in out;
+    const selftest_run_t* run;
+    uint32_t rng;
+    bool in_burst;
+    uint8_t* hit;               // Per frame: a data shard was dropped
+    int frames;
+    volatile uint32_t highest;  // Newest frame id forwarded or dropped
+    uint64_t forwarded, dropped;
+} selftest_shim_t;
+
+typedef struct {
+    volatile int running;
+    int fd;
+    fec_video_rx_t rx;
+    uint8_t* expect;
+    uint32_t ok, mismatched;
+    volatile uint64_t last_rx_us;
+} selftest_rx_t;
+
+// Deterministic frame i: IDR-sized every 30th, a large one every 100th
+static size_t selftest_frame(uint32_t i, uint8_t* out) {
+    uint32_t rng = (i + 1) * 2654435761u;
+    size_t len;
+    if (i % 100 == 99) {
+        len = 300 * 1024;
+    } else if (i % 30 == 0) {
+        len = 60 * 1024 + selftest_rand(&rng) % 4096;
+    } else {
+        len = 500 + selftest_rand(&rng) % 20000;
+    }
+    for (size_t n = 0; n < len; n++) {
+        out[n] = (uint8_t)selftest_rand(&rng);
+    }
+    return len;
+}
+
+static bool shim_drop(selftest_shim_t* shim) {
+    const selftest_run_t* run = shim->run;
+    uint32_t r = selftest_rand(&shim->rng) % 10000;
+    if (run->burst > 0) {
+        // Gilbert-Elliott: bursts start often enough to average loss_pct
+        if (shim->in_burst) {
+            shim->in_burst = r >= (uint32_t)(10000 / run->burst);
+        } else {
+            shim->in_burst = r < (uint32_t)(run->loss_pct * 100 / run->burst);
+        }
+        return shim->in_burst;
+    }
+    return r < (uint32_t)(run->loss_pct * 100);
+}
+
+static void* shim_thread(void* arg) {
+    selftest_shim_t* shim = (selftest_shim_t*)arg;
+    uint8_t* buf = (uint8_t*)malloc((size_t)SELFTEST_BATCH * FEC_VIDEO_DATAGRAM_MAX);
+    struct mmsghdr msgs[SELFTEST_BATCH], out[SELFTEST_BATCH];
+    struct iovec iov[SELFTEST_BATCH];
+
+    while (shim->running) {
+        struct pollfd pfd;
+        pfd.fd = shim->in_fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 20) <= 0) {
+            continue;
+        }
+        for (int i = 0; i < SELFTEST_BATCH; i++) {
+            iov[i].iov_base = buf + (size_t)i * FEC_VIDEO_DATAGRAM_MAX;
+            iov[i].iov_len = FEC_VIDEO_DATAGRAM_MAX;
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(shim->in_fd, msgs, SELFTEST_BATCH, MSG_DONTWAIT, NULL);
+
+        int keep = 0;
+        for (int i = 0; i < n; i++) {
+            fec_video_header_t h;
+            const uint8_t* pkt = (const uint8_t*)iov[i].iov_base;
+            if (fec_video_header_read(pkt, msgs[i].msg_len, &h)) {
+                if ((int32_t)(h.frame_id - shim->highest) > 0) {
+                    __atomic_store_n(&shim->highest, h.frame_id, __ATOMIC_RELEASE);
+                }
+                if (shim_drop(shim)) {
+                    shim->dropped++;
+                    if (h.index < h.k && h.frame_id < (uint32_t)shim->frames) {
+                        shim->hit[h.frame_id] = 1;
+                    }
+                    continue;
+                }
+            }
+            memset(&out[keep], 0, sizeof(out[keep]));
+            iov[i].iov_len = msgs[i].msg_len;
+            out[keep].msg_hdr.msg_name = &shim->out;
+            out[keep].msg_hdr.msg_namelen = sizeof(shim->out);
+            out[keep].msg_hdr.msg_iov = &iov[i];
+            out[keep].msg_hdr.msg_iovlen = 1;
+            keep++;
+        }
+        for (int sent = 0; sent < keep;) {
+            int m = sendmmsg(shim->out_fd, out + sent, keep - sent, 0);
+            if (m <= 0) {
+                break;
+            }
+            sent += m;
+        }
+        shim->forwarded += keep;
+    }
+    free(buf);
+    return NULL;
+}
+
+static void selftest_on_frame(const uint8_t* frame, size_t len, uint64_t pts_us,
+                              uint32_t frame_id, void* user) {
+    selftest_rx_t* rx = (selftest_rx_t*)user;
+    size_t expect_len = selftest_frame(frame_id, rx->expect);
+    if (expect_len == len && memcmp(rx->expect, frame, len) == 0 &&
+        pts_us == (uint64_t)frame_id * 33333) {
+        rx->ok++;
+    } else {
+        rx->mismatched++;
+    }
+}
+
+static void* rx_thread(void* arg) {
+    selftest_rx_t* rx = (selftest_rx_t*)arg;
+    uint8_t* buf = (uint8_t*)malloc((size_t)SELFTEST_BATCH * FEC_VIDEO_DATAGRAM_MAX);
+    struct mmsghdr msgs[SELFTEST_BATCH];
+    struct iovec iov[SELFTEST_BATCH];
+
+    while (rx->running) {
+        struct pollfd pfd;
+        pfd.fd = rx->fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 20) <= 0) {
+            continue;
+        }
+        for (int i = 0; i < SELFTEST_BATCH; i++) {
+            iov[i].iov_base = buf + (size_t)i * FEC_VIDEO_DATAGRAM_MAX;
+            iov[i].iov_len = FEC_VIDEO_DATAGRAM_MAX;
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(rx->fd, msgs, SELFTEST_BATCH, MSG_DONTWAIT, NULL);
+        for (int i = 0; i < n; i++) {
+            fec_video_rx_push(&rx->rx, (const uint8_t*)iov[i].iov_base, msgs[i].msg_len);
+        }
+        if (n > 0) {
+            rx->last_rx_us = TEST_COMM_GetNowUs();
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+static int bind_udp(int port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("fec selftest: socket");
+        return -1;
+    }
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "fec selftest: bind port %d: %s\n", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int selftest_one(int port, const selftest_run_t* run, int frames, uint8_t* frame) {
+    selftest_shim_t shim;
+    selftest_rx_t rx;
+    fec_video_tx_t tx;
+    memset(&shim, 0, sizeof(shim));
+    memset(&rx, 0, sizeof(rx));
+
+    shim.in_fd = bind_udp(port);
+    shim.out_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    rx.fd = bind_udp(port + 1);
+    shim.out.sin_family = AF_INET;
+    shim.out.sin_port = htons(port + 1);
+    shim.out.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    shim.run = run;
+    shim.rng = 0x9E3779B9u ^ (uint32_t)(run->loss_pct * 131 + run->burst * 7 + run->ratio);
+    shim.frames = frames;
+    shim.hit = (uint8_t*)calloc(frames, 1);
+    shim.highest = (uint32_t)-1;
+    rx.expect = (uint8_t*)malloc(FEC_VIDEO_FRAME_MAX);
+
+    int ret = -1;
+    if (shim.in_fd < 0 || shim.out_fd < 0 || rx.fd < 0 || !shim.hit || !rx.expect ||
+        fec_video_rx_init(&rx.rx, FEC_VIDEO_FRAME_MAX, selftest_on_frame, &rx) != 0) {
+        goto out;
+    }
+    if (fec_video_tx_open(&tx, "127.0.0.1", port, FEC_VIDEO_SHARD_MAX, run->ratio, false) != 0) {
+        fec_video_rx_free(&rx.rx);
+        goto out;
+    }
+
+    shim.running = rx.running = 1;
+    pthread_t shim_tid, rx_tid;
+    pthread_create(&shim_tid, NULL, shim_thread, &shim);
+    pthread_create(&rx_tid, NULL, rx_thread, &rx);
+
+    {
+        uint64_t start = TEST_COMM_GetNowUs();
+        for (int i = 0; i < frames; i++) {
+            // Let the shim keep up; a frame it dropped entirely still counts
+            uint64_t wait_start = TEST_COMM_GetNowUs();
+            while ((int32_t)(i - 1 - __atomic_load_n(&shim.highest, __ATOMIC_ACQUIRE)) > SELFTEST_IN_FLIGHT &&
+                   TEST_COMM_GetNowUs() - wait_start < 200000) {
+                usleep(50);
+            }
+            size_t len = selftest_frame(i, frame);
+            uint64_t pts = (uint64_t)i * 33333;
+            // Two slices, to exercise gathering
+            size_t split = i % 3 == 0 ? len / 3 : 0;
+            if (split) {
+                fec_video_tx_send(&tx, frame, split, pts, false);
+            }
+            fec_video_tx_send(&tx, frame + split, len - split, pts, true);
+        }
+        while (TEST_COMM_GetNowUs() - (rx.last_rx_us > start ? rx.last_rx_us : start) < 200000) {
+            usleep(1000);
+        }
+        double seconds = (TEST_COMM_GetNowUs() - start) / 1e6;
+
+        shim.running = rx.running = 0;
+        pthread_join(shim_tid, NULL);
+        pthread_join(rx_tid, NULL);
+        fec_video_rx_flush(&rx.rx);
+
+        int hit = 0;
+        for (int i = 0; i < frames; i++) {
+            hit += shim.hit[i];
+        }
+        const fec_video_rx_stats_t* st = &rx.rx.stats;
+        uint64_t sent = shim.forwarded + shim.dropped;
+        printf("fec selftest parity %3d%%, loss %2d%% %-11s: %d frames, %d hit by loss -> %llu recovered, "
+               "%llu lost | %u ok, %u corrupt | %.1f%% of %llu datagrams dropped, %llu shards rebuilt, %.2f s\n",
+               run->ratio, run->loss_pct, run->burst ? "(bursts)" : "(uniform)",
+               frames, hit,
+               (unsigned long long)st->recovered_frames,
+               (unsigned long long)(frames - st->frames),
+               rx.ok, rx.mismatched,
+               sent ? 100.0 * shim.dropped / sent : 0.0, (unsigned long long)sent,
+               (unsigned long long)st->recovered_shards, seconds);
+
+        bool recovering = run->ratio == 0 || hit == 0 || st->recovered_frames > 0;
+        ret = rx.mismatched == 0 && rx.ok == st->frames && recovering ? 0 : -1;
+    }
+
+    fec_video_tx_close(&tx);
+    fec_video_rx_free(&rx.rx);
+out:
+    if (shim.in_fd >= 0) close(shim.in_fd);
+    if (shim.out_fd >= 0) close(shim.out_fd);
+    if (rx.fd >= 0) close(rx.fd);
+    free(shim.hit);
+    free(rx.expect);
+    return ret;
+}
+
+int fec_video_selftest(int port, int frames) {
+    static const selftest_run_t runs[] = {
+        { 0,  5,  0 },              // Baseline: every hit frame is lost
+        { 25, 5,  0 },
+        { 25, 10, 0 },
+        { 50, 20, 0 },
+        { 50, 5,  8 },
+    };
+
+    uint8_t* frame = (uint8_t*)malloc(FEC_VIDEO_FRAME_MAX);
+    if (!frame) {
+        return -1;
+    }
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        failed += selftest_one(port, &runs[i], frames, frame) != 0;
+    }
+    free(frame);
+    printf("fec selftest: %s\n", failed ? "FAIL" : "PASS");
+    return failed ? -1 : 0;
+}
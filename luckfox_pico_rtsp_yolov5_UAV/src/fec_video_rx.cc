@@ -0,0 +1,281 @@
+#include "fec_video_rx.h"
+#include "fec_rs.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    put16(p, v >> 16);
+    put16(p + 2, v & 0xFFFF);
+}
+
+static uint16_t get16(const uint8_t* p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+void fec_video_header_write(uint8_t* out, const fec_video_header_t* h) {
+    put16(out, FEC_VIDEO_MAGIC);
+    out[2] = FEC_VIDEO_VERSION;
+    out[3] = h->flags;
+    put32(out + 4, h->frame_id);
+    put32(out + 8, (uint32_t)(h->pts_us >> 32));
+    put32(out + 12, (uint32_t)h->pts_us);
+    put32(out + 16, h->frame_len);
+    out[20] = h->block;
+    out[21] = h->blocks;
+    out[22] = h->k;
+    out[23] = h->m;
+    out[24] = h->index;
+    out[25] = 0;
+    put16(out + 26, h->shard_len);
+}
+
+bool fec_video_header_read(const uint8_t* pkt, size_t len, fec_video_header_t* h) {
+    if (len < FEC_VIDEO_HEADER_LEN || get16(pkt) != FEC_VIDEO_MAGIC ||
+        pkt[2] != FEC_VIDEO_VERSION) {
+        return false;
+    }
+    h->flags = pkt[3];
+    h->frame_id = get32(pkt + 4);
+    h->pts_us = ((uint64_t)get32(pkt + 8) << 32) | get32(pkt + 12);
+    h->frame_len = get32(pkt + 16);
+    h->block = pkt[20];
+    h->blocks = pkt[21];
+    h->k = pkt[22];
+    h->m = pkt[23];
+    h->index = pkt[24];
+    h->shard_len = get16(pkt + 26);
+
+    if (h->shard_len < FEC_VIDEO_SHARD_MIN || h->shard_len > FEC_VIDEO_SHARD_MAX ||
+        len != (size_t)FEC_VIDEO_HEADER_LEN + h->shard_len) {
+        return false;
+    }
+    if (h->frame_len == 0 || h->blocks == 0 || h->block >= h->blocks || h->k == 0 ||
+        h->m > h->k || h->m > FEC_RS_MAX_PARITY || h->k + h->m > FEC_RS_MAX_SHARDS ||
+        h->index >= h->k + h->m) {
+        return false;
+    }
+    return true;
+}
+
+void fec_video_block_layout(uint32_t frame_len, uint16_t shard_len, int blocks, int block,
+                            int* first, int* k) {
+    int total = (int)((frame_len + shard_len - 1) / shard_len);
+    int base = total / blocks;
+    int extra = total % blocks;
+    *first = block * base + (block < extra ? block : extra);
+    *k = base + (block < extra ? 1 : 0);
+}
+
+// ---------------------------------------------------------------------------
+// Receiver
+// ---------------------------------------------------------------------------
+
+static size_t max_shards(size_t frame_cap) {
+    return frame_cap / FEC_VIDEO_SHARD_MIN + 1;
+}
+
+int fec_video_rx_init(fec_video_rx_t* rx, size_t frame_cap, fec_video_frame_fn fn, void* user) {
+    memset(rx, 0, sizeof(*rx));
+    if (frame_cap > FEC_VIDEO_FRAME_MAX) {
+        frame_cap = FEC_VIDEO_FRAME_MAX;
+    }
+    rx->frame_cap = frame_cap;
+    rx->fn = fn;
+    rx->user = user;
+
+    for (int i = 0; i < FEC_VIDEO_RX_SLOTS; i++) {
+        fec_video_slot_t* s = &rx->slots[i];
+        // Whole shards: the last one of a frame is padded
+        s->data = (uint8_t*)malloc(frame_cap + FEC_VIDEO_SHARD_MAX);
+        s->parity = (uint8_t*)malloc(frame_cap + FEC_VIDEO_SHARD_MAX);
+        s->have = (uint8_t*)malloc(max_shards(frame_cap));
+        if (!s->data || !s->parity || !s->have) {
+            fec_video_rx_free(rx);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void fec_video_rx_free(fec_video_rx_t* rx) {
+    for (int i = 0; i < FEC_VIDEO_RX_SLOTS; i++) {
+        fec_video_slot_t* s = &rx->slots[i];
+        free(s->data);
+        free(s->parity);
+        free(s->have);
+        s->data = s->parity = s->have = NULL;
+    }
+}
+
+static void release(fec_video_rx_t* rx, fec_video_slot_t* s) {
+    if (s->used && !s->done) {
+        rx->stats.lost_frames++;
+    }
+    s->used = false;
+}
+
+static fec_video_slot_t* find_slot(fec_video_rx_t* rx, uint32_t frame_id) {
+    for (int i = 0; i < FEC_VIDEO_RX_SLOTS; i++) {
+        if (rx->slots[i].used && rx->slots[i].frame_id == frame_id) {
+            return &rx->slots[i];
+        }
+    }
+    return NULL;
+}
+
+// A free slot, else the oldest delivered frame, else the oldest incomplete one
+static fec_video_slot_t* take_slot(fec_video_rx_t* rx) {
+    fec_video_slot_t* best = NULL;
+    for (int i = 0; i < FEC_VIDEO_RX_SLOTS; i++) {
+        fec_video_slot_t* s = &rx->slots[i];
+        if (!s->used) {
+            return s;
+        }
+        if (!best || (s->done && !best->done) ||
+            (s->done == best->done && (int32_t)(s->frame_id - best->frame_id) < 0)) {
+            best = s;
+        }
+    }
+    release(rx, best);
+    return best;
+}
+
+static void complete(fec_video_rx_t* rx, fec_video_slot_t* s) {
+    uint8_t* shards[FEC_RS_MAX_SHARDS];
+    bool present[FEC_RS_MAX_SHARDS];
+
+    for (int b = 0; b < s->blocks; b++) {
+        int first, k;
+        fec_video_block_layout(s->frame_len, s->shard_len, s->blocks, b, &first, &k);
+        int m = s->block_m[b];
+
+        bool whole = true;
+        for (int i = 0; i < k; i++) {
+            whole = whole && (s->have[first + i] & 1);
+        }
+        if (whole) {
+            continue;
+        }
+
+        for (int i = 0; i < k; i++) {
+            shards[i] = s->data + (size_t)(first + i) * s->shard_len;
+            present[i] = s->have[first + i] & 1;
+        }
+        for (int j = 0; j < m; j++) {
+            shards[k + j] = s->parity + (size_t)(first + j) * s->shard_len;
+            present[k + j] = (s->have[first + j] & 2) != 0;
+        }
+        int rebuilt = fec_rs_decode(k, m, shards, present, s->shard_len);
+        if (rebuilt < 0) {
+            return;                 // Counted as lost when the slot is reused
+        }
+        rx->stats.recovered_shards += rebuilt;
+        s->recovered = true;
+    }
+
+    s->done = true;
+    rx->stats.frames++;
+    if (s->recovered) {
+        rx->stats.recovered_frames++;
+    }
+    if (rx->fn) {
+        rx->fn(s->data, s->frame_len, s->pts_us, s->frame_id, rx->user);
+    }
+}
+
+int fec_video_rx_push(fec_video_rx_t* rx, const uint8_t* pkt, size_t len) {
+    fec_video_header_t h;
+    rx->stats.datagrams++;
+    if (!fec_video_header_read(pkt, len, &h) || h.frame_len > rx->frame_cap) {
+        rx->stats.invalid++;
+        return 0;
+    }
+
+    int first, k;
+    fec_video_block_layout(h.frame_len, h.shard_len, h.blocks, h.block, &first, &k);
+    if (k != h.k) {
+        rx->stats.invalid++;
+        return 0;
+    }
+
+    fec_video_slot_t* s = find_slot(rx, h.frame_id);
+    if (!s) {
+        // Only frames newer than any seen start a slot; frames between the
+        // newest and this one never showed up at all. A far jump either way
+        // is a restarted sender.
+        int32_t ahead = (int32_t)(h.frame_id - rx->newest);
+        if (rx->have_newest && (ahead > FEC_VIDEO_RX_RESYNC || ahead < -FEC_VIDEO_RX_RESYNC)) {
+            fec_video_rx_flush(rx);
+            rx->have_newest = false;
+        }
+        if (rx->have_newest && ahead <= 0) {
+            rx->stats.late++;
+            return 0;
+        }
+        if (rx->have_newest) {
+            rx->stats.lost_frames += ahead - 1;
+        }
+        rx->have_newest = true;
+        rx->newest = h.frame_id;
+
+        s = take_slot(rx);
+        s->used = true;
+        s->done = false;
+        s->recovered = false;
+        s->frame_id = h.frame_id;
+        s->pts_us = h.pts_us;
+        s->frame_len = h.frame_len;
+        s->shard_len = h.shard_len;
+        s->blocks = h.blocks;
+        s->flags = h.flags;
+        s->blocks_ready = 0;
+        memset(s->have, 0, (h.frame_len + h.shard_len - 1) / h.shard_len);
+        memset(s->block_count, 0, sizeof(s->block_count));
+        memset(s->block_m, 0, sizeof(s->block_m));
+    } else if (s->frame_len != h.frame_len || s->shard_len != h.shard_len ||
+               s->blocks != h.blocks) {
+        rx->stats.invalid++;
+        return 0;
+    }
+
+    if (s->done) {
+        rx->stats.surplus++;
+        return 0;
+    }
+
+    bool parity = h.index >= k;
+    int pos = first + (parity ? h.index - k : h.index);
+    uint8_t bit = parity ? 2 : 1;
+    if (s->have[pos] & bit) {
+        rx->stats.duplicates++;
+        return 0;
+    }
+    s->have[pos] |= bit;
+    memcpy((parity ? s->parity : s->data) + (size_t)pos * h.shard_len,
+           pkt + FEC_VIDEO_HEADER_LEN, h.shard_len);
+    s->block_m[h.block] = h.m;
+
+    if (++s->block_count[h.block] == k) {
+        s->blocks_ready++;
+    }
+    if (s->blocks_ready == s->blocks) {
+        complete(rx, s);
+        return s->done ? 1 : 0;
+    }
+    return 0;
+}
+
+void fec_video_rx_flush(fec_video_rx_t* rx) {
+    for (int i = 0; i < FEC_VIDEO_RX_SLOTS; i++) {
+        release(rx, &rx->slots[i]);
+    }
+}
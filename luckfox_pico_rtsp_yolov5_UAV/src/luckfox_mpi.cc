@@ -88,38 +88,63 @@ int vi_chn_init(int channelId, int width, int height) {
 	return ret;
 }
 
-int venc_init(int chnId, int width, int height, RK_CODEC_ID_E enType) {
-	printf("%s\n",__func__);
+// A channel bound straight to another module (VENC): frames are never taken
+// with GetChnFrame, so no depth is kept back for the application
+int vi_chn_init_bound(int channelId, int width, int height, int buf_cnt) {
+	int ret;
+	VI_CHN_ATTR_S vi_chn_attr;
+	memset(&vi_chn_attr, 0, sizeof(vi_chn_attr));
+	vi_chn_attr.stIspOpt.u32BufCount = buf_cnt;
+	vi_chn_attr.stIspOpt.enMemoryType = VI_V4L2_MEMORY_TYPE_DMABUF;
+	vi_chn_attr.stSize.u32Width = width;
+	vi_chn_attr.stSize.u32Height = height;
+	vi_chn_attr.enPixelFormat = RK_FMT_YUV420SP;
+	vi_chn_attr.enCompressMode = COMPRESS_MODE_NONE;
+	vi_chn_attr.u32Depth = 0;
+	ret = RK_MPI_VI_SetChnAttr(0, channelId, &vi_chn_attr);
+	ret |= RK_MPI_VI_EnableChn(0, channelId);
+	if (ret) {
+		printf("ERROR: create VI chn %d (%dx%d) error! ret=%d\n", channelId, width, height, ret);
+		return ret;
+	}
+
+	return ret;
+}
+
+int venc_init(int chnId, int width, int height, RK_CODEC_ID_E enType,
+              const venc_profile_t *profile) {
+	printf("%s: %s\n", __func__, profile->name);
 	VENC_RECV_PIC_PARAM_S stRecvParam;
 	VENC_CHN_ATTR_S stAttr;
 	memset(&stAttr, 0, sizeof(VENC_CHN_ATTR_S));
 
-	if (enType == RK_VIDEO_ID_AVC) {
-		stAttr.stRcAttr.enRcMode = VENC_RC_MODE_H264CBR;
-		stAttr.stRcAttr.stH264Cbr.u32BitRate = 10 * 1024;
-		stAttr.stRcAttr.stH264Cbr.u32Gop = 1;
-	} else if (enType == RK_VIDEO_ID_HEVC) {
-		stAttr.stRcAttr.enRcMode = VENC_RC_MODE_H265CBR;
-		stAttr.stRcAttr.stH265Cbr.u32BitRate = 10 * 1024;
-		stAttr.stRcAttr.stH265Cbr.u32Gop = 60;
-	} else if (enType == RK_VIDEO_ID_MJPEG) {
+	stAttr.stVencAttr.enType = enType;
+	if (enType == RK_VIDEO_ID_MJPEG) {
 		stAttr.stRcAttr.enRcMode = VENC_RC_MODE_MJPEGCBR;
-		stAttr.stRcAttr.stMjpegCbr.u32BitRate = 10 * 1024;
+		stAttr.stRcAttr.stMjpegCbr.u32BitRate = profile->bitrate_kbps;
+		stAttr.stVencAttr.u32StreamBufCnt = profile->stream_buf_cnt;
+	} else {
+		// GOP, rate control and output buffers come from the profile
+		venc_profile_fill_attr(profile, &stAttr);
 	}
 
-	stAttr.stVencAttr.enType = enType;
 	stAttr.stVencAttr.enPixelFormat = RK_FMT_RGB888;
 	if (enType == RK_VIDEO_ID_AVC)
 		stAttr.stVencAttr.u32Profile = H264E_PROFILE_HIGH;
+	else if (enType == RK_VIDEO_ID_HEVC)
+		stAttr.stVencAttr.u32Profile = H265E_PROFILE_MAIN;
 	stAttr.stVencAttr.u32PicWidth = width;
 	stAttr.stVencAttr.u32PicHeight = height;
 	stAttr.stVencAttr.u32VirWidth = width;
 	stAttr.stVencAttr.u32VirHeight = height;
-	stAttr.stVencAttr.u32StreamBufCnt = 2;
 	stAttr.stVencAttr.u32BufSize = width * height * 3 / 2;
 	stAttr.stVencAttr.enMirror = MIRROR_NONE;
+	// One packet per slice, so split frames can be streamed slice by slice
+	stAttr.stVencAttr.bByFrame = RK_FALSE;
 
 	RK_MPI_VENC_CreateChn(chnId, &stAttr);
+	if (enType != RK_VIDEO_ID_MJPEG)
+		venc_profile_apply_extras(chnId, enType, width, height, profile);
 
 	memset(&stRecvParam, 0, sizeof(VENC_RECV_PIC_PARAM_S));
 	stRecvParam.s32RecvPicNum = -1;
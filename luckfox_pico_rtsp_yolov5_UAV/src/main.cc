@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/poll.h>
 #include <time.h>
 #include <unistd.h>
@@ -20,6 +21,24 @@
 #include "uart_comm.h"
 #include "rga_hw_accel.h"
 #include "mavlink_comm.h"
+#include "dma_pool.h"
+#include "venc_sink.h"
+#include "mavlink_parser.h"
+#include "param_store.h"
+#include "telemetry_sched.h"
+#include "target_tracker.h"
+#include "tile_infer.h"
+#include "motion_gate.h"
+#include "detection_sei.h"
+#include "venc_roi.h"
+#include "venc_profile.h"
+#include "rtsp_server.h"
+#include "fec_video.h"
+#include "fec_rs.h"
+#include "clip_recorder.h"
+#include "venc_hires.h"
+#include "snapshot.h"
+#include "dataset_capture.h"
 
 #include "im2d.hpp"
 #include "RgaUtils.h"
@@ -34,10 +53,32 @@ int height   = DISP_HEIGHT;
 
 // Serial terminal
 #define SERIAL_PORT_NUM 3  // UART3
+#define SERIAL_BAUD 115200
+#define SERIAL_TX_QUEUE 64 // Packets buffered ahead of the tty
+#define TELEMETRY_SHARE 0.8f // Link share for detections; the rest serves PARAM/TIMESYNC
 
-// Box color and thickness
-#define BOX_COLOR 0x00FF00  // Green
-#define BOX_THICKNESS 4
+// Optional UDP telemetry (Ethernet / USB gadget)
+#define UDP_DEFAULT_PORT 14550
+
+// Built-in RTSP server loopback test (--bench-rtsp)
+#define RTSP_SELFTEST_PORT 18554
+
+// FEC video loss test through a dropping shim (--bench-fec)
+#define FEC_SELFTEST_PORT 18600
+
+// Event clips: video kept from before and recorded after each detection
+#define RECORD_DEFAULT_PRE_S 5
+#define RECORD_DEFAULT_POST_S 5
+#define RECORD_SELFTEST_DIR "/tmp/clip_selftest"
+
+// Training data capture archive test (--bench-dataset)
+#define DATASET_SELFTEST_DIR "/tmp/dataset_selftest"
+
+// Synthetic frames timed by --bench-tracker (also the --tracker-replay limit)
+#define TRACKER_BENCH_FRAMES 20000
+
+// Detector and overlay parameters, tunable over MAVLink PARAM_SET
+#define PARAM_FILE "./detector.params"
 
 // Print also on ssh
 // #define PRINT_ON_SSH
@@ -49,11 +90,14 @@ float scale ;
 int leftPadding ;
 int topPadding  ;
 
-// Profiling
+// Profiling: CLOCK_MONOTONIC, the time base of the VI and VENC PTS
 static inline long long now_us() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+    return (long long)TEST_COMM_GetNowUs();
+}
+
+// A new RTSP viewer should not wait for the next IDR or intra refresh
+static void request_idr(void *user) {
+	RK_MPI_VENC_RequestIDR(0, RK_TRUE);
 }
 
 void mapCoordinates(int *x, int *y) {	
@@ -64,8 +108,309 @@ void mapCoordinates(int *x, int *y) {
     *y = (int)((float)my / scale);
 }
 
+static void print_usage(const char *prog) {
+	printf("Usage: %s [options]\n", prog);
+	printf("  --bench-alloc    Benchmark DMA allocator backends and exit\n");
+	printf("  --bench-mavlink  Benchmark the MAVLink codec, fuzz the receive parser and exit\n");
+	printf("  --bench-udp      Send detection batches to a loopback receiver and exit\n");
+	printf("  --bench-sei      Round-trip detection SEIs through synthetic H.264 and H.265 streams and exit\n");
+	printf("  --sei-dump FILE  Print the detection SEIs of a recorded H.264 or H.265 stream and exit\n");
+	printf("  --bench-tracker  Time the target tracker on a synthetic scene, check ID stability and exit\n");
+	printf("  --tracker-replay FILE  Time the target tracker on the detection SEIs of a recorded stream and exit\n");
+	printf("  --bench-rtsp     Loopback test of the built-in RTSP server (UDP and TCP) and exit\n");
+	printf("  --bench-fec      Benchmark the Reed-Solomon kernels, test loss recovery on loopback and exit\n");
+	printf("  --bench-recorder Record synthetic event clips to %s, check them and exit\n", RECORD_SELFTEST_DIR);
+	printf("  --bench-dataset  Write synthetic samples through the dataset archive writer to %s, check them and exit\n", DATASET_SELFTEST_DIR);
+	printf("  --bench-codec    Encode the camera with H.264 and H.265 at fixed QPs, compare bitrates and exit\n");
+	printf("  -c, --codec NAME Stream codec: h264 (default) or h265\n");
+	printf("  -u, --udp IP[:PORT]  Also send every detection over UDP (default port %d)\n", UDP_DEFAULT_PORT);
+	printf("  -r, --rtsp-port PORT  Also serve the stream from the built-in RTSP server on PORT\n");
+	printf("  -f, --fec-udp IP[:PORT]  Also send the video over UDP with Reed-Solomon parity (default port %d)\n", FEC_VIDEO_DEFAULT_PORT);
+	printf("  --fec-ratio N    Parity shards per 100 data shards for --fec-udp (default %d, 0 = none)\n", FEC_VIDEO_DEFAULT_RATIO);
+	printf("  --hires WxH      Also encode WxH (e.g. %dx%d) from the ISP main path; --record then records it\n",
+		VENC_HIRES_DEFAULT_WIDTH, VENC_HIRES_DEFAULT_HEIGHT);
+	printf("  --hires-kbps N   Average bitrate of the --hires stream (default %d)\n", VENC_HIRES_DEFAULT_KBPS);
+	printf("  -o, --record DIR Write MPEG-TS clips around every detection to DIR\n");
+	printf("  --pre-event S    Seconds kept from before a detection (default %d)\n", RECORD_DEFAULT_PRE_S);
+	printf("  --post-event S   Seconds recorded after the last detection (default %d)\n", RECORD_DEFAULT_POST_S);
+	printf("  --snapshots DIR  Write a JPEG of every new target, and of better views of it, to DIR\n");
+	printf("  --snapshot-conf F  Confidence a target needs for a better-view snapshot (default %.2f)\n", SNAPSHOT_DEFAULT_CONF);
+	printf("  --dataset DIR    Sample clean frames by confidence band with YOLO labels into tar archives in DIR\n");
+	printf("  --dataset-rate N Write rate limit of --dataset in KB/s (default %d)\n", DATASET_DEFAULT_RATE_KB);
+	printf("  --tiles N        Also infer N zoomed tiles per frame for small targets (sets DET_TILES)\n");
+	printf("  --tile-size PX   Side of a tile in camera pixels (default %d)\n", TILE_INFER_DEFAULT_SIZE);
+	printf("  --motion-gate    Run the NPU only on motion, or near recent detections (sets MOT_GATE)\n");
+	printf("  -s, --sei        Embed each frame's detections in the video as SEI user data\n");
+	printf("  -p, --profile NAME  Encoder profile: low-latency, low-bandwidth or archival\n");
+	printf("  --slices N       Encode and stream every frame as N slices (1 = whole frames)\n");
+	printf("  -h, --help       Show this help\n");
+}
+
 int main(int argc, char *argv[]) {
+	bool bench_alloc = false;
+	bool bench_mavlink = false;
+	bool bench_udp = false;
+	bool bench_sei = false;
+	bool bench_rtsp = false;
+	bool bench_fec = false;
+	bool bench_codec = false;
+	bool bench_recorder = false;
+	bool bench_dataset = false;
+	bool bench_tracker = false;
+	const char *tracker_replay_path = NULL;
+	const char *record_dir = NULL;
+	int record_pre_s = RECORD_DEFAULT_PRE_S;
+	int record_post_s = RECORD_DEFAULT_POST_S;
+	int hires_width = 0, hires_height = 0;
+	int hires_kbps = VENC_HIRES_DEFAULT_KBPS;
+	const char *snapshot_dir = NULL;
+	float snapshot_conf = SNAPSHOT_DEFAULT_CONF;
+	const char *dataset_dir = NULL;
+	int dataset_rate_kb = DATASET_DEFAULT_RATE_KB;
+	RK_CODEC_ID_E enCodecType = RK_VIDEO_ID_AVC;
+	int rtsp_port = 0;
+	char fec_ip[64] = "";
+	int fec_port = FEC_VIDEO_DEFAULT_PORT;
+	int fec_ratio = FEC_VIDEO_DEFAULT_RATIO;
+	bool sei_enabled = false;
+	const char *sei_dump_path = NULL;
+	char udp_ip[64] = "";
+	int udp_port = UDP_DEFAULT_PORT;
+	int venc_profile_id = -1;
+	int tiles_per_frame = -1;
+	int tile_size = TILE_INFER_DEFAULT_SIZE;
+	bool motion_gate_on = false;
+
+	static const struct option long_options[] = {
+		{"bench-alloc", no_argument, NULL, 'B'},
+		{"bench-mavlink", no_argument, NULL, 'M'},
+		{"bench-udp",   no_argument, NULL, 'U'},
+		{"bench-sei",   no_argument, NULL, 'S'},
+		{"sei-dump",    required_argument, NULL, 'D'},
+		{"bench-tracker", no_argument, NULL, 'Y'},
+		{"tracker-replay", required_argument, NULL, 'Z'},
+		{"bench-rtsp",  no_argument, NULL, 'R'},
+		{"rtsp-port",   required_argument, NULL, 'r'},
+		{"bench-fec",   no_argument, NULL, 'E'},
+		{"bench-codec", no_argument, NULL, 'C'},
+		{"codec",       required_argument, NULL, 'c'},
+		{"bench-recorder", no_argument, NULL, 'Q'},
+		{"record",      required_argument, NULL, 'o'},
+		{"pre-event",   required_argument, NULL, 'P'},
+		{"post-event",  required_argument, NULL, 'A'},
+		{"hires",       required_argument, NULL, 'H'},
+		{"hires-kbps",  required_argument, NULL, 'K'},
+		{"snapshots",   required_argument, NULL, 'J'},
+		{"snapshot-conf", required_argument, NULL, 'T'},
+		{"bench-dataset", no_argument, NULL, 'X'},
+		{"dataset",     required_argument, NULL, 'G'},
+		{"dataset-rate", required_argument, NULL, 'W'},
+		{"tiles",       required_argument, NULL, 'L'},
+		{"tile-size",   required_argument, NULL, 'I'},
+		{"motion-gate", no_argument, NULL, 'V'},
+		{"fec-udp",     required_argument, NULL, 'f'},
+		{"fec-ratio",   required_argument, NULL, 'F'},
+		{"udp",         required_argument, NULL, 'u'},
+		{"sei",         no_argument, NULL, 's'},
+		{"profile",     required_argument, NULL, 'p'},
+		{"slices",      required_argument, NULL, 'N'},
+		{"help",        no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	int opt;
+	while ((opt = getopt_long(argc, argv, "hu:sp:r:f:c:o:", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'B':
+			bench_alloc = true;
+			break;
+		case 'M':
+			bench_mavlink = true;
+			break;
+		case 'U':
+			bench_udp = true;
+			break;
+		case 'S':
+			bench_sei = true;
+			break;
+		case 'D':
+			sei_dump_path = optarg;
+			break;
+		case 'Y':
+			bench_tracker = true;
+			break;
+		case 'Z':
+			tracker_replay_path = optarg;
+			break;
+		case 'R':
+			bench_rtsp = true;
+			break;
+		case 'r':
+			rtsp_port = atoi(optarg);
+			break;
+		case 'E':
+			bench_fec = true;
+			break;
+		case 'C':
+			bench_codec = true;
+			break;
+		case 'c':
+			if (strcasecmp(optarg, "h264") == 0) {
+				enCodecType = RK_VIDEO_ID_AVC;
+			} else if (strcasecmp(optarg, "h265") == 0 || strcasecmp(optarg, "hevc") == 0) {
+				enCodecType = RK_VIDEO_ID_HEVC;
+			} else {
+				fprintf(stderr, "Unknown codec %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'Q':
+			bench_recorder = true;
+			break;
+		case 'o':
+			record_dir = optarg;
+			break;
+		case 'P':
+			record_pre_s = atoi(optarg);
+			break;
+		case 'A':
+			record_post_s = atoi(optarg);
+			break;
+		case 'H':
+			if (sscanf(optarg, "%dx%d", &hires_width, &hires_height) != 2 ||
+				hires_width <= 0 || hires_height <= 0) {
+				fprintf(stderr, "Bad --hires size %s (WxH)\n", optarg);
+				return 1;
+			}
+			break;
+		case 'K':
+			hires_kbps = atoi(optarg);
+			break;
+		case 'J':
+			snapshot_dir = optarg;
+			break;
+		case 'T':
+			snapshot_conf = atof(optarg);
+			break;
+		case 'X':
+			bench_dataset = true;
+			break;
+		case 'G':
+			dataset_dir = optarg;
+			break;
+		case 'W':
+			dataset_rate_kb = atoi(optarg);
+			break;
+		case 'f': {
+			snprintf(fec_ip, sizeof(fec_ip), "%s", optarg);
+			char *colon = strchr(fec_ip, ':');
+			if (colon) {
+				*colon = '\0';
+				fec_port = atoi(colon + 1);
+			}
+			break;
+		}
+		case 'F':
+			fec_ratio = atoi(optarg);
+			break;
+		case 'L':
+			tiles_per_frame = atoi(optarg);
+			break;
+		case 'I':
+			tile_size = atoi(optarg);
+			break;
+		case 'V':
+			motion_gate_on = true;
+			break;
+		case 's':
+			sei_enabled = true;
+			break;
+		case 'p':
+			venc_profile_id = venc_profile_find(optarg);
+			if (venc_profile_id < 0) {
+				fprintf(stderr, "Unknown encoder profile %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'N':
+			venc_profile_override_slices(atoi(optarg));
+			break;
+		case 'u': {
+			snprintf(udp_ip, sizeof(udp_ip), "%s", optarg);
+			char *colon = strchr(udp_ip, ':');
+			if (colon) {
+				*colon = '\0';
+				udp_port = atoi(colon + 1);
+			}
+			break;
+		}
+		case 'h':
+		default:
+			print_usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	// Pure CPU test, no need to stop the camera pipeline for it
+	if (bench_mavlink) {
+		mavlink_codec_benchmark(16 * 1024 * 1024);
+		return mavlink_parser_selftest(16 * 1024 * 1024) == 0 ? 0 : 1;
+	}
+	if (bench_udp) {
+		return mavlink_udp_benchmark(UDP_DEFAULT_PORT + 1, 2.0) == 0 ? 0 : 1;
+	}
+	if (bench_sei) {
+		return detection_sei_selftest("/tmp/sei_selftest.h264", 300) == 0 ? 0 : 1;
+	}
+	if (bench_rtsp) {
+		return rtsp_server_selftest(RTSP_SELFTEST_PORT, 300) == 0 ? 0 : 1;
+	}
+	if (bench_fec) {
+		fec_rs_benchmark(64 * 1024 * 1024);
+		return fec_video_selftest(FEC_SELFTEST_PORT, 300) == 0 ? 0 : 1;
+	}
+	if (bench_recorder) {
+		return clip_recorder_selftest(RECORD_SELFTEST_DIR) == 0 ? 0 : 1;
+	}
+	if (bench_dataset) {
+		return dataset_capture_selftest(DATASET_SELFTEST_DIR) == 0 ? 0 : 1;
+	}
+	if (sei_dump_path) {
+		return detection_sei_dump(sei_dump_path) >= 0 ? 0 : 1;
+	}
+	if (bench_tracker || tracker_replay_path) {
+		return target_tracker_benchmark(tracker_replay_path, TRACKER_BENCH_FRAMES) == 0 ? 0 : 1;
+	}
+
     system("RkLunch-stop.sh");
+
+	if (bench_alloc) {
+		if (RK_MPI_SYS_Init() != RK_SUCCESS) {
+			RK_LOGE("rk mpi sys init fail!");
+			return -1;
+		}
+		dma_pool_benchmark(DISP_WIDTH, DISP_HEIGHT, RK_FORMAT_RGB_888, 50);
+		dma_pool_benchmark(DISP_WIDTH, DISP_HEIGHT, RK_FORMAT_YCbCr_420_SP, 50);
+		RK_MPI_SYS_Exit();
+		return 0;
+	}
+
+	if (bench_codec) {
+		SAMPLE_COMM_ISP_Init(0, RK_AIQ_WORKING_MODE_NORMAL, RK_FALSE, "/etc/iqfiles");
+		SAMPLE_COMM_ISP_Run(0);
+		if (RK_MPI_SYS_Init() != RK_SUCCESS) {
+			RK_LOGE("rk mpi sys init fail!");
+			return -1;
+		}
+		vi_dev_init();
+		vi_chn_init(0, width, height);
+		int rc = venc_codec_compare(0, width, height, 300);
+		RK_MPI_VI_DisableChn(0, 0);
+		RK_MPI_VI_DisableDev(0);
+		RK_MPI_SYS_Exit();
+		SAMPLE_COMM_ISP_Stop(0);
+		return rc == 0 ? 0 : 1;
+	}
+
 	RK_S32 s32Ret = 0; 
 	int sX,sY,eX,eY; 
 		
@@ -76,14 +421,19 @@ int main(int argc, char *argv[]) {
     int ret;
 	const char *model_path = "./model/yolov5.rknn";
     memset(&rknn_app_ctx, 0, sizeof(rknn_app_context_t));	
+	param_store_init(PARAM_FILE);
 	init_yolov5_model(model_path, &rknn_app_ctx);
+	param_set(PARAM_DET_MODEL_SIZE, rknn_app_ctx.model_width, false);
+	if (venc_profile_id >= 0)
+		param_set(PARAM_ENC_PROFILE, venc_profile_id, false);
+	if (tiles_per_frame >= 0 && param_set(PARAM_DET_TILES, tiles_per_frame, false) != 0)
+		return 1;
+	if (motion_gate_on)
+		param_set(PARAM_MOT_GATE, 1, false);
 	printf("init rknn model success!\n");
 	init_post_process();
 
 	//h264_frame	
-	VENC_STREAM_S stFrame;	
-	stFrame.pstPack = (VENC_PACK_S *)malloc(sizeof(VENC_PACK_S));
-	RK_U64 H264_PTS = 0;
 	RK_U32 H264_TimeRef = 0; 
 	VIDEO_FRAME_INFO_S stViFrame;
 	
@@ -109,7 +459,6 @@ int main(int argc, char *argv[]) {
 	h264_frame.stVFrame.enPixelFormat =  RK_FMT_RGB888; 
 	h264_frame.stVFrame.u32FrameFlag = 160;
 	h264_frame.stVFrame.pMbBlk = src_Blk;
-	unsigned char *data = (unsigned char *)RK_MPI_MB_Handle2VirAddr(src_Blk);
 
 	// rkaiq init
 	RK_BOOL multi_sensor = RK_FALSE;	
@@ -130,21 +479,113 @@ int main(int argc, char *argv[]) {
 	rtsp_session_handle g_rtsp_session;
 	g_rtsplive = create_rtsp_demo(554);
 	g_rtsp_session = rtsp_new_session(g_rtsplive, "/live/0");
-	rtsp_set_video(g_rtsp_session, RTSP_CODEC_ID_VIDEO_H264, NULL, 0);
+	// Parameter sets follow from the stream (venc_sink_set_codec)
+	rtsp_set_video(g_rtsp_session, enCodecType == RK_VIDEO_ID_HEVC ?
+			RTSP_CODEC_ID_VIDEO_H265 : RTSP_CODEC_ID_VIDEO_H264, NULL, 0);
 	rtsp_sync_video_ts(g_rtsp_session, rtsp_get_reltime(), rtsp_get_ntptime());
 	
-	// vi init
+	// vi init; with --hires the full frame takes the ISP main path (VI chn 0)
+	// and the detector and live stream move to the self path (VI chn 1)
+	bool hires_enabled = hires_width > 0;
+	int vi_chn = hires_enabled ? 1 : 0;
 	vi_dev_init();
-	vi_chn_init(0, width, height);
+	vi_chn_init(vi_chn, width, height);
 
 	// venc init
-	RK_CODEC_ID_E enCodecType = RK_VIDEO_ID_AVC;
-	venc_init(0, width, height, enCodecType);
+	venc_profile_id = param_get_int(PARAM_ENC_PROFILE);
+	venc_init(0, width, height, enCodecType, venc_profile_get(venc_profile_id));
 
 	printf("venc init success\n");	
 
+	// Encoded packets are drained and pushed to RTSP on their own thread
+	venc_sink_t venc_sink;
+	venc_sink_init(&venc_sink, 0, g_rtsplive, g_rtsp_session, 10);
+	venc_sink_set_codec(&venc_sink, enCodecType == RK_VIDEO_ID_HEVC);
+	detection_sei_set_codec(enCodecType == RK_VIDEO_ID_HEVC);
+	if (sei_enabled)
+		venc_sink_set_prefix(&venc_sink, detection_sei_prefix, NULL);
+
+	// Built-in RTSP server: packetised once per frame, sendmmsg per client
+	static rtsp_server_t rtsp_server;
+	bool rtsp_server_enabled = false;
+	if (rtsp_port > 0) {
+		if (rtsp_server_start(&rtsp_server, rtsp_port, "/live/0",
+				enCodecType == RK_VIDEO_ID_HEVC ? RTP_CODEC_H265 : RTP_CODEC_H264) != 0) {
+			return 1;
+		}
+		rtsp_server_set_play_callback(&rtsp_server, request_idr, NULL);
+		venc_sink_add_consumer(&venc_sink, rtsp_server_venc_consumer, &rtsp_server);
+		rtsp_server_enabled = true;
+	}
+
+	// Video over UDP with per-frame Reed-Solomon parity, for lossy radio links
+	static fec_video_tx_t fec_video;
+	bool fec_video_enabled = false;
+	if (fec_ip[0]) {
+		if (fec_video_tx_open(&fec_video, fec_ip, fec_port, FEC_VIDEO_SHARD_MAX, fec_ratio,
+				enCodecType == RK_VIDEO_ID_HEVC) != 0) {
+			return 1;
+		}
+		venc_sink_add_consumer(&venc_sink, fec_video_venc_consumer, &fec_video);
+		fec_video_enabled = true;
+	}
+
+	// Full-resolution recording stream, bound VI -> VENC in hardware
+	static venc_hires_t hires;
+	if (hires_enabled &&
+		venc_hires_init(&hires, hires_width, hires_height, enCodecType, hires_kbps) != 0) {
+		return 1;
+	}
+
+	// Event clips from an in-memory ring; the ring is sized for the highest
+	// bitrate any profile can switch to, or the --hires stream's peak
+	static clip_recorder_t recorder;
+	bool recorder_enabled = false;
+	if (record_dir) {
+		uint32_t peak_kbps = 0;
+		for (int i = 0; i < VENC_PROFILE_COUNT; i++) {
+			const venc_profile_t *p = venc_profile_get(i);
+			uint32_t kbps = p->max_kbps > p->bitrate_kbps ? p->max_kbps : p->bitrate_kbps;
+			if (kbps > peak_kbps)
+				peak_kbps = kbps;
+		}
+		if (hires_enabled)
+			peak_kbps = hires_kbps * 3 / 2;
+		if (clip_recorder_start(&recorder, record_dir, enCodecType == RK_VIDEO_ID_HEVC,
+				record_pre_s * 1000, record_post_s * 1000, peak_kbps) != 0) {
+			return 1;
+		}
+		venc_sink_add_consumer(hires_enabled ? &hires.sink : &venc_sink,
+			clip_recorder_venc_consumer, &recorder);
+		recorder_enabled = true;
+	}
+	// JPEG stills of targets on their own encoder channel, off the frame loop
+	static snapshot_t snapshots;
+	bool snapshots_enabled = false;
+	if (snapshot_dir) {
+		if (snapshot_start(&snapshots, snapshot_dir, snapshot_conf) != 0) {
+			return 1;
+		}
+		snapshots_enabled = true;
+	}
+	// Training frames with pseudo-labels, encoded and written at low priority
+	static dataset_capture_t dataset;
+	bool dataset_enabled = false;
+	if (dataset_dir) {
+		if (dataset_capture_start(&dataset, dataset_dir, width, height, dataset_rate_kb) != 0) {
+			return 1;
+		}
+		dataset_enabled = true;
+	}
+	if (hires_enabled && venc_hires_start(&hires) != 0) {
+		return -1;
+	}
+	if (venc_sink_start(&venc_sink) != 0) {
+		return -1;
+	}
+
 	// Init serial port
-	int serial_fd = uart_init(SERIAL_PORT_NUM, 115200);
+	int serial_fd = uart_init(SERIAL_PORT_NUM, SERIAL_BAUD);
 	if (serial_fd < 0) {
 		return 1;
 	}
@@ -152,50 +593,153 @@ int main(int argc, char *argv[]) {
 	// Test UART connection
 	uart_printf(serial_fd, "UART success!\n");
 
+	// From here on telemetry is queued; the frame loop never waits on the tty
+	if (uart_tx_start(serial_fd, SERIAL_TX_QUEUE) != 0) {
+		return 1;
+	}
+	uart_tx_stats_t uart_stats;
+
+	// Autopilot traffic (HEARTBEAT, ATTITUDE, TIMESYNC) is parsed on its own thread
+	static mavlink_parser_t mavlink_rx;
+	mavlink_parser_init(&mavlink_rx);
+	mavlink_comm_attach(&mavlink_rx, serial_fd);
+	param_mavlink_attach(&mavlink_rx, serial_fd);
+	if (mavlink_parser_start(&mavlink_rx, serial_fd) != 0) {
+		return 1;
+	}
+	mavlink_vehicle_state_t vehicle;
+
+	// Detections compete for the serial link's byte budget
+	static telemetry_sched_t telemetry;
+	telemetry_sched_init(&telemetry, serial_fd, SERIAL_BAUD, TELEMETRY_SHARE);
+	telemetry_sched_stats_t telemetry_stats;
+
+	// Detections keep their target_num from frame to frame
+	static target_tracker_t tracker;
+	target_tracker_init(&tracker);
+
+	// Targets get the bits; the background absorbs the CBR squeeze
+	venc_roi_t venc_roi;
+	venc_roi_init(&venc_roi, 0, width, height);
+
+	// ENC_PROFILE changes are applied to the live channel between frames
+	venc_profile_ctl_t venc_profile;
+	venc_profile_ctl_init(&venc_profile, 0, enCodecType, width, height, venc_profile_id);
+
+	// UDP has the bandwidth for every target; it runs next to the UART
+	static udp_link_t udp_link;
+	mavlink_transport_t udp_transport;
+	bool udp_enabled = false;
+	if (udp_ip[0]) {
+		if (udp_link_open(&udp_link, udp_ip, udp_port, 0) != 0) {
+			return 1;
+		}
+		mavlink_transport_udp(&udp_transport, &udp_link);
+		udp_enabled = true;
+	}
+
+	// Zoomed tiles for targets too small for the letterboxed frame; how many
+	// run per frame is DET_TILES
+	static tile_infer_t tiler;
+	if (tile_infer_init(&tiler, width, height, tile_size,
+			rknn_app_ctx.model_width, rknn_app_ctx.model_height) != 0) {
+		return 1;
+	}
+
+	// IVS motion detection deciding whether the NPU runs on a frame, and on
+	// which part of it; a pass-through while MOT_GATE is 0. Focus crops are
+	// tile sized, zoomed over the model input like a tile.
+	static motion_gate_t motion_gate;
+	motion_gate_init(&motion_gate, width, height, tiler.size, tiler.tiles[0].rect.height);
+
+	mavlink_target_t targets[OBJ_NUMB_MAX_SIZE];
+	RK_U32 frame_count = 0;
+
+	// Capture->telemetry latency over the current 100-frame window
+	long long tlm_latency, tlm_latency_sum = 0, tlm_latency_max = 0;
+	uint64_t enc_frames_prev = 0, enc_sum_prev = 0;
+	venc_sink_stats_t sink_stats;
+
 
 	// Profiling
-	long long t0, t1, t2;
+	long long t0, t1, t2, t_overlay, t_track, t3;
 
 	while (1)
 	{
 		// -----------------------------
 		// 1. GET CAMERA FRAME (NV12)
 		// -----------------------------
-		s32Ret = RK_MPI_VI_GetChnFrame(0, 0, &stViFrame, 0);
+		s32Ret = RK_MPI_VI_GetChnFrame(0, vi_chn, &stViFrame, 0);
 		if (s32Ret != RK_SUCCESS) 
 			continue;
 
-		void* vi_data = RK_MPI_MB_Handle2VirAddr(stViFrame.stVFrame.pMbBlk);
+		MB_BLK vi_blk = stViFrame.stVFrame.pMbBlk;
 
 		t0 = now_us();
 
+		// Hardware capture time; every later stage is stamped from it
+		long long capture_us = (long long)stViFrame.stVFrame.u64PTS;
+		if (capture_us <= 0 || capture_us > t0 || t0 - capture_us > 1000000)
+			capture_us = t0;
+
 		// -----------------------------
 		// 2. PREPROCESS → RKNN TENSOR
 		// -----------------------------
-		rga_letterbox_nv12_to_rknn(
-			vi_data, width, height,
-			&rknn_app_ctx,
-			640, 640,
-			&scale, &leftPadding, &topPadding
-		);
+		// Still scenes skip the NPU; lone motion gets a zoomed crop only
+		im_rect focus;
+		motion_gate_decision_t gate = motion_gate_decide(&motion_gate, &stViFrame,
+			(uint64_t)capture_us, &focus);
+		int tiles_run = 0;
+		od_results.count = 0;
+
+		if (gate == MOTION_GATE_FULL) {
+			rga_letterbox_nv12_to_rknn(
+				vi_blk, width, height,
+				&rknn_app_ctx,
+				rknn_app_ctx.model_width, rknn_app_ctx.model_height,
+				&scale, &leftPadding, &topPadding
+			);
+		} else if (gate == MOTION_GATE_FOCUS) {
+			rga_crop_nv12_to_rknn(vi_blk, width, height, focus, &rknn_app_ctx,
+				rknn_app_ctx.model_width, rknn_app_ctx.model_height);
+		}
 
 		t1 = now_us();
 
 		// -----------------------------
 		// 3. RUN YOLO INFERENCE
 		// -----------------------------
-		inference_yolov5_model(&rknn_app_ctx, &od_results);
+		if (gate == MOTION_GATE_FULL) {
+			inference_yolov5_model(&rknn_app_ctx, &od_results);
+
+			// Map inference coords back to screen coords
+			for (int i = 0; i < od_results.count; i++) {
+				image_rect_t* box = &od_results.results[i].box;
+				mapCoordinates(&box->left, &box->top);
+				mapCoordinates(&box->right, &box->bottom);
+			}
+
+			// This frame's share of the tiles, merged in by cross-tile NMS
+			tiles_run = tile_infer_run(&tiler, vi_blk, &rknn_app_ctx,
+				param_get_int(PARAM_DET_TILES), &od_results);
+		} else if (gate == MOTION_GATE_FOCUS) {
+			if (inference_yolov5_model(&rknn_app_ctx, &od_results) < 0)
+				od_results.count = 0;
+			tile_infer_map_results(&focus, rknn_app_ctx.model_width,
+				rknn_app_ctx.model_height, &od_results);
+		}
 
 		t2 = now_us();
+		motion_gate_done(&motion_gate, gate, od_results.count, t2 - t0, (uint64_t)capture_us);
 
 		// -----------------------------
 		// 4. COPY NV12 CAMERA → RGB888 DMA BUFFER
 		// -----------------------------
-		rga_buffer_t src_nv12 = wrapbuffer_virtualaddr(
-			vi_data, width, height, RK_FORMAT_YCbCr_420_SP
+		rga_buffer_t src_nv12 = wrapbuffer_handle(
+			rga_handle_from_mb(vi_blk), width, height, RK_FORMAT_YCbCr_420_SP
 		);
-		rga_buffer_t dst_rgb = wrapbuffer_virtualaddr(
-			data, width, height, RK_FORMAT_RGB_888
+		rga_buffer_t dst_rgb = wrapbuffer_handle(
+			rga_handle_from_mb(src_Blk), width, height, RK_FORMAT_RGB_888
 		);
 
 		// Convert NV12 camera to RGB888 display buffer
@@ -206,6 +750,9 @@ int main(int argc, char *argv[]) {
 		// -----------------------------
 		// 5. DRAW YOLO BOXES (ON RGB BUFFER)
 		// -----------------------------
+		int target_count = 0;
+		int box_color = param_get_int(PARAM_OVL_BOX_COLOR);
+		int box_thickness = param_get_int(PARAM_OVL_BOX_THICK);
 		for (int i = 0; i < od_results.count; i++)
 		{
 			object_detect_result* det = &(od_results.results[i]);
@@ -214,86 +761,242 @@ int main(int argc, char *argv[]) {
 			int sY = det->box.top;
 			int eX = det->box.right;
 			int eY = det->box.bottom;
-
-			// Map inference coords back to screen coords
-			mapCoordinates(&sX, &sY);
-			mapCoordinates(&eX, &eY);
 			
 			#ifdef PRINT_ON_SSH
 			printf("%s @ (%d %d %d %d) %.3f\n", coco_cls_to_name(det->cls_id),
 							 sX, sY, eX, eY, det->prop);
 			#endif
 							 
-			draw_box_rga(data, width, height,
+			draw_box_rga(src_Blk, width, height,
 						sX, sY,
 						eX - sX, eY - sY,
-						BOX_COLOR, BOX_THICKNESS);
-
-			// Send detection via MAVLink over UART
-			mavlink_send_detection(
-				serial_fd,
-				sX, sY, eX - sX, eY - sY,
-				det->prop,
-				det->cls_id,
-				i,
-				width, height
-			);
+						box_color, box_thickness);
+
+			// Collect for the per-frame MAVLink batch
+			mavlink_target_t* target = &targets[target_count++];
+			target->x = sX;
+			target->y = sY;
+			target->width = eX - sX;
+			target->height = eY - sY;
+			target->confidence = det->prop;
+			target->class_id = det->cls_id;
+		}
+
+		t_overlay = now_us();
+		t_track = t_overlay;
+
+		// A skipped frame, or a focus crop that found nothing, was never
+		// searched: it is not reported as "no targets", and the tracks coast
+		// to the next inferred frame instead of aging on it
+		bool inferred = gate == MOTION_GATE_FULL || target_count > 0;
+
+		if (inferred) {
+			// Stable IDs for telemetry, SEI and snapshots
+			target_tracker_update(&tracker, targets, target_count, capture_us);
+			t_track = now_us();
+
+			// Send the detections that fit the link budget in one MAVLink message
+			telemetry_sched_submit(&telemetry, targets, target_count, width, height, capture_us);
+			if (udp_enabled) {
+				// Whole frame leaves in one sendmmsg()
+				mavlink_send_detection_batch_on(&udp_transport, targets, target_count,
+					width, height, capture_us);
+				mavlink_transport_flush(&udp_transport);
+			}
 		}
 
+		t3 = now_us();
+		tlm_latency = t3 - capture_us;
+		tlm_latency_sum += tlm_latency;
+		if (tlm_latency > tlm_latency_max)
+			tlm_latency_max = tlm_latency;
+
+		// Lower QP around targets; only re-applied when the boxes move
+		if (inferred)
+			venc_roi_update(&venc_roi, targets, target_count, param_get_int(PARAM_ENC_ROI_QP));
+
+		// One consistent copy of the sink thread's counters per frame
+		venc_sink_get_stats(&venc_sink, &sink_stats);
+
+		// Profile switches reconfigure the running channel; RTSP stays up
+		int profile_req = param_get_int(PARAM_ENC_PROFILE);
+		if (profile_req != venc_profile.active &&
+			venc_profile_switch(&venc_profile, profile_req, &sink_stats) != 0)
+			param_set(PARAM_ENC_PROFILE, venc_profile.active, false);
+
+		// Detections ride in the video as SEI, matched to the frame by PTS
+		if (sei_enabled && inferred)
+			detection_sei_publish(capture_us, targets, target_count, width, height);
+
+		// The recorder's writer thread does the file I/O
+		if (recorder_enabled && target_count > 0)
+			clip_recorder_trigger(&recorder, capture_us);
+
+		// RGA crops run alongside the rest of the frame; the worker encodes
+		if (snapshots_enabled)
+			snapshot_offer(&snapshots, vi_blk, width, height, targets, target_count, capture_us);
+		// Labels must come from the whole frame; a focus crop misses the rest
+		if (dataset_enabled && gate == MOTION_GATE_FULL)
+			dataset_capture_offer(&dataset, vi_blk, targets, target_count, capture_us);
+
 		// -----------------------------
 		// 6. SEND RGB BUFFER TO ENCODER
 		// -----------------------------
 		h264_frame.stVFrame.pMbBlk   = src_Blk;
 		h264_frame.stVFrame.u32TimeRef = H264_TimeRef++;
-		h264_frame.stVFrame.u64PTS   = TEST_COMM_GetNowUs();
+		h264_frame.stVFrame.u64PTS   = capture_us;
 
+		// The encoded packet goes to RTSP from the venc_sink thread
 		RK_MPI_VENC_SendFrame(0, &h264_frame, 0);
 
 		// -----------------------------
-		// 7. GET ENCODED STREAM → RTSP
-		// -----------------------------
-		s32Ret = RK_MPI_VENC_GetStream(0, &stFrame, 0);
-		if (s32Ret == RK_SUCCESS)
-		{
-			void* pData = RK_MPI_MB_Handle2VirAddr(stFrame.pstPack->pMbBlk);
-
-			rtsp_tx_video(g_rtsp_session,
-						(uint8_t*)pData,
-						stFrame.pstPack->u32Len,
-						stFrame.pstPack->u64PTS);
-
-			rtsp_do_event(g_rtsplive);
-		}
-
-		// -----------------------------
-		// 8. RELEASE BUFFERS
+		// 7. RELEASE BUFFERS
 		// -----------------------------
-		RK_MPI_VI_ReleaseChnFrame(0, 0, &stViFrame);
-		RK_MPI_VENC_ReleaseStream(0, &stFrame);
+		// Snapshot crops and dataset copies read the camera frame until their fences signal
+		if (snapshots_enabled)
+			snapshot_frame_done(&snapshots);
+		if (dataset_enabled)
+			dataset_capture_frame_done(&dataset);
+		RK_MPI_VI_ReleaseChnFrame(0, vi_chn, &stViFrame);
 
 		// -----------------------------
-		// 9. PROFILING PRINT
+		// 8. PROFILING PRINT
 		// -----------------------------
-		printf("RGA Preprocess=%lld ms | NPU Inference=%lld ms\n",
+		printf("RGA Preprocess=%lld ms | NPU Inference=%lld ms (%s, %d tiles) | RGA Overlay=%lld us | Tracker=%lld us | Telemetry=%lld us | Capture->TLM=%lld us | Capture->ENC=%u us\n",
 			(t1 - t0) / 1000,
-			(t2 - t1) / 1000);
+			(t2 - t1) / 1000,
+			gate == MOTION_GATE_FULL ? "full" : (gate == MOTION_GATE_FOCUS ? "focus" : "skip"),
+			tiles_run,
+			t_overlay - t2,
+			t_track - t_overlay,
+			t3 - t_track,
+			tlm_latency,
+			sink_stats.latency_last_us);
+
+		// Keep the autopilot clock offset fresh (about 1 Hz)
+		if (frame_count % 20 == 0)
+			mavlink_timesync_request(serial_fd);
+
+		if (++frame_count % 100 == 0) {
+			uint64_t enc_frames = sink_stats.latency_frames;
+			uint64_t enc_sum = sink_stats.latency_sum_us;
+			printf("Latency: capture->TLM avg=%lld max=%lld us | capture->ENC avg=%llu max=%u us\n",
+				tlm_latency_sum / 100, tlm_latency_max,
+				(unsigned long long)(enc_frames > enc_frames_prev ?
+					(enc_sum - enc_sum_prev) / (enc_frames - enc_frames_prev) : 0),
+				sink_stats.latency_max_us);
+			tlm_latency_sum = 0;
+			tlm_latency_max = 0;
+			enc_frames_prev = enc_frames;
+			enc_sum_prev = enc_sum;
+
+			uart_tx_get_stats(&uart_stats);
+			printf("UART tx: queued=%llu sent=%llu dropped=%llu depth=%u max=%u\n",
+				(unsigned long long)uart_stats.enqueued,
+				(unsigned long long)uart_stats.sent_packets,
+				(unsigned long long)uart_stats.dropped_oldest,
+				uart_stats.depth, uart_stats.high_water);
+
+			telemetry_sched_get_stats(&telemetry, &telemetry_stats);
+			printf("Telemetry: offered=%llu sent=%llu coalesced=%llu shed=%llu link=%.0f%% queue_age=%u us max_wait=%u us\n",
+				(unsigned long long)telemetry_stats.offered,
+				(unsigned long long)telemetry_stats.sent,
+				(unsigned long long)telemetry_stats.coalesced,
+				(unsigned long long)telemetry_stats.shed,
+				telemetry_stats.utilisation * 100.0f,
+				telemetry_stats.queue_age_us, uart_stats.max_wait_us);
+
+			target_tracker_print_stats(&tracker);
+			if (tiler.stats.frames)
+				tile_infer_print_stats(&tiler);
+			motion_gate_print_stats(&motion_gate);
+
+			printf("VENC ROI: active=%u updates=%llu set_calls=%llu errors=%llu\n",
+				venc_roi.stats.active,
+				(unsigned long long)venc_roi.stats.updates,
+				(unsigned long long)venc_roi.stats.set_calls,
+				(unsigned long long)venc_roi.stats.errors);
+
+			venc_profile_sample(&venc_profile, &sink_stats);
+			venc_profile_print(&venc_profile);
+
+			// Sliced frames start streaming before the encoder finishes them
+			if (sink_stats.sliced_frames) {
+				uint64_t sliced = sink_stats.sliced_frames;
+				printf("VENC slices: %.1f per frame | capture->first slice avg=%llu us | first->last slice avg=%llu us | max gap=%u us\n",
+					(double)sink_stats.slices / sliced,
+					(unsigned long long)(sink_stats.first_slice_sum_us / (enc_frames ? enc_frames : 1)),
+					(unsigned long long)(sink_stats.slice_span_sum_us / sliced),
+					sink_stats.slice_gap_max_us);
+			}
+
+			if (rtsp_server_enabled)
+				rtsp_server_print_stats(&rtsp_server);
+			if (fec_video_enabled)
+				fec_video_tx_print_stats(&fec_video);
+			if (recorder_enabled)
+				clip_recorder_print_stats(&recorder);
+			if (hires_enabled)
+				venc_hires_print_stats(&hires, 0, &sink_stats, width * height);
+			if (snapshots_enabled)
+				snapshot_print_stats(&snapshots);
+			if (dataset_enabled)
+				dataset_capture_print_stats(&dataset);
+
+			if (udp_enabled) {
+				printf("UDP tx: datagrams=%llu bytes=%llu syscalls=%llu errors=%llu\n",
+					(unsigned long long)udp_link.stats.datagrams,
+					(unsigned long long)udp_link.stats.bytes,
+					(unsigned long long)udp_link.stats.syscalls,
+					(unsigned long long)udp_link.stats.errors);
+			}
+
+			mavlink_get_vehicle_state(&vehicle);
+			printf("MAVLink rx: frames=%llu bad_crc=%llu heartbeats=%llu attitude=%.1f/%.1f/%.1f deg timesync=%s rtt=%u us\n",
+				(unsigned long long)mavlink_rx.stats.frames,
+				(unsigned long long)mavlink_rx.stats.bad_crc,
+				(unsigned long long)vehicle.heartbeats,
+				vehicle.attitude.roll * 57.2958f,
+				vehicle.attitude.pitch * 57.2958f,
+				vehicle.attitude.yaw * 57.2958f,
+				vehicle.timesync_synced ? "locked" : "none",
+				vehicle.timesync_rtt_us);
+		}
 	} // while(1)
 
 
+	// Snapshot and dataset blocks are still imported into RGA until the cache goes
+	if (snapshots_enabled)
+		snapshot_stop(&snapshots);
+	if (dataset_enabled)
+		dataset_capture_stop(&dataset);
+
+	// Drop RGA imports before the buffers go away
+	rga_handle_cache_release();
+
 	// Destory MB
 	RK_MPI_MB_ReleaseMB(src_Blk);
 	// Destory Pool
 	RK_MPI_MB_DestroyPool(src_Pool);
 	
-	RK_MPI_VI_DisableChn(0, 0);
+	// Unbinds the main path before VI goes away
+	if (hires_enabled)
+		venc_hires_stop(&hires);
+	RK_MPI_VI_DisableChn(0, vi_chn);
 	RK_MPI_VI_DisableDev(0);
 
 	SAMPLE_COMM_ISP_Stop(0);
 	
 	RK_MPI_VENC_StopRecvFrame(0);
+	venc_sink_stop(&venc_sink);
+	if (rtsp_server_enabled)
+		rtsp_server_stop(&rtsp_server);
+	if (fec_video_enabled)
+		fec_video_tx_close(&fec_video);
+	if (recorder_enabled)
+		clip_recorder_stop(&recorder);
 	RK_MPI_VENC_DestroyChn(0);
-
-	free(stFrame.pstPack);
+	motion_gate_stop(&motion_gate);
 
 	if (g_rtsplive)
 		rtsp_del_demo(g_rtsplive);
@@ -301,7 +1004,11 @@ int main(int argc, char *argv[]) {
 	RK_MPI_SYS_Exit();
 
 	// Close UART
+	mavlink_parser_stop(&mavlink_rx);
+	uart_tx_stop();
 	uart_close(serial_fd);
+	if (udp_enabled)
+		udp_link_close(&udp_link);
 
 	// Release rknn model
     release_yolov5_model(&rknn_app_ctx);		
@@ -0,0 +1,325 @@
+#include "mavlink_codec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+// ---------------------------------------------------------------------------
+// CRC
+// ---------------------------------------------------------------------------
+
+// mavlink_crc_step(0, i): one table lookup replaces the per-byte shifts
+constexpr uint16_t mavlink_crc_table[256] = {
+    0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
+    0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
+    0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
+    0x9cc9, 0x8d40, 0xbfdb, 0xae52, 0xdaed, 0xcb64, 0xf9ff, 0xe876,
+    0x2102, 0x308b, 0x0210, 0x1399, 0x6726, 0x76af, 0x4434, 0x55bd,
+    0xad4a, 0xbcc3, 0x8e58, 0x9fd1, 0xeb6e, 0xfae7, 0xc87c, 0xd9f5,
+    0x3183, 0x200a, 0x1291, 0x0318, 0x77a7, 0x662e, 0x54b5, 0x453c,
+    0xbdcb, 0xac42, 0x9ed9, 0x8f50, 0xfbef, 0xea66, 0xd8fd, 0xc974,
+    0x4204, 0x538d, 0x6116, 0x709f, 0x0420, 0x15a9, 0x2732, 0x36bb,
+    0xce4c, 0xdfc5, 0xed5e, 0xfcd7, 0x8868, 0x99e1, 0xab7a, 0xbaf3,
+    0x5285, 0x430c, 0x7197, 0x601e, 0x14a1, 0x0528, 0x37b3, 0x263a,
+    0xdecd, 0xcf44, 0xfddf, 0xec56, 0x98e9, 0x8960, 0xbbfb, 0xaa72,
+    0x6306, 0x728f, 0x4014, 0x519d, 0x2522, 0x34ab, 0x0630, 0x17b9,
+    0xef4e, 0xfec7, 0xcc5c, 0xddd5, 0xa96a, 0xb8e3, 0x8a78, 0x9bf1,
+    0x7387, 0x620e, 0x5095, 0x411c, 0x35a3, 0x242a, 0x16b1, 0x0738,
+    0xffcf, 0xee46, 0xdcdd, 0xcd54, 0xb9eb, 0xa862, 0x9af9, 0x8b70,
+    0x8408, 0x9581, 0xa71a, 0xb693, 0xc22c, 0xd3a5, 0xe13e, 0xf0b7,
+    0x0840, 0x19c9, 0x2b52, 0x3adb, 0x4e64, 0x5fed, 0x6d76, 0x7cff,
+    0x9489, 0x8500, 0xb79b, 0xa612, 0xd2ad, 0xc324, 0xf1bf, 0xe036,
+    0x18c1, 0x0948, 0x3bd3, 0x2a5a, 0x5ee5, 0x4f6c, 0x7df7, 0x6c7e,
+    0xa50a, 0xb483, 0x8618, 0x9791, 0xe32e, 0xf2a7, 0xc03c, 0xd1b5,
+    0x2942, 0x38cb, 0x0a50, 0x1bd9, 0x6f66, 0x7eef, 0x4c74, 0x5dfd,
+    0xb58b, 0xa402, 0x9699, 0x8710, 0xf3af, 0xe226, 0xd0bd, 0xc134,
+    0x39c3, 0x284a, 0x1ad1, 0x0b58, 0x7fe7, 0x6e6e, 0x5cf5, 0x4d7c,
+    0xc60c, 0xd785, 0xe51e, 0xf497, 0x8028, 0x91a1, 0xa33a, 0xb2b3,
+    0x4a44, 0x5bcd, 0x6956, 0x78df, 0x0c60, 0x1de9, 0x2f72, 0x3efb,
+    0xd68d, 0xc704, 0xf59f, 0xe416, 0x90a9, 0x8120, 0xb3bb, 0xa232,
+    0x5ac5, 0x4b4c, 0x79d7, 0x685e, 0x1ce1, 0x0d68, 0x3ff3, 0x2e7a,
+    0xe70e, 0xf687, 0xc41c, 0xd595, 0xa12a, 0xb0a3, 0x8238, 0x93b1,
+    0x6b46, 0x7acf, 0x4854, 0x59dd, 0x2d62, 0x3ceb, 0x0e70, 0x1ff9,
+    0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
+    0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78,
+};
+
+static_assert(mavlink_crc_table[1] == mavlink_crc_step(0, 1), "CRC-16/MCRF4XX table");
+
+// Slicing-by-4: slice[k][i] is the CRC contribution of byte i followed by k
+// zero bytes, so four input bytes cost four independent lookups
+struct crc_slice_tables {
+    uint16_t t[4][256];
+    constexpr crc_slice_tables() : t() {
+        for (int i = 0; i < 256; i++) {
+            t[0][i] = mavlink_crc_table[i];
+            for (int k = 1; k < 4; k++)
+                t[k][i] = (t[k - 1][i] >> 8) ^ mavlink_crc_table[t[k - 1][i] & 0xFF];
+        }
+    }
+};
+
+static constexpr crc_slice_tables crc_slice;
+
+uint16_t mavlink_crc_accumulate_buffer(uint16_t crc, const uint8_t* data, size_t length)
+{
+    while (length >= 4) {
+        uint32_t x = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                            ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+        crc = crc_slice.t[3][x & 0xFF] ^ crc_slice.t[2][(x >> 8) & 0xFF] ^
+              crc_slice.t[1][(x >> 16) & 0xFF] ^ crc_slice.t[0][x >> 24];
+        data += 4;
+        length -= 4;
+    }
+    while (length--)
+        crc = mavlink_crc_accumulate(*data++, crc);
+    return crc;
+}
+
+uint16_t mavlink_crc_calculate(const uint8_t* data, size_t length)
+{
+    return mavlink_crc_accumulate_buffer(0xFFFF, data, length);
+}
+
+uint16_t mavlink_crc_calculate_bitwise(const uint8_t* data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < length; i++) {
+        uint8_t tmp = data[i] ^ (uint8_t)(crc & 0xFF);
+        tmp ^= (tmp << 4);
+        crc = (crc >> 8) ^ (tmp << 8) ^ (tmp << 3) ^ (tmp >> 4);
+    }
+
+    return crc;
+}
+
+// ---------------------------------------------------------------------------
+// Message definitions (wire order, base fields only)
+// ---------------------------------------------------------------------------
+
+static constexpr mavlink_field_def HEARTBEAT_FIELDS[] = {
+    { "uint32_t", "custom_mode", 0 },
+    { "uint8_t", "type", 0 },
+    { "uint8_t", "autopilot", 0 },
+    { "uint8_t", "base_mode", 0 },
+    { "uint8_t", "system_status", 0 },
+    { "uint8_t", "mavlink_version", 0 },
+};
+
+static constexpr mavlink_field_def PARAM_REQUEST_READ_FIELDS[] = {
+    { "int16_t", "param_index", 0 },
+    { "uint8_t", "target_system", 0 },
+    { "uint8_t", "target_component", 0 },
+    { "char", "param_id", 16 },
+};
+
+static constexpr mavlink_field_def PARAM_REQUEST_LIST_FIELDS[] = {
+    { "uint8_t", "target_system", 0 },
+    { "uint8_t", "target_component", 0 },
+};
+
+static constexpr mavlink_field_def PARAM_VALUE_FIELDS[] = {
+    { "float", "param_value", 0 },
+    { "uint16_t", "param_count", 0 },
+    { "uint16_t", "param_index", 0 },
+    { "char", "param_id", 16 },
+    { "uint8_t", "param_type", 0 },
+};
+
+static constexpr mavlink_field_def PARAM_SET_FIELDS[] = {
+    { "float", "param_value", 0 },
+    { "uint8_t", "target_system", 0 },
+    { "uint8_t", "target_component", 0 },
+    { "char", "param_id", 16 },
+    { "uint8_t", "param_type", 0 },
+};
+
+static constexpr mavlink_field_def ATTITUDE_FIELDS[] = {
+    { "uint32_t", "time_boot_ms", 0 },
+    { "float", "roll", 0 },
+    { "float", "pitch", 0 },
+    { "float", "yaw", 0 },
+    { "float", "rollspeed", 0 },
+    { "float", "pitchspeed", 0 },
+    { "float", "yawspeed", 0 },
+};
+
+static constexpr mavlink_field_def TIMESYNC_FIELDS[] = {
+    { "int64_t", "tc1", 0 },
+    { "int64_t", "ts1", 0 },
+};
+
+static constexpr mavlink_field_def UAV_DETECTION_FIELDS[] = {
+    { "uint64_t", "time_usec", 0 },
+    { "float", "x", 0 },
+    { "float", "y", 0 },
+    { "float", "width", 0 },
+    { "float", "height", 0 },
+    { "float", "confidence", 0 },
+    { "uint8_t", "target_num", 0 },
+    { "uint8_t", "class_id", 0 },
+};
+
+// Targets are 11-byte records; on the wire they are an opaque byte array
+static constexpr mavlink_field_def UAV_DETECTION_BATCH_FIELDS[] = {
+    { "uint64_t", "time_usec", 0 },
+    { "uint8_t", "count", 0 },
+    { "uint8_t", "targets", 242 },
+};
+
+// Guard the generator against the published common.xml seeds
+static_assert(mavlink_crc_extra("HEARTBEAT", HEARTBEAT_FIELDS) == 50, "HEARTBEAT CRC_EXTRA");
+static_assert(mavlink_crc_extra("PARAM_REQUEST_READ", PARAM_REQUEST_READ_FIELDS) == 214, "PARAM_REQUEST_READ CRC_EXTRA");
+static_assert(mavlink_crc_extra("PARAM_REQUEST_LIST", PARAM_REQUEST_LIST_FIELDS) == 159, "PARAM_REQUEST_LIST CRC_EXTRA");
+static_assert(mavlink_crc_extra("PARAM_VALUE", PARAM_VALUE_FIELDS) == 220, "PARAM_VALUE CRC_EXTRA");
+static_assert(mavlink_crc_extra("PARAM_SET", PARAM_SET_FIELDS) == 168, "PARAM_SET CRC_EXTRA");
+static_assert(mavlink_crc_extra("ATTITUDE", ATTITUDE_FIELDS) == 39, "ATTITUDE CRC_EXTRA");
+static_assert(mavlink_crc_extra("TIMESYNC", TIMESYNC_FIELDS) == 34, "TIMESYNC CRC_EXTRA");
+
+typedef struct {
+    uint32_t msgid;
+    uint8_t crc_extra;
+    uint8_t max_len;
+} mavlink_msg_entry_t;
+
+// Sorted by msgid for the binary search in mavlink_msg_lookup()
+static const mavlink_msg_entry_t msg_table[] = {
+    { MAVLINK_MSG_ID_HEARTBEAT, mavlink_crc_extra("HEARTBEAT", HEARTBEAT_FIELDS), 9 },
+    { MAVLINK_MSG_ID_PARAM_REQUEST_READ, mavlink_crc_extra("PARAM_REQUEST_READ", PARAM_REQUEST_READ_FIELDS), 20 },
+    { MAVLINK_MSG_ID_PARAM_REQUEST_LIST, mavlink_crc_extra("PARAM_REQUEST_LIST", PARAM_REQUEST_LIST_FIELDS), 2 },
+    { MAVLINK_MSG_ID_PARAM_VALUE, mavlink_crc_extra("PARAM_VALUE", PARAM_VALUE_FIELDS), 25 },
+    { MAVLINK_MSG_ID_PARAM_SET, mavlink_crc_extra("PARAM_SET", PARAM_SET_FIELDS), 23 },
+    { MAVLINK_MSG_ID_ATTITUDE, mavlink_crc_extra("ATTITUDE", ATTITUDE_FIELDS), 28 },
+    { MAVLINK_MSG_ID_TIMESYNC, mavlink_crc_extra("TIMESYNC", TIMESYNC_FIELDS), 18 },
+    { MAVLINK_MSG_ID_UAV_DETECTION, mavlink_crc_extra("UAV_DETECTION", UAV_DETECTION_FIELDS), 30 },
+    { MAVLINK_MSG_ID_UAV_DETECTION_BATCH, mavlink_crc_extra("UAV_DETECTION_BATCH", UAV_DETECTION_BATCH_FIELDS), 251 },
+};
+
+int mavlink_msg_lookup(uint32_t msgid, uint8_t* crc_extra, uint8_t* max_len)
+{
+    int lo = 0;
+    int hi = (int)(sizeof(msg_table) / sizeof(msg_table[0])) - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (msg_table[mid].msgid == msgid) {
+            *crc_extra = msg_table[mid].crc_extra;
+            *max_len = msg_table[mid].max_len;
+            return 0;
+        }
+        if (msg_table[mid].msgid < msgid)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+
+// ---------------------------------------------------------------------------
+// Serializer
+// ---------------------------------------------------------------------------
+
+int mavlink_finalize(uint8_t* frame, uint8_t seq, uint8_t sysid, uint8_t compid,
+                     uint32_t msgid, uint8_t payload_len)
+{
+    uint8_t crc_extra, max_len;
+    if (mavlink_msg_lookup(msgid, &crc_extra, &max_len) != 0 || payload_len > max_len) {
+        fprintf(stderr, "MAVLink: cannot serialise message %u (%u bytes)\n",
+                msgid, payload_len);
+        return -1;
+    }
+
+    // MAVLink v2 payload truncation: drop trailing zeros, keep at least one byte
+    const uint8_t* payload = frame + MAVLINK_HEADER_LEN;
+    while (payload_len > 1 && payload[payload_len - 1] == 0)
+        payload_len--;
+
+    frame[0] = MAVLINK_STX_V2;
+    frame[1] = payload_len;
+    frame[2] = 0;                       // incompat_flags
+    frame[3] = 0;                       // compat_flags
+    frame[4] = seq;
+    frame[5] = sysid;
+    frame[6] = compid;
+    frame[7] = msgid & 0xFF;
+    frame[8] = (msgid >> 8) & 0xFF;
+    frame[9] = (msgid >> 16) & 0xFF;
+
+    // Header + payload, excluding magic byte, then the per-message seed
+    uint16_t crc = mavlink_crc_calculate(frame + 1, MAVLINK_HEADER_LEN - 1 + payload_len);
+    crc = mavlink_crc_accumulate(crc_extra, crc);
+
+    uint8_t* ck = frame + MAVLINK_HEADER_LEN + payload_len;
+    ck[0] = crc & 0xFF;
+    ck[1] = (crc >> 8) & 0xFF;
+
+    return MAVLINK_HEADER_LEN + payload_len + MAVLINK_CHECKSUM_LEN;
+}
+
+int mavlink_serialize(uint8_t* out, size_t out_size,
+                      uint8_t seq, uint8_t sysid, uint8_t compid,
+                      uint32_t msgid, const void* payload, uint8_t payload_len)
+{
+    if (out_size < (size_t)MAVLINK_HEADER_LEN + payload_len + MAVLINK_CHECKSUM_LEN) {
+        fprintf(stderr, "MAVLink buffer too small\n");
+        return -1;
+    }
+    memcpy(out + MAVLINK_HEADER_LEN, payload, payload_len);
+    return mavlink_finalize(out, seq, sysid, compid, msgid, payload_len);
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark
+// ---------------------------------------------------------------------------
+
+static double elapsed_s(const struct timeval* t0, const struct timeval* t1)
+{
+    return (t1->tv_sec - t0->tv_sec) + (t1->tv_usec - t0->tv_usec) / 1e6;
+}
+
+void mavlink_codec_benchmark(size_t bytes)
+{
+    uint8_t* data = (uint8_t*)malloc(bytes);
+    if (!data) {
+        fprintf(stderr, "MAVLink codec benchmark: allocation failed\n");
+        return;
+    }
+    unsigned int seed = 1;
+    for (size_t i = 0; i < bytes; i++)
+        data[i] = (uint8_t)rand_r(&seed);
+
+    // Checksum whole frames' worth at a time, like the serializer does
+    struct timeval t0, t1, t2;
+    uint16_t crc_bit = 0, crc_tab = 0;
+    gettimeofday(&t0, NULL);
+    for (size_t off = 0; off < bytes; off += 256)
+        crc_bit ^= mavlink_crc_calculate_bitwise(data + off, bytes - off < 256 ? bytes - off : 256);
+    gettimeofday(&t1, NULL);
+    for (size_t off = 0; off < bytes; off += 256)
+        crc_tab ^= mavlink_crc_calculate(data + off, bytes - off < 256 ? bytes - off : 256);
+    gettimeofday(&t2, NULL);
+
+    double s_bit = elapsed_s(&t0, &t1);
+    double s_tab = elapsed_s(&t1, &t2);
+    printf("MAVLink CRC: bitwise %.1f MB/s, table %.1f MB/s (%s)\n",
+           s_bit > 0 ? bytes / s_bit / 1e6 : 0.0,
+           s_tab > 0 ? bytes / s_tab / 1e6 : 0.0,
+           crc_bit == crc_tab ? "match" : "MISMATCH");
+
+    // Full-size batch frames serialised in place
+    uint8_t frame[MAVLINK_MAX_FRAME_LEN];
+    const int frames = 200000;
+    gettimeofday(&t0, NULL);
+    for (int i = 0; i < frames; i++) {
+        memcpy(frame + MAVLINK_HEADER_LEN, data + (i % 1024), 251);
+        mavlink_finalize(frame, (uint8_t)i, 1, 1, MAVLINK_MSG_ID_UAV_DETECTION_BATCH, 251);
+    }
+    gettimeofday(&t1, NULL);
+
+    double s_ser = elapsed_s(&t0, &t1);
+    printf("MAVLink serializer: %.2f us per 251-byte frame\n",
+           s_ser * 1e6 / frames);
+
+    free(data);
+}
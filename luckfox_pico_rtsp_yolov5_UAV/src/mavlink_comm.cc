@@ -1,35 +1,166 @@
 #include "mavlink_comm.h"
+#include "mavlink_codec.h"
 #include "uart_comm.h"
+#include "udp_link.h"
 #include <string.h>
-#include <sys/time.h>
+#include <time.h>
 #include <stdio.h>
-
-// MAVLink v2 constants
-#define MAVLINK_STX 0xFD
-#define MAVLINK_DETECTION_MSG_ID 9000  // Custom message ID for detection
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
 
 // System and component IDs
 static uint8_t system_id = 1;
 static uint8_t component_id = 1;
 static uint8_t msg_seq = 0;
 
-// CRC-16/MCRF4XX (MAVLink checksum)
-static uint16_t crc_calculate(const uint8_t* data, uint16_t length) {
-    uint16_t crc = 0xFFFF;
-    
-    for (uint16_t i = 0; i < length; i++) {
-        uint8_t tmp = data[i] ^ (uint8_t)(crc & 0xFF);
-        tmp ^= (tmp << 4);
-        crc = (crc >> 8) ^ (tmp << 8) ^ (tmp << 3) ^ (tmp >> 4);
+// Same clock as the VI/VENC PTS (CLOCK_MONOTONIC), so timestamps compare
+static uint64_t get_time_usec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static int64_t get_time_nsec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+uint8_t mavlink_system_id(void) {
+    return system_id;
+}
+
+uint8_t mavlink_component_id(void) {
+    return component_id;
+}
+
+// Senders run on the frame loop and on the receive thread
+static uint8_t next_seq() {
+    return __sync_fetch_and_add(&msg_seq, 1);
+}
+
+// ---------------------------------------------------------------------------
+// Transports
+// ---------------------------------------------------------------------------
+
+static uint8_t* uart_reserve(void* ctx) {
+    return uart_tx_reserve((int)(intptr_t)ctx);
+}
+
+static int uart_commit(void* ctx, size_t length) {
+    return uart_tx_commit(length);
+}
+
+static void uart_abort(void* ctx) {
+    uart_tx_abort();
+}
+
+static int uart_send(void* ctx, const uint8_t* data, size_t length) {
+    return uart_write((int)(intptr_t)ctx, data, length);
+}
+
+void mavlink_transport_uart(mavlink_transport_t* transport, int uart_fd) {
+    memset(transport, 0, sizeof(*transport));
+    transport->name = "uart";
+    transport->ctx = (void*)(intptr_t)uart_fd;
+    transport->reserve = uart_reserve;
+    transport->commit = uart_commit;
+    transport->abort = uart_abort;
+    transport->send = uart_send;
+}
+
+static uint8_t* udp_reserve(void* ctx) {
+    return udp_link_reserve((udp_link_t*)ctx);
+}
+
+static int udp_commit(void* ctx, size_t length) {
+    return udp_link_commit((udp_link_t*)ctx, length);
+}
+
+static void udp_abort(void* ctx) {
+    udp_link_abort((udp_link_t*)ctx);
+}
+
+static int udp_send(void* ctx, const uint8_t* data, size_t length) {
+    return udp_link_send((udp_link_t*)ctx, data, length);
+}
+
+static int udp_flush(void* ctx) {
+    return udp_link_flush((udp_link_t*)ctx);
+}
+
+void mavlink_transport_udp(mavlink_transport_t* transport, udp_link_t* link) {
+    memset(transport, 0, sizeof(*transport));
+    transport->name = "udp";
+    transport->ctx = link;
+    transport->reserve = udp_reserve;
+    transport->commit = udp_commit;
+    transport->abort = udp_abort;
+    transport->send = udp_send;
+    transport->flush = udp_flush;
+}
+
+int mavlink_transport_flush(const mavlink_transport_t* transport) {
+    return transport->flush ? transport->flush(transport->ctx) : 0;
+}
+
+// Frame to serialise into: a slot owned by the transport (UART ring, UDP
+// batch) when it has one free, otherwise the caller's stack buffer
+static uint8_t* tx_begin(const mavlink_transport_t* t, uint8_t* fallback, bool* reserved) {
+    uint8_t* slot = t->reserve ? t->reserve(t->ctx) : NULL;
+    *reserved = slot != NULL;
+    return slot ? slot : fallback;
+}
+
+// Finalise the payload at frame + MAVLINK_HEADER_LEN and hand it over
+static int tx_end(const mavlink_transport_t* t, uint8_t* frame, bool reserved,
+                  uint32_t msgid, uint8_t payload_len) {
+    int len = mavlink_finalize(frame, next_seq(), system_id, component_id,
+                               msgid, payload_len);
+    if (reserved) {
+        if (len < 0) {
+            t->abort(t->ctx);
+            return -1;
+        }
+        return t->commit(t->ctx, len);
     }
-    
-    return crc;
+    return len < 0 ? -1 : t->send(t->ctx, frame, len);
 }
 
-static uint64_t get_time_usec() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (uint64_t)tv.tv_sec * 1000000ULL + (uint64_t)tv.tv_usec;
+int mavlink_send_message_on(const mavlink_transport_t* transport, uint32_t msgid,
+                            const void* payload, uint8_t payload_len) {
+    uint8_t fallback[MAVLINK_MAX_FRAME_LEN];
+    bool reserved;
+    uint8_t* frame = tx_begin(transport, fallback, &reserved);
+
+    memcpy(frame + MAVLINK_HEADER_LEN, payload, payload_len);
+    return tx_end(transport, frame, reserved, msgid, payload_len);
+}
+
+int mavlink_send_message(int uart_fd, uint32_t msgid,
+                         const void* payload, uint8_t payload_len) {
+    mavlink_transport_t uart;
+    mavlink_transport_uart(&uart, uart_fd);
+    return mavlink_send_message_on(&uart, msgid, payload, payload_len);
+}
+
+static void fill_detection(
+    mavlink_detection_payload_t* payload,
+    int x, int y, int width, int height,
+    float confidence, uint8_t class_id, uint8_t target_num,
+    int frame_width, int frame_height
+) {
+    // Calculate normalized coordinates (-1 to 1, center is 0)
+    payload->time_usec = mavlink_board_to_autopilot_us(get_time_usec());
+    payload->x = ((float)x / frame_width) * 2.0f - 1.0f;
+    payload->y = ((float)y / frame_height) * 2.0f - 1.0f;
+    payload->width = (float)width / frame_width;
+    payload->height = (float)height / frame_height;
+    payload->confidence = confidence;
+    payload->target_num = target_num;
+    payload->class_id = class_id;
 }
 
 int mavlink_pack_detection(
@@ -38,59 +169,12 @@ int mavlink_pack_detection(
     int frame_width, int frame_height,
     uint8_t* buffer, int buffer_size
 ) {
-    // Calculate normalized coordinates (-1 to 1, center is 0)
-    float norm_x = ((float)x / frame_width) * 2.0f - 1.0f;
-    float norm_y = ((float)y / frame_height) * 2.0f - 1.0f;
-    float norm_width = (float)width / frame_width;
-    float norm_height = (float)height / frame_height;
-    
-    // Create payload
     mavlink_detection_payload_t payload;
-    payload.time_usec = get_time_usec();
-    payload.x = norm_x;
-    payload.y = norm_y;
-    payload.width = norm_width;
-    payload.height = norm_height;
-    payload.confidence = confidence;
-    payload.target_num = target_num;
-    payload.class_id = class_id;
-    
-    uint8_t payload_len = sizeof(mavlink_detection_payload_t);
-    
-    // Check buffer size
-    int total_len = 10 + payload_len + 2; // header + payload + checksum
-    if (buffer_size < total_len) {
-        fprintf(stderr, "MAVLink buffer too small\n");
-        return -1;
-    }
-    
-    // Build MAVLink message
-    uint8_t* ptr = buffer;
-    
-    // Header
-    *ptr++ = MAVLINK_STX;                    // magic
-    *ptr++ = payload_len;                    // length
-    *ptr++ = 0;                              // incompat_flags
-    *ptr++ = 0;                              // compat_flags
-    *ptr++ = msg_seq++;                      // sequence
-    *ptr++ = system_id;                      // sysid
-    *ptr++ = component_id;                   // compid
-    *ptr++ = MAVLINK_DETECTION_MSG_ID & 0xFF;        // msgid low
-    *ptr++ = (MAVLINK_DETECTION_MSG_ID >> 8) & 0xFF; // msgid mid
-    *ptr++ = (MAVLINK_DETECTION_MSG_ID >> 16) & 0xFF;// msgid high
-    
-    // Payload
-    memcpy(ptr, &payload, payload_len);
-    ptr += payload_len;
-    
-    // Calculate checksum (header + payload, excluding magic byte)
-    uint16_t checksum = crc_calculate(buffer + 1, 9 + payload_len);
-    
-    // Add checksum
-    *ptr++ = checksum & 0xFF;
-    *ptr++ = (checksum >> 8) & 0xFF;
-    
-    return total_len;
+    fill_detection(&payload, x, y, width, height, confidence, class_id, target_num,
+                   frame_width, frame_height);
+
+    return mavlink_serialize(buffer, buffer_size, next_seq(), system_id, component_id,
+                             MAVLINK_MSG_ID_UAV_DETECTION, &payload, sizeof(payload));
 }
 
 int mavlink_send_detection(
@@ -99,19 +183,364 @@ int mavlink_send_detection(
     float confidence, uint8_t class_id, uint8_t target_num,
     int frame_width, int frame_height
 ) {
-    uint8_t buffer[280]; // MAVLink max message size
-    
-    int msg_len = mavlink_pack_detection(
-        x, y, width, height,
-        confidence, class_id, target_num,
-        frame_width, frame_height,
-        buffer, sizeof(buffer)
-    );
-    
-    if (msg_len < 0) {
+    mavlink_transport_t uart;
+    mavlink_transport_uart(&uart, uart_fd);
+
+    uint8_t fallback[MAVLINK_MAX_FRAME_LEN];
+    bool reserved;
+    uint8_t* frame = tx_begin(&uart, fallback, &reserved);
+
+    // Built in place in the transmit slot
+    fill_detection((mavlink_detection_payload_t*)(frame + MAVLINK_HEADER_LEN),
+                   x, y, width, height, confidence, class_id, target_num,
+                   frame_width, frame_height);
+    return tx_end(&uart, frame, reserved, MAVLINK_MSG_ID_UAV_DETECTION,
+                  sizeof(mavlink_detection_payload_t));
+}
+
+// Quantise a normalised value to int16 (full scale = 1.0)
+static int16_t quantize_norm(float v) {
+    if (v > 1.0f) v = 1.0f;
+    if (v < -1.0f) v = -1.0f;
+    return (int16_t)(v * 32767.0f + (v >= 0 ? 0.5f : -0.5f));
+}
+
+static void fill_batch(
+    mavlink_detection_batch_payload_t* payload,
+    uint64_t time_usec,
+    const mavlink_target_t* targets, int count,
+    int frame_width, int frame_height
+) {
+    if (count > MAVLINK_BATCH_MAX_TARGETS) {
+        count = MAVLINK_BATCH_MAX_TARGETS;
+    }
+
+    // Unused slots stay zero so truncation removes them
+    memset(payload, 0, sizeof(*payload));
+    payload->time_usec = time_usec;
+    payload->count = (uint8_t)count;
+
+    for (int i = 0; i < count; i++) {
+        const mavlink_target_t* t = &targets[i];
+        mavlink_batch_target_t* q = &payload->targets[i];
+        float conf = t->confidence < 0.0f ? 0.0f : (t->confidence > 1.0f ? 1.0f : t->confidence);
+
+        q->x = quantize_norm(((float)t->x / frame_width) * 2.0f - 1.0f);
+        q->y = quantize_norm(((float)t->y / frame_height) * 2.0f - 1.0f);
+        q->width = quantize_norm((float)t->width / frame_width);
+        q->height = quantize_norm((float)t->height / frame_height);
+        q->confidence = (uint8_t)(conf * 255.0f + 0.5f);
+        q->class_id = t->class_id;
+        q->target_num = t->target_num;
+    }
+}
+
+int mavlink_pack_detection_batch(
+    const mavlink_target_t* targets, int count,
+    int frame_width, int frame_height, uint64_t capture_us,
+    uint8_t* buffer, int buffer_size
+) {
+    mavlink_detection_batch_payload_t payload;
+    fill_batch(&payload, mavlink_board_to_autopilot_us(capture_us ? capture_us : get_time_usec()),
+               targets, count, frame_width, frame_height);
+
+    return mavlink_serialize(buffer, buffer_size, next_seq(), system_id, component_id,
+                             MAVLINK_MSG_ID_UAV_DETECTION_BATCH, &payload, sizeof(payload));
+}
+
+int mavlink_send_detection_batch_on(
+    const mavlink_transport_t* transport,
+    const mavlink_target_t* targets, int count,
+    int frame_width, int frame_height, uint64_t capture_us
+) {
+    uint64_t time_usec = mavlink_board_to_autopilot_us(capture_us ? capture_us : get_time_usec());
+    int sent = 0;
+
+    for (int first = 0; first < count; first += MAVLINK_BATCH_MAX_TARGETS) {
+        int n = count - first;
+        if (n > MAVLINK_BATCH_MAX_TARGETS) {
+            n = MAVLINK_BATCH_MAX_TARGETS;
+        }
+
+        uint8_t fallback[MAVLINK_MAX_FRAME_LEN];
+        bool reserved;
+        uint8_t* frame = tx_begin(transport, fallback, &reserved);
+
+        // Built in place in the transmit slot
+        fill_batch((mavlink_detection_batch_payload_t*)(frame + MAVLINK_HEADER_LEN),
+                   time_usec, targets + first, n, frame_width, frame_height);
+        int ret = tx_end(transport, frame, reserved, MAVLINK_MSG_ID_UAV_DETECTION_BATCH,
+                         sizeof(mavlink_detection_batch_payload_t));
+        if (ret < 0) {
+            return -1;
+        }
+        sent += ret;
+    }
+
+    return sent;
+}
+
+int mavlink_send_detection_batch(
+    int uart_fd,
+    const mavlink_target_t* targets, int count,
+    int frame_width, int frame_height, uint64_t capture_us
+) {
+    mavlink_transport_t uart;
+    mavlink_transport_uart(&uart, uart_fd);
+    return mavlink_send_detection_batch_on(&uart, targets, count,
+                                           frame_width, frame_height, capture_us);
+}
+
+// Latest autopilot state, written on the parser thread
+static mavlink_vehicle_state_t vehicle_state;
+static pthread_mutex_t vehicle_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void on_heartbeat(const mavlink_frame_t* frame, void* user) {
+    mavlink_heartbeat_t msg;
+    mavlink_frame_decode(frame, &msg, sizeof(msg));
+
+    pthread_mutex_lock(&vehicle_lock);
+    if (vehicle_state.heartbeats == 0) {
+        printf("MAVLink: heartbeat from system %u component %u (type %u, autopilot %u)\n",
+               frame->sysid, frame->compid, msg.type, msg.autopilot);
+    }
+    vehicle_state.heartbeats++;
+    vehicle_state.heartbeat_time_us = get_time_usec();
+    vehicle_state.sysid = frame->sysid;
+    vehicle_state.compid = frame->compid;
+    vehicle_state.heartbeat = msg;
+    pthread_mutex_unlock(&vehicle_lock);
+}
+
+static void on_attitude(const mavlink_frame_t* frame, void* user) {
+    mavlink_attitude_t msg;
+    mavlink_frame_decode(frame, &msg, sizeof(msg));
+
+    pthread_mutex_lock(&vehicle_lock);
+    vehicle_state.attitude_time_us = get_time_usec();
+    vehicle_state.attitude = msg;
+    pthread_mutex_unlock(&vehicle_lock);
+}
+
+// Round trips slower than this are too skewed to trust
+#define TIMESYNC_MAX_RTT_NS 50000000LL
+
+static int timesync_uart_fd = -1;
+static int64_t timesync_pending_ts1;        // Our last request, 0 when none
+
+static void on_timesync(const mavlink_frame_t* frame, void* user) {
+    mavlink_timesync_t msg;
+    mavlink_frame_decode(frame, &msg, sizeof(msg));
+    int64_t now_ns = get_time_nsec();
+
+    if (msg.tc1 == 0) {
+        // Request from the autopilot: answer with our clock
+        mavlink_timesync_t reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.tc1 = now_ns;
+        reply.ts1 = msg.ts1;
+        reply.target_system = frame->sysid;
+        reply.target_component = frame->compid;
+        if (timesync_uart_fd >= 0) {
+            mavlink_send_message(timesync_uart_fd, MAVLINK_MSG_ID_TIMESYNC, &reply, sizeof(reply));
+        }
+        return;
+    }
+
+    // Response: only our own outstanding request yields a usable round trip
+    pthread_mutex_lock(&vehicle_lock);
+    vehicle_state.timesync_time_us = now_ns / 1000;
+    vehicle_state.timesync = msg;
+
+    int64_t rtt = now_ns - msg.ts1;
+    if (msg.ts1 == timesync_pending_ts1 && rtt >= 0 && rtt < TIMESYNC_MAX_RTT_NS) {
+        // Autopilot clock read at the midpoint of the round trip
+        int64_t offset = msg.tc1 + rtt / 2 - now_ns;
+        if (!vehicle_state.timesync_synced) {
+            vehicle_state.timesync_offset_ns = offset;
+            vehicle_state.timesync_synced = 1;
+            printf("MAVLink: time synced to system %u, offset %lld us, rtt %lld us\n",
+                   frame->sysid, (long long)(offset / 1000), (long long)(rtt / 1000));
+        } else {
+            // Exponential filter (1/8) against serial jitter
+            vehicle_state.timesync_offset_ns += (offset - vehicle_state.timesync_offset_ns) / 8;
+        }
+        vehicle_state.timesync_rtt_us = (uint32_t)(rtt / 1000);
+        timesync_pending_ts1 = 0;
+    }
+    pthread_mutex_unlock(&vehicle_lock);
+}
+
+int mavlink_timesync_request(int uart_fd) {
+    mavlink_timesync_t req;
+    memset(&req, 0, sizeof(req));
+    req.ts1 = get_time_nsec();
+
+    pthread_mutex_lock(&vehicle_lock);
+    timesync_pending_ts1 = req.ts1;
+    pthread_mutex_unlock(&vehicle_lock);
+
+    return mavlink_send_message(uart_fd, MAVLINK_MSG_ID_TIMESYNC, &req, sizeof(req));
+}
+
+uint64_t mavlink_board_to_autopilot_us(uint64_t board_us) {
+    pthread_mutex_lock(&vehicle_lock);
+    int synced = vehicle_state.timesync_synced;
+    int64_t offset_ns = vehicle_state.timesync_offset_ns;
+    pthread_mutex_unlock(&vehicle_lock);
+
+    if (!synced) {
+        return board_us;
+    }
+    return (uint64_t)((int64_t)board_us + offset_ns / 1000);
+}
+
+int mavlink_comm_attach(mavlink_parser_t* parser, int uart_fd) {
+    timesync_uart_fd = uart_fd;
+
+    if (mavlink_parser_register(parser, MAVLINK_MSG_ID_HEARTBEAT, on_heartbeat, NULL) != 0 ||
+        mavlink_parser_register(parser, MAVLINK_MSG_ID_ATTITUDE, on_attitude, NULL) != 0 ||
+        mavlink_parser_register(parser, MAVLINK_MSG_ID_TIMESYNC, on_timesync, NULL) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void mavlink_get_vehicle_state(mavlink_vehicle_state_t* state) {
+    pthread_mutex_lock(&vehicle_lock);
+    *state = vehicle_state;
+    pthread_mutex_unlock(&vehicle_lock);
+}
+
+// ---------------------------------------------------------------------------
+// UDP loopback benchmark
+// ---------------------------------------------------------------------------
+
+#define BENCH_TARGETS_PER_FRAME 60     // Three batch messages per video frame
+
+typedef struct {
+    int fd;
+    volatile int running;
+    uint64_t datagrams;
+    uint64_t frames;                    // Datagrams that parsed as one frame
+} udp_bench_rx_t;
+
+static void* udp_bench_rx_thread(void* arg) {
+    udp_bench_rx_t* rx = (udp_bench_rx_t*)arg;
+    static uint8_t bufs[UDP_LINK_BATCH][UDP_LINK_SLOT_SIZE];
+    struct mmsghdr msgs[UDP_LINK_BATCH];
+    struct iovec iov[UDP_LINK_BATCH];
+    static mavlink_parser_t parser;
+    mavlink_parser_init(&parser);
+
+    for (int i = 0; i < UDP_LINK_BATCH; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = sizeof(bufs[i]);
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (rx->running) {
+        struct timespec timeout = {0, 100 * 1000 * 1000};
+        int n = recvmmsg(rx->fd, msgs, UDP_LINK_BATCH, MSG_WAITFORONE, &timeout);
+        for (int i = 0; i < n; i++) {
+            rx->frames += mavlink_parser_push(&parser, bufs[i], msgs[i].msg_len);
+        }
+        if (n > 0) {
+            rx->datagrams += n;
+        }
+    }
+    return NULL;
+}
+
+static int udp_bench_phase(const char* label, udp_link_t* link, bool batched,
+                           int port, double seconds) {
+    udp_bench_rx_t rx;
+    memset(&rx, 0, sizeof(rx));
+    rx.fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(rx.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct timeval tv = {0, 100 * 1000};
+    setsockopt(rx.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(rx.fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("udp bench: bind");
+        close(rx.fd);
+        return -1;
+    }
+
+    pthread_t thread;
+    rx.running = 1;
+    pthread_create(&thread, NULL, udp_bench_rx_thread, &rx);
+
+    mavlink_transport_t transport;
+    mavlink_transport_udp(&transport, link);
+    if (!batched) {
+        // Every frame goes straight out with its own sendto()
+        transport.reserve = NULL;
+    }
+
+    mavlink_target_t targets[BENCH_TARGETS_PER_FRAME];
+    for (int i = 0; i < BENCH_TARGETS_PER_FRAME; i++) {
+        targets[i].x = 10 * i;
+        targets[i].y = 5 * i;
+        targets[i].width = 32;
+        targets[i].height = 24;
+        targets[i].confidence = 0.5f;
+        targets[i].class_id = 0;
+        targets[i].target_num = (uint8_t)i;
+    }
+
+    udp_link_stats_t before = link->stats;
+    uint64_t start = get_time_usec();
+    uint64_t end = start + (uint64_t)(seconds * 1e6);
+    uint64_t video_frames = 0;
+    while (get_time_usec() < end) {
+        mavlink_send_detection_batch_on(&transport, targets, BENCH_TARGETS_PER_FRAME,
+                                        1280, 720, 0);
+        mavlink_transport_flush(&transport);
+        video_frames++;
+    }
+    double elapsed = (get_time_usec() - start) / 1e6;
+
+    // Let the receiver drain the socket
+    usleep(200 * 1000);
+    rx.running = 0;
+    pthread_join(thread, NULL);
+    close(rx.fd);
+
+    uint64_t sent = link->stats.datagrams - before.datagrams;
+    uint64_t syscalls = link->stats.syscalls - before.syscalls;
+    printf("%-9s sent %8.0f msg/s (%.2f msg/syscall)  received %8.0f msg/s  parsed %llu/%llu  video frames %.0f/s\n",
+           label, sent / elapsed, syscalls ? (double)sent / syscalls : 0.0,
+           rx.datagrams / elapsed,
+           (unsigned long long)rx.frames, (unsigned long long)rx.datagrams,
+           video_frames / elapsed);
+
+    return rx.frames == rx.datagrams ? 0 : -1;
+}
+
+int mavlink_udp_benchmark(int port, double seconds) {
+    udp_link_t link;
+    if (udp_link_open(&link, "127.0.0.1", port, 0) != 0) {
         return -1;
     }
-    
-    // Send via UART
-    return uart_write(uart_fd, buffer, msg_len);
+
+    printf("UDP loopback: %d targets per video frame, %d batch messages\n",
+           BENCH_TARGETS_PER_FRAME,
+           (BENCH_TARGETS_PER_FRAME + MAVLINK_BATCH_MAX_TARGETS - 1) / MAVLINK_BATCH_MAX_TARGETS);
+    int ret = udp_bench_phase("sendto", &link, false, port, seconds);
+    if (udp_bench_phase("sendmmsg", &link, true, port, seconds) != 0) {
+        ret = -1;
+    }
+
+    udp_link_close(&link);
+    printf("UDP loopback: %s\n", ret == 0 ? "PASS" : "FAIL");
+    return ret;
 }
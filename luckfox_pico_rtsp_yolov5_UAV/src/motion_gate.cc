@@ -0,0 +1,288 @@
+#include "motion_gate.h"
+#include "luckfox_mpi.h"
+#include "param_store.h"
+#include <stdio.h>
+#include <string.h>
+
+#define THERMAL_ZONE "/sys/class/thermal/thermal_zone0/temp"
+#define HWMON_MAX 8
+
+static const char* decision_names[MOTION_GATE_DECISIONS] = {"full", "focus", "skip"};
+
+// SoC temperature in millidegrees, INT32_MIN if there is no thermal zone
+static int read_temp_mc() {
+    FILE* f = fopen(THERMAL_ZONE, "r");
+    int mc = INT32_MIN;
+    if (f) {
+        if (fscanf(f, "%d", &mc) != 1) {
+            mc = INT32_MIN;
+        }
+        fclose(f);
+    }
+    return mc;
+}
+
+// Board power in microwatts from the first hwmon sensor reporting it, -1 if
+// there is none (the Luckfox boards have no power monitor)
+static long read_power_uw() {
+    for (int i = 0; i < HWMON_MAX; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/class/hwmon/hwmon%d/power1_input", i);
+        FILE* f = fopen(path, "r");
+        if (!f) {
+            continue;
+        }
+        long uw = -1;
+        if (fscanf(f, "%ld", &uw) != 1) {
+            uw = -1;
+        }
+        fclose(f);
+        if (uw >= 0) {
+            return uw;
+        }
+    }
+    return -1;
+}
+
+// Busy and total jiffies of all CPUs
+static void read_cpu(uint64_t* busy, uint64_t* total) {
+    unsigned long long v[8] = {0};
+    FILE* f = fopen("/proc/stat", "r");
+    *busy = 0;
+    *total = 0;
+    if (!f) {
+        return;
+    }
+    if (fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) >= 4) {
+        for (int i = 0; i < 8; i++) {
+            *total += v[i];
+        }
+        *busy = *total - v[3] - v[4];   // Less idle and iowait
+    }
+    fclose(f);
+}
+
+static void window_start(motion_gate_t* mg) {
+    motion_gate_window_t* w = &mg->window;
+    w->us = TEST_COMM_GetNowUs();
+    w->frames = mg->stats.frames;
+    memcpy(w->decisions, mg->stats.decisions, sizeof(w->decisions));
+    w->motion_frames = mg->stats.motion_frames;
+    w->keepalives = mg->stats.keepalives;
+    w->npu_us = mg->stats.npu_us;
+    read_cpu(&w->cpu_busy, &w->cpu_total);
+}
+
+void motion_gate_init(motion_gate_t* mg, int width, int height, int focus_w, int focus_h) {
+    memset(mg, 0, sizeof(*mg));
+    mg->width = width;
+    mg->height = height;
+    mg->focus_w = focus_w < width ? focus_w & ~1 : width;
+    mg->focus_h = focus_h < height ? focus_h & ~1 : height;
+    mg->sad = -1;
+    mg->temp_start_mc = read_temp_mc();
+    window_start(mg);
+}
+
+static int ivs_start(motion_gate_t* mg) {
+    IVS_CHN_ATTR_S attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.enMode = IVS_MODE_MD;
+    attr.u32PicWidth = mg->width;
+    attr.u32PicHeight = mg->height;
+    attr.enPixelFormat = RK_FMT_YUV420SP;
+    attr.s32Gop = 30;
+    attr.bMDEnable = RK_TRUE;
+    attr.s32MDInterval = 1;
+    attr.u32MDSensibility = MOTION_GATE_MD_SENSITIVITY;
+    attr.u32MaxWidth = mg->width;
+    attr.u32MaxHeight = mg->height;
+    RK_S32 ret = RK_MPI_IVS_CreateChn(MOTION_GATE_IVS_CHN, &attr);
+    if (ret != RK_SUCCESS) {
+        fprintf(stderr, "motion_gate: IVS channel %d create failed: %#x, gate disabled\n",
+                MOTION_GATE_IVS_CHN, ret);
+        mg->ivs_failed = true;
+        return -1;
+    }
+    mg->ivs_started = true;
+    mg->sad = -1;
+    printf("motion_gate: IVS motion detection on %dx%d\n", mg->width, mg->height);
+    return 0;
+}
+
+static void apply_sad(motion_gate_t* mg) {
+    int sad = param_get_int(PARAM_MOT_SAD);
+    if (sad == mg->sad) {
+        return;
+    }
+    IVS_MD_ATTR_S md;
+    memset(&md, 0, sizeof(md));
+    md.s32ThreshSad = sad;
+    md.s32ThreshMove = 2;
+    md.s32SwitchSad = 0;
+    if (RK_MPI_IVS_SetMdAttr(MOTION_GATE_IVS_CHN, &md) != RK_SUCCESS) {
+        mg->stats.ivs_errors++;
+    }
+    mg->sad = sad;      // Not retried every frame on error
+}
+
+// Send the frame and pick up whatever result is ready; results trail the
+// frames by the engine's latency, so the latest one stands until the next
+static void ivs_poll(motion_gate_t* mg, VIDEO_FRAME_INFO_S* frame) {
+    if (RK_MPI_IVS_SendFrame(MOTION_GATE_IVS_CHN, frame, 0) != RK_SUCCESS) {
+        mg->stats.ivs_errors++;
+        return;
+    }
+    IVS_RESULT_INFO_S info;
+    memset(&info, 0, sizeof(info));
+    if (RK_MPI_IVS_GetResults(MOTION_GATE_IVS_CHN, &info, 0) != RK_SUCCESS) {
+        return;     // Not ready yet
+    }
+    if (info.s32ResultNum > 0 && info.pstResults) {
+        const IVS_MD_INFO_S* md = &info.pstResults[0].stMdInfo;
+        uint64_t area = 0;
+        int x0 = mg->width, y0 = mg->height, x1 = 0, y1 = 0;
+        mg->rect_count = 0;
+        for (uint32_t i = 0; i < md->u32RectNum; i++) {
+            const RECT_S* r = &md->stRect[i];
+            int l = r->s32X < 0 ? 0 : r->s32X;
+            int t = r->s32Y < 0 ? 0 : r->s32Y;
+            int rr = r->s32X + (int)r->u32Width;
+            int b = r->s32Y + (int)r->u32Height;
+            rr = rr > mg->width ? mg->width : rr;
+            b = b > mg->height ? mg->height : b;
+            if (rr <= l || b <= t) {
+                continue;
+            }
+            area += (uint64_t)(rr - l) * (b - t);
+            x0 = l < x0 ? l : x0;
+            y0 = t < y0 ? t : y0;
+            x1 = rr > x1 ? rr : x1;
+            y1 = b > y1 ? b : y1;
+            mg->rect_count++;
+        }
+        mg->area_permille = (uint32_t)(area * 1000 / ((uint64_t)mg->width * mg->height));
+        if (mg->rect_count) {
+            mg->bbox.x = x0;
+            mg->bbox.y = y0;
+            mg->bbox.width = x1 - x0;
+            mg->bbox.height = y1 - y0;
+        }
+        mg->moving = mg->rect_count > 0 &&
+                     mg->area_permille >= (uint32_t)param_get_int(PARAM_MOT_MIN_AREA);
+        if (mg->moving) {
+            mg->stats.motion_frames++;
+        }
+    }
+    RK_MPI_IVS_ReleaseResults(MOTION_GATE_IVS_CHN, &info);
+}
+
+// A focus-sized crop centred on the motion, if the motion and some context
+// around it fit in one
+static bool focus_rect(const motion_gate_t* mg, im_rect* focus) {
+    int need_w = mg->bbox.width * (100 + MOTION_GATE_MARGIN_PCT) / 100;
+    int need_h = mg->bbox.height * (100 + MOTION_GATE_MARGIN_PCT) / 100;
+    if (need_w > mg->focus_w || need_h > mg->focus_h) {
+        return false;
+    }
+    int x = mg->bbox.x + mg->bbox.width / 2 - mg->focus_w / 2;
+    int y = mg->bbox.y + mg->bbox.height / 2 - mg->focus_h / 2;
+    x = x < 0 ? 0 : (x > mg->width - mg->focus_w ? mg->width - mg->focus_w : x);
+    y = y < 0 ? 0 : (y > mg->height - mg->focus_h ? mg->height - mg->focus_h : y);
+    focus->x = x & ~1;
+    focus->y = y & ~1;
+    focus->width = mg->focus_w;
+    focus->height = mg->focus_h;
+    return true;
+}
+
+motion_gate_decision_t motion_gate_decide(motion_gate_t* mg, VIDEO_FRAME_INFO_S* frame,
+                                          uint64_t now_us, im_rect* focus) {
+    mg->stats.frames++;
+    if (!param_get_int(PARAM_MOT_GATE) || mg->ivs_failed ||
+        (!mg->ivs_started && ivs_start(mg) != 0)) {
+        return MOTION_GATE_FULL;
+    }
+    apply_sad(mg);
+    ivs_poll(mg, frame);
+
+    uint64_t hold_us = (uint64_t)param_get_int(PARAM_MOT_HOLD_MS) * 1000;
+    uint64_t keepalive_us = (uint64_t)param_get_int(PARAM_MOT_KEEPALIVE_MS) * 1000;
+    bool tracking = mg->detection_us && now_us - mg->detection_us < hold_us;
+
+    if (tracking) {
+        return MOTION_GATE_FULL;
+    }
+    if (mg->moving) {
+        return focus_rect(mg, focus) ? MOTION_GATE_FOCUS : MOTION_GATE_FULL;
+    }
+    if (keepalive_us && now_us - mg->full_us >= keepalive_us) {
+        mg->stats.keepalives++;
+        return MOTION_GATE_FULL;
+    }
+    return MOTION_GATE_SKIP;
+}
+
+void motion_gate_done(motion_gate_t* mg, motion_gate_decision_t decision, int detections,
+                      uint64_t npu_us, uint64_t now_us) {
+    mg->stats.decisions[decision]++;
+    mg->stats.npu_us += npu_us;
+    if (decision == MOTION_GATE_FULL) {
+        mg->full_us = now_us;
+    }
+    if (detections > 0) {
+        mg->detection_us = now_us;
+    }
+}
+
+void motion_gate_print_stats(motion_gate_t* mg) {
+    const motion_gate_stats_t* st = &mg->stats;
+    const motion_gate_window_t* w = &mg->window;
+    uint64_t span_us = TEST_COMM_GetNowUs() - w->us;
+    if (span_us == 0) {
+        return;
+    }
+    uint64_t d[MOTION_GATE_DECISIONS];
+    for (int i = 0; i < MOTION_GATE_DECISIONS; i++) {
+        d[i] = st->decisions[i] - w->decisions[i];
+    }
+    uint64_t runs = d[MOTION_GATE_FULL] + d[MOTION_GATE_FOCUS];
+    uint64_t cpu_busy, cpu_total;
+    read_cpu(&cpu_busy, &cpu_total);
+
+    char temp[32] = "n/a";
+    int mc = read_temp_mc();
+    if (mc != INT32_MIN) {
+        snprintf(temp, sizeof(temp), "%.1f C (%+.1f)", mc / 1000.0f,
+                 mg->temp_start_mc != INT32_MIN ? (mc - mg->temp_start_mc) / 1000.0f : 0.0f);
+    }
+    char power[16] = "n/a";
+    long uw = read_power_uw();
+    if (uw >= 0) {
+        snprintf(power, sizeof(power), "%.2f W", uw / 1e6f);
+    }
+
+    printf("Motion gate: %s | %.1f fps, NPU %.1f runs/s %.0f%% busy | %s=%llu %s=%llu %s=%llu "
+           "keepalive=%llu | motion %.1f%% in %d rects, %llu frames | CPU %.0f%% | SoC %s | "
+           "power %s | ivs_errors=%llu\n",
+           !param_get_int(PARAM_MOT_GATE) ? "off" : (mg->ivs_failed ? "failed" : "on"),
+           (st->frames - w->frames) * 1e6 / span_us, runs * 1e6 / span_us,
+           (st->npu_us - w->npu_us) * 100.0 / span_us,
+           decision_names[MOTION_GATE_FULL], (unsigned long long)d[MOTION_GATE_FULL],
+           decision_names[MOTION_GATE_FOCUS], (unsigned long long)d[MOTION_GATE_FOCUS],
+           decision_names[MOTION_GATE_SKIP], (unsigned long long)d[MOTION_GATE_SKIP],
+           (unsigned long long)(st->keepalives - w->keepalives), mg->area_permille / 10.0, mg->rect_count,
+           (unsigned long long)(st->motion_frames - w->motion_frames),
+           cpu_total > w->cpu_total ?
+               (cpu_busy - w->cpu_busy) * 100.0 / (cpu_total - w->cpu_total) : 0.0,
+           temp, power, (unsigned long long)st->ivs_errors);
+    window_start(mg);
+}
+
+void motion_gate_stop(motion_gate_t* mg) {
+    if (mg->ivs_started) {
+        RK_MPI_IVS_DestroyChn(MOTION_GATE_IVS_CHN);
+        mg->ivs_started = false;
+    }
+}
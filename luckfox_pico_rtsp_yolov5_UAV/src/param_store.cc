@@ -0,0 +1,245 @@
+#include "param_store.h"
+#include "mavlink_comm.h"
+#include "motion_gate.h"
+#include "tile_infer.h"
+#include "venc_profile.h"
+#include "yolov5.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    const char* name;
+    uint8_t type;               // PARAM_TYPE_*
+    bool readonly;              // Not settable over MAVLink
+    float def;
+    float min;
+    float max;
+} param_def_t;
+
+// Indexed by param_id_t
+static const param_def_t param_defs[PARAM_COUNT] = {
+    { "DET_NMS_THRESH", PARAM_TYPE_REAL32, false, NMS_THRESH, 0.0f, 1.0f },
+    { "DET_BOX_THRESH", PARAM_TYPE_REAL32, false, BOX_THRESH, 0.0f, 1.0f },
+    { "DET_MAX_OBJ",    PARAM_TYPE_INT32,  false, OBJ_NUMB_MAX_SIZE, 1, OBJ_NUMB_MAX_SIZE },
+    { "DET_MODEL_SIZE", PARAM_TYPE_INT32,  true,  640, 32, 4096 },
+    { "OVL_BOX_COLOR",  PARAM_TYPE_INT32,  false, 0x00FF00, 0, 0xFFFFFF },
+    { "OVL_BOX_THICK",  PARAM_TYPE_INT32,  false, 4, 1, 32 },
+    { "ENC_ROI_QP",     PARAM_TYPE_INT32,  false, -8, -20, 0 },
+    { "ENC_PROFILE",    PARAM_TYPE_INT32,  false, VENC_PROFILE_LOW_LATENCY, 0, VENC_PROFILE_COUNT - 1 },
+    { "DET_TILES",      PARAM_TYPE_INT32,  false, 0, 0, TILE_INFER_MAX },
+    { "MOT_GATE",       PARAM_TYPE_INT32,  false, 0, 0, 1 },
+    { "MOT_SAD",        PARAM_TYPE_INT32,  false, MOTION_GATE_DEFAULT_SAD, 0, 4095 },
+    { "MOT_MIN_AREA",   PARAM_TYPE_INT32,  false, MOTION_GATE_DEFAULT_AREA, 0, 1000 },
+    { "MOT_HOLD_MS",    PARAM_TYPE_INT32,  false, MOTION_GATE_DEFAULT_HOLD_MS, 0, 60000 },
+    { "MOT_KEEPALIVE_MS", PARAM_TYPE_INT32, false, MOTION_GATE_DEFAULT_KEEPALIVE_MS, 0, 60000 },
+};
+
+// Raw 32-bit values (float bits or int32), one atomic word per parameter
+static uint32_t param_bits[PARAM_COUNT];
+static const char* param_path = NULL;
+static int param_uart_fd = -1;
+
+static uint32_t encode(const param_def_t* def, float value) {
+    uint32_t bits;
+    if (def->type == PARAM_TYPE_REAL32) {
+        memcpy(&bits, &value, sizeof(bits));
+    } else {
+        int32_t i = (int32_t)(value + (value >= 0 ? 0.5f : -0.5f));
+        memcpy(&bits, &i, sizeof(bits));
+    }
+    return bits;
+}
+
+static float decode(const param_def_t* def, uint32_t bits) {
+    if (def->type == PARAM_TYPE_REAL32) {
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+    int32_t i;
+    memcpy(&i, &bits, sizeof(i));
+    return (float)i;
+}
+
+float param_get_float(param_id_t id) {
+    uint32_t bits = __atomic_load_n(&param_bits[id], __ATOMIC_RELAXED);
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+int32_t param_get_int(param_id_t id) {
+    return (int32_t)__atomic_load_n(&param_bits[id], __ATOMIC_RELAXED);
+}
+
+int param_set(param_id_t id, float value, bool remote) {
+    if (id < 0 || id >= PARAM_COUNT) {
+        return -1;
+    }
+    const param_def_t* def = &param_defs[id];
+    if (remote && def->readonly) {
+        printf("param: %s is read-only\n", def->name);
+        return -1;
+    }
+    if (!(value >= def->min && value <= def->max)) {
+        printf("param: %s=%g outside [%g, %g]\n", def->name, value, def->min, def->max);
+        return -1;
+    }
+    __atomic_store_n(&param_bits[id], encode(def, value), __ATOMIC_RELAXED);
+    return 0;
+}
+
+int param_find(const char* name) {
+    for (int i = 0; i < PARAM_COUNT; i++) {
+        if (strncmp(param_defs[i].name, name, PARAM_NAME_LEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void param_store_init(const char* path) {
+    param_path = path;
+
+    for (int i = 0; i < PARAM_COUNT; i++) {
+        param_bits[i] = encode(&param_defs[i], param_defs[i].def);
+    }
+
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        printf("param: no %s, using defaults\n", path);
+        return;
+    }
+
+    char name[64];
+    float value;
+    int loaded = 0;
+    while (fscanf(fp, "%63s %f", name, &value) == 2) {
+        int id = param_find(name);
+        if (id < 0 || param_defs[id].readonly) {
+            continue;
+        }
+        if (param_set((param_id_t)id, value, false) == 0) {
+            loaded++;
+        }
+    }
+    fclose(fp);
+    printf("param: loaded %d values from %s\n", loaded, path);
+}
+
+int param_save(void) {
+    if (!param_path) {
+        return -1;
+    }
+
+    // Write a sibling file and rename it so a power cut never leaves half a file
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", param_path);
+    FILE* fp = fopen(tmp, "w");
+    if (!fp) {
+        perror("param: fopen");
+        return -1;
+    }
+    for (int i = 0; i < PARAM_COUNT; i++) {
+        const param_def_t* def = &param_defs[i];
+        if (def->readonly) {
+            continue;
+        }
+        if (def->type == PARAM_TYPE_REAL32) {
+            fprintf(fp, "%s %.6g\n", def->name, param_get_float((param_id_t)i));
+        } else {
+            fprintf(fp, "%s %d\n", def->name, param_get_int((param_id_t)i));
+        }
+    }
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+
+    if (rename(tmp, param_path) != 0) {
+        perror("param: rename");
+        return -1;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// MAVLink PARAM protocol
+// ---------------------------------------------------------------------------
+
+static bool addressed_to_us(uint8_t target_system, uint8_t target_component) {
+    return (target_system == 0 || target_system == mavlink_system_id()) &&
+           (target_component == 0 || target_component == mavlink_component_id());
+}
+
+static void send_param_value(int id) {
+    const param_def_t* def = &param_defs[id];
+    mavlink_param_value_t msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.param_value = decode(def, __atomic_load_n(&param_bits[id], __ATOMIC_RELAXED));
+    msg.param_count = PARAM_COUNT;
+    msg.param_index = (uint16_t)id;
+    strncpy(msg.param_id, def->name, sizeof(msg.param_id));
+    msg.param_type = def->type;
+
+    mavlink_send_message(param_uart_fd, MAVLINK_MSG_ID_PARAM_VALUE, &msg, sizeof(msg));
+}
+
+static void on_param_request_list(const mavlink_frame_t* frame, void* user) {
+    mavlink_param_request_list_t req;
+    mavlink_frame_decode(frame, &req, sizeof(req));
+    if (!addressed_to_us(req.target_system, req.target_component)) {
+        return;
+    }
+
+    for (int i = 0; i < PARAM_COUNT; i++) {
+        send_param_value(i);
+    }
+}
+
+static void on_param_request_read(const mavlink_frame_t* frame, void* user) {
+    mavlink_param_request_read_t req;
+    mavlink_frame_decode(frame, &req, sizeof(req));
+    if (!addressed_to_us(req.target_system, req.target_component)) {
+        return;
+    }
+
+    int id = req.param_index >= 0 ? req.param_index : param_find(req.param_id);
+    if (id >= 0 && id < PARAM_COUNT) {
+        send_param_value(id);
+    }
+}
+
+static void on_param_set(const mavlink_frame_t* frame, void* user) {
+    mavlink_param_set_t req;
+    mavlink_frame_decode(frame, &req, sizeof(req));
+    if (!addressed_to_us(req.target_system, req.target_component)) {
+        return;
+    }
+
+    int id = param_find(req.param_id);
+    if (id < 0) {
+        return;
+    }
+
+    if (param_set((param_id_t)id, req.param_value, true) == 0) {
+        printf("param: %.16s set to %g\n", req.param_id, req.param_value);
+        param_save();
+    }
+
+    // Echo the value now in effect, accepted or not
+    send_param_value(id);
+}
+
+int param_mavlink_attach(mavlink_parser_t* parser, int uart_fd) {
+    param_uart_fd = uart_fd;
+
+    if (mavlink_parser_register(parser, MAVLINK_MSG_ID_PARAM_REQUEST_LIST, on_param_request_list, NULL) != 0 ||
+        mavlink_parser_register(parser, MAVLINK_MSG_ID_PARAM_REQUEST_READ, on_param_request_read, NULL) != 0 ||
+        mavlink_parser_register(parser, MAVLINK_MSG_ID_PARAM_SET, on_param_set, NULL) != 0) {
+        return -1;
+    }
+    return 0;
+}
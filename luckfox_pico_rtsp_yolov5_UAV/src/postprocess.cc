@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "yolov5.h"
+#include "param_store.h"
 
 #include <math.h>
 #include <stdint.h>
@@ -446,12 +447,13 @@ int post_process(rknn_app_context_t *app_ctx, void *outputs,  float conf_thresho
     }
 
     int last_count = 0;
+    int max_objects = param_get_int(PARAM_DET_MAX_OBJ);
     od_results->count = 0;
 
     /* box valid detect target */
     for (int i = 0; i < validCount; ++i)
     {
-        if (indexArray[i] == -1 || last_count >= OBJ_NUMB_MAX_SIZE)
+        if (indexArray[i] == -1 || last_count >= max_objects)
         {
             continue;
         }
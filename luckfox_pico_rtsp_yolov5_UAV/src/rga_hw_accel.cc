@@ -4,10 +4,137 @@
 #include "RgaApi.h"
 #include "RgaUtils.h"
 #include "dma_alloc.h"
+#include "dma_pool.h"
 #include "yolov5.h"
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdexcept>
 
+// Staging buffers for rga_resize: mapped and imported into RGA once, reused
+// for every call with the same size and format
+static DmaPool g_resize_pool(DMA_POOL_BACKEND_HEAP);
+
+// ---------------------------------------------------------------------------
+// RGA handle cache
+// ---------------------------------------------------------------------------
+
+
+enum {
+    RGA_HANDLE_KEY_NONE = 0,
+    RGA_HANDLE_KEY_MB,      // keyed by RK_MPI_MB_Handle2UniqueId
+    RGA_HANDLE_KEY_FD,      // keyed by dma-buf fd
+};
+
+typedef struct {
+    int kind;
+    int key;
+    int size;
+    rga_buffer_handle_t handle;
+    uint32_t last_use;
+} rga_cached_handle_t;
+
+// Entries in use start at RGA_HANDLE_CACHE_BASE and grow with each pool's
+// rga_handle_cache_reserve(). A full cache re-imports every frame, and an
+// evicted handle may still be read by an IM_ASYNC job in flight.
+static rga_cached_handle_t g_handle_cache[RGA_HANDLE_CACHE_MAX];
+static int g_handle_capacity = RGA_HANDLE_CACHE_BASE;
+static uint32_t g_handle_clock = 0;
+static pthread_mutex_t g_handle_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static rga_buffer_handle_t rga_handle_lookup(int kind, int key, int fd, int size)
+{
+    rga_buffer_handle_t handle = 0;
+    rga_cached_handle_t* victim = &g_handle_cache[0];
+
+    pthread_mutex_lock(&g_handle_lock);
+    g_handle_clock++;
+
+    for (int i = 0; i < g_handle_capacity; i++) {
+        rga_cached_handle_t* e = &g_handle_cache[i];
+        if (e->kind == kind && e->key == key && e->size == size) {
+            e->last_use = g_handle_clock;
+            handle = e->handle;
+            pthread_mutex_unlock(&g_handle_lock);
+            return handle;
+        }
+        // Prefer an empty slot, else the least recently used one
+        if (victim->kind != RGA_HANDLE_KEY_NONE &&
+            (e->kind == RGA_HANDLE_KEY_NONE || e->last_use < victim->last_use))
+            victim = e;
+    }
+
+    handle = importbuffer_fd(fd, size);
+    if (!handle) {
+        printf("RGA: importbuffer_fd failed for fd %d\n", fd);
+        pthread_mutex_unlock(&g_handle_lock);
+        return 0;
+    }
+
+    if (victim->kind != RGA_HANDLE_KEY_NONE) {
+        static bool warned = false;
+        if (!warned) {
+            printf("RGA: handle cache of %d full, evicting; a buffer pool is not reserved\n",
+                   g_handle_capacity);
+            warned = true;
+        }
+        releasebuffer_handle(victim->handle);
+    }
+
+    victim->kind = kind;
+    victim->key = key;
+    victim->size = size;
+    victim->handle = handle;
+    victim->last_use = g_handle_clock;
+
+    pthread_mutex_unlock(&g_handle_lock);
+    return handle;
+}
+
+rga_buffer_handle_t rga_handle_from_mb(MB_BLK mb)
+{
+    if (mb == NULL)
+        return 0;
+    return rga_handle_lookup(RGA_HANDLE_KEY_MB,
+                             RK_MPI_MB_Handle2UniqueId(mb),
+                             RK_MPI_MB_Handle2Fd(mb),
+                             (int)RK_MPI_MB_GetSize(mb));
+}
+
+rga_buffer_handle_t rga_handle_from_fd(int fd, int size)
+{
+    if (fd < 0)
+        return 0;
+    return rga_handle_lookup(RGA_HANDLE_KEY_FD, fd, fd, size);
+}
+
+void rga_handle_cache_reserve(int n)
+{
+    pthread_mutex_lock(&g_handle_lock);
+    g_handle_capacity += n;
+    if (g_handle_capacity > RGA_HANDLE_CACHE_MAX) {
+        printf("RGA: %d handles reserved, only %d fit\n", g_handle_capacity,
+               RGA_HANDLE_CACHE_MAX);
+        g_handle_capacity = RGA_HANDLE_CACHE_MAX;
+    }
+    pthread_mutex_unlock(&g_handle_lock);
+}
+
+void rga_handle_cache_release()
+{
+    pthread_mutex_lock(&g_handle_lock);
+    for (int i = 0; i < RGA_HANDLE_CACHE_MAX; i++) {
+        if (g_handle_cache[i].kind != RGA_HANDLE_KEY_NONE)
+            releasebuffer_handle(g_handle_cache[i].handle);
+        memset(&g_handle_cache[i], 0, sizeof(rga_cached_handle_t));
+    }
+    pthread_mutex_unlock(&g_handle_lock);
+}
+
+// ---------------------------------------------------------------------------
+// Operations
+// ---------------------------------------------------------------------------
+
 void rga_resize(const cv::Mat& src, cv::Mat& dst, int dst_w, int dst_h)
 {
     int src_w = src.cols;
@@ -18,100 +145,70 @@ void rga_resize(const cv::Mat& src, cv::Mat& dst, int dst_w, int dst_h)
     size_t src_size = src_w * src_h * 3;
     size_t dst_size = dst_w * dst_h * 3;
 
-    int src_fd = -1;
-    int dst_fd = -1;
-    void* src_buf = nullptr;
-    void* dst_buf = nullptr;
-
-    // Allocate DMA buffers
-    if (dma_buf_alloc(RV1106_CMA_HEAP_PATH, src_size, &src_fd, &src_buf) < 0)
+    // Lease pooled DMA buffers
+    DmaLease src_buf = g_resize_pool.acquire(src_w, src_h, src_fmt);
+    if (!src_buf.valid())
         throw std::runtime_error("RGA: failed to allocate source DMA buffer");
 
-    if (dma_buf_alloc(RV1106_CMA_HEAP_PATH, dst_size, &dst_fd, &dst_buf) < 0) {
-        dma_buf_free(src_size, &src_fd, src_buf);
+    DmaLease dst_buf = g_resize_pool.acquire(dst_w, dst_h, dst_fmt);
+    if (!dst_buf.valid())
         throw std::runtime_error("RGA: failed to allocate dest DMA buffer");
-    }
 
     // Copy from cv::Mat into DMA source buffer
-    memcpy(src_buf, src.data, src_size);
+    memcpy(src_buf.va(), src.data, src_size);
+    src_buf.sync_for_device();
 
-    // Import DMA buffers into RGA
-    rga_buffer_handle_t src_handle = importbuffer_fd(src_fd, src_size);
-    rga_buffer_handle_t dst_handle = importbuffer_fd(dst_fd, dst_size);
-
-    if (!src_handle || !dst_handle) {
-        dma_buf_free(src_size, &src_fd, src_buf);
-        dma_buf_free(dst_size, &dst_fd, dst_buf);
-        throw std::runtime_error("RGA: failed to import DMA buffers");
-    }
-
-    rga_buffer_t src_rga = wrapbuffer_handle(src_handle, src_w, src_h, src_fmt);
-    rga_buffer_t dst_rga = wrapbuffer_handle(dst_handle, dst_w, dst_h, dst_fmt);
+    rga_buffer_t src_rga = src_buf.rga();
+    rga_buffer_t dst_rga = dst_buf.rga();
     im_rect src_rect = {};
     im_rect dst_rect = {};
 
     // Check parameters
-    if (imcheck(src_rga, dst_rga, src_rect, dst_rect) != IM_STATUS_NOERROR) {
-        releasebuffer_handle(src_handle);
-        releasebuffer_handle(dst_handle);
-        dma_buf_free(src_size, &src_fd, src_buf);
-        dma_buf_free(dst_size, &dst_fd, dst_buf);
+    if (imcheck(src_rga, dst_rga, src_rect, dst_rect) != IM_STATUS_NOERROR)
         throw std::runtime_error("RGA: check parameters failed");
-    }
 
     int ret = imresize(src_rga, dst_rga);
-    if (ret != IM_STATUS_SUCCESS) {
-        releasebuffer_handle(src_handle);
-        releasebuffer_handle(dst_handle);
-        dma_buf_free(src_size, &src_fd, src_buf);
-        dma_buf_free(dst_size, &dst_fd, dst_buf);
+    if (ret != IM_STATUS_SUCCESS)
         throw std::runtime_error("RGA: imresize failed");
-    }
 
     // Copy RGA output back into a normal cv::Mat
+    dst_buf.sync_for_cpu();
     dst.create(dst_h, dst_w, CV_8UC3);
-    memcpy(dst.data, dst_buf, dst_size);
+    memcpy(dst.data, dst_buf.va(), dst_size);
 
-    // Free everything
-    releasebuffer_handle(src_handle);
-    releasebuffer_handle(dst_handle);
-    dma_buf_free(src_size, &src_fd, src_buf);
-    dma_buf_free(dst_size, &dst_fd, dst_buf);
+    // Leases return both buffers to the pool
 }
 
-void draw_box_rga(void* buf, int w, int h,
+void draw_box_rga(MB_BLK blk, int w, int h,
                   int x, int y, int box_w, int box_h,
                   uint32_t color_rgb, int thickness)
 {
-    rga_buffer_t img = wrapbuffer_virtualaddr(buf, w, h, RK_FORMAT_RGB_888);
-
-    // Top border
-    im_rect t = {x, y, box_w, thickness};
-    imfill(img, t, color_rgb);
-
-    // Bottom
-    im_rect b = {x, y + box_h - thickness, box_w, thickness};
-    imfill(img, b, color_rgb);
-
-    // Left
-    im_rect l = {x, y, thickness, box_h};
-    imfill(img, l, color_rgb);
+    rga_buffer_t img = wrapbuffer_handle(rga_handle_from_mb(blk), w, h, RK_FORMAT_RGB_888);
 
-    // Right
-    im_rect r = {x + box_w - thickness, y, thickness, box_h};
-    imfill(img, r, color_rgb);
+    im_rect edges[4] = {
+        {x, y, box_w, thickness},                       // Top border
+        {x, y + box_h - thickness, box_w, thickness},   // Bottom
+        {x, y, thickness, box_h},                       // Left
+        {x + box_w - thickness, y, thickness, box_h},   // Right
+    };
+    imfillArray(img, edges, 4, color_rgb);
 }
 
-void clear_frame(void* buf, int w, int h)
+void clear_frame(MB_BLK blk, int w, int h)
 {
-    rga_buffer_t img = wrapbuffer_virtualaddr(buf, w, h, RK_FORMAT_RGB_888);
+    rga_buffer_t img = wrapbuffer_handle(rga_handle_from_mb(blk), w, h, RK_FORMAT_RGB_888);
     im_rect rect = {0, 0, w, h};
     imfill(img, rect, 0x000000); // black
 }
 
+// Tensor and rectangle the letterbox padding was last painted around;
+// cleared when something else overwrites the padding
+static rga_buffer_handle_t padded_handle = 0;
+static im_rect padded_rect = {0, 0, 0, 0};
+
 // Direct NV12 → RGB888 → Resize → Letterbox → RKNN DMA input
 void rga_letterbox_nv12_to_rknn(
-    void* nv12_ptr,
+    MB_BLK nv12_blk,
     int src_w, int src_h,
     rknn_app_context_t* ctx,
     int dst_w, int dst_h,
@@ -136,15 +233,13 @@ void rga_letterbox_nv12_to_rknn(
     // 2. Setup RKNN output buffer
     // -------------------------------------------------
     rknn_tensor_mem* dst_mem = ctx->input_mems[0];
-    uint8_t* out_ptr = (uint8_t*)dst_mem->virt_addr;
-
-    int dst_stride = dst_w * 3; // RGB888 24bpp
+    rga_buffer_handle_t dst_handle = rga_handle_from_fd(dst_mem->fd, dst_mem->size);
 
     // -------------------------------------------------
     // 3. Source NV12
     // -------------------------------------------------
-    rga_buffer_t src = wrapbuffer_virtualaddr(
-        nv12_ptr,
+    rga_buffer_t src = wrapbuffer_handle(
+        rga_handle_from_mb(nv12_blk),
         src_w,
         src_h,
         RK_FORMAT_YCbCr_420_SP
@@ -153,8 +248,8 @@ void rga_letterbox_nv12_to_rknn(
     // -------------------------------------------------
     // 4. Destination FULL padded RGB
     // -------------------------------------------------
-    rga_buffer_t dst_full = wrapbuffer_virtualaddr(
-        out_ptr,
+    rga_buffer_t dst_full = wrapbuffer_handle(
+        dst_handle,
         dst_w,
         dst_h,
         RK_FORMAT_RGB_888
@@ -163,21 +258,52 @@ void rga_letterbox_nv12_to_rknn(
     // -------------------------------------------------
     // 5. Clear the tensor (letterbox padding)
     // -------------------------------------------------
-    im_rect full_rect = {0, 0, dst_w, dst_h};
-    imfill(dst_full, full_rect, 0x000000);
+    // The scaled image overwrites the same sub-rectangle every frame, so the
+    // padding only needs to be painted when the geometry changes
+    im_rect sub_rect = {*left_pad, *top_pad, new_w, new_h};
 
-    // -------------------------------------------------
-    // 6. Sub-rectangle for scaled region
-    // -------------------------------------------------
-    rga_buffer_t dst_sub = wrapbuffer_virtualaddr(
-        out_ptr + (*top_pad) * dst_stride + (*left_pad) * 3,
-        new_w,
-        new_h,
-        RK_FORMAT_RGB_888
-    );
+    if (padded_handle != dst_handle ||
+        memcmp(&padded_rect, &sub_rect, sizeof(im_rect)) != 0) {
+        im_rect full_rect = {0, 0, dst_w, dst_h};
+        imfill(dst_full, full_rect, 0x000000);
+        padded_handle = dst_handle;
+        padded_rect = sub_rect;
+    }
 
     // -------------------------------------------------
-    // 7. NV12 → RGB + resize into padded area
+    // 6. NV12 → RGB + resize into padded area
     // -------------------------------------------------
-    imresize(src, dst_sub);
+    im_rect src_rect = {0, 0, src_w, src_h};
+    im_rect pat_rect = {};
+    rga_buffer_t pat;
+    memset(&pat, 0, sizeof(pat));
+
+    improcess(src, dst_full, pat, src_rect, sub_rect, pat_rect, IM_SYNC);
+}
+
+void rga_crop_nv12_to_rknn(
+    MB_BLK nv12_blk,
+    int src_w, int src_h,
+    im_rect crop,
+    rknn_app_context_t* ctx,
+    int dst_w, int dst_h
+){
+    rknn_tensor_mem* dst_mem = ctx->input_mems[0];
+    rga_buffer_handle_t dst_handle = rga_handle_from_fd(dst_mem->fd, dst_mem->size);
+
+    rga_buffer_t src = wrapbuffer_handle(
+        rga_handle_from_mb(nv12_blk), src_w, src_h, RK_FORMAT_YCbCr_420_SP);
+    rga_buffer_t dst = wrapbuffer_handle(dst_handle, dst_w, dst_h, RK_FORMAT_RGB_888);
+
+    // The crop fills the whole tensor, letterbox padding included
+    if (padded_handle == dst_handle) {
+        padded_handle = 0;
+    }
+
+    im_rect dst_rect = {0, 0, dst_w, dst_h};
+    im_rect pat_rect = {};
+    rga_buffer_t pat;
+    memset(&pat, 0, sizeof(pat));
+
+    improcess(src, dst, pat, crop, dst_rect, pat_rect, IM_SYNC);
 }
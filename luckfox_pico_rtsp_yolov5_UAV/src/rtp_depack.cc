@@ -0,0 +1,207 @@
+#include "rtp_depack.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t start_code[4] = { 0, 0, 0, 1 };
+
+int rtp_depack_init(rtp_depack_t* d, rtp_codec_t codec, size_t frame_cap) {
+    memset(d, 0, sizeof(*d));
+    d->codec = codec;
+    d->frame = (uint8_t*)malloc(frame_cap);
+    if (!d->frame) {
+        return -1;
+    }
+    d->frame_cap = frame_cap;
+    return 0;
+}
+
+void rtp_depack_free(rtp_depack_t* d) {
+    free(d->frame);
+    d->frame = NULL;
+    d->frame_cap = 0;
+}
+
+static void append(rtp_depack_t* d, const uint8_t* data, size_t len) {
+    if (d->frame_len + len > d->frame_cap) {
+        d->frame_damaged = true;
+        return;
+    }
+    memcpy(d->frame + d->frame_len, data, len);
+    d->frame_len += len;
+}
+
+static int finish_frame(rtp_depack_t* d, rtp_depack_frame_fn fn, void* user) {
+    if (d->frame_len == 0) {
+        // Nothing usable arrived for this timestamp
+        d->frame_damaged = false;
+        d->in_fu = false;
+        return 0;
+    }
+    if (d->in_fu) {
+        d->frame_damaged = true;    // Fragmented NAL never got its end
+    }
+    d->frames++;
+    if (d->frame_damaged) {
+        d->damaged_frames++;
+    }
+    if (fn) {
+        fn(d->frame, d->frame_len, d->frame_ts, d->frame_damaged, user);
+    }
+    d->frame_len = 0;
+    d->frame_damaged = false;
+    d->in_fu = false;
+    return 1;
+}
+
+// Single NAL or aggregation packet; returns false if malformed
+static bool push_h264(rtp_depack_t* d, const uint8_t* p, size_t len) {
+    uint8_t type = p[0] & 0x1F;
+
+    if (type >= 1 && type <= 23) {
+        append(d, start_code, 4);
+        append(d, p, len);
+        return true;
+    }
+
+    if (type == 24) {
+        // STAP-A: 16-bit size before each NAL
+        size_t pos = 1;
+        while (pos + 2 <= len) {
+            size_t n = ((size_t)p[pos] << 8) | p[pos + 1];
+            pos += 2;
+            if (n == 0 || pos + n > len) {
+                return false;
+            }
+            append(d, start_code, 4);
+            append(d, p + pos, n);
+            pos += n;
+        }
+        return pos == len;
+    }
+
+    if (type == 28) {
+        if (len < 2) {
+            return false;
+        }
+        bool start = p[1] & 0x80;
+        bool end = p[1] & 0x40;
+        if (start) {
+            uint8_t header = (p[0] & 0xE0) | (p[1] & 0x1F);
+            append(d, start_code, 4);
+            append(d, &header, 1);
+            d->in_fu = true;
+        } else if (!d->in_fu) {
+            return false;           // Lost the start of this NAL
+        }
+        append(d, p + 2, len - 2);
+        if (end) {
+            d->in_fu = false;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+static bool push_h265(rtp_depack_t* d, const uint8_t* p, size_t len) {
+    if (len < 2) {
+        return false;
+    }
+    uint8_t type = (p[0] >> 1) & 0x3F;
+
+    if (type < 48) {
+        append(d, start_code, 4);
+        append(d, p, len);
+        return true;
+    }
+
+    if (type == 49) {
+        if (len < 3) {
+            return false;
+        }
+        bool start = p[2] & 0x80;
+        bool end = p[2] & 0x40;
+        if (start) {
+            uint8_t header[2];
+            header[0] = (p[0] & 0x81) | ((p[2] & 0x3F) << 1);
+            header[1] = p[1];
+            append(d, start_code, 4);
+            append(d, header, 2);
+            d->in_fu = true;
+        } else if (!d->in_fu) {
+            return false;
+        }
+        append(d, p + 3, len - 3);
+        if (end) {
+            d->in_fu = false;
+        }
+        return true;
+    }
+
+    return false;                   // Aggregation (48) and PACI (50) are not sent by us
+}
+
+int rtp_depack_push(rtp_depack_t* d, const uint8_t* pkt, size_t len,
+                    rtp_depack_frame_fn fn, void* user) {
+    if (len < RTP_HEADER_LEN || (pkt[0] >> 6) != 2) {
+        return 0;
+    }
+    d->packets++;
+
+    size_t header = RTP_HEADER_LEN + (pkt[0] & 0x0F) * 4;
+    if (pkt[0] & 0x10) {
+        // Header extension: 16-bit profile, 16-bit length in words
+        if (len < header + 4) {
+            return 0;
+        }
+        header += 4 + (((size_t)pkt[header + 2] << 8) | pkt[header + 3]) * 4;
+    }
+    if (header >= len) {
+        return 0;
+    }
+    size_t payload_len = len - header;
+    if (pkt[0] & 0x20) {
+        size_t pad = pkt[len - 1];
+        if (pad > payload_len) {
+            return 0;
+        }
+        payload_len -= pad;
+    }
+    if (payload_len == 0) {
+        return 0;
+    }
+
+    bool marker = pkt[1] & 0x80;
+    uint16_t seq = ((uint16_t)pkt[2] << 8) | pkt[3];
+    uint32_t ts = ((uint32_t)pkt[4] << 24) | ((uint32_t)pkt[5] << 16) |
+                  ((uint32_t)pkt[6] << 8) | pkt[7];
+
+    int completed = 0;
+
+    // A new timestamp closes a frame whose marker packet was lost
+    if (d->frame_len > 0 && ts != d->frame_ts) {
+        d->frame_damaged = true;
+        completed += finish_frame(d, fn, user);
+    }
+
+    if (d->have_seq && seq != d->next_seq) {
+        d->lost += (uint16_t)(seq - d->next_seq);
+        d->frame_damaged = true;
+        d->in_fu = false;
+    }
+    d->have_seq = true;
+    d->next_seq = seq + 1;
+    d->frame_ts = ts;
+
+    const uint8_t* payload = pkt + header;
+    bool ok = d->codec == RTP_CODEC_H265 ? push_h265(d, payload, payload_len)
+                                         : push_h264(d, payload, payload_len);
+    if (!ok) {
+        d->frame_damaged = true;
+    }
+
+    if (marker) {
+        completed += finish_frame(d, fn, user);
+    }
+    return completed;
+}
@@ -0,0 +1,1267 @@
+#include "rtsp_server.h"
+#include "luckfox_mpi.h"
+#include "util.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/sockios.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#define RTSP_IOV_PACKETS 256        // Interleaved packets per sendmsg (two iovecs each)
+
+static uint32_t rand32(void) {
+    uint32_t v;
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || read(fd, &v, sizeof(v)) != sizeof(v)) {
+        v = (uint32_t)TEST_COMM_GetNowUs() * 2654435761u;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return v;
+}
+
+static size_t base64_encode(const uint8_t* in, size_t len, char* out, size_t size) {
+    static const char table[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t n = 0;
+    for (size_t i = 0; i < len && n + 5 <= size; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < len) v |= in[i + 2];
+        out[n++] = table[(v >> 18) & 0x3F];
+        out[n++] = table[(v >> 12) & 0x3F];
+        out[n++] = i + 1 < len ? table[(v >> 6) & 0x3F] : '=';
+        out[n++] = i + 2 < len ? table[v & 0x3F] : '=';
+    }
+    out[n] = '\0';
+    return n;
+}
+
+// Copy the value of "Name: value" from a NUL-terminated request
+static bool header_value(const char* req, const char* name, char* out, size_t size) {
+    size_t name_len = strlen(name);
+    const char* line = strstr(req, "\r\n");
+    while (line) {
+        line += 2;
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char* v = line + name_len + 1;
+            while (*v == ' ' || *v == '\t') {
+                v++;
+            }
+            size_t n = strcspn(v, "\r\n");
+            if (n >= size) {
+                n = size - 1;
+            }
+            memcpy(out, v, n);
+            out[n] = '\0';
+            return true;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return false;
+}
+
+// Index of the next 00 00 01 at or after from, or len
+static size_t find_start_code(const uint8_t* data, size_t from, size_t len) {
+    size_t i = from;
+    while (i + 3 <= len) {
+        if (data[i + 2] > 1) {
+            i += 3;
+        } else if (data[i + 2] == 1 && data[i + 1] == 0 && data[i] == 0) {
+            return i;
+        } else {
+            i++;
+        }
+    }
+    return len;
+}
+
+// Next NAL unit at or after *pos (start code excluded); NULL when done
+static const uint8_t* next_nal(const uint8_t* data, size_t len, size_t* pos, size_t* nal_len) {
+    size_t sc = find_start_code(data, *pos, len);
+    if (sc == len) {
+        return NULL;
+    }
+    size_t start = sc + 3;
+    size_t end = find_start_code(data, start, len);
+    *pos = end;
+    // A 4-byte start code's leading zero belongs to the next NAL
+    if (end < len && end > start && data[end - 1] == 0) {
+        end--;
+    }
+    *nal_len = end - start;
+    return data + start;
+}
+
+// ---------------------------------------------------------------------------
+// Client output
+// ---------------------------------------------------------------------------
+
+static void backlog_append(rtsp_client_t* c, const void* data, size_t len) {
+    if (c->backlog_off + c->backlog_len + len > RTSP_TCP_BACKLOG) {
+        memmove(c->backlog, c->backlog + c->backlog_off, c->backlog_len);
+        c->backlog_off = 0;
+    }
+    memcpy(c->backlog + c->backlog_off + c->backlog_len, data, len);
+    c->backlog_len += len;
+}
+
+static void backlog_flush(rtsp_client_t* c) {
+    while (c->backlog_len > 0) {
+        ssize_t n = send(c->fd, c->backlog + c->backlog_off, c->backlog_len,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                c->dead = true;
+            }
+            return;
+        }
+        c->backlog_off += n;
+        c->backlog_len -= n;
+    }
+    c->backlog_off = 0;
+}
+
+// RTSP responses share the backlog with interleaved media to keep order
+static void client_write(rtsp_client_t* c, const char* data, size_t len) {
+    backlog_flush(c);
+    if (c->backlog_len == 0) {
+        ssize_t n = send(c->fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                c->dead = true;
+                return;
+            }
+            n = 0;
+        }
+        data += n;
+        len -= n;
+    }
+    if (len > RTSP_TCP_BACKLOG - c->backlog_len) {
+        c->dead = true;                 // Reader stalled for good
+        return;
+    }
+    if (len > 0) {
+        backlog_append(c, data, len);
+    }
+}
+
+static void update_queue(rtsp_client_t* c, int fd) {
+    int queued = 0;
+    ioctl(fd, SIOCOUTQ, &queued);
+    c->stats.queue_bytes = (uint32_t)(c->backlog_len + (queued > 0 ? queued : 0));
+    if (c->stats.queue_bytes > c->stats.queue_max) {
+        c->stats.queue_max = c->stats.queue_bytes;
+    }
+}
+
+static void send_udp(rtsp_server_t* srv, rtsp_client_t* c) {
+    int count = srv->arena_count;
+
+    for (int i = 0; i < count; i++) {
+        srv->iov[i].iov_base = srv->arena[i];
+        srv->iov[i].iov_len = srv->arena_len[i];
+        memset(&srv->msgs[i], 0, sizeof(srv->msgs[i]));
+        srv->msgs[i].msg_hdr.msg_name = &c->rtp_dest;
+        srv->msgs[i].msg_hdr.msg_namelen = sizeof(c->rtp_dest);
+        srv->msgs[i].msg_hdr.msg_iov = &srv->iov[i];
+        srv->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // A full send buffer takes none of the rest: those packets are dropped
+    int sent = 0;
+    while (sent < count) {
+        int n = sendmmsg(srv->rtp_fd, srv->msgs + sent, count - sent, MSG_DONTWAIT);
+        c->stats.syscalls++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = sent; i < sent + n; i++) {
+            c->stats.bytes += srv->msgs[i].msg_len;
+        }
+        sent += n;
+        if (n == 0) {
+            break;
+        }
+    }
+
+    c->stats.packets += sent;
+    if (sent < count) {
+        c->stats.dropped_packets += count - sent;
+        c->stats.dropped_sends++;
+    }
+    update_queue(c, srv->rtp_fd);
+}
+
+static void send_tcp(rtsp_server_t* srv, rtsp_client_t* c) {
+    int count = srv->arena_count;
+    int i = 0;
+
+    for (int k = 0; k < count; k++) {
+        srv->prefix[k][0] = '$';
+        srv->prefix[k][1] = c->channel;
+        srv->prefix[k][2] = srv->arena_len[k] >> 8;
+        srv->prefix[k][3] = srv->arena_len[k] & 0xFF;
+    }
+
+    // Straight to the socket while nothing older is waiting
+    backlog_flush(c);
+    while (c->backlog_len == 0 && !c->dead && i < count) {
+        int n = count - i < RTSP_IOV_PACKETS ? count - i : RTSP_IOV_PACKETS;
+        for (int k = 0; k < n; k++) {
+            srv->iov[2 * k].iov_base = srv->prefix[i + k];
+            srv->iov[2 * k].iov_len = 4;
+            srv->iov[2 * k + 1].iov_base = srv->arena[i + k];
+            srv->iov[2 * k + 1].iov_len = srv->arena_len[i + k];
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = srv->iov;
+        msg.msg_iovlen = 2 * n;
+
+        ssize_t sent = sendmsg(c->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        c->stats.syscalls++;
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                c->dead = true;
+            }
+            break;
+        }
+        c->stats.bytes += sent;
+
+        // Skip whole packets; a partly sent one must be completed
+        int k = 0;
+        while (k < n && (size_t)sent >= 4 + (size_t)srv->arena_len[i + k]) {
+            sent -= 4 + srv->arena_len[i + k];
+            k++;
+        }
+        c->stats.packets += k;
+        i += k;
+        if (k < n && sent > 0) {
+            size_t done = sent;
+            if (done < 4) {
+                backlog_append(c, srv->prefix[i] + done, 4 - done);
+                done = 4;
+            }
+            backlog_append(c, srv->arena[i] + (done - 4), srv->arena_len[i] - (done - 4));
+            c->stats.packets++;
+            i++;
+        }
+        if (k < n) {
+            break;
+        }
+    }
+
+    // The rest queues behind, as far as the backlog allows
+    for (; i < count && !c->dead; i++) {
+        size_t need = 4 + srv->arena_len[i];
+        if (need > RTSP_TCP_BACKLOG - c->backlog_len) {
+            c->stats.dropped_packets += count - i;
+            c->stats.dropped_sends++;
+            break;
+        }
+        backlog_append(c, srv->prefix[i], 4);
+        backlog_append(c, srv->arena[i], srv->arena_len[i]);
+        c->stats.packets++;
+    }
+    update_queue(c, c->fd);
+}
+
+// Send the arena to every playing client and empty it
+static void arena_send(rtsp_server_t* srv) {
+    for (int i = 0; i < RTSP_SERVER_MAX_CLIENTS; i++) {
+        rtsp_client_t* c = &srv->clients[i];
+        if (c->state != RTSP_CLIENT_PLAYING || c->dead) {
+            continue;
+        }
+        if (c->tcp) {
+            send_tcp(srv, c);
+        } else {
+            send_udp(srv, c);
+        }
+    }
+    srv->arena_count = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Packetiser
+// ---------------------------------------------------------------------------
+
+static uint8_t* rtp_slot(rtsp_server_t* srv) {
+    if (srv->arena_count == RTP_ARENA_PACKETS) {
+        arena_send(srv);
+        srv->stats.arena_flushes++;
+    }
+    return srv->arena[srv->arena_count] + RTP_HEADER_LEN;
+}
+
+static void rtp_commit(rtsp_server_t* srv, size_t payload_len, bool marker, uint32_t ts) {
+    uint8_t* p = srv->arena[srv->arena_count];
+    p[0] = 0x80;
+    p[1] = (marker ? 0x80 : 0) | RTP_PT_VIDEO;
+    p[2] = srv->seq >> 8;
+    p[3] = srv->seq & 0xFF;
+    p[4] = ts >> 24;
+    p[5] = ts >> 16;
+    p[6] = ts >> 8;
+    p[7] = ts;
+    p[8] = srv->ssrc >> 24;
+    p[9] = srv->ssrc >> 16;
+    p[10] = srv->ssrc >> 8;
+    p[11] = srv->ssrc;
+    srv->arena_len[srv->arena_count++] = (uint16_t)(RTP_HEADER_LEN + payload_len);
+    srv->seq++;
+    srv->stats.packets++;
+}
+
+static void packetise_nal(rtsp_server_t* srv, const uint8_t* nal, size_t len,
+                          uint32_t ts, bool last) {
+    if (len <= RTP_PAYLOAD_MAX) {
+        memcpy(rtp_slot(srv), nal, len);
+        rtp_commit(srv, len, last, ts);
+        return;
+    }
+
+    // FU-A (RFC 6184) / FU (RFC 7798): the NAL header moves into the FU headers
+    bool hevc = srv->codec == RTP_CODEC_H265;
+    size_t header_len = hevc ? 2 : 1;
+    size_t fu_len = hevc ? 3 : 2;
+    size_t chunk_max = RTP_PAYLOAD_MAX - fu_len;
+    uint8_t type = hevc ? (nal[0] >> 1) & 0x3F : nal[0] & 0x1F;
+
+    const uint8_t* p = nal + header_len;
+    size_t left = len - header_len;
+    bool first = true;
+    while (left > 0) {
+        size_t chunk = left < chunk_max ? left : chunk_max;
+        bool end = chunk == left;
+        uint8_t* out = rtp_slot(srv);
+        uint8_t fu = (first ? 0x80 : 0) | (end ? 0x40 : 0) | type;
+        if (hevc) {
+            out[0] = (nal[0] & 0x81) | (49 << 1);
+            out[1] = nal[1];
+            out[2] = fu;
+        } else {
+            out[0] = (nal[0] & 0xE0) | 28;
+            out[1] = fu;
+        }
+        memcpy(out + fu_len, p, chunk);
+        rtp_commit(srv, fu_len + chunk, last && end, ts);
+        p += chunk;
+        left -= chunk;
+        first = false;
+    }
+}
+
+// Remember parameter sets for the SDP; true for a VCL (slice) NAL
+static bool inspect_nal(rtsp_server_t* srv, const uint8_t* nal, size_t len) {
+    uint8_t* dst = NULL;
+    size_t* dst_len = NULL;
+    bool vcl;
+
+    if (srv->codec == RTP_CODEC_H265) {
+        uint8_t type = (nal[0] >> 1) & 0x3F;
+        vcl = type < 32;
+        if (type == 32) { dst = srv->vps; dst_len = &srv->vps_len; }
+        if (type == 33) { dst = srv->sps; dst_len = &srv->sps_len; }
+        if (type == 34) { dst = srv->pps; dst_len = &srv->pps_len; }
+    } else {
+        uint8_t type = nal[0] & 0x1F;
+        vcl = type >= 1 && type <= 5;
+        if (type == 7) { dst = srv->sps; dst_len = &srv->sps_len; }
+        if (type == 8) { dst = srv->pps; dst_len = &srv->pps_len; }
+    }
+
+    if (dst && len <= RTP_PARAM_SET_MAX) {
+        memcpy(dst, nal, len);
+        *dst_len = len;
+    }
+    return vcl;
+}
+
+int rtsp_server_send(rtsp_server_t* srv, const uint8_t* data, size_t len,
+                     uint64_t pts_us, bool frame_end) {
+    uint32_t ts = (uint32_t)(pts_us * 9 / 100) + srv->ts_offset;
+
+    pthread_mutex_lock(&srv->lock);
+
+    bool playing = false;
+    for (int i = 0; i < RTSP_SERVER_MAX_CLIENTS; i++) {
+        if (srv->clients[i].state == RTSP_CLIENT_PLAYING && !srv->clients[i].dead) {
+            playing = true;
+        }
+    }
+
+    uint64_t packets = srv->stats.packets;
+    size_t pos = 0, nal_len = 0, next_len = 0;
+    const uint8_t* nal = next_nal(data, len, &pos, &nal_len);
+    while (nal) {
+        const uint8_t* next = next_nal(data, len, &pos, &next_len);
+        bool vcl = nal_len > 0 && inspect_nal(srv, nal, nal_len);
+        if (playing) {
+            if (nal_len > 0) {
+                packetise_nal(srv, nal, nal_len, ts, frame_end && !next);
+            }
+        } else if (vcl) {
+            break;                      // Parameter sets come first; skip the slice data
+        }
+        nal = next;
+        nal_len = next_len;
+    }
+
+    if (playing) {
+        arena_send(srv);
+        srv->stats.sends++;
+    }
+    if (frame_end) {
+        srv->stats.frames++;
+    }
+    int built = (int)(srv->stats.packets - packets);
+
+    pthread_mutex_unlock(&srv->lock);
+    return built;
+}
+
+void rtsp_server_venc_consumer(const VENC_PACK_S* pack, const uint8_t* data,
+                               uint32_t len, void* user) {
+    rtsp_server_send((rtsp_server_t*)user, data, len, pack->u64PTS, pack->bFrameEnd);
+}
+
+// ---------------------------------------------------------------------------
+// RTSP control
+// ---------------------------------------------------------------------------
+
+static void rtsp_reply(rtsp_client_t* c, int code, const char* reason, const char* cseq,
+                       const char* headers, const char* body) {
+    char buf[4096];
+    int n = snprintf(buf, sizeof(buf), "RTSP/1.0 %d %s\r\nCSeq: %s\r\nServer: luckfox-uav\r\n%s",
+                     code, reason, cseq, headers ? headers : "");
+    if (body) {
+        n += snprintf(buf + n, sizeof(buf) - n, "Content-Length: %zu\r\n\r\n%s", strlen(body), body);
+    } else {
+        n += snprintf(buf + n, sizeof(buf) - n, "\r\n");
+    }
+    if (n >= (int)sizeof(buf)) {
+        n = sizeof(buf) - 1;
+    }
+    client_write(c, buf, n);
+}
+
+static void build_sdp(rtsp_server_t* srv, rtsp_client_t* c, char* sdp, size_t size) {
+    struct sockaddr_in local;
+    socklen_t local_len = sizeof(local);
+    char ip[INET_ADDRSTRLEN] = "0.0.0.0";
+    if (getsockname(c->fd, (struct sockaddr*)&local, &local_len) == 0) {
+        inet_ntop(AF_INET, &local.sin_addr, ip, sizeof(ip));
+    }
+
+    char fmtp[1200];
+    char b64[3][RTP_PARAM_SET_MAX * 4 / 3 + 8];
+    base64_encode(srv->vps, srv->vps_len, b64[0], sizeof(b64[0]));
+    base64_encode(srv->sps, srv->sps_len, b64[1], sizeof(b64[1]));
+    base64_encode(srv->pps, srv->pps_len, b64[2], sizeof(b64[2]));
+
+    if (srv->codec == RTP_CODEC_H265) {
+        if (srv->vps_len && srv->sps_len && srv->pps_len) {
+            snprintf(fmtp, sizeof(fmtp), "a=fmtp:%d sprop-vps=%s;sprop-sps=%s;sprop-pps=%s\r\n",
+                     RTP_PT_VIDEO, b64[0], b64[1], b64[2]);
+        } else {
+            fmtp[0] = '\0';
+        }
+    } else if (srv->sps_len && srv->pps_len) {
+        snprintf(fmtp, sizeof(fmtp),
+                 "a=fmtp:%d packetization-mode=1;profile-level-id=%02X%02X%02X;sprop-parameter-sets=%s,%s\r\n",
+                 RTP_PT_VIDEO, srv->sps[1], srv->sps[2], srv->sps[3], b64[1], b64[2]);
+    } else {
+        snprintf(fmtp, sizeof(fmtp), "a=fmtp:%d packetization-mode=1\r\n", RTP_PT_VIDEO);
+    }
+
+    snprintf(sdp, size,
+             "v=0\r\n"
+             "o=- %u 1 IN IP4 %s\r\n"
+             "s=Luckfox UAV\r\n"
+             "c=IN IP4 0.0.0.0\r\n"
+             "t=0 0\r\n"
+             "a=control:*\r\n"
+             "m=video 0 RTP/AVP %d\r\n"
+             "a=rtpmap:%d %s/90000\r\n"
+             "%s"
+             "a=control:track0\r\n",
+             srv->ssrc, ip, RTP_PT_VIDEO, RTP_PT_VIDEO,
+             srv->codec == RTP_CODEC_H265 ? "H265" : "H264", fmtp);
+}
+
+static void handle_setup(rtsp_server_t* srv, rtsp_client_t* c, const char* req, const char* cseq) {
+    char transport[256], headers[512];
+    if (!header_value(req, "Transport", transport, sizeof(transport))) {
+        rtsp_reply(c, 461, "Unsupported Transport", cseq, NULL, NULL);
+        return;
+    }
+    if (c->session == 0) {
+        c->session = rand32() | 1;
+    }
+
+    const char* p;
+    if (strstr(transport, "RTP/AVP/TCP")) {
+        int rtp = 0, rtcp = 1;
+        if ((p = strstr(transport, "interleaved="))) {
+            sscanf(p, "interleaved=%d-%d", &rtp, &rtcp);
+        }
+        c->tcp = true;
+        c->channel = (uint8_t)rtp;
+        snprintf(headers, sizeof(headers),
+                 "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d;ssrc=%08X\r\n"
+                 "Session: %08X;timeout=%d\r\n",
+                 rtp, rtcp, srv->ssrc, c->session, RTSP_SESSION_TIMEOUT);
+    } else {
+        int rtp = 0, rtcp = 0;
+        if (!(p = strstr(transport, "client_port=")) ||
+            sscanf(p, "client_port=%d-%d", &rtp, &rtcp) < 1 || rtp <= 0) {
+            rtsp_reply(c, 461, "Unsupported Transport", cseq, NULL, NULL);
+            return;
+        }
+        if (rtcp <= 0) {
+            rtcp = rtp + 1;
+        }
+        c->tcp = false;
+        c->rtp_dest = c->peer;
+        c->rtp_dest.sin_port = htons(rtp);
+        snprintf(headers, sizeof(headers),
+                 "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d;ssrc=%08X\r\n"
+                 "Session: %08X;timeout=%d\r\n",
+                 rtp, rtcp, srv->rtp_port, srv->rtp_port + 1, srv->ssrc,
+                 c->session, RTSP_SESSION_TIMEOUT);
+    }
+
+    c->state = RTSP_CLIENT_READY;
+    rtsp_reply(c, 200, "OK", cseq, headers, NULL);
+}
+
+// Returns true when the client just started playing
+static bool handle_request(rtsp_server_t* srv, rtsp_client_t* c, const char* req) {
+    char method[16] = "", url[256] = "", cseq[16] = "0", headers[1024];
+    sscanf(req, "%15s %255s", method, url);
+    header_value(req, "CSeq", cseq, sizeof(cseq));
+
+    if (strcmp(method, "OPTIONS") == 0) {
+        rtsp_reply(c, 200, "OK", cseq,
+                   "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER, SET_PARAMETER\r\n",
+                   NULL);
+    } else if (strcmp(method, "DESCRIBE") == 0) {
+        if (!strstr(url, srv->path)) {
+            rtsp_reply(c, 404, "Not Found", cseq, NULL, NULL);
+            return false;
+        }
+        char sdp[2048];
+        build_sdp(srv, c, sdp, sizeof(sdp));
+        snprintf(headers, sizeof(headers),
+                 "Content-Base: %s/\r\nContent-Type: application/sdp\r\n", url);
+        rtsp_reply(c, 200, "OK", cseq, headers, sdp);
+    } else if (strcmp(method, "SETUP") == 0) {
+        handle_setup(srv, c, req, cseq);
+    } else if (strcmp(method, "PLAY") == 0) {
+        if (c->state < RTSP_CLIENT_READY) {
+            rtsp_reply(c, 455, "Method Not Valid in This State", cseq, NULL, NULL);
+            return false;
+        }
+        snprintf(headers, sizeof(headers),
+                 "Session: %08X;timeout=%d\r\nRange: npt=0.000-\r\nRTP-Info: url=%s;seq=%u\r\n",
+                 c->session, RTSP_SESSION_TIMEOUT, url, srv->seq);
+        rtsp_reply(c, 200, "OK", cseq, headers, NULL);
+        bool started = c->state != RTSP_CLIENT_PLAYING;
+        c->state = RTSP_CLIENT_PLAYING;
+        srv->stats.sessions += started;
+        return started;
+    } else if (strcmp(method, "PAUSE") == 0) {
+        if (c->state == RTSP_CLIENT_PLAYING) {
+            c->state = RTSP_CLIENT_READY;
+        }
+        snprintf(headers, sizeof(headers), "Session: %08X\r\n", c->session);
+        rtsp_reply(c, 200, "OK", cseq, headers, NULL);
+    } else if (strcmp(method, "TEARDOWN") == 0) {
+        snprintf(headers, sizeof(headers), "Session: %08X\r\n", c->session);
+        rtsp_reply(c, 200, "OK", cseq, headers, NULL);
+        c->dead = true;
+    } else if (strcmp(method, "GET_PARAMETER") == 0 || strcmp(method, "SET_PARAMETER") == 0) {
+        // Keep-alive
+        snprintf(headers, sizeof(headers), "Session: %08X\r\n", c->session);
+        rtsp_reply(c, 200, "OK", cseq, headers, NULL);
+    } else {
+        rtsp_reply(c, 501, "Not Implemented", cseq, NULL, NULL);
+    }
+    return false;
+}
+
+// Returns the number of clients that started playing
+static int client_read(rtsp_server_t* srv, rtsp_client_t* c) {
+    ssize_t n = recv(c->fd, c->rx + c->rx_len, RTSP_RX_BUF - c->rx_len, MSG_DONTWAIT);
+    if (n <= 0) {
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            c->dead = true;
+        }
+        return 0;
+    }
+    c->rx_len += n;
+
+    int started = 0;
+    while (c->rx_len > 0 && !c->dead) {
+        size_t used;
+        if (c->rx[0] == '$') {
+            // Interleaved RTCP from the client
+            if (c->rx_len < 4) {
+                break;
+            }
+            used = 4 + (((uint8_t)c->rx[2] << 8) | (uint8_t)c->rx[3]);
+            if (used > RTSP_RX_BUF) {
+                c->dead = true;
+                break;
+            }
+            if (c->rx_len < used) {
+                break;
+            }
+        } else {
+            char* end = (char*)memmem(c->rx, c->rx_len, "\r\n\r\n", 4);
+            if (!end) {
+                if (c->rx_len == RTSP_RX_BUF) {
+                    c->dead = true;     // Oversized request
+                }
+                break;
+            }
+            size_t header_len = end + 4 - c->rx;
+
+            char req[RTSP_RX_BUF + 1];
+            memcpy(req, c->rx, header_len);
+            req[header_len] = '\0';
+
+            char value[16];
+            size_t body = 0;
+            if (header_value(req, "Content-Length", value, sizeof(value))) {
+                body = strtoul(value, NULL, 10);
+            }
+            used = header_len + body;
+            if (used > RTSP_RX_BUF) {
+                c->dead = true;
+                break;
+            }
+            if (c->rx_len < used) {
+                break;
+            }
+            started += handle_request(srv, c, req);
+        }
+        memmove(c->rx, c->rx + used, c->rx_len - used);
+        c->rx_len -= used;
+    }
+    return started;
+}
+
+static void client_close(rtsp_client_t* c) {
+    if (c->fd >= 0) {
+        close(c->fd);
+    }
+    free(c->backlog);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+static void accept_client(rtsp_server_t* srv) {
+    struct sockaddr_in peer;
+    socklen_t peer_len = sizeof(peer);
+    int fd = accept4(srv->listen_fd, (struct sockaddr*)&peer, &peer_len,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    rtsp_client_t* c = NULL;
+    for (int i = 0; i < RTSP_SERVER_MAX_CLIENTS && !c; i++) {
+        if (srv->clients[i].state == RTSP_CLIENT_FREE) {
+            c = &srv->clients[i];
+        }
+    }
+    uint8_t* backlog = c ? (uint8_t*)malloc(RTSP_TCP_BACKLOG) : NULL;
+    if (!backlog) {
+        fprintf(stderr, "rtsp_server: rejecting %s, no free client slot\n", inet_ntoa(peer.sin_addr));
+        close(fd);
+        return;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    memset(c, 0, sizeof(*c));
+    c->state = RTSP_CLIENT_CONNECTED;
+    c->fd = fd;
+    c->peer = peer;
+    c->backlog = backlog;
+    printf("rtsp_server: client %s:%d connected\n", inet_ntoa(peer.sin_addr), ntohs(peer.sin_port));
+}
+
+static void* rtsp_server_thread(void* arg) {
+    rtsp_server_t* srv = (rtsp_server_t*)arg;
+    struct pollfd pfds[2 + RTSP_SERVER_MAX_CLIENTS];
+    int slot[2 + RTSP_SERVER_MAX_CLIENTS];
+
+    while (srv->running) {
+        int n = 0;
+        pthread_mutex_lock(&srv->lock);
+        for (int i = 0; i < RTSP_SERVER_MAX_CLIENTS; i++) {
+            rtsp_client_t* c = &srv->clients[i];
+            if (c->state == RTSP_CLIENT_FREE) {
+                continue;
+            }
+            if (c->dead) {
+                backlog_flush(c);       // Last words, e.g. the TEARDOWN reply
+                printf("rtsp_server: client %s:%d closed\n",
+                       inet_ntoa(c->peer.sin_addr), ntohs(c->peer.sin_port));
+                client_close(c);
+                continue;
+            }
+            pfds[n].fd = c->fd;
+            pfds[n].events = POLLIN | (c->backlog_len ? POLLOUT : 0);
+            slot[n++] = i;
+        }
+        pthread_mutex_unlock(&srv->lock);
+
+        pfds[n].fd = srv->listen_fd;
+        pfds[n].events = POLLIN;
+        slot[n++] = -1;
+        pfds[n].fd = srv->rtcp_fd;
+        pfds[n].events = POLLIN;
+        slot[n++] = -2;
+
+        if (poll(pfds, n, 20) <= 0) {
+            continue;
+        }
+
+        int started = 0;
+        pthread_mutex_lock(&srv->lock);
+        for (int k = 0; k < n; k++) {
+            if (!pfds[k].revents) {
+                continue;
+            }
+            if (slot[k] == -1) {
+                accept_client(srv);
+            } else if (slot[k] == -2) {
+                char rr[1500];
+                while (recv(srv->rtcp_fd, rr, sizeof(rr), MSG_DONTWAIT) > 0) {
+                }
+            } else {
+                rtsp_client_t* c = &srv->clients[slot[k]];
+                if (pfds[k].revents & POLLIN) {
+                    started += client_read(srv, c);
+                }
+                if (pfds[k].revents & POLLOUT) {
+                    backlog_flush(c);
+                }
+                if (pfds[k].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                    c->dead = true;
+                }
+            }
+        }
+        pthread_mutex_unlock(&srv->lock);
+
+        // Outside the lock: the callback may talk to the encoder
+        for (; started > 0; started--) {
+            if (srv->on_play) {
+                srv->on_play(srv->on_play_user);
+            }
+        }
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Lifecycle
+// ---------------------------------------------------------------------------
+
+static int bind_socket(int type, int port) {
+    int fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("rtsp_server: socket");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "rtsp_server: bind port %d: %s\n", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int rtsp_server_start(rtsp_server_t* srv, int port, const char* path, rtp_codec_t codec) {
+    memset(srv, 0, sizeof(*srv));
+    srv->listen_fd = srv->rtp_fd = srv->rtcp_fd = -1;
+    for (int i = 0; i < RTSP_SERVER_MAX_CLIENTS; i++) {
+        srv->clients[i].fd = -1;
+    }
+    srv->port = port;
+    srv->rtp_port = port + 2;
+    srv->codec = codec;
+    snprintf(srv->path, sizeof(srv->path), "%s", path);
+    pthread_mutex_init(&srv->lock, NULL);
+
+    srv->arena = (uint8_t(*)[RTP_SLOT_SIZE])malloc((size_t)RTP_ARENA_PACKETS * RTP_SLOT_SIZE);
+    srv->msgs = (struct mmsghdr*)calloc(RTP_ARENA_PACKETS, sizeof(struct mmsghdr));
+    srv->iov = (struct iovec*)calloc(2 * RTP_ARENA_PACKETS, sizeof(struct iovec));
+    srv->prefix = (uint8_t(*)[4])malloc((size_t)RTP_ARENA_PACKETS * 4);
+    if (!srv->arena || !srv->msgs || !srv->iov || !srv->prefix) {
+        fprintf(stderr, "rtsp_server: out of memory\n");
+        rtsp_server_stop(srv);
+        return -1;
+    }
+
+    srv->listen_fd = bind_socket(SOCK_STREAM, port);
+    srv->rtp_fd = bind_socket(SOCK_DGRAM, srv->rtp_port);
+    srv->rtcp_fd = bind_socket(SOCK_DGRAM, srv->rtp_port + 1);
+    if (srv->listen_fd < 0 || srv->rtp_fd < 0 || srv->rtcp_fd < 0 ||
+        listen(srv->listen_fd, 4) != 0) {
+        rtsp_server_stop(srv);
+        return -1;
+    }
+
+    // Room for a few IDR frames per client in the kernel
+    int sndbuf = 1024 * 1024;
+    setsockopt(srv->rtp_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    srv->ssrc = rand32();
+    srv->seq = (uint16_t)rand32();
+    srv->ts_offset = rand32();
+
+    srv->running = 1;
+    if (pthread_create(&srv->thread, NULL, rtsp_server_thread, srv) != 0) {
+        perror("rtsp_server: pthread_create");
+        srv->running = 0;
+        rtsp_server_stop(srv);
+        return -1;
+    }
+
+    printf("rtsp_server: rtsp://<board>:%d%s (%s, RTP/UDP from port %d)\n",
+           port, srv->path, codec == RTP_CODEC_H265 ? "H.265" : "H.264", srv->rtp_port);
+    return 0;
+}
+
+void rtsp_server_set_play_callback(rtsp_server_t* srv, void (*fn)(void* user), void* user) {
+    pthread_mutex_lock(&srv->lock);
+    srv->on_play = fn;
+    srv->on_play_user = user;
+    pthread_mutex_unlock(&srv->lock);
+}
+
+void rtsp_server_print_stats(rtsp_server_t* srv) {
+    pthread_mutex_lock(&srv->lock);
+    printf("RTSP server: frames=%llu packets=%llu sessions=%llu arena_flushes=%llu\n",
+           (unsigned long long)srv->stats.frames,
+           (unsigned long long)srv->stats.packets,
+           (unsigned long long)srv->stats.sessions,
+           (unsigned long long)srv->stats.arena_flushes);
+    for (int i = 0; i < RTSP_SERVER_MAX_CLIENTS; i++) {
+        rtsp_client_t* c = &srv->clients[i];
+        if (c->state == RTSP_CLIENT_FREE) {
+            continue;
+        }
+        if (c->state == RTSP_CLIENT_PLAYING) {
+            update_queue(c, c->tcp ? c->fd : srv->rtp_fd);
+        }
+        printf("  %s:%d %s %s: packets=%llu dropped=%llu queue=%u max=%u syscalls=%llu\n",
+               inet_ntoa(c->peer.sin_addr), ntohs(c->peer.sin_port),
+               c->tcp ? "tcp" : "udp",
+               c->state == RTSP_CLIENT_PLAYING ? "playing" : "idle",
+               (unsigned long long)c->stats.packets,
+               (unsigned long long)c->stats.dropped_packets,
+               c->stats.queue_bytes, c->stats.queue_max,
+               (unsigned long long)c->stats.syscalls);
+    }
+    pthread_mutex_unlock(&srv->lock);
+}
+
+void rtsp_server_stop(rtsp_server_t* srv) {
+    if (srv->running) {
+        srv->running = 0;
+        pthread_join(srv->thread, NULL);
+    }
+    for (int i = 0; i < RTSP_SERVER_MAX_CLIENTS; i++) {
+        if (srv->clients[i].state != RTSP_CLIENT_FREE) {
+            client_close(&srv->clients[i]);
+        }
+    }
+    if (srv->listen_fd >= 0) close(srv->listen_fd);
+    if (srv->rtp_fd >= 0) close(srv->rtp_fd);
+    if (srv->rtcp_fd >= 0) close(srv->rtcp_fd);
+    srv->listen_fd = srv->rtp_fd = srv->rtcp_fd = -1;
+
+    free(srv->arena);
+    free(srv->msgs);
+    free(srv->iov);
+    free(srv->prefix);
+    srv->arena = NULL;
+    srv->msgs = NULL;
+    srv->iov = NULL;
+    srv->prefix = NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Loopback self-test
+// ---------------------------------------------------------------------------
+
+#define SELFTEST_FRAME_MAX (1024 * 1024)
+#define SELFTEST_PTS_STEP 40000             // 25 fps, 3600 ticks of 90 kHz
+#define SELFTEST_IN_FLIGHT 4
+
+typedef struct {
+    rtp_codec_t codec;
+    bool tcp;
+    int rtsp_fd;
+    int rtp_fd;                             // UDP runs only
+    volatile int running;
+    pthread_t thread;
+
+    rtp_depack_t depack;
+    uint8_t* expect;
+    bool have_ts;
+    uint32_t first_ts;
+    volatile uint32_t frames_done;
+    uint32_t ok, mismatched, damaged;
+    uint64_t last_rx_us;
+} selftest_rx_t;
+
+static size_t selftest_nal(rtp_codec_t codec, uint8_t type, size_t size, uint32_t* rng,
+                           uint8_t* out) {
+    size_t n = 0;
+    out[n++] = 0; out[n++] = 0; out[n++] = 0; out[n++] = 1;
+    if (codec == RTP_CODEC_H265) {
+        out[n++] = type << 1;
+        out[n++] = 1;
+    } else {
+        out[n++] = 0x60 | type;
+    }
+    // No zero bytes, so no start code lookalikes
+    for (size_t i = 0; i < size; i++) {
+        out[n++] = 1 + selftest_rand(rng) % 255;
+    }
+    return n;
+}
+
+// Deterministic frame i; *split is where a two-slice send divides it (0 = none)
+static size_t selftest_frame(rtp_codec_t codec, uint32_t i, uint8_t* out, size_t* split) {
+    uint32_t rng = (i + 1) * 2654435761u;
+    bool hevc = codec == RTP_CODEC_H265;
+    size_t n = 0;
+    *split = 0;
+
+    bool key = i % 30 == 0;
+    if (key) {
+        if (hevc) {
+            n += selftest_nal(codec, 32, 20, &rng, out + n);
+        }
+        n += selftest_nal(codec, hevc ? 33 : 7, 30, &rng, out + n);
+        n += selftest_nal(codec, hevc ? 34 : 8, 6, &rng, out + n);
+    }
+
+    // Every 50th frame outgrows the packet arena
+    int slices = i % 50 == 49 ? 2 : 1 + selftest_rand(&rng) % 4;
+    for (int s = 0; s < slices; s++) {
+        size_t size;
+        uint32_t r = selftest_rand(&rng);
+        if (i % 50 == 49) {
+            size = 400 * 1024;
+        } else if (r % 4 == 0) {
+            size = 2000 + r % 30000;
+        } else {
+            size = 10 + r % 1600;
+        }
+        if (s == 1 && i % 3 == 0) {
+            *split = n;
+        }
+        uint8_t type = key ? (hevc ? 19 : 5) : 1;
+        n += selftest_nal(codec, type, size, &rng, out + n);
+    }
+    return n;
+}
+
+static void selftest_on_frame(const uint8_t* frame, size_t len, uint32_t ts, bool damaged,
+                              void* user) {
+    selftest_rx_t* rx = (selftest_rx_t*)user;
+    if (!rx->have_ts) {
+        rx->first_ts = ts;
+        rx->have_ts = true;
+    }
+    uint32_t index = (ts - rx->first_ts) / (SELFTEST_PTS_STEP * 9 / 100);
+
+    size_t split;
+    size_t expect_len = selftest_frame(rx->codec, index, rx->expect, &split);
+    if (damaged) {
+        rx->damaged++;
+    } else if (expect_len == len && memcmp(rx->expect, frame, len) == 0) {
+        rx->ok++;
+    } else {
+        rx->mismatched++;
+    }
+    __atomic_store_n(&rx->frames_done, rx->frames_done + 1, __ATOMIC_RELEASE);
+}
+
+static void* selftest_rx_thread(void* arg) {
+    selftest_rx_t* rx = (selftest_rx_t*)arg;
+    uint8_t* buf = (uint8_t*)malloc(64 * 1024 * 2);
+    size_t have = 0;
+
+    while (rx->running) {
+        struct pollfd pfd;
+        pfd.fd = rx->tcp ? rx->rtsp_fd : rx->rtp_fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 50) <= 0) {
+            continue;
+        }
+
+        if (!rx->tcp) {
+            struct mmsghdr msgs[32];
+            struct iovec iov[32];
+            for (int i = 0; i < 32; i++) {
+                iov[i].iov_base = buf + i * 2048;
+                iov[i].iov_len = 2048;
+                memset(&msgs[i], 0, sizeof(msgs[i]));
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            int n = recvmmsg(rx->rtp_fd, msgs, 32, MSG_DONTWAIT, NULL);
+            for (int i = 0; i < n; i++) {
+                rtp_depack_push(&rx->depack, buf + i * 2048, msgs[i].msg_len,
+                                selftest_on_frame, rx);
+            }
+        } else {
+            ssize_t n = recv(rx->rtsp_fd, buf + have, 64 * 1024 * 2 - have, MSG_DONTWAIT);
+            if (n <= 0) {
+                continue;
+            }
+            have += n;
+            size_t pos = 0;
+            while (have - pos >= 4 && buf[pos] == '$') {
+                size_t len = ((size_t)buf[pos + 2] << 8) | buf[pos + 3];
+                if (have - pos < 4 + len) {
+                    break;
+                }
+                if (buf[pos + 1] == 0) {
+                    rtp_depack_push(&rx->depack, buf + pos + 4, len, selftest_on_frame, rx);
+                }
+                pos += 4 + len;
+            }
+            memmove(buf, buf + pos, have - pos);
+            have -= pos;
+        }
+        rx->last_rx_us = TEST_COMM_GetNowUs();
+    }
+
+    free(buf);
+    return NULL;
+}
+
+// Send a request and read the response headers (and body) into resp
+static int selftest_request(int fd, const char* req, char* resp, size_t size) {
+    if (send(fd, req, strlen(req), MSG_NOSIGNAL) != (ssize_t)strlen(req)) {
+        return -1;
+    }
+    size_t have = 0;
+    while (have + 1 < size) {
+        ssize_t n = recv(fd, resp + have, size - 1 - have, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        have += n;
+        resp[have] = '\0';
+        char* end = strstr(resp, "\r\n\r\n");
+        if (end) {
+            char value[16];
+            size_t body = header_value(resp, "Content-Length", value, sizeof(value)) ?
+                          strtoul(value, NULL, 10) : 0;
+            if (have >= (size_t)(end + 4 - resp) + body) {
+                return strncmp(resp, "RTSP/1.0 200", 12) == 0 ? 0 : -1;
+            }
+        }
+    }
+    return -1;
+}
+
+static int selftest_play(int port, selftest_rx_t* rx) {
+    char req[512], resp[4096], session[32], url[128];
+    snprintf(url, sizeof(url), "rtsp://127.0.0.1:%d/live/0", port);
+
+    rx->rtsp_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct timeval tv = { 2, 0 };
+    setsockopt(rx->rtsp_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(rx->rtsp_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("rtsp selftest: connect");
+        return -1;
+    }
+
+    snprintf(req, sizeof(req), "OPTIONS %s RTSP/1.0\r\nCSeq: 1\r\n\r\n", url);
+    if (selftest_request(rx->rtsp_fd, req, resp, sizeof(resp)) != 0) {
+        return -1;
+    }
+    snprintf(req, sizeof(req), "DESCRIBE %s RTSP/1.0\r\nCSeq: 2\r\nAccept: application/sdp\r\n\r\n", url);
+    if (selftest_request(rx->rtsp_fd, req, resp, sizeof(resp)) != 0 ||
+        !strstr(resp, rx->codec == RTP_CODEC_H265 ? "H265/90000" : "H264/90000")) {
+        fprintf(stderr, "rtsp selftest: bad DESCRIBE response\n%s\n", resp);
+        return -1;
+    }
+
+    if (rx->tcp) {
+        snprintf(req, sizeof(req),
+                 "SETUP %s/track0 RTSP/1.0\r\nCSeq: 3\r\nTransport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n\r\n",
+                 url);
+    } else {
+        rx->rtp_fd = bind_socket(SOCK_DGRAM, 0);
+        int rcvbuf = 16 * 1024 * 1024;
+        if (setsockopt(rx->rtp_fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) != 0) {
+            setsockopt(rx->rtp_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        }
+        struct sockaddr_in local;
+        socklen_t local_len = sizeof(local);
+        getsockname(rx->rtp_fd, (struct sockaddr*)&local, &local_len);
+        snprintf(req, sizeof(req),
+                 "SETUP %s/track0 RTSP/1.0\r\nCSeq: 3\r\nTransport: RTP/AVP;unicast;client_port=%d-%d\r\n\r\n",
+                 url, ntohs(local.sin_port), ntohs(local.sin_port) + 1);
+    }
+    if (selftest_request(rx->rtsp_fd, req, resp, sizeof(resp)) != 0 ||
+        !header_value(resp, "Session", session, sizeof(session))) {
+        fprintf(stderr, "rtsp selftest: SETUP failed\n%s\n", resp);
+        return -1;
+    }
+    session[strcspn(session, ";")] = '\0';
+
+    snprintf(req, sizeof(req), "PLAY %s RTSP/1.0\r\nCSeq: 4\r\nSession: %s\r\n\r\n", url, session);
+    return selftest_request(rx->rtsp_fd, req, resp, sizeof(resp));
+}
+
+static int selftest_run(int port, rtp_codec_t codec, bool tcp, int frames, uint8_t* frame) {
+    const char* name = codec == RTP_CODEC_H265 ? "H.265" : "H.264";
+    const char* transport = tcp ? "TCP" : "UDP";
+
+    static rtsp_server_t srv;
+    if (rtsp_server_start(&srv, port, "/live/0", codec) != 0) {
+        return -1;
+    }
+
+    selftest_rx_t rx;
+    memset(&rx, 0, sizeof(rx));
+    rx.codec = codec;
+    rx.tcp = tcp;
+    rx.rtsp_fd = rx.rtp_fd = -1;
+    rx.expect = (uint8_t*)malloc(SELFTEST_FRAME_MAX);
+    rtp_depack_init(&rx.depack, codec, SELFTEST_FRAME_MAX);
+
+    int ret = -1;
+    if (selftest_play(port, &rx) != 0) {
+        fprintf(stderr, "rtsp selftest %s/%s: RTSP handshake failed\n", name, transport);
+    } else {
+        rx.running = 1;
+        pthread_create(&rx.thread, NULL, selftest_rx_thread, &rx);
+
+        uint64_t start = TEST_COMM_GetNowUs();
+        uint64_t packets = 0;
+        for (int i = 0; i < frames; i++) {
+            // Keep a few frames in flight so the receiver sets the pace
+            uint64_t wait_start = TEST_COMM_GetNowUs();
+            while (i - (int)__atomic_load_n(&rx.frames_done, __ATOMIC_ACQUIRE) > SELFTEST_IN_FLIGHT &&
+                   TEST_COMM_GetNowUs() - wait_start < 1000000) {
+                usleep(50);
+            }
+
+            size_t split;
+            size_t len = selftest_frame(codec, i, frame, &split);
+            uint64_t pts = (uint64_t)i * SELFTEST_PTS_STEP;
+            if (split) {
+                packets += rtsp_server_send(&srv, frame, split, pts, false);
+                packets += rtsp_server_send(&srv, frame + split, len - split, pts, true);
+            } else {
+                packets += rtsp_server_send(&srv, frame, len, pts, true);
+            }
+        }
+
+        // Drain: until every frame is in or the link goes quiet
+        while (__atomic_load_n(&rx.frames_done, __ATOMIC_ACQUIRE) < (uint32_t)frames &&
+               TEST_COMM_GetNowUs() - (rx.last_rx_us > start ? rx.last_rx_us : start) < 500000) {
+            usleep(1000);
+        }
+        double seconds = (TEST_COMM_GetNowUs() - start) / 1e6;
+        rx.running = 0;
+        pthread_join(rx.thread, NULL);
+
+        uint64_t bytes = 0, dropped = 0, syscalls = 0;
+        uint32_t queue_max = 0;
+        pthread_mutex_lock(&srv.lock);
+        for (int i = 0; i < RTSP_SERVER_MAX_CLIENTS; i++) {
+            rtsp_client_t* c = &srv.clients[i];
+            if (c->state == RTSP_CLIENT_PLAYING) {
+                bytes = c->stats.bytes;
+                dropped = c->stats.dropped_packets;
+                syscalls = c->stats.syscalls;
+                queue_max = c->stats.queue_max;
+            }
+        }
+        uint64_t flushes = srv.stats.arena_flushes;
+        pthread_mutex_unlock(&srv.lock);
+
+        printf("rtsp selftest %s/%s: %u/%d frames ok, %u mismatched, %u damaged, %llu packets lost | "
+               "%llu packets in %.2f s = %.0f packets/s, %.1f Mbit/s | syscalls=%llu dropped=%llu queue max=%u arena flushes=%llu\n",
+               name, transport, rx.ok, frames, rx.mismatched, rx.damaged,
+               (unsigned long long)rx.depack.lost,
+               (unsigned long long)packets, seconds, packets / seconds, bytes * 8 / seconds / 1e6,
+               (unsigned long long)syscalls, (unsigned long long)dropped, queue_max,
+               (unsigned long long)flushes);
+        ret = rx.ok == (uint32_t)frames && rx.mismatched == 0 ? 0 : -1;
+    }
+
+    if (rx.rtsp_fd >= 0) close(rx.rtsp_fd);
+    if (rx.rtp_fd >= 0) close(rx.rtp_fd);
+    rtp_depack_free(&rx.depack);
+    free(rx.expect);
+    rtsp_server_stop(&srv);
+    return ret;
+}
+
+int rtsp_server_selftest(int port, int frames) {
+    uint8_t* frame = (uint8_t*)malloc(SELFTEST_FRAME_MAX);
+    if (!frame) {
+        return -1;
+    }
+
+    int failed = 0;
+    for (int codec = RTP_CODEC_H264; codec <= RTP_CODEC_H265; codec++) {
+        for (int tcp = 0; tcp <= 1; tcp++) {
+            failed += selftest_run(port, (rtp_codec_t)codec, tcp, frames, frame) != 0;
+        }
+    }
+
+    free(frame);
+    printf("rtsp selftest: %s\n", failed ? "FAIL" : "PASS");
+    return failed ? -1 : 0;
+}
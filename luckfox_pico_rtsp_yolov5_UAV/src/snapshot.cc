@@ -0,0 +1,381 @@
+#include "snapshot.h"
+#include "luckfox_mpi.h"
+#include "rga_hw_accel.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void* encode_thread(void* arg);
+
+int snapshot_start(snapshot_t* snap, const char* dir, float conf) {
+    memset(snap, 0, sizeof(*snap));
+    snprintf(snap->dir, sizeof(snap->dir), "%s", dir);
+    snap->conf = conf;
+    snap->chn = SNAPSHOT_VENC_CHN;
+    snap->block_size = (size_t)SNAPSHOT_WIDTH * SNAPSHOT_HEIGHT * 3;
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "snapshot: mkdir %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    // Every crop in flight or queued owns one block; none are allocated later
+    MB_POOL_CONFIG_S pool_cfg;
+    memset(&pool_cfg, 0, sizeof(pool_cfg));
+    pool_cfg.u64MBSize = snap->block_size;
+    pool_cfg.u32MBCnt = SNAPSHOT_POOL_BLOCKS;
+    pool_cfg.enAllocType = MB_ALLOC_TYPE_DMA;
+    snap->pool = RK_MPI_MB_CreatePool(&pool_cfg);
+    if (snap->pool == MB_INVALID_POOLID) {
+        fprintf(stderr, "snapshot: MB pool of %u x %zu bytes failed\n",
+                pool_cfg.u32MBCnt, snap->block_size);
+        return -1;
+    }
+    rga_handle_cache_reserve(SNAPSHOT_POOL_BLOCKS);
+
+    // The MJPEG path of venc_init() takes RGB888, which RGA produces while
+    // cropping. Snapshots are sparse stills, so fixed quality replaces CBR.
+    venc_profile_t profile;
+    memset(&profile, 0, sizeof(profile));
+    profile.name = "snapshot";
+    profile.bitrate_kbps = 2048;
+    profile.stream_buf_cnt = 2;
+    venc_init(snap->chn, SNAPSHOT_WIDTH, SNAPSHOT_HEIGHT, RK_VIDEO_ID_MJPEG, &profile);
+
+    VENC_CHN_ATTR_S attr;
+    memset(&attr, 0, sizeof(attr));
+    if (RK_MPI_VENC_GetChnAttr(snap->chn, &attr) != RK_SUCCESS) {
+        fprintf(stderr, "snapshot: VENC chn %d was not created\n", snap->chn);
+        RK_MPI_MB_DestroyPool(snap->pool);
+        return -1;
+    }
+    memset(&attr.stRcAttr, 0, sizeof(attr.stRcAttr));
+    attr.stRcAttr.enRcMode = VENC_RC_MODE_MJPEGFIXQP;
+    attr.stRcAttr.stMjpegFixQp.u32Qfactor = SNAPSHOT_QFACTOR;
+    if (RK_MPI_VENC_SetChnAttr(snap->chn, &attr) != RK_SUCCESS) {
+        fprintf(stderr, "snapshot: fixed quality on VENC chn %d failed, keeping CBR\n", snap->chn);
+    }
+
+    pthread_mutex_init(&snap->lock, NULL);
+    pthread_cond_init(&snap->cond, NULL);
+    snap->running = 1;
+    if (pthread_create(&snap->thread, NULL, encode_thread, snap) != 0) {
+        perror("snapshot: pthread_create");
+        snap->running = 0;
+        RK_MPI_VENC_StopRecvFrame(snap->chn);
+        RK_MPI_VENC_DestroyChn(snap->chn);
+        RK_MPI_MB_DestroyPool(snap->pool);
+        return -1;
+    }
+    snap->rate_us = TEST_COMM_GetNowUs();
+
+    printf("snapshot: %dx%d JPEG on VENC chn %d, conf >= %.2f, %u crop buffers, to %s\n",
+           SNAPSHOT_WIDTH, SNAPSHOT_HEIGHT, snap->chn, conf, pool_cfg.u32MBCnt, dir);
+    return 0;
+}
+
+// The snapshot history of the detection's tracker ID, or NULL for an ID not
+// seen within the TTL; free_slot is then where its history can start, -1 if
+// the table is full
+static snapshot_track_t* match_track(snapshot_t* snap, const mavlink_target_t* t,
+                                     uint64_t pts_us, int* free_slot) {
+    *free_slot = -1;
+    for (int i = 0; i < SNAPSHOT_MAX_TRACKS; i++) {
+        snapshot_track_t* tr = &snap->tracks[i];
+        if (tr->id == 0 || pts_us - tr->last_seen_us > SNAPSHOT_TRACK_TTL_MS * 1000ULL) {
+            if (*free_slot < 0) {
+                *free_slot = i;
+            }
+            continue;
+        }
+        if (tr->id == t->target_num) {
+            return tr;
+        }
+    }
+    return NULL;
+}
+
+// Box plus margin, grown to the snapshot's aspect ratio and kept inside the
+// frame, on the even coordinates NV12 needs
+static im_rect crop_rect(const mavlink_target_t* t, int width, int height) {
+    int cw = t->width + t->width * SNAPSHOT_MARGIN_PCT * 2 / 100;
+    int ch = t->height + t->height * SNAPSHOT_MARGIN_PCT * 2 / 100;
+    if (cw * SNAPSHOT_HEIGHT < ch * SNAPSHOT_WIDTH) {
+        cw = ch * SNAPSHOT_WIDTH / SNAPSHOT_HEIGHT;
+    } else {
+        ch = cw * SNAPSHOT_HEIGHT / SNAPSHOT_WIDTH;
+    }
+    if (cw < SNAPSHOT_MIN_CROP) {
+        cw = SNAPSHOT_MIN_CROP;
+    }
+    if (ch < SNAPSHOT_MIN_CROP) {
+        ch = SNAPSHOT_MIN_CROP;
+    }
+    if (cw > width) {
+        cw = width;
+    }
+    if (ch > height) {
+        ch = height;
+    }
+
+    int x = t->x + t->width / 2 - cw / 2;
+    int y = t->y + t->height / 2 - ch / 2;
+    x = x < 0 ? 0 : (x > width - cw ? width - cw : x);
+    y = y < 0 ? 0 : (y > height - ch ? height - ch : y);
+
+    im_rect r;
+    r.x = x & ~1;
+    r.y = y & ~1;
+    r.width = cw & ~1;
+    r.height = ch & ~1;
+    return r;
+}
+
+void snapshot_offer(snapshot_t* snap, MB_BLK frame, int width, int height,
+                    const mavlink_target_t* targets, int count, uint64_t pts_us) {
+    for (int i = 0; i < count; i++) {
+        const mavlink_target_t* t = &targets[i];
+        // Only confirmed tracks are worth a picture
+        if (t->target_num == 0 || t->width <= 0 || t->height <= 0) {
+            continue;
+        }
+        int free_slot;
+        snapshot_track_t* tr = match_track(snap, t, pts_us, &free_slot);
+        if (!tr && free_slot < 0) {
+            continue;
+        }
+        if (tr) {
+            tr->last_seen_us = pts_us;
+        }
+
+        // New tracks are shot once; later only a clearly better view is. A
+        // new track's history starts with its first queued crop, so one whose
+        // crop is dropped is tried again next frame.
+        bool want = !tr ||
+            (t->confidence >= snap->conf &&
+             t->confidence >= tr->shot_conf + SNAPSHOT_CONF_STEP &&
+             pts_us - tr->last_shot_us >= SNAPSHOT_COOLDOWN_MS * 1000ULL);
+        if (!want || snap->pending_count == SNAPSHOT_MAX_PER_FRAME) {
+            continue;
+        }
+
+        // The worker frees queue slots; a stale read only drops early
+        pthread_mutex_lock(&snap->lock);
+        uint32_t depth = snap->queue_head - snap->queue_tail;
+        pthread_mutex_unlock(&snap->lock);
+        if (depth + snap->pending_count >= SNAPSHOT_QUEUE) {
+            snap->stats.dropped_queue++;
+            continue;
+        }
+        MB_BLK mb = RK_MPI_MB_GetMB(snap->pool, snap->block_size, RK_FALSE);
+        if (mb == NULL) {
+            snap->stats.dropped_buffer++;
+            continue;
+        }
+
+        snapshot_job_t* job = &snap->pending[snap->pending_count];
+        job->mb = mb;
+        job->fence = -1;
+        job->info.track_id = t->target_num;
+        job->info.class_id = t->class_id;
+        job->info.confidence = t->confidence;
+        job->info.pts_us = pts_us;
+        job->info.rect = crop_rect(t, width, height);
+
+        // Crop, scale and NV12 -> RGB888 in one asynchronous RGA job
+        rga_buffer_t src = wrapbuffer_handle(rga_handle_from_mb(frame), width, height,
+                                             RK_FORMAT_YCbCr_420_SP);
+        rga_buffer_t dst = wrapbuffer_handle(rga_handle_from_mb(mb), SNAPSHOT_WIDTH,
+                                             SNAPSHOT_HEIGHT, RK_FORMAT_RGB_888);
+        rga_buffer_t pat;
+        memset(&pat, 0, sizeof(pat));
+        im_rect drect = { 0, 0, SNAPSHOT_WIDTH, SNAPSHOT_HEIGHT };
+        im_rect prect;
+        memset(&prect, 0, sizeof(prect));
+        IM_STATUS st = improcess(src, dst, pat, job->info.rect, drect, prect,
+                                 -1, &job->fence, NULL, IM_ASYNC);
+        if (st != IM_STATUS_SUCCESS && st != IM_STATUS_NOERROR) {
+            fprintf(stderr, "snapshot: RGA crop failed: %s\n", imStrError(st));
+            RK_MPI_MB_ReleaseMB(mb);
+            snap->stats.errors++;
+            continue;
+        }
+
+        if (!tr) {
+            tr = &snap->tracks[free_slot];
+            memset(tr, 0, sizeof(*tr));
+            tr->id = t->target_num;
+            tr->last_seen_us = pts_us;
+            snap->stats.tracks++;
+        }
+        tr->last_shot_us = pts_us;
+        tr->shot_conf = t->confidence;
+        snap->pending_count++;
+        snap->stats.crops++;
+    }
+}
+
+void snapshot_frame_done(snapshot_t* snap) {
+    if (snap->pending_count == 0) {
+        return;
+    }
+
+    // imsync() waits for the job and closes the fence
+    uint64_t t0 = TEST_COMM_GetNowUs();
+    for (int i = 0; i < snap->pending_count; i++) {
+        snapshot_job_t* job = &snap->pending[i];
+        if (job->fence >= 0 && imsync(job->fence) != IM_STATUS_SUCCESS) {
+            snap->stats.errors++;
+        }
+        job->fence = -1;
+    }
+    uint32_t wait = (uint32_t)(TEST_COMM_GetNowUs() - t0);
+    snap->stats.fence_wait_sum_us += wait;
+    if (wait > snap->stats.fence_wait_max_us) {
+        snap->stats.fence_wait_max_us = wait;
+    }
+
+    pthread_mutex_lock(&snap->lock);
+    for (int i = 0; i < snap->pending_count; i++) {
+        snap->queue[snap->queue_head % SNAPSHOT_QUEUE] = snap->pending[i];
+        snap->queue_head++;
+    }
+    uint32_t depth = snap->queue_head - snap->queue_tail;
+    snap->stats.depth = depth;
+    if (depth > snap->stats.depth_max) {
+        snap->stats.depth_max = depth;
+    }
+    pthread_cond_signal(&snap->cond);
+    pthread_mutex_unlock(&snap->lock);
+    snap->pending_count = 0;
+}
+
+// Encode one crop and write the JPEG; returns its size, or -1
+static long encode_job(snapshot_t* snap, const snapshot_job_t* job) {
+    VIDEO_FRAME_INFO_S frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.stVFrame.pMbBlk = job->mb;
+    frame.stVFrame.u32Width = SNAPSHOT_WIDTH;
+    frame.stVFrame.u32Height = SNAPSHOT_HEIGHT;
+    frame.stVFrame.u32VirWidth = SNAPSHOT_WIDTH;
+    frame.stVFrame.u32VirHeight = SNAPSHOT_HEIGHT;
+    frame.stVFrame.enPixelFormat = RK_FMT_RGB888;
+    frame.stVFrame.u32TimeRef = snap->file_no;
+    frame.stVFrame.u64PTS = job->info.pts_us;
+    if (RK_MPI_VENC_SendFrame(snap->chn, &frame, 1000) != RK_SUCCESS) {
+        fprintf(stderr, "snapshot: SendFrame to VENC chn %d failed\n", snap->chn);
+        return -1;
+    }
+
+    VENC_STREAM_S stream;
+    VENC_PACK_S pack;
+    memset(&stream, 0, sizeof(stream));
+    stream.pstPack = &pack;
+    if (RK_MPI_VENC_GetStream(snap->chn, &stream, 1000) != RK_SUCCESS) {
+        fprintf(stderr, "snapshot: no JPEG from VENC chn %d\n", snap->chn);
+        return -1;
+    }
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/snap%05u_t%u_c%u_%02d.jpg", snap->dir, snap->file_no++,
+             job->info.track_id, job->info.class_id, (int)(job->info.confidence * 100));
+    long len = -1;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "snapshot: open %s: %s\n", path, strerror(errno));
+    } else {
+        len = 0;
+        RK_U32 count = stream.u32PackCount ? stream.u32PackCount : 1;
+        for (RK_U32 i = 0; i < count && len >= 0; i++) {
+            const uint8_t* data = (const uint8_t*)RK_MPI_MB_Handle2VirAddr(stream.pstPack[i].pMbBlk);
+            if (write_all(fd, data, stream.pstPack[i].u32Len) != 0) {
+                fprintf(stderr, "snapshot: write %s: %s\n", path, strerror(errno));
+                len = -1;
+            } else {
+                len += stream.pstPack[i].u32Len;
+            }
+        }
+        close(fd);
+    }
+    RK_MPI_VENC_ReleaseStream(snap->chn, &stream);
+    return len;
+}
+
+static void* encode_thread(void* arg) {
+    snapshot_t* snap = (snapshot_t*)arg;
+
+    pthread_mutex_lock(&snap->lock);
+    for (;;) {
+        while (snap->running && snap->queue_head == snap->queue_tail) {
+            pthread_cond_wait(&snap->cond, &snap->lock);
+        }
+        if (snap->queue_head == snap->queue_tail) {
+            break;
+        }
+        // The slot stays counted in the depth until the JPEG is written
+        snapshot_job_t job = snap->queue[snap->queue_tail % SNAPSHOT_QUEUE];
+        pthread_mutex_unlock(&snap->lock);
+
+        long len = encode_job(snap, &job);
+        RK_MPI_MB_ReleaseMB(job.mb);
+        uint64_t now = TEST_COMM_GetNowUs();
+
+        pthread_mutex_lock(&snap->lock);
+        snap->queue_tail++;
+        snap->stats.depth = snap->queue_head - snap->queue_tail;
+        if (len < 0) {
+            snap->stats.errors++;
+        } else {
+            snap->stats.written++;
+            snap->stats.bytes += len;
+            uint32_t latency = now > job.info.pts_us ? (uint32_t)(now - job.info.pts_us) : 0;
+            snap->stats.latency_sum_us += latency;
+            if (latency > snap->stats.latency_max_us) {
+                snap->stats.latency_max_us = latency;
+            }
+        }
+    }
+    pthread_mutex_unlock(&snap->lock);
+    return NULL;
+}
+
+void snapshot_print_stats(snapshot_t* snap) {
+    pthread_mutex_lock(&snap->lock);
+    snapshot_stats_t st = snap->stats;
+    pthread_mutex_unlock(&snap->lock);
+
+    uint64_t now = TEST_COMM_GetNowUs();
+    double seconds = (now - snap->rate_us) / 1e6;
+    double rate = seconds > 0 ? (st.crops - snap->rate_crops) / seconds : 0;
+    snap->rate_crops = st.crops;
+    snap->rate_us = now;
+
+    printf("Snapshots: %.1f crops/s | tracks=%llu crops=%llu written=%llu (%llu KB) | queue %u (max %u) "
+           "| dropped full=%llu no-buffer=%llu errors=%llu | fence wait %llu us per crop, max=%u us "
+           "| capture->JPEG avg=%llu max=%u us\n",
+           rate, (unsigned long long)st.tracks, (unsigned long long)st.crops,
+           (unsigned long long)st.written, (unsigned long long)(st.bytes / 1024),
+           st.depth, st.depth_max,
+           (unsigned long long)st.dropped_queue, (unsigned long long)st.dropped_buffer,
+           (unsigned long long)st.errors,
+           (unsigned long long)(st.crops ? st.fence_wait_sum_us / st.crops : 0), st.fence_wait_max_us,
+           (unsigned long long)(st.written ? st.latency_sum_us / st.written : 0), st.latency_max_us);
+}
+
+void snapshot_stop(snapshot_t* snap) {
+    snapshot_frame_done(snap);
+
+    pthread_mutex_lock(&snap->lock);
+    snap->running = 0;
+    pthread_cond_signal(&snap->cond);
+    pthread_mutex_unlock(&snap->lock);
+    pthread_join(snap->thread, NULL);
+
+    RK_MPI_VENC_StopRecvFrame(snap->chn);
+    RK_MPI_VENC_DestroyChn(snap->chn);
+    RK_MPI_MB_DestroyPool(snap->pool);
+}
@@ -0,0 +1,603 @@
+#include "target_tracker.h"
+#include "detection_sei.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Noise, relative to the box height so near and far targets behave alike.
+// Process noise is given per frame at TRACKER_NOISE_FPS and scaled by the
+// real frame interval.
+#define TRACKER_NOISE_FPS 20.0f
+#define TRACKER_STD_POS 0.05f           // Position drift per frame, box heights
+#define TRACKER_STD_VEL 0.1f            // Velocity drift per frame, box heights per second
+#define TRACKER_STD_MEAS 0.05f          // Detector box error, box heights
+#define TRACKER_STD_VEL_INIT 2.0f       // Unknown velocity of a new track, box heights per second
+#define TRACKER_MAX_DT_S 0.5f           // Longest gap predicted across
+
+// Track states an association stage draws from
+#define STATE_BIT(s) (1u << (s))
+
+static uint64_t mono_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void target_tracker_init(target_tracker_t* trk) {
+    memset(trk, 0, sizeof(*trk));
+    trk->next_id = 1;
+}
+
+// ---------------------------------------------------------------------------
+// Kalman filter
+// ---------------------------------------------------------------------------
+
+static void axis_init(tracker_axis_t* a, float z, float scale) {
+    float sp = 2.0f * TRACKER_STD_MEAS * scale;
+    float sv = TRACKER_STD_VEL_INIT * scale;
+    a->p = z;
+    a->v = 0.0f;
+    a->p00 = sp * sp;
+    a->p01 = 0.0f;
+    a->p11 = sv * sv;
+}
+
+static void axis_predict(tracker_axis_t* a, float dt, float scale) {
+    float steps = dt * TRACKER_NOISE_FPS;
+    float qp = TRACKER_STD_POS * scale;
+    float qv = TRACKER_STD_VEL * scale;
+
+    a->p += a->v * dt;
+    a->p00 += dt * (2.0f * a->p01 + dt * a->p11) + qp * qp * steps;
+    a->p01 += dt * a->p11;
+    a->p11 += qv * qv * steps;
+}
+
+static void axis_correct(tracker_axis_t* a, float z, float scale) {
+    float r = TRACKER_STD_MEAS * scale;
+    float s = a->p00 + r * r;
+    float k0 = a->p00 / s;
+    float k1 = a->p01 / s;
+    float y = z - a->p;
+
+    a->p += k0 * y;
+    a->v += k1 * y;
+    a->p11 -= k1 * a->p01;
+    a->p00 -= k0 * a->p00;
+    a->p01 -= k0 * a->p01;
+}
+
+// Noise scale of a track: its predicted height, never under a pixel
+static float track_scale(const tracker_track_t* tr) {
+    return tr->kf[3].p > 1.0f ? tr->kf[3].p : 1.0f;
+}
+
+static void track_correct(tracker_track_t* tr, const mavlink_target_t* t) {
+    float scale = track_scale(tr);
+    axis_correct(&tr->kf[0], t->x + t->width * 0.5f, scale);
+    axis_correct(&tr->kf[1], t->y + t->height * 0.5f, scale);
+    axis_correct(&tr->kf[2], (float)t->width, scale);
+    axis_correct(&tr->kf[3], (float)t->height, scale);
+}
+
+// ---------------------------------------------------------------------------
+// Association
+// ---------------------------------------------------------------------------
+
+static float box_iou(const tracker_track_t* tr, const mavlink_target_t* t) {
+    float w = tr->kf[2].p > 1.0f ? tr->kf[2].p : 1.0f;
+    float h = track_scale(tr);
+    float ax0 = tr->kf[0].p - w * 0.5f, ax1 = ax0 + w;
+    float ay0 = tr->kf[1].p - h * 0.5f, ay1 = ay0 + h;
+    float bx0 = t->x, bx1 = t->x + t->width;
+    float by0 = t->y, by1 = t->y + t->height;
+
+    float iw = (ax1 < bx1 ? ax1 : bx1) - (ax0 > bx0 ? ax0 : bx0);
+    float ih = (ay1 < by1 ? ay1 : by1) - (ay0 > by0 ? ay0 : by0);
+    if (iw <= 0.0f || ih <= 0.0f) {
+        return 0.0f;
+    }
+    float inter = iw * ih;
+    return inter / (w * h + (float)t->width * t->height - inter);
+}
+
+static int pair_cmp(const void* a, const void* b) {
+    const tracker_pair_t* pa = (const tracker_pair_t*)a;
+    const tracker_pair_t* pb = (const tracker_pair_t*)b;
+    if (pa->iou != pb->iou) {
+        return pa->iou > pb->iou ? -1 : 1;
+    }
+    if (pa->track != pb->track) {
+        return pa->track - pb->track;
+    }
+    return pa->det - pb->det;
+}
+
+// Match unmatched tracks in the given states to unmatched detections on the
+// chosen side of TRACKER_HIGH_CONF, best overlap first
+static void associate(target_tracker_t* trk, const mavlink_target_t* targets, int count,
+                      unsigned states, bool high, float min_iou) {
+    int n = 0;
+    for (int i = 0; i < TRACKER_MAX_TRACKS; i++) {
+        const tracker_track_t* tr = &trk->tracks[i];
+        if (!(states & STATE_BIT(tr->state)) || trk->track_det[i] >= 0) {
+            continue;
+        }
+        for (int d = 0; d < count; d++) {
+            const mavlink_target_t* t = &targets[d];
+            if (trk->det_track[d] >= 0 || (t->confidence >= TRACKER_HIGH_CONF) != high ||
+                t->class_id != tr->class_id) {
+                continue;
+            }
+            float iou = box_iou(tr, t);
+            if (iou >= min_iou) {
+                trk->pairs[n].iou = iou;
+                trk->pairs[n].track = (int16_t)i;
+                trk->pairs[n].det = (int16_t)d;
+                n++;
+            }
+        }
+    }
+
+    qsort(trk->pairs, n, sizeof(trk->pairs[0]), pair_cmp);
+    for (int k = 0; k < n; k++) {
+        const tracker_pair_t* p = &trk->pairs[k];
+        if (trk->track_det[p->track] >= 0 || trk->det_track[p->det] >= 0) {
+            continue;
+        }
+        trk->track_det[p->track] = p->det;
+        trk->det_track[p->det] = p->track;
+    }
+}
+
+// Next ID not held by a live track; 0 is never used
+static uint8_t alloc_id(target_tracker_t* trk) {
+    for (int tries = 0; tries < 255; tries++) {
+        uint8_t id = trk->next_id;
+        trk->next_id = id == 255 ? 1 : id + 1;
+        bool used = false;
+        for (int i = 0; i < TRACKER_MAX_TRACKS && !used; i++) {
+            used = trk->tracks[i].state != TRACK_FREE && trk->tracks[i].id == id;
+        }
+        if (!used) {
+            return id;
+        }
+    }
+    return 0;   // Unreachable: 64 tracks cannot hold 255 IDs
+}
+
+// A free slot, or failing that the slot of the track lost the longest
+static int alloc_slot(target_tracker_t* trk) {
+    int stalest = -1;
+    for (int i = 0; i < TRACKER_MAX_TRACKS; i++) {
+        const tracker_track_t* tr = &trk->tracks[i];
+        if (tr->state == TRACK_FREE) {
+            return i;
+        }
+        if (tr->state == TRACK_LOST &&
+            (stalest < 0 || tr->last_seen_us < trk->tracks[stalest].last_seen_us)) {
+            stalest = i;
+        }
+    }
+    if (stalest >= 0) {
+        trk->stats.ended++;
+    }
+    return stalest;
+}
+
+static void start_track(target_tracker_t* trk, int slot, const mavlink_target_t* t,
+                        uint64_t pts_us) {
+    tracker_track_t* tr = &trk->tracks[slot];
+    float scale = t->height > 1 ? (float)t->height : 1.0f;
+    memset(tr, 0, sizeof(*tr));
+    tr->state = TRACK_TENTATIVE;
+    tr->id = alloc_id(trk);
+    tr->class_id = t->class_id;
+    axis_init(&tr->kf[0], t->x + t->width * 0.5f, scale);
+    axis_init(&tr->kf[1], t->y + t->height * 0.5f, scale);
+    axis_init(&tr->kf[2], (float)t->width, scale);
+    axis_init(&tr->kf[3], (float)t->height, scale);
+    tr->confidence = t->confidence;
+    tr->hits = 1;
+    tr->start_us = tr->last_seen_us = pts_us;
+    trk->stats.started++;
+}
+
+int target_tracker_update(target_tracker_t* trk, mavlink_target_t* targets, int count,
+                          uint64_t pts_us) {
+    uint64_t t0 = mono_ns();
+    for (int d = TRACKER_MAX_DETECTIONS; d < count; d++) {
+        targets[d].target_num = 0;
+    }
+    if (count > TRACKER_MAX_DETECTIONS) {
+        count = TRACKER_MAX_DETECTIONS;
+    }
+    trk->det_count = count;
+    trk->stats.frames++;
+    trk->stats.detections += count;
+
+    float dt = trk->last_us && pts_us > trk->last_us ? (pts_us - trk->last_us) / 1e6f : 0.0f;
+    if (dt > TRACKER_MAX_DT_S) {
+        dt = TRACKER_MAX_DT_S;
+    }
+    trk->last_us = pts_us;
+
+    for (int i = 0; i < TRACKER_MAX_TRACKS; i++) {
+        tracker_track_t* tr = &trk->tracks[i];
+        trk->track_det[i] = -1;
+        if (tr->state == TRACK_FREE || dt <= 0.0f) {
+            continue;
+        }
+        float scale = track_scale(tr);
+        for (int k = 0; k < 4; k++) {
+            axis_predict(&tr->kf[k], dt, scale);
+        }
+    }
+    for (int d = 0; d < count; d++) {
+        trk->det_track[d] = -1;
+    }
+
+    // Confident detections first; weak ones only extend established tracks
+    associate(trk, targets, count, STATE_BIT(TRACK_CONFIRMED) | STATE_BIT(TRACK_LOST),
+              true, TRACKER_MATCH_IOU);
+    associate(trk, targets, count, STATE_BIT(TRACK_CONFIRMED), false, TRACKER_LOW_MATCH_IOU);
+    associate(trk, targets, count, STATE_BIT(TRACK_TENTATIVE), true, TRACKER_NEW_MATCH_IOU);
+
+    int active = 0;
+    for (int i = 0; i < TRACKER_MAX_TRACKS; i++) {
+        tracker_track_t* tr = &trk->tracks[i];
+        if (tr->state == TRACK_FREE) {
+            continue;
+        }
+        int d = trk->track_det[i];
+        if (d >= 0) {
+            const mavlink_target_t* t = &targets[d];
+            track_correct(tr, t);
+            tr->confidence = t->confidence;
+            tr->hits++;
+            tr->last_seen_us = pts_us;
+            if (t->confidence >= TRACKER_HIGH_CONF) {
+                trk->stats.matched_high++;
+            } else {
+                trk->stats.matched_low++;
+            }
+            if (tr->state == TRACK_LOST) {
+                tr->state = TRACK_CONFIRMED;
+                trk->stats.recovered++;
+            } else if (tr->state == TRACK_TENTATIVE && tr->hits >= TRACKER_CONFIRM_HITS) {
+                tr->state = TRACK_CONFIRMED;
+                trk->stats.confirmed++;
+            }
+        } else if (tr->state == TRACK_TENTATIVE ||
+                   (tr->state == TRACK_LOST &&
+                    pts_us - tr->last_seen_us > TRACKER_MAX_LOST_MS * 1000ULL)) {
+            tr->state = TRACK_FREE;
+            trk->stats.ended++;
+        } else if (tr->state == TRACK_CONFIRMED) {
+            tr->state = TRACK_LOST;
+        }
+        if (tr->state == TRACK_CONFIRMED) {
+            active++;
+        }
+    }
+
+    // Confident leftovers are new targets (or false positives that will not
+    // survive their next frame)
+    for (int d = 0; d < count; d++) {
+        if (trk->det_track[d] >= 0 || targets[d].confidence < TRACKER_HIGH_CONF) {
+            continue;
+        }
+        int slot = alloc_slot(trk);
+        if (slot < 0) {
+            trk->stats.table_full++;
+            continue;
+        }
+        start_track(trk, slot, &targets[d], pts_us);
+        trk->det_track[d] = (int16_t)slot;
+    }
+
+    for (int d = 0; d < count; d++) {
+        const tracker_track_t* tr = target_tracker_track_of(trk, d);
+        targets[d].target_num = tr ? tr->id : 0;
+    }
+    trk->stats.active = active;
+
+    uint32_t ns = (uint32_t)(mono_ns() - t0);
+    trk->stats.update_sum_ns += ns;
+    if (ns > trk->stats.update_max_ns) {
+        trk->stats.update_max_ns = ns;
+    }
+    return active;
+}
+
+const tracker_track_t* target_tracker_track_of(const target_tracker_t* trk, int i) {
+    if (i < 0 || i >= trk->det_count || trk->det_track[i] < 0) {
+        return NULL;
+    }
+    const tracker_track_t* tr = &trk->tracks[trk->det_track[i]];
+    return tr->state == TRACK_CONFIRMED ? tr : NULL;
+}
+
+void target_tracker_print_stats(target_tracker_t* trk) {
+    const tracker_stats_t* st = &trk->stats;
+    printf("Tracker: %u active | started=%llu confirmed=%llu recovered=%llu ended=%llu table_full=%llu | "
+           "matched high=%llu low=%llu of %llu | update avg=%.1f max=%.1f us\n",
+           st->active, (unsigned long long)st->started, (unsigned long long)st->confirmed,
+           (unsigned long long)st->recovered, (unsigned long long)st->ended,
+           (unsigned long long)st->table_full, (unsigned long long)st->matched_high,
+           (unsigned long long)st->matched_low, (unsigned long long)st->detections,
+           st->frames ? st->update_sum_ns / 1e3 / st->frames : 0.0, st->update_max_ns / 1e3);
+
+    for (int i = 0; i < TRACKER_MAX_TRACKS; i++) {
+        const tracker_track_t* tr = &trk->tracks[i];
+        if (tr->state != TRACK_CONFIRMED) {
+            continue;
+        }
+        printf("  #%u class %u at %.0f,%.0f %.0fx%.0f v=%+.0f,%+.0f px/s age %.1f s hits %u\n",
+               tr->id, tr->class_id, tr->kf[0].p, tr->kf[1].p, tr->kf[2].p, tr->kf[3].p,
+               tr->kf[0].v, tr->kf[1].v, (tr->last_seen_us - tr->start_us) / 1e6, tr->hits);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark
+// ---------------------------------------------------------------------------
+
+#define BENCH_WIDTH 720
+#define BENCH_HEIGHT 480
+#define BENCH_FPS 30
+#define BENCH_OBJECTS 10
+#define BENCH_MAX_SWITCH_PCT 0.5        // ID switches per true detection
+#define BENCH_MIN_COVERAGE_PCT 85.0     // True detections reported with an ID
+
+typedef struct {
+    float x, y, vx, vy, w, h;   // Centre, velocity (px/s) and size
+    uint8_t class_id;
+    int life;                   // Frames until the object leaves
+    int occluded;               // Frames of weak or missed detections left
+    uint8_t last_id;            // ID last reported for this object
+} bench_object_t;
+
+typedef struct {
+    uint32_t* ns;               // Per frame cost
+    int frames;
+    int capacity;
+} bench_timing_t;
+
+static uint32_t bench_rand(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static float bench_uniform(uint32_t* state, float lo, float hi) {
+    return lo + (hi - lo) * (bench_rand(state) % 10000) / 10000.0f;
+}
+
+static void bench_spawn(bench_object_t* o, uint32_t* rs) {
+    memset(o, 0, sizeof(*o));
+    o->w = bench_uniform(rs, 24.0f, 80.0f);
+    o->h = o->w * bench_uniform(rs, 0.6f, 1.0f);
+    o->x = bench_uniform(rs, o->w, BENCH_WIDTH - o->w);
+    o->y = bench_uniform(rs, o->h, BENCH_HEIGHT - o->h);
+    o->vx = bench_uniform(rs, -120.0f, 120.0f);
+    o->vy = bench_uniform(rs, -80.0f, 80.0f);
+    o->class_id = bench_rand(rs) % 2;
+    o->life = 150 + bench_rand(rs) % 300;
+}
+
+static void bench_move(bench_object_t* o, float dt) {
+    o->x += o->vx * dt;
+    o->y += o->vy * dt;
+    if (o->x < o->w * 0.5f || o->x > BENCH_WIDTH - o->w * 0.5f) {
+        o->vx = -o->vx;
+    }
+    if (o->y < o->h * 0.5f || o->y > BENCH_HEIGHT - o->h * 0.5f) {
+        o->vy = -o->vy;
+    }
+}
+
+static void bench_timed_update(target_tracker_t* trk, bench_timing_t* tm,
+                               mavlink_target_t* targets, int count, uint64_t pts_us) {
+    uint64_t t0 = mono_ns();
+    target_tracker_update(trk, targets, count, pts_us);
+    uint32_t ns = (uint32_t)(mono_ns() - t0);
+    if (tm->frames < tm->capacity) {
+        tm->ns[tm->frames++] = ns;
+    }
+}
+
+static int u32_cmp(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void bench_print_timing(bench_timing_t* tm, uint64_t detections) {
+    if (tm->frames == 0) {
+        return;
+    }
+    uint64_t sum = 0;
+    for (int i = 0; i < tm->frames; i++) {
+        sum += tm->ns[i];
+    }
+    qsort(tm->ns, tm->frames, sizeof(tm->ns[0]), u32_cmp);
+    printf("tracker bench: %d frames, %.1f detections/frame | update avg=%.2f p50=%.2f p99=%.2f max=%.2f us\n",
+           tm->frames, (double)detections / tm->frames, sum / 1e3 / tm->frames,
+           tm->ns[tm->frames / 2] / 1e3, tm->ns[tm->frames * 99 / 100] / 1e3,
+           tm->ns[tm->frames - 1] / 1e3);
+}
+
+static int bench_synthetic(target_tracker_t* trk, bench_timing_t* tm, int frames) {
+    uint32_t rs = 1234;
+    bench_object_t objects[BENCH_OBJECTS];
+    mavlink_target_t targets[BENCH_OBJECTS + 1];
+    int truth[BENCH_OBJECTS + 1];   // Object behind each detection, -1 for clutter
+    uint64_t true_dets = 0, covered = 0, switches = 0, spawned = BENCH_OBJECTS;
+    const float dt = 1.0f / BENCH_FPS;
+
+    for (int i = 0; i < BENCH_OBJECTS; i++) {
+        bench_spawn(&objects[i], &rs);
+    }
+
+    for (int f = 0; f < frames; f++) {
+        int count = 0;
+        for (int i = 0; i < BENCH_OBJECTS; i++) {
+            bench_object_t* o = &objects[i];
+            if (--o->life <= 0) {
+                bench_spawn(o, &rs);
+                spawned++;
+            }
+            bench_move(o, dt);
+            if (o->occluded == 0 && bench_rand(&rs) % 100 < 2) {
+                o->occluded = 5 + bench_rand(&rs) % 15;
+            }
+
+            // Occluded: half missed, the rest weak; otherwise 5 % missed
+            float conf;
+            if (o->occluded > 0) {
+                o->occluded--;
+                if (bench_rand(&rs) % 2) {
+                    continue;
+                }
+                conf = bench_uniform(&rs, 0.15f, 0.45f);
+            } else {
+                if (bench_rand(&rs) % 100 < 5) {
+                    continue;
+                }
+                conf = bench_uniform(&rs, 0.55f, 0.95f);
+            }
+            float w = o->w * bench_uniform(&rs, 0.96f, 1.04f);
+            float h = o->h * bench_uniform(&rs, 0.96f, 1.04f);
+            mavlink_target_t* t = &targets[count];
+            t->x = (int)(o->x + bench_uniform(&rs, -2.0f, 2.0f) - w * 0.5f);
+            t->y = (int)(o->y + bench_uniform(&rs, -2.0f, 2.0f) - h * 0.5f);
+            t->width = (int)w;
+            t->height = (int)h;
+            t->confidence = conf;
+            t->class_id = o->class_id;
+            truth[count++] = i;
+        }
+        if (bench_rand(&rs) % 100 < 60) {
+            mavlink_target_t* t = &targets[count];
+            t->width = 16 + bench_rand(&rs) % 60;
+            t->height = 16 + bench_rand(&rs) % 60;
+            t->x = bench_rand(&rs) % (BENCH_WIDTH - t->width);
+            t->y = bench_rand(&rs) % (BENCH_HEIGHT - t->height);
+            t->confidence = bench_uniform(&rs, 0.2f, 0.6f);
+            t->class_id = bench_rand(&rs) % 2;
+            truth[count++] = -1;
+        }
+
+        // Detector output order carries no identity
+        for (int i = count - 1; i > 0; i--) {
+            int j = bench_rand(&rs) % (i + 1);
+            mavlink_target_t tmp = targets[i];
+            targets[i] = targets[j];
+            targets[j] = tmp;
+            int tt = truth[i];
+            truth[i] = truth[j];
+            truth[j] = tt;
+        }
+
+        bench_timed_update(trk, tm, targets, count, (uint64_t)f * 1000000 / BENCH_FPS + 1);
+
+        for (int d = 0; d < count; d++) {
+            if (truth[d] < 0) {
+                continue;
+            }
+            bench_object_t* o = &objects[truth[d]];
+            uint8_t id = targets[d].target_num;
+            true_dets++;
+            if (id == 0) {
+                continue;
+            }
+            covered++;
+            if (o->last_id != 0 && o->last_id != id) {
+                switches++;
+            }
+            o->last_id = id;
+        }
+    }
+
+    double switch_pct = true_dets ? 100.0 * switches / true_dets : 0.0;
+    double coverage_pct = true_dets ? 100.0 * covered / true_dets : 0.0;
+    printf("tracker bench: synthetic %dx%d, %d objects at a time (%llu in all), %llu true detections | "
+           "ID switches=%llu (%.2f%%) | with ID %.1f%%\n",
+           BENCH_WIDTH, BENCH_HEIGHT, BENCH_OBJECTS, (unsigned long long)spawned,
+           (unsigned long long)true_dets, (unsigned long long)switches, switch_pct, coverage_pct);
+    return switch_pct <= BENCH_MAX_SWITCH_PCT && coverage_pct >= BENCH_MIN_COVERAGE_PCT ? 0 : -1;
+}
+
+typedef struct {
+    target_tracker_t* trk;
+    bench_timing_t* tm;
+    int malformed;
+} bench_replay_t;
+
+static void bench_replay_frame(const uint8_t* data, size_t len, void* user) {
+    bench_replay_t* rp = (bench_replay_t*)user;
+    detection_sei_frame_t frame;
+    if (detection_sei_decode(data, len, &frame) != 0) {
+        rp->malformed++;
+        return;
+    }
+    bench_timed_update(rp->trk, rp->tm, frame.targets, frame.count, frame.pts);
+}
+
+static int bench_replay(target_tracker_t* trk, bench_timing_t* tm, const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        perror("target_tracker: fopen");
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t* data = (uint8_t*)malloc(size > 0 ? size : 1);
+    if (!data || fread(data, 1, size, fp) != (size_t)size) {
+        fprintf(stderr, "target_tracker: cannot read %s\n", path);
+        free(data);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    bench_replay_t rp = {trk, tm, 0};
+    int found = h264_sei_scan(data, size, detection_sei_uuid, bench_replay_frame, &rp);
+    if (found == 0) {
+        found = h265_sei_scan(data, size, detection_sei_uuid, bench_replay_frame, &rp);
+    }
+    free(data);
+    printf("tracker bench: replayed %d detection SEIs from %s (%d malformed)\n",
+           found, path, rp.malformed);
+    return found > 0 ? 0 : -1;
+}
+
+int target_tracker_benchmark(const char* path, int frames) {
+    // The tracker table is too large for a thread stack
+    target_tracker_t* trk = (target_tracker_t*)malloc(sizeof(*trk));
+    bench_timing_t tm;
+    tm.frames = 0;
+    tm.capacity = frames > 0 ? frames : 1;
+    tm.ns = (uint32_t*)malloc(tm.capacity * sizeof(uint32_t));
+    if (!trk || !tm.ns) {
+        free(trk);
+        free(tm.ns);
+        return -1;
+    }
+    target_tracker_init(trk);
+
+    int ret;
+    if (path) {
+        ret = bench_replay(trk, &tm, path);
+    } else {
+        ret = bench_synthetic(trk, &tm, frames);
+    }
+    bench_print_timing(&tm, trk->stats.detections);
+    target_tracker_print_stats(trk);
+    printf("tracker bench: %s\n", ret == 0 ? "PASS" : "FAIL");
+
+    free(tm.ns);
+    free(trk);
+    return ret;
+}
@@ -0,0 +1,227 @@
+#include "telemetry_sched.h"
+#include "mavlink_codec.h"
+#include "yolov5.h"
+#include "uart_comm.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Tracks not seen for this many frames are forgotten
+#define TELEM_TRACK_EXPIRE 10
+// Age (frames) at which a track earns the full age score
+#define TELEM_AGE_FULL 10
+
+// Priority weights, summing to 1
+#define TELEM_W_CONF 0.5f
+#define TELEM_W_AGE 0.3f
+#define TELEM_W_CENTER 0.2f
+
+// Wire cost of a batch: header + checksum + time_usec + count, then per target
+#define TELEM_MSG_OVERHEAD (MAVLINK_HEADER_LEN + MAVLINK_CHECKSUM_LEN + 9)
+#define TELEM_TARGET_BYTES ((int)sizeof(mavlink_batch_target_t))
+
+typedef struct {
+    int idx;                    // Index into the submitted targets
+    int track;                  // Index into sched->tracks
+    float priority;
+} telem_candidate_t;
+
+static uint64_t get_time_usec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void telemetry_sched_init(telemetry_sched_t* sched, int uart_fd, int baud_rate, float share) {
+    memset(sched, 0, sizeof(*sched));
+    sched->uart_fd = uart_fd;
+    sched->line_bytes_per_s = baud_rate / 10;
+    sched->budget_bytes_per_s = sched->line_bytes_per_s * share;
+
+    // A quarter second of budget, but never less than one full batch
+    sched->burst_bytes = sched->budget_bytes_per_s / 4;
+    float full_batch = TELEM_MSG_OVERHEAD + MAVLINK_BATCH_MAX_TARGETS * TELEM_TARGET_BYTES;
+    if (sched->burst_bytes < full_batch) {
+        sched->burst_bytes = full_batch;
+    }
+    sched->tokens = sched->burst_bytes;
+
+    sched->coalesce_ms = 500;
+    sched->coalesce_move = 0.1f;
+    sched->refill_us = sched->util_start_us = get_time_usec();
+}
+
+static void refill(telemetry_sched_t* sched, uint64_t now) {
+    sched->tokens += sched->budget_bytes_per_s * (float)(now - sched->refill_us) / 1e6f;
+    if (sched->tokens > sched->burst_bytes) {
+        sched->tokens = sched->burst_bytes;
+    }
+    sched->refill_us = now;
+}
+
+// Continue the live track carrying the detection's tracker ID, or start a
+// new one (evicting the stalest if full). Detections without an ID (0) always
+// start a single-frame track.
+static int match_track(telemetry_sched_t* sched, const mavlink_target_t* t) {
+    int best = -1, free_slot = -1, stalest = 0;
+
+    for (int i = 0; i < TELEM_MAX_TRACKS; i++) {
+        telem_track_t* tr = &sched->tracks[i];
+        if (!tr->in_use) {
+            if (free_slot < 0) free_slot = i;
+            continue;
+        }
+        if (tr->last_frame < sched->tracks[stalest].last_frame) {
+            stalest = i;
+        }
+        if (t->target_num != 0 && tr->id == t->target_num && tr->last_frame != sched->frame) {
+            best = i;
+        }
+    }
+
+    telem_track_t* tr;
+    if (best >= 0) {
+        tr = &sched->tracks[best];
+        tr->age++;
+    } else {
+        best = free_slot >= 0 ? free_slot : stalest;
+        tr = &sched->tracks[best];
+        memset(tr, 0, sizeof(*tr));
+        tr->in_use = 1;
+        tr->id = t->target_num;
+        tr->class_id = t->class_id;
+        tr->age = 1;
+    }
+
+    tr->last_frame = sched->frame;
+    tr->cx = t->x + t->width / 2;
+    tr->cy = t->y + t->height / 2;
+    tr->w = t->width;
+    tr->h = t->height;
+    return best;
+}
+
+static bool should_coalesce(const telemetry_sched_t* sched, const telem_track_t* tr, uint64_t now) {
+    if (tr->sent_us == 0 || now - tr->sent_us >= (uint64_t)sched->coalesce_ms * 1000) {
+        return false;
+    }
+    int size = tr->sent_w > tr->sent_h ? tr->sent_w : tr->sent_h;
+    int limit = (int)(size * sched->coalesce_move);
+    return abs(tr->cx - tr->sent_cx) <= limit && abs(tr->cy - tr->sent_cy) <= limit &&
+           abs(tr->w - tr->sent_w) <= limit && abs(tr->h - tr->sent_h) <= limit;
+}
+
+static float priority_of(const mavlink_target_t* t, const telem_track_t* tr,
+                         int frame_width, int frame_height) {
+    float conf = t->confidence < 0.0f ? 0.0f : (t->confidence > 1.0f ? 1.0f : t->confidence);
+    float age = tr->age >= TELEM_AGE_FULL ? 1.0f : (float)tr->age / TELEM_AGE_FULL;
+
+    // 1 at the image centre, 0 in the corners
+    float dx = (tr->cx - frame_width * 0.5f) / (frame_width * 0.5f);
+    float dy = (tr->cy - frame_height * 0.5f) / (frame_height * 0.5f);
+    float center = 1.0f - sqrtf((dx * dx + dy * dy) * 0.5f);
+    if (center < 0.0f) center = 0.0f;
+
+    return TELEM_W_CONF * conf + TELEM_W_AGE * age + TELEM_W_CENTER * center;
+}
+
+static void update_utilisation(telemetry_sched_t* sched, const uart_tx_stats_t* uart, uint64_t now) {
+    sched->stats.queue_age_us = uart->oldest_age_us;
+
+    uint64_t elapsed = now - sched->util_start_us;
+    if (elapsed >= 1000000) {
+        sched->stats.utilisation = (float)(uart->sent_bytes - sched->util_start_bytes) /
+                                   ((float)sched->line_bytes_per_s * elapsed / 1e6f);
+        sched->util_start_us = now;
+        sched->util_start_bytes = uart->sent_bytes;
+    }
+}
+
+int telemetry_sched_submit(telemetry_sched_t* sched,
+                           const mavlink_target_t* targets, int count,
+                           int frame_width, int frame_height, uint64_t capture_us) {
+    uint64_t now = get_time_usec();
+    sched->frame++;
+    sched->stats.frames++;
+    sched->stats.offered += count;
+    refill(sched, now);
+
+    for (int i = 0; i < TELEM_MAX_TRACKS; i++) {
+        telem_track_t* tr = &sched->tracks[i];
+        if (tr->in_use && sched->frame - tr->last_frame > TELEM_TRACK_EXPIRE) {
+            tr->in_use = 0;
+        }
+    }
+
+    // Rank what is worth sending; insertion sort, count is at most a few dozen
+    telem_candidate_t cand[OBJ_NUMB_MAX_SIZE];
+    int n = 0;
+    for (int i = 0; i < count && n < OBJ_NUMB_MAX_SIZE; i++) {
+        int track = match_track(sched, &targets[i]);
+        if (should_coalesce(sched, &sched->tracks[track], now)) {
+            sched->stats.coalesced++;
+            continue;
+        }
+        float p = priority_of(&targets[i], &sched->tracks[track], frame_width, frame_height);
+        int j = n++;
+        while (j > 0 && cand[j - 1].priority < p) {
+            cand[j] = cand[j - 1];
+            j--;
+        }
+        cand[j].idx = i;
+        cand[j].track = track;
+        cand[j].priority = p;
+    }
+
+    // A backlog in the UART queue (PARAM lists, bursts) means the link is
+    // already behind; adding to it only makes every packet older
+    uart_tx_stats_t uart;
+    uart_tx_get_stats(&uart);
+    float available = uart.queued_bytes > sched->burst_bytes ? 0.0f : sched->tokens;
+
+    mavlink_target_t out[OBJ_NUMB_MAX_SIZE];
+    int selected = 0;
+    float cost = 0.0f;
+    for (; selected < n; selected++) {
+        float step = TELEM_TARGET_BYTES;
+        if (selected % MAVLINK_BATCH_MAX_TARGETS == 0) {
+            step += TELEM_MSG_OVERHEAD;
+        }
+        if (cost + step > available) {
+            break;
+        }
+        cost += step;
+
+        telem_track_t* tr = &sched->tracks[cand[selected].track];
+        out[selected] = targets[cand[selected].idx];
+        tr->sent_us = now;
+        tr->sent_cx = tr->cx;
+        tr->sent_cy = tr->cy;
+        tr->sent_w = tr->w;
+        tr->sent_h = tr->h;
+    }
+    sched->stats.shed += n - selected;
+
+    int sent = 0;
+    if (selected > 0) {
+        sent = mavlink_send_detection_batch(sched->uart_fd, out, selected,
+                                            frame_width, frame_height, capture_us);
+    }
+    if (sent > 0) {
+        // Truncation makes the real size at most the estimate
+        sched->tokens -= sent;
+        sched->stats.sent += selected;
+        sched->stats.bytes += sent;
+    }
+
+    update_utilisation(sched, &uart, now);
+    return sent < 0 ? -1 : selected;
+}
+
+void telemetry_sched_get_stats(telemetry_sched_t* sched, telemetry_sched_stats_t* stats) {
+    uart_tx_stats_t uart;
+    uart_tx_get_stats(&uart);
+    update_utilisation(sched, &uart, get_time_usec());
+    *stats = sched->stats;
+}
@@ -0,0 +1,228 @@
+#include "tile_infer.h"
+#include "luckfox_mpi.h"
+#include "param_store.h"
+#include "rga_hw_accel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Evenly spaced tile origins along one axis, neighbours overlapping by at
+// least TILE_INFER_MIN_OVERLAP_PCT; returns the number of tiles
+static int layout_axis(int length, int tile, int* pos, int max) {
+    if (tile >= length) {
+        pos[0] = 0;
+        return 1;
+    }
+    int step = tile * (100 - TILE_INFER_MIN_OVERLAP_PCT) / 100;
+    int n = 1 + (length - tile + step - 1) / step;
+    if (n > max) {
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        pos[i] = (int)((long)i * (length - tile) / (n - 1)) & ~1;
+    }
+    return n;
+}
+
+int tile_infer_init(tile_infer_t* ti, int frame_w, int frame_h, int size,
+                    int model_w, int model_h) {
+    memset(ti, 0, sizeof(*ti));
+    ti->frame_w = frame_w;
+    ti->frame_h = frame_h;
+    ti->model_w = model_w;
+    ti->model_h = model_h;
+
+    // Tiles keep the model's aspect ratio so nothing is stretched
+    int tile_w = size & ~1;
+    int tile_h = (size * model_h / model_w) & ~1;
+    if (tile_w < TILE_INFER_MIN_SIZE || tile_w > frame_w || tile_h > frame_h) {
+        fprintf(stderr, "tile_infer: %dx%d tiles do not fit a %dx%d frame (at least %d)\n",
+                tile_w, tile_h, frame_w, frame_h, TILE_INFER_MIN_SIZE);
+        return -1;
+    }
+
+    int xs[TILE_INFER_MAX], ys[TILE_INFER_MAX];
+    ti->cols = layout_axis(frame_w, tile_w, xs, TILE_INFER_MAX);
+    ti->rows = layout_axis(frame_h, tile_h, ys, TILE_INFER_MAX);
+    if (ti->cols < 0 || ti->rows < 0 || ti->cols * ti->rows > TILE_INFER_MAX) {
+        fprintf(stderr, "tile_infer: %dx%d tiles need more than %d over a %dx%d frame\n",
+                tile_w, tile_h, TILE_INFER_MAX, frame_w, frame_h);
+        return -1;
+    }
+    ti->size = tile_w;
+    for (int r = 0; r < ti->rows; r++) {
+        for (int c = 0; c < ti->cols; c++) {
+            tile_t* t = &ti->tiles[ti->count++];
+            t->rect.x = xs[c];
+            t->rect.y = ys[r];
+            t->rect.width = tile_w;
+            t->rect.height = tile_h;
+        }
+    }
+
+    printf("tile_infer: %d tiles (%dx%d) of %dx%d, %.1fx zoom into the %dx%d model\n",
+           ti->count, ti->cols, ti->rows, tile_w, tile_h,
+           (float)model_w / tile_w, model_w, model_h);
+    return 0;
+}
+
+// The tile waiting longest, counting frames double for a tile whose last run
+// found something new
+static int next_tile(tile_infer_t* ti, const bool* picked) {
+    int best = -1;
+    uint32_t best_score = 0;
+    for (int i = 0; i < ti->count; i++) {
+        const tile_t* t = &ti->tiles[i];
+        if (picked[i]) {
+            continue;
+        }
+        uint32_t wait = t->runs ? ti->frame - t->last_frame : ti->frame + ti->count - i;
+        uint32_t score = wait * (t->found ? TILE_INFER_HOT_WEIGHT : 1);
+        if (best < 0 || score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+static void add_candidate(tile_infer_t* ti, int* n, const object_detect_result* det, int tile) {
+    if (*n == TILE_INFER_MAX_CANDIDATES) {
+        ti->stats.dropped++;
+        return;
+    }
+    tile_candidate_t* c = &ti->cand[(*n)++];
+    c->det = *det;
+    c->tile = tile;
+    c->suppressed = false;
+}
+
+static int candidate_cmp(const void* a, const void* b) {
+    float pa = ((const tile_candidate_t*)a)->det.prop;
+    float pb = ((const tile_candidate_t*)b)->det.prop;
+    return pa > pb ? -1 : (pa < pb ? 1 : 0);
+}
+
+// Same target: the usual IoU test, or the smaller box lying mostly inside the
+// larger one (a target cut by a tile edge, seen whole by the full frame)
+static bool duplicate(const image_rect_t* a, const image_rect_t* b, float nms_thresh) {
+    int iw = (a->right < b->right ? a->right : b->right) - (a->left > b->left ? a->left : b->left);
+    int ih = (a->bottom < b->bottom ? a->bottom : b->bottom) - (a->top > b->top ? a->top : b->top);
+    if (iw <= 0 || ih <= 0) {
+        return false;
+    }
+    float inter = (float)iw * ih;
+    float area_a = (float)(a->right - a->left) * (a->bottom - a->top);
+    float area_b = (float)(b->right - b->left) * (b->bottom - b->top);
+    float smaller = area_a < area_b ? area_a : area_b;
+    return inter >= nms_thresh * (area_a + area_b - inter) ||
+           (smaller > 0 && inter >= TILE_INFER_MERGE_IOS * smaller);
+}
+
+void tile_infer_map_results(const im_rect* rect, int model_w, int model_h,
+                            object_detect_result_list* results) {
+    for (int i = 0; i < results->count; i++) {
+        image_rect_t* box = &results->results[i].box;
+        box->left = rect->x + box->left * rect->width / model_w;
+        box->right = rect->x + box->right * rect->width / model_w;
+        box->top = rect->y + box->top * rect->height / model_h;
+        box->bottom = rect->y + box->bottom * rect->height / model_h;
+    }
+}
+
+int tile_infer_run(tile_infer_t* ti, MB_BLK nv12, rknn_app_context_t* ctx, int max_tiles,
+                   object_detect_result_list* results) {
+    ti->frame++;
+    if (max_tiles <= 0) {
+        return 0;
+    }
+    if (max_tiles > ti->count) {
+        max_tiles = ti->count;
+    }
+    uint64_t t0 = TEST_COMM_GetNowUs();
+
+    int n = 0;
+    for (int i = 0; i < results->count; i++) {
+        add_candidate(ti, &n, &results->results[i], -1);
+    }
+    ti->stats.frame_detections += results->count;
+
+    bool picked[TILE_INFER_MAX];
+    memset(picked, 0, sizeof(picked));
+    for (int k = 0; k < max_tiles; k++) {
+        int i = next_tile(ti, picked);
+        tile_t* t = &ti->tiles[i];
+        picked[i] = true;
+        t->last_frame = ti->frame;
+        t->runs++;
+        t->found = 0;
+
+        rga_crop_nv12_to_rknn(nv12, ti->frame_w, ti->frame_h, t->rect, ctx,
+                              ti->model_w, ti->model_h);
+        if (inference_yolov5_model(ctx, &ti->tile_results) < 0) {
+            continue;
+        }
+        ti->stats.tile_runs++;
+        ti->stats.tile_detections += ti->tile_results.count;
+
+        tile_infer_map_results(&t->rect, ti->model_w, ti->model_h, &ti->tile_results);
+        for (int d = 0; d < ti->tile_results.count; d++) {
+            add_candidate(ti, &n, &ti->tile_results.results[d], i);
+        }
+    }
+
+    // Cross-tile NMS, most confident first. A tile detection that survives
+    // without having overlapped any full-frame detection is a new target.
+    float nms_thresh = param_get_float(PARAM_DET_NMS_THRESH);
+    int max_objects = param_get_int(PARAM_DET_MAX_OBJ);
+    qsort(ti->cand, n, sizeof(ti->cand[0]), candidate_cmp);
+    results->count = 0;
+    for (int i = 0; i < n; i++) {
+        tile_candidate_t* c = &ti->cand[i];
+        if (c->suppressed) {
+            continue;
+        }
+        bool covers_frame_det = false;
+        for (int j = i + 1; j < n; j++) {
+            tile_candidate_t* o = &ti->cand[j];
+            if (o->suppressed || o->det.cls_id != c->det.cls_id ||
+                !duplicate(&c->det.box, &o->det.box, nms_thresh)) {
+                continue;
+            }
+            o->suppressed = true;
+            covers_frame_det |= o->tile < 0;
+            ti->stats.merged++;
+        }
+        if (results->count == max_objects) {
+            continue;
+        }
+        results->results[results->count++] = c->det;
+        if (c->tile >= 0 && !covers_frame_det) {
+            ti->tiles[c->tile].found++;
+            ti->stats.added++;
+            ti->stats.added_height_sum += c->det.box.bottom - c->det.box.top;
+        }
+    }
+
+    uint32_t spent = (uint32_t)(TEST_COMM_GetNowUs() - t0);
+    ti->stats.frames++;
+    ti->stats.tile_sum_us += spent;
+    if (spent > ti->stats.tile_max_us) {
+        ti->stats.tile_max_us = spent;
+    }
+    return max_tiles;
+}
+
+void tile_infer_print_stats(tile_infer_t* ti) {
+    const tile_infer_stats_t* st = &ti->stats;
+    printf("Tiles: %d of %dx%d | %llu runs in %llu frames, avg %llu ms max %u ms per frame | "
+           "detections frame=%llu tiles=%llu merged=%llu added=%llu (avg %llu px high) dropped=%llu\n",
+           ti->count, ti->size, ti->tiles[0].rect.height,
+           (unsigned long long)st->tile_runs, (unsigned long long)st->frames,
+           (unsigned long long)(st->frames ? st->tile_sum_us / st->frames / 1000 : 0),
+           st->tile_max_us / 1000,
+           (unsigned long long)st->frame_detections, (unsigned long long)st->tile_detections,
+           (unsigned long long)st->merged, (unsigned long long)st->added,
+           (unsigned long long)(st->added ? st->added_height_sum / st->added : 0),
+           (unsigned long long)st->dropped);
+}
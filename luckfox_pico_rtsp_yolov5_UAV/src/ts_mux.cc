@@ -0,0 +1,183 @@
+#include "ts_mux.h"
+#include <string.h>
+
+uint32_t ts_crc32(const uint8_t* data, size_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint32_t)data[i] << 24;
+        for (int b = 0; b < 8; b++) {
+            crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+void ts_mux_init(ts_mux_t* mux, bool hevc, ts_mux_write_fn write, void* user) {
+    memset(mux, 0, sizeof(*mux));
+    mux->hevc = hevc;
+    mux->write = write;
+    mux->user = user;
+}
+
+static void put_psi(ts_mux_t* mux, uint16_t pid, uint8_t* cc, const uint8_t* section, size_t len) {
+    uint8_t pkt[TS_PACKET_LEN];
+    memset(pkt, 0xFF, sizeof(pkt));
+    pkt[0] = 0x47;
+    pkt[1] = 0x40 | (pid >> 8);     // Payload unit start
+    pkt[2] = pid & 0xFF;
+    pkt[3] = 0x10 | (*cc & 0x0F);   // Payload only
+    *cc = (*cc + 1) & 0x0F;
+    pkt[4] = 0;                     // Pointer field
+
+    memcpy(pkt + 5, section, len);
+    uint32_t crc = ts_crc32(section, len);
+    pkt[5 + len] = crc >> 24;
+    pkt[6 + len] = (crc >> 16) & 0xFF;
+    pkt[7 + len] = (crc >> 8) & 0xFF;
+    pkt[8 + len] = crc & 0xFF;
+    mux->write(pkt, mux->user);
+}
+
+void ts_mux_tables(ts_mux_t* mux) {
+    // Section lengths count from after the length field, CRC included
+    const uint8_t pat[] = {
+        0x00, 0xB0, 13,                 // table_id, section_length
+        0x00, 0x01, 0xC1, 0x00, 0x00,   // transport_stream_id 1, version 0, current
+        0x00, 0x01,                     // program 1
+        0xE0 | (TS_PID_PMT >> 8), TS_PID_PMT & 0xFF,
+    };
+    put_psi(mux, 0, &mux->cc_pat, pat, sizeof(pat));
+
+    const uint8_t pmt[] = {
+        0x02, 0xB0, 18,
+        0x00, 0x01, 0xC1, 0x00, 0x00,   // program 1, version 0, current
+        0xE0 | (TS_PID_VIDEO >> 8), TS_PID_VIDEO & 0xFF,    // PCR PID
+        0xF0, 0x00,                     // No program descriptors
+        (uint8_t)(mux->hevc ? TS_STREAM_TYPE_H265 : TS_STREAM_TYPE_H264),
+        0xE0 | (TS_PID_VIDEO >> 8), TS_PID_VIDEO & 0xFF,
+        0xF0, 0x00,
+    };
+    put_psi(mux, TS_PID_PMT, &mux->cc_pmt, pmt, sizeof(pmt));
+}
+
+static void put_pts(uint8_t* p, uint64_t pts) {
+    p[0] = 0x20 | ((pts >> 29) & 0x0E) | 1;
+    p[1] = (pts >> 22) & 0xFF;
+    p[2] = ((pts >> 14) & 0xFE) | 1;
+    p[3] = (pts >> 7) & 0xFF;
+    p[4] = ((pts << 1) & 0xFE) | 1;
+}
+
+static void put_pcr(uint8_t* p, uint64_t base) {
+    p[0] = (base >> 25) & 0xFF;
+    p[1] = (base >> 17) & 0xFF;
+    p[2] = (base >> 9) & 0xFF;
+    p[3] = (base >> 1) & 0xFF;
+    p[4] = ((base & 1) << 7) | 0x7E;    // Reserved bits, extension 0
+    p[5] = 0;
+}
+
+static bool starts_with_aud(const uint8_t* au, size_t len, bool hevc) {
+    size_t sc = len >= 4 && au[2] == 0 ? 4 : 3;
+    if (len <= sc || au[0] != 0 || au[1] != 0 || au[sc - 1] != 1) {
+        return false;
+    }
+    return hevc ? ((au[sc] >> 1) & 0x3F) == 35 : (au[sc] & 0x1F) == 9;
+}
+
+void ts_mux_frame(ts_mux_t* mux, const uint8_t* prefix, size_t prefix_len,
+                  const uint8_t* au, size_t len, uint64_t pts_us, bool key) {
+    static const uint8_t aud_h264[] = { 0, 0, 0, 1, 0x09, 0xF0 };
+    static const uint8_t aud_h265[] = { 0, 0, 0, 1, 0x46, 0x01, 0x50 };
+
+    bool start = !mux->have_base;
+    if (start) {
+        mux->have_base = true;
+        mux->base_us = pts_us;
+    }
+    uint64_t pts = TS_CLOCK_START + (pts_us - mux->base_us) * 9 / 100;
+
+    if (key || start) {
+        ts_mux_tables(mux);
+    }
+
+    uint8_t pes[14] = { 0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x80, 5 };
+    put_pts(pes + 9, pts);
+
+    // The PES payload is gathered from up to four pieces
+    const uint8_t* piece[4];
+    size_t piece_len[4];
+    int pieces = 0;
+    piece[pieces] = pes;
+    piece_len[pieces++] = sizeof(pes);
+    if (!starts_with_aud(au, len, mux->hevc)) {
+        piece[pieces] = mux->hevc ? aud_h265 : aud_h264;
+        piece_len[pieces++] = mux->hevc ? sizeof(aud_h265) : sizeof(aud_h264);
+    }
+    if (prefix && prefix_len) {
+        piece[pieces] = prefix;
+        piece_len[pieces++] = prefix_len;
+    }
+    piece[pieces] = au;
+    piece_len[pieces++] = len;
+
+    size_t remaining = 0;
+    for (int i = 0; i < pieces; i++) {
+        remaining += piece_len[i];
+    }
+
+    int cur = 0;
+    size_t off = 0;
+    bool first = true;
+    while (remaining > 0) {
+        uint8_t pkt[TS_PACKET_LEN];
+        pkt[0] = 0x47;
+        pkt[1] = (first ? 0x40 : 0) | (TS_PID_VIDEO >> 8);
+        pkt[2] = TS_PID_VIDEO & 0xFF;
+
+        // Adaptation field: PCR on the first packet, stuffing on the last
+        size_t af = first ? 8 : 0;
+        size_t space = TS_PACKET_LEN - 4 - af;
+        if (remaining < space) {
+            af += space - remaining;
+            space = remaining;
+        }
+        pkt[3] = (af ? 0x30 : 0x10) | (mux->cc_video & 0x0F);
+        mux->cc_video = (mux->cc_video + 1) & 0x0F;
+
+        uint8_t* p = pkt + 4;
+        if (af) {
+            p[0] = (uint8_t)(af - 1);
+            if (af > 1) {
+                p[1] = 0;
+                size_t used = 2;
+                if (first) {
+                    p[1] = 0x10 | (key ? 0x40 : 0);
+                    put_pcr(p + 2, pts > TS_PCR_LEAD ? pts - TS_PCR_LEAD : 0);
+                    used += 6;
+                }
+                memset(p + used, 0xFF, af - used);
+            }
+            p += af;
+        }
+
+        size_t fill = space;
+        while (fill > 0) {
+            size_t n = piece_len[cur] - off;
+            if (n > fill) {
+                n = fill;
+            }
+            memcpy(p, piece[cur] + off, n);
+            p += n;
+            fill -= n;
+            off += n;
+            if (off == piece_len[cur]) {
+                cur++;
+                off = 0;
+            }
+        }
+        remaining -= space;
+        first = false;
+        mux->write(pkt, mux->user);
+    }
+}
@@ -7,6 +7,13 @@
 #include <termios.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <time.h>
+
+// Writer thread batches this many packets per writev()
+#define UART_TX_BATCH 8
 
 int uart_init(int port_num, int baud_rate) {
     char serial_port[20];
@@ -32,8 +39,8 @@ int uart_init(int port_num, int baud_rate) {
     // Create device path
     snprintf(serial_port, sizeof(serial_port), "/dev/ttyS%d", port_num);
 
-    // Open serial port
-    serial_fd = open(serial_port, O_RDWR | O_NOCTTY);
+    // Open serial port; writes never block the caller
+    serial_fd = open(serial_port, O_RDWR | O_NOCTTY | O_NONBLOCK);
     if (serial_fd == -1) {
         perror("Failed to open serial port");
         return -1;
@@ -55,6 +62,16 @@ int uart_init(int port_num, int baud_rate) {
     tty.c_cflag &= ~CSTOPB;    // One stop bit
     tty.c_cflag &= ~CSIZE;     // Clear current data size setting
     tty.c_cflag |= CS8;        // 8 data bits
+    tty.c_cflag |= CREAD | CLOCAL; // Enable receiver, ignore modem lines
+
+    // Raw mode: MAVLink is binary in both directions, so no line editing,
+    // echo, signal characters, flow control or CR/LF translation
+    tty.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHONL | ISIG | IEXTEN);
+    tty.c_iflag &= ~(IXON | IXOFF | IXANY | IGNBRK | BRKINT | PARMRK |
+                     ISTRIP | INLCR | IGNCR | ICRNL);
+    tty.c_oflag &= ~OPOST;
+    tty.c_cc[VMIN] = 0;        // Reads return whatever is buffered
+    tty.c_cc[VTIME] = 0;
 
     // Apply settings
     if (tcsetattr(serial_fd, TCSANOW, &tty) != 0) {
@@ -94,9 +111,8 @@ int uart_printf(int fd, const char *format, ...) {
     }
 
     // Write to UART
-    bytes_written = write(fd, buffer, len);
+    bytes_written = uart_write(fd, buffer, len);
     if (bytes_written < 0) {
-        perror("Error writing to UART");
         return -1;
     }
 
@@ -116,13 +132,271 @@ int uart_write(int fd, const void *data, size_t length) {
         return -1;
     }
 
-    bytes_written = write(fd, data, length);
-    if (bytes_written < 0) {
-        perror("Error writing to UART");
+    const uint8_t *ptr = (const uint8_t *)data;
+    size_t remaining = length;
+
+    while (remaining > 0) {
+        bytes_written = write(fd, ptr, remaining);
+        if (bytes_written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Non-blocking fd: wait for room in the tty buffer
+                struct pollfd pfd = {fd, POLLOUT, 0};
+                poll(&pfd, 1, 100);
+                continue;
+            }
+            if (errno == EINTR)
+                continue;
+            perror("Error writing to UART");
+            return -1;
+        }
+        ptr += bytes_written;
+        remaining -= bytes_written;
+    }
+
+    return (int)length;
+}
+
+// ---------------------------------------------------------------------------
+// Non-blocking transmit queue
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    uint16_t len;
+    uint64_t enqueue_us;        // When the packet was committed
+    uint8_t data[UART_TX_SLOT_SIZE];
+} uart_tx_slot_t;
+
+static struct {
+    int fd;
+    int capacity;
+    uart_tx_slot_t *slots;
+    int head;                   // Next slot to fill
+    int tail;                   // Oldest queued slot
+    int depth;
+    uint32_t queued_bytes;
+    volatile int running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uart_tx_stats_t stats;
+} g_tx = {-1, 0, NULL, 0, 0, 0, 0, 0, 0,
+          PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, {}};
+
+static uint64_t uart_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// Write a batch of packets, waiting on POLLOUT whenever the tty is full;
+// gives up on the rest once uart_tx_stop() clears running
+static void uart_tx_flush(struct iovec *iov, int count) {
+    int idx = 0;
+
+    while (idx < count) {
+        ssize_t n = writev(g_tx.fd, iov + idx, count - idx);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (!g_tx.running) {
+                    pthread_mutex_lock(&g_tx.lock);
+                    g_tx.stats.dropped_stopped += count - idx;
+                    pthread_mutex_unlock(&g_tx.lock);
+                    return;
+                }
+                struct pollfd pfd = {g_tx.fd, POLLOUT, 0};
+                poll(&pfd, 1, 100);
+                continue;
+            }
+            if (errno == EINTR)
+                continue;
+            pthread_mutex_lock(&g_tx.lock);
+            g_tx.stats.write_errors++;
+            pthread_mutex_unlock(&g_tx.lock);
+            return;
+        }
+
+        // Account completed packets, then trim a partially written one
+        pthread_mutex_lock(&g_tx.lock);
+        g_tx.stats.sent_bytes += n;
+        while (idx < count && (size_t)n >= iov[idx].iov_len) {
+            n -= iov[idx].iov_len;
+            idx++;
+            g_tx.stats.sent_packets++;
+        }
+        pthread_mutex_unlock(&g_tx.lock);
+        if (idx < count && n > 0) {
+            iov[idx].iov_base = (uint8_t *)iov[idx].iov_base + n;
+            iov[idx].iov_len -= n;
+        }
+    }
+}
+
+static void *uart_tx_thread(void *arg) {
+    (void)arg;
+    // Private copies let producers evict the oldest ring entry at any time
+    static uart_tx_slot_t batch[UART_TX_BATCH];
+    struct iovec iov[UART_TX_BATCH];
+
+    while (g_tx.running) {
+        pthread_mutex_lock(&g_tx.lock);
+        while (g_tx.depth == 0 && g_tx.running)
+            pthread_cond_wait(&g_tx.cond, &g_tx.lock);
+
+        int count = 0;
+        uint64_t now = uart_now_us();
+        while (g_tx.depth > 0 && count < UART_TX_BATCH) {
+            uart_tx_slot_t *slot = &g_tx.slots[g_tx.tail];
+            uint32_t wait = (uint32_t)(now - slot->enqueue_us);
+            if (wait > g_tx.stats.max_wait_us)
+                g_tx.stats.max_wait_us = wait;
+            g_tx.queued_bytes -= slot->len;
+            memcpy(batch[count].data, slot->data, slot->len);
+            iov[count].iov_base = batch[count].data;
+            iov[count].iov_len = slot->len;
+            count++;
+            g_tx.tail = (g_tx.tail + 1) % g_tx.capacity;
+            g_tx.depth--;
+        }
+        pthread_mutex_unlock(&g_tx.lock);
+
+        if (count > 0)
+            uart_tx_flush(iov, count);
+    }
+
+    return NULL;
+}
+
+int uart_tx_start(int fd, int capacity) {
+    if (fd < 0 || capacity <= 0) {
+        fprintf(stderr, "Invalid UART tx queue parameters\n");
         return -1;
     }
 
-    return (int)bytes_written;
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        perror("Error setting UART non-blocking");
+        return -1;
+    }
+
+    g_tx.slots = (uart_tx_slot_t *)calloc(capacity, sizeof(uart_tx_slot_t));
+    if (g_tx.slots == NULL) {
+        fprintf(stderr, "Out of memory for UART tx queue\n");
+        return -1;
+    }
+
+    g_tx.fd = fd;
+    g_tx.capacity = capacity;
+    g_tx.head = g_tx.tail = g_tx.depth = 0;
+    g_tx.queued_bytes = 0;
+    memset(&g_tx.stats, 0, sizeof(g_tx.stats));
+    g_tx.running = 1;
+
+    if (pthread_create(&g_tx.thread, NULL, uart_tx_thread, NULL) != 0) {
+        perror("Error creating UART writer thread");
+        g_tx.running = 0;
+        free(g_tx.slots);
+        g_tx.slots = NULL;
+        g_tx.fd = -1;
+        return -1;
+    }
+
+    printf("UART tx queue started (%d packets)\n", capacity);
+    return 0;
+}
+
+uint8_t *uart_tx_reserve(int fd) {
+    if (!g_tx.running || fd != g_tx.fd) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_tx.lock);
+
+    // Full: evict the oldest packet rather than block the producer
+    if (g_tx.depth == g_tx.capacity) {
+        g_tx.queued_bytes -= g_tx.slots[g_tx.tail].len;
+        g_tx.tail = (g_tx.tail + 1) % g_tx.capacity;
+        g_tx.depth--;
+        g_tx.stats.dropped_oldest++;
+    }
+
+    // The lock stays held until uart_tx_commit()/uart_tx_abort()
+    return g_tx.slots[g_tx.head].data;
+}
+
+int uart_tx_commit(size_t length) {
+    if (length == 0 || length > UART_TX_SLOT_SIZE) {
+        g_tx.stats.dropped_invalid++;
+        pthread_mutex_unlock(&g_tx.lock);
+        return -1;
+    }
+
+    g_tx.slots[g_tx.head].len = (uint16_t)length;
+    g_tx.slots[g_tx.head].enqueue_us = uart_now_us();
+    g_tx.queued_bytes += length;
+    g_tx.head = (g_tx.head + 1) % g_tx.capacity;
+    g_tx.depth++;
+
+    g_tx.stats.enqueued++;
+    if ((uint32_t)g_tx.depth > g_tx.stats.high_water)
+        g_tx.stats.high_water = g_tx.depth;
+
+    pthread_cond_signal(&g_tx.cond);
+    pthread_mutex_unlock(&g_tx.lock);
+
+    return (int)length;
+}
+
+void uart_tx_abort(void) {
+    pthread_mutex_unlock(&g_tx.lock);
+}
+
+int uart_tx_enqueue(const void *data, size_t length) {
+    if (data == NULL || length == 0 || length > UART_TX_SLOT_SIZE) {
+        pthread_mutex_lock(&g_tx.lock);
+        g_tx.stats.dropped_invalid++;
+        pthread_mutex_unlock(&g_tx.lock);
+        return -1;
+    }
+
+    uint8_t *slot = uart_tx_reserve(g_tx.fd);
+    if (slot == NULL) {
+        return -1;
+    }
+    memcpy(slot, data, length);
+    return uart_tx_commit(length);
+}
+
+int uart_tx_send(int fd, const void *data, size_t length) {
+    if (g_tx.running && fd == g_tx.fd) {
+        return uart_tx_enqueue(data, length);
+    }
+    return uart_write(fd, data, length);
+}
+
+void uart_tx_get_stats(uart_tx_stats_t *stats) {
+    pthread_mutex_lock(&g_tx.lock);
+    *stats = g_tx.stats;
+    stats->depth = g_tx.depth;
+    stats->queued_bytes = g_tx.queued_bytes;
+    stats->oldest_age_us = g_tx.depth > 0 ?
+        (uint32_t)(uart_now_us() - g_tx.slots[g_tx.tail].enqueue_us) : 0;
+    pthread_mutex_unlock(&g_tx.lock);
+}
+
+void uart_tx_stop(void) {
+    if (!g_tx.running) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_tx.lock);
+    g_tx.running = 0;
+    pthread_cond_broadcast(&g_tx.cond);
+    pthread_mutex_unlock(&g_tx.lock);
+    pthread_join(g_tx.thread, NULL);
+
+    free(g_tx.slots);
+    g_tx.slots = NULL;
+    g_tx.fd = -1;
 }
 
 void uart_close(int fd) {
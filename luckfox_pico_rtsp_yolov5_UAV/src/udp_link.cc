@@ -0,0 +1,145 @@
+#include "udp_link.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int udp_link_open(udp_link_t* link, const char* dest_ip, int dest_port, int local_port) {
+    memset(link, 0, sizeof(*link));
+    link->fd = -1;
+    pthread_mutex_init(&link->lock, NULL);
+
+    link->dest.sin_family = AF_INET;
+    link->dest.sin_port = htons(dest_port);
+    if (inet_pton(AF_INET, dest_ip, &link->dest.sin_addr) != 1) {
+        fprintf(stderr, "udp_link: invalid address %s\n", dest_ip);
+        return -1;
+    }
+
+    link->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (link->fd < 0) {
+        perror("udp_link: socket");
+        return -1;
+    }
+
+    if (local_port > 0) {
+        struct sockaddr_in local;
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_port = htons(local_port);
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(link->fd, (struct sockaddr*)&local, sizeof(local)) != 0) {
+            perror("udp_link: bind");
+            close(link->fd);
+            link->fd = -1;
+            return -1;
+        }
+    }
+
+    printf("udp_link: sending to %s:%d\n", dest_ip, dest_port);
+    return 0;
+}
+
+// Caller holds the lock
+static int flush_locked(udp_link_t* link) {
+    struct mmsghdr msgs[UDP_LINK_BATCH];
+    struct iovec iov[UDP_LINK_BATCH];
+    int count = link->pending;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    memset(msgs, 0, sizeof(msgs[0]) * count);
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = link->slots[i];
+        iov[i].iov_len = link->lens[i];
+        msgs[i].msg_hdr.msg_name = &link->dest;
+        msgs[i].msg_hdr.msg_namelen = sizeof(link->dest);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // A datagram socket either takes a packet whole or not at all, so a
+    // short count (full socket buffer) just drops the rest of the batch
+    int sent = 0;
+    while (sent < count) {
+        int n = sendmmsg(link->fd, msgs + sent, count - sent, 0);
+        link->stats.syscalls++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = sent; i < sent + n; i++) {
+            link->stats.bytes += msgs[i].msg_len;
+        }
+        sent += n;
+        if (n == 0) {
+            break;
+        }
+    }
+
+    link->stats.datagrams += sent;
+    link->stats.errors += count - sent;
+    link->pending = 0;
+    return sent;
+}
+
+uint8_t* udp_link_reserve(udp_link_t* link) {
+    pthread_mutex_lock(&link->lock);
+    if (link->pending == UDP_LINK_BATCH) {
+        flush_locked(link);
+    }
+    // The lock stays held until udp_link_commit()/udp_link_abort()
+    return link->slots[link->pending];
+}
+
+int udp_link_commit(udp_link_t* link, size_t length) {
+    if (length == 0 || length > UDP_LINK_SLOT_SIZE) {
+        pthread_mutex_unlock(&link->lock);
+        return -1;
+    }
+    link->lens[link->pending++] = (uint16_t)length;
+    pthread_mutex_unlock(&link->lock);
+    return (int)length;
+}
+
+void udp_link_abort(udp_link_t* link) {
+    pthread_mutex_unlock(&link->lock);
+}
+
+int udp_link_send(udp_link_t* link, const void* data, size_t length) {
+    ssize_t n = sendto(link->fd, data, length, 0,
+                       (struct sockaddr*)&link->dest, sizeof(link->dest));
+
+    pthread_mutex_lock(&link->lock);
+    link->stats.syscalls++;
+    if (n < 0) {
+        link->stats.errors++;
+    } else {
+        link->stats.datagrams++;
+        link->stats.bytes += n;
+    }
+    pthread_mutex_unlock(&link->lock);
+
+    return n < 0 ? -1 : (int)n;
+}
+
+int udp_link_flush(udp_link_t* link) {
+    pthread_mutex_lock(&link->lock);
+    int sent = flush_locked(link);
+    pthread_mutex_unlock(&link->lock);
+    return sent;
+}
+
+void udp_link_close(udp_link_t* link) {
+    if (link->fd >= 0) {
+        close(link->fd);
+        link->fd = -1;
+    }
+    link->pending = 0;
+}
@@ -0,0 +1,179 @@
+#include "venc_hires.h"
+#include "luckfox_mpi.h"
+#include "venc_profile.h"
+#include <stdio.h>
+#include <string.h>
+
+static long mem_available_kb()
+{
+    FILE* fp = fopen("/proc/meminfo", "r");
+    if (!fp)
+        return -1;
+    char line[128];
+    long kb = -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "MemAvailable: %ld kB", &kb) == 1)
+            break;
+    }
+    fclose(fp);
+    return kb;
+}
+
+int venc_hires_init(venc_hires_t* hires, int width, int height, RK_CODEC_ID_E codec,
+                    uint32_t kbps)
+{
+    memset(hires, 0, sizeof(*hires));
+    hires->vi_chn = VENC_HIRES_VI_CHN;
+    hires->venc_chn = VENC_HIRES_VENC_CHN;
+    hires->width = width;
+    hires->height = height;
+    hires->kbps = kbps;
+    hires->codec = codec;
+
+    long avail_before = mem_available_kb();
+
+    if (vi_chn_init_bound(hires->vi_chn, width, height, VENC_HIRES_VI_BUFS) != 0)
+        return -1;
+
+    // Recording favours quality over latency: VBR, long GOP, whole frames
+    venc_profile_t profile;
+    memset(&profile, 0, sizeof(profile));
+    profile.name = "hires";
+    profile.rc = VENC_PROFILE_RC_VBR;
+    profile.bitrate_kbps = kbps;
+    profile.max_kbps = kbps * 3 / 2;
+    profile.min_kbps = kbps / 4;
+    profile.gop = VENC_HIRES_GOP;
+    profile.slices = 1;
+    profile.stream_buf_cnt = 4;
+
+    VENC_CHN_ATTR_S attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.stVencAttr.enType = codec;
+    venc_profile_fill_attr(&profile, &attr);
+    attr.stVencAttr.enPixelFormat = RK_FMT_YUV420SP;
+    if (codec == RK_VIDEO_ID_HEVC)
+        attr.stVencAttr.u32Profile = H265E_PROFILE_MAIN;
+    else
+        attr.stVencAttr.u32Profile = H264E_PROFILE_HIGH;
+    attr.stVencAttr.u32PicWidth = width;
+    attr.stVencAttr.u32PicHeight = height;
+    attr.stVencAttr.u32VirWidth = width;
+    attr.stVencAttr.u32VirHeight = height;
+    attr.stVencAttr.u32BufSize = width * height / 2;
+    attr.stVencAttr.bByFrame = RK_TRUE;
+
+    if (RK_MPI_VENC_CreateChn(hires->venc_chn, &attr) != RK_SUCCESS) {
+        printf("venc_hires: CreateChn %d failed\n", hires->venc_chn);
+        RK_MPI_VI_DisableChn(0, hires->vi_chn);
+        return -1;
+    }
+    VENC_RECV_PIC_PARAM_S recv;
+    memset(&recv, 0, sizeof(recv));
+    recv.s32RecvPicNum = -1;
+    RK_MPI_VENC_StartRecvFrame(hires->venc_chn, &recv);
+
+    MPP_CHN_S src, dst;
+    src.enModId = RK_ID_VI;
+    src.s32DevId = 0;
+    src.s32ChnId = hires->vi_chn;
+    dst.enModId = RK_ID_VENC;
+    dst.s32DevId = 0;
+    dst.s32ChnId = hires->venc_chn;
+    if (RK_MPI_SYS_Bind(&src, &dst) != RK_SUCCESS) {
+        printf("venc_hires: bind VI chn %d -> VENC chn %d failed\n", hires->vi_chn, hires->venc_chn);
+        RK_MPI_VENC_StopRecvFrame(hires->venc_chn);
+        RK_MPI_VENC_DestroyChn(hires->venc_chn);
+        RK_MPI_VI_DisableChn(0, hires->vi_chn);
+        return -1;
+    }
+    hires->bound = true;
+
+    // NV12 capture buffers, the stream buffer, and a reconstructed plus a
+    // reference picture at the encoder's 16 (H.264) / 64 (H.265) alignment
+    size_t frame = (size_t)width * height * 3 / 2;
+    int a = codec == RK_VIDEO_ID_HEVC ? 64 : 16;
+    size_t aligned = (size_t)((width + a - 1) / a * a) * ((height + a - 1) / a * a) * 3 / 2;
+    hires->mem_estimate = VENC_HIRES_VI_BUFS * frame + attr.stVencAttr.u32BufSize + 2 * aligned;
+
+    long avail_after = mem_available_kb();
+    hires->mem_used_kb = avail_before >= 0 && avail_after >= 0 ? avail_before - avail_after : -1;
+
+    venc_sink_init(&hires->sink, hires->venc_chn, NULL, NULL, 10);
+    venc_sink_set_codec(&hires->sink, codec == RK_VIDEO_ID_HEVC);
+
+    printf("venc_hires: VI chn %d -> VENC chn %d bound, %dx%d %s at %u kbps, ~%zu KB of buffers\n",
+           hires->vi_chn, hires->venc_chn, width, height,
+           codec == RK_VIDEO_ID_HEVC ? "H.265" : "H.264", kbps, hires->mem_estimate / 1024);
+    return 0;
+}
+
+int venc_hires_start(venc_hires_t* hires)
+{
+    hires->load.sample_us = TEST_COMM_GetNowUs();
+    hires->live_load.sample_us = hires->load.sample_us;
+    return venc_sink_start(&hires->sink);
+}
+
+// Rate since the previous sample and pictures waiting in the encoder now
+static void sample_load(venc_hires_load_t* load, int chn, const venc_sink_stats_t* st,
+                        double* fps, double* mbps, uint32_t* backlog)
+{
+    RK_U64 now = TEST_COMM_GetNowUs();
+    double seconds = (now - load->sample_us) / 1e6;
+    *fps = seconds > 0 ? (st->latency_frames - load->frames) / seconds : 0;
+    *mbps = seconds > 0 ? (st->bytes - load->bytes) * 8 / seconds / 1e6 : 0;
+    load->frames = st->latency_frames;
+    load->bytes = st->bytes;
+    load->sample_us = now;
+
+    VENC_CHN_STATUS_S status;
+    memset(&status, 0, sizeof(status));
+    *backlog = RK_MPI_VENC_QueryStatus(chn, &status) == RK_SUCCESS ? status.u32LeftPics : 0;
+    if (*backlog > load->backlog_max)
+        load->backlog_max = *backlog;
+}
+
+void venc_hires_print_stats(venc_hires_t* hires, int live_chn, const venc_sink_stats_t* live,
+                            int live_pixels)
+{
+    double fps, mbps, live_fps, live_mbps;
+    uint32_t backlog, live_backlog;
+    venc_sink_stats_t stats;
+    venc_sink_get_stats(&hires->sink, &stats);
+    sample_load(&hires->load, hires->venc_chn, &stats, &fps, &mbps, &backlog);
+    sample_load(&hires->live_load, live_chn, live, &live_fps, &live_mbps, &live_backlog);
+
+    const venc_sink_stats_t* st = &stats;
+    double mpix = (fps * hires->width * hires->height + live_fps * live_pixels) / 1e6;
+    printf("VENC hires %dx%d: %.1f fps %.2f Mbit/s, capture->ENC avg=%llu peak=%u us, queued %u (max %u) | "
+           "live: %.1f fps %.2f Mbit/s, queued %u (max %u) | encoder %.1f Mpixel/s\n",
+           hires->width, hires->height, fps, mbps,
+           (unsigned long long)(st->latency_frames ? st->latency_sum_us / st->latency_frames : 0),
+           st->latency_max_us, backlog, hires->load.backlog_max,
+           live_fps, live_mbps, live_backlog, hires->live_load.backlog_max, mpix);
+    printf("VENC hires memory: ~%zu KB estimated (VI %d x %zu KB, stream, ref/recon), %ld KB MemAvailable drop at setup\n",
+           hires->mem_estimate / 1024, VENC_HIRES_VI_BUFS,
+           (size_t)hires->width * hires->height * 3 / 2 / 1024, hires->mem_used_kb);
+}
+
+void venc_hires_stop(venc_hires_t* hires)
+{
+    venc_sink_stop(&hires->sink);
+    if (!hires->bound)
+        return;
+
+    MPP_CHN_S src, dst;
+    src.enModId = RK_ID_VI;
+    src.s32DevId = 0;
+    src.s32ChnId = hires->vi_chn;
+    dst.enModId = RK_ID_VENC;
+    dst.s32DevId = 0;
+    dst.s32ChnId = hires->venc_chn;
+    RK_MPI_SYS_UnBind(&src, &dst);
+    hires->bound = false;
+
+    RK_MPI_VENC_StopRecvFrame(hires->venc_chn);
+    RK_MPI_VENC_DestroyChn(hires->venc_chn);
+    RK_MPI_VI_DisableChn(0, hires->vi_chn);
+}
@@ -0,0 +1,324 @@
+#include "venc_profile.h"
+#include "luckfox_mpi.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+// Indexed by venc_profile_id_t. Refresh rows are sized for the 720x480
+// stream (30 macroblock rows): low-latency refreshes the whole picture every
+// 15 frames and sends it as 4 slices.
+static const venc_profile_t venc_profiles[VENC_PROFILE_COUNT] = {
+    { "low-latency",   VENC_PROFILE_RC_CBR,  4096, 0,     0,    300, 2, 4, 2 },
+    { "low-bandwidth", VENC_PROFILE_RC_AVBR, 1024, 1536,  256,  120, 0, 1, 2 },
+    { "archival",      VENC_PROFILE_RC_VBR,  8192, 12288, 4096, 30,  0, 1, 4 },
+};
+
+static int slice_override = 0;
+
+const venc_profile_t* venc_profile_get(int id)
+{
+    if (id < 0 || id >= VENC_PROFILE_COUNT)
+        return NULL;
+    return &venc_profiles[id];
+}
+
+int venc_profile_find(const char* name)
+{
+    for (int i = 0; i < VENC_PROFILE_COUNT; i++) {
+        if (strcasecmp(name, venc_profiles[i].name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+void venc_profile_override_slices(int slices)
+{
+    slice_override = slices > 0 ? slices : 0;
+}
+
+int venc_profile_slices(const venc_profile_t* profile)
+{
+    return slice_override ? slice_override : (int)profile->slices;
+}
+
+void venc_profile_fill_attr(const venc_profile_t* profile, VENC_CHN_ATTR_S* attr)
+{
+    bool hevc = attr->stVencAttr.enType == RK_VIDEO_ID_HEVC;
+    VENC_RC_ATTR_S* rc = &attr->stRcAttr;
+
+    // The H.265 rate control structs are typedefs of the H.264 ones
+    memset(rc, 0, sizeof(*rc));
+    switch (profile->rc) {
+    case VENC_PROFILE_RC_CBR:
+        rc->enRcMode = hevc ? VENC_RC_MODE_H265CBR : VENC_RC_MODE_H264CBR;
+        rc->stH264Cbr.u32Gop = profile->gop;
+        rc->stH264Cbr.u32BitRate = profile->bitrate_kbps;
+        break;
+    case VENC_PROFILE_RC_VBR:
+        rc->enRcMode = hevc ? VENC_RC_MODE_H265VBR : VENC_RC_MODE_H264VBR;
+        rc->stH264Vbr.u32Gop = profile->gop;
+        rc->stH264Vbr.u32BitRate = profile->bitrate_kbps;
+        rc->stH264Vbr.u32MaxBitRate = profile->max_kbps;
+        rc->stH264Vbr.u32MinBitRate = profile->min_kbps;
+        break;
+    case VENC_PROFILE_RC_AVBR:
+        rc->enRcMode = hevc ? VENC_RC_MODE_H265AVBR : VENC_RC_MODE_H264AVBR;
+        rc->stH264Avbr.u32Gop = profile->gop;
+        rc->stH264Avbr.u32BitRate = profile->bitrate_kbps;
+        rc->stH264Avbr.u32MaxBitRate = profile->max_kbps;
+        rc->stH264Avbr.u32MinBitRate = profile->min_kbps;
+        break;
+    }
+
+    attr->stVencAttr.u32StreamBufCnt = profile->stream_buf_cnt;
+}
+
+int venc_profile_apply_extras(int chn, RK_CODEC_ID_E codec, int width, int height,
+                              const venc_profile_t* profile)
+{
+    int ret = 0;
+
+    VENC_INTRA_REFRESH_S refresh;
+    memset(&refresh, 0, sizeof(refresh));
+    refresh.bRefreshEnable = profile->refresh_rows ? RK_TRUE : RK_FALSE;
+    refresh.enIntraRefreshMode = INTRA_REFRESH_ROW;
+    refresh.u32RefreshNum = profile->refresh_rows;
+    if (RK_MPI_VENC_SetIntraRefresh(chn, &refresh) != RK_SUCCESS) {
+        printf("venc_profile: SetIntraRefresh failed on chn %d\n", chn);
+        ret = -1;
+    }
+
+    // Whole rows per slice, rounded up so there are never more than asked
+    int unit = codec == RK_VIDEO_ID_HEVC ? 64 : 16;
+    int cols = (width + unit - 1) / unit;
+    int rows = (height + unit - 1) / unit;
+    int slices = venc_profile_slices(profile);
+    VENC_SLICE_SPLIT_S split;
+    memset(&split, 0, sizeof(split));
+    split.bSplitEnable = slices > 1 ? RK_TRUE : RK_FALSE;
+    split.u32SplitMode = 1;     // By macroblock / CTU count
+    split.u32SplitSize = (rows + slices - 1) / slices * cols;
+    if (RK_MPI_VENC_SetSliceSplit(chn, &split) != RK_SUCCESS) {
+        printf("venc_profile: SetSliceSplit failed on chn %d\n", chn);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+void venc_profile_ctl_init(venc_profile_ctl_t* ctl, int chn, RK_CODEC_ID_E codec,
+                           int width, int height, int id)
+{
+    memset(ctl, 0, sizeof(*ctl));
+    ctl->chn = chn;
+    ctl->codec = codec;
+    ctl->width = width;
+    ctl->height = height;
+    ctl->active = id;
+    ctl->last_us = TEST_COMM_GetNowUs();
+}
+
+void venc_profile_sample(venc_profile_ctl_t* ctl, const venc_sink_stats_t* sink)
+{
+    venc_profile_stats_t* st = &ctl->stats[ctl->active];
+    uint64_t now = TEST_COMM_GetNowUs();
+
+    uint64_t frames = sink->latency_frames - ctl->last_frames;
+    uint64_t latency_sum = sink->latency_sum_us - ctl->last_latency_sum_us;
+
+    st->frames += frames;
+    st->bytes += sink->bytes - ctl->last_bytes;
+    st->active_us += now - ctl->last_us;
+    st->latency_sum_us += latency_sum;
+    if (frames > 0 && latency_sum / frames > st->latency_peak_us)
+        st->latency_peak_us = (uint32_t)(latency_sum / frames);
+
+    ctl->last_us = now;
+    ctl->last_bytes = sink->bytes;
+    ctl->last_frames = sink->latency_frames;
+    ctl->last_latency_sum_us = sink->latency_sum_us;
+}
+
+int venc_profile_switch(venc_profile_ctl_t* ctl, int id, const venc_sink_stats_t* sink)
+{
+    const venc_profile_t* profile = venc_profile_get(id);
+    if (!profile)
+        return -1;
+    if (id == ctl->active)
+        return 0;
+
+    VENC_CHN_ATTR_S attr;
+    memset(&attr, 0, sizeof(attr));
+    if (RK_MPI_VENC_GetChnAttr(ctl->chn, &attr) != RK_SUCCESS) {
+        printf("venc_profile: GetChnAttr failed on chn %d\n", ctl->chn);
+        ctl->errors++;
+        return -1;
+    }
+
+    // Output buffers are allocated at creation; keep the current count
+    RK_U32 buf_cnt = attr.stVencAttr.u32StreamBufCnt;
+    venc_profile_fill_attr(profile, &attr);
+    attr.stVencAttr.u32StreamBufCnt = buf_cnt;
+
+    if (RK_MPI_VENC_SetChnAttr(ctl->chn, &attr) != RK_SUCCESS) {
+        printf("venc_profile: SetChnAttr failed on chn %d\n", ctl->chn);
+        ctl->errors++;
+        return -1;
+    }
+
+    // Charge everything up to here to the profile being left
+    venc_profile_sample(ctl, sink);
+    ctl->active = id;
+    ctl->switches++;
+
+    if (venc_profile_apply_extras(ctl->chn, ctl->codec, ctl->width, ctl->height, profile) != 0)
+        ctl->errors++;
+
+    // Start the new settings on a clean reference
+    RK_MPI_VENC_RequestIDR(ctl->chn, RK_TRUE);
+
+    printf("venc_profile: chn %d now %s (gop %u, %u kbps)\n",
+           ctl->chn, profile->name, profile->gop, profile->bitrate_kbps);
+    return 0;
+}
+
+void venc_profile_print(const venc_profile_ctl_t* ctl)
+{
+    for (int i = 0; i < VENC_PROFILE_COUNT; i++) {
+        const venc_profile_stats_t* st = &ctl->stats[i];
+        if (st->active_us == 0)
+            continue;
+
+        double seconds = st->active_us / 1e6;
+        printf("VENC profile %s%s: %.2f Mbit/s over %.0f s, %llu frames, capture->ENC avg=%llu peak=%u us\n",
+               venc_profiles[i].name, i == ctl->active ? "*" : "",
+               st->bytes * 8 / seconds / 1e6, seconds,
+               (unsigned long long)st->frames,
+               (unsigned long long)(st->frames ? st->latency_sum_us / st->frames : 0),
+               st->latency_peak_us);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// H.264 / H.265 comparison
+// ---------------------------------------------------------------------------
+
+#define CODEC_COMPARE_GOP 60
+
+static int codec_compare_create(int chn, RK_CODEC_ID_E codec, int width, int height, int qp)
+{
+    VENC_CHN_ATTR_S attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.stVencAttr.enType = codec;
+    attr.stVencAttr.enPixelFormat = RK_FMT_YUV420SP;
+    if (codec == RK_VIDEO_ID_HEVC)
+        attr.stVencAttr.u32Profile = H265E_PROFILE_MAIN;
+    else
+        attr.stVencAttr.u32Profile = H264E_PROFILE_HIGH;
+    attr.stVencAttr.u32PicWidth = width;
+    attr.stVencAttr.u32PicHeight = height;
+    attr.stVencAttr.u32VirWidth = width;
+    attr.stVencAttr.u32VirHeight = height;
+    attr.stVencAttr.u32BufSize = width * height * 3 / 2;
+    attr.stVencAttr.u32StreamBufCnt = 2;
+    attr.stVencAttr.bByFrame = RK_TRUE;
+
+    // VENC_H265_FIXQP_S is the H.264 struct under another name
+    VENC_H264_FIXQP_S* fix = &attr.stRcAttr.stH264FixQp;
+    attr.stRcAttr.enRcMode = codec == RK_VIDEO_ID_HEVC ? VENC_RC_MODE_H265FIXQP
+                                                       : VENC_RC_MODE_H264FIXQP;
+    fix->u32Gop = CODEC_COMPARE_GOP;
+    fix->u32SrcFrameRateNum = 30;
+    fix->u32SrcFrameRateDen = 1;
+    fix->fr32DstFrameRateNum = 30;
+    fix->fr32DstFrameRateDen = 1;
+    fix->u32IQp = qp;
+    fix->u32PQp = qp;
+    fix->u32BQp = qp;
+
+    if (RK_MPI_VENC_CreateChn(chn, &attr) != RK_SUCCESS) {
+        printf("venc_codec_compare: CreateChn %d failed\n", chn);
+        return -1;
+    }
+    VENC_RECV_PIC_PARAM_S recv;
+    memset(&recv, 0, sizeof(recv));
+    recv.s32RecvPicNum = -1;
+    RK_MPI_VENC_StartRecvFrame(chn, &recv);
+    return 0;
+}
+
+static void codec_compare_destroy(int chn)
+{
+    RK_MPI_VENC_StopRecvFrame(chn);
+    RK_MPI_VENC_DestroyChn(chn);
+}
+
+// Bytes of the frame just sent to chn, 0 if none came out
+static uint64_t codec_compare_drain(int chn)
+{
+    VENC_STREAM_S stream;
+    VENC_PACK_S pack;
+    memset(&stream, 0, sizeof(stream));
+    stream.pstPack = &pack;
+
+    if (RK_MPI_VENC_GetStream(chn, &stream, 1000) != RK_SUCCESS)
+        return 0;
+    uint64_t bytes = 0;
+    RK_U32 count = stream.u32PackCount ? stream.u32PackCount : 1;
+    for (RK_U32 i = 0; i < count; i++)
+        bytes += stream.pstPack[i].u32Len;
+    RK_MPI_VENC_ReleaseStream(chn, &stream);
+    return bytes;
+}
+
+int venc_codec_compare(int vi_chn, int width, int height, int frames)
+{
+    static const int qps[] = { 26, 32, 38 };
+    const int avc_chn = 1, hevc_chn = 2;
+
+    printf("Codec comparison: %dx%d, %d frames per QP, GOP %d, same camera frames to both\n",
+           width, height, frames, CODEC_COMPARE_GOP);
+
+    for (size_t q = 0; q < sizeof(qps) / sizeof(qps[0]); q++) {
+        if (codec_compare_create(avc_chn, RK_VIDEO_ID_AVC, width, height, qps[q]) != 0)
+            return -1;
+        if (codec_compare_create(hevc_chn, RK_VIDEO_ID_HEVC, width, height, qps[q]) != 0) {
+            codec_compare_destroy(avc_chn);
+            return -1;
+        }
+
+        uint64_t avc_bytes = 0, hevc_bytes = 0;
+        int avc_frames = 0, hevc_frames = 0;
+        for (int f = 0; f < frames; f++) {
+            VIDEO_FRAME_INFO_S frame;
+            if (RK_MPI_VI_GetChnFrame(0, vi_chn, &frame, 1000) != RK_SUCCESS) {
+                printf("venc_codec_compare: no frame from VI chn %d\n", vi_chn);
+                break;
+            }
+            RK_MPI_VENC_SendFrame(avc_chn, &frame, 1000);
+            RK_MPI_VENC_SendFrame(hevc_chn, &frame, 1000);
+            RK_MPI_VI_ReleaseChnFrame(0, vi_chn, &frame);
+
+            uint64_t n = codec_compare_drain(avc_chn);
+            avc_bytes += n;
+            avc_frames += n > 0;
+            n = codec_compare_drain(hevc_chn);
+            hevc_bytes += n;
+            hevc_frames += n > 0;
+        }
+
+        codec_compare_destroy(avc_chn);
+        codec_compare_destroy(hevc_chn);
+
+        if (avc_frames == 0 || hevc_frames == 0) {
+            printf("venc_codec_compare: QP %d produced no output\n", qps[q]);
+            return -1;
+        }
+        double avc = (double)avc_bytes / avc_frames;
+        double hevc = (double)hevc_bytes / hevc_frames;
+        printf("  QP %d: H.264 %.0f B/frame (%.2f Mbit/s), H.265 %.0f B/frame (%.2f Mbit/s), "
+               "H.265/H.264 %.0f%%\n",
+               qps[q], avc, avc * 8 * 30 / 1e6, hevc, hevc * 8 * 30 / 1e6, 100.0 * hevc / avc);
+    }
+    return 0;
+}
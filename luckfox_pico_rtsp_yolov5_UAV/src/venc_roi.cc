@@ -0,0 +1,143 @@
+#include "venc_roi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void venc_roi_init(venc_roi_t* roi, int chn, int width, int height)
+{
+    memset(roi, 0, sizeof(*roi));
+    roi->chn = chn;
+    roi->width = width;
+    roi->height = height;
+}
+
+// Macroblock-aligned region around a box, with a margin of a quarter of its
+// larger side so a target moving between updates stays inside
+static RECT_S roi_rect_for(const venc_roi_t* roi, const mavlink_target_t* t)
+{
+    int margin = (t->width > t->height ? t->width : t->height) / 4;
+    if (margin < VENC_ROI_ALIGN)
+        margin = VENC_ROI_ALIGN;
+
+    int x0 = t->x - margin, y0 = t->y - margin;
+    int x1 = t->x + t->width + margin, y1 = t->y + t->height + margin;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > roi->width) x1 = roi->width;
+    if (y1 > roi->height) y1 = roi->height;
+
+    x0 &= ~(VENC_ROI_ALIGN - 1);
+    y0 &= ~(VENC_ROI_ALIGN - 1);
+    x1 = (x1 + VENC_ROI_ALIGN - 1) & ~(VENC_ROI_ALIGN - 1);
+    y1 = (y1 + VENC_ROI_ALIGN - 1) & ~(VENC_ROI_ALIGN - 1);
+    if (x1 > roi->width) x1 = roi->width & ~(VENC_ROI_ALIGN - 1);
+    if (y1 > roi->height) y1 = roi->height & ~(VENC_ROI_ALIGN - 1);
+
+    RECT_S r;
+    r.s32X = x0;
+    r.s32Y = y0;
+    r.u32Width = x1 > x0 ? x1 - x0 : VENC_ROI_ALIGN;
+    r.u32Height = y1 > y0 ? y1 - y0 : VENC_ROI_ALIGN;
+    return r;
+}
+
+static bool rect_close(const RECT_S* a, const RECT_S* b)
+{
+    return abs(a->s32X - b->s32X) < VENC_ROI_MOVE &&
+           abs(a->s32Y - b->s32Y) < VENC_ROI_MOVE &&
+           abs((int)(a->s32X + a->u32Width) - (int)(b->s32X + b->u32Width)) < VENC_ROI_MOVE &&
+           abs((int)(a->s32Y + a->u32Height) - (int)(b->s32Y + b->u32Height)) < VENC_ROI_MOVE;
+}
+
+// Every new region has an applied one within VENC_ROI_MOVE (order-free)
+static bool regions_unchanged(const venc_roi_t* roi, const RECT_S* rects, int count)
+{
+    if (count != roi->count)
+        return false;
+
+    bool used[VENC_ROI_MAX] = { false };
+    for (int i = 0; i < count; i++) {
+        int match = -1;
+        for (int j = 0; j < roi->count && match < 0; j++) {
+            if (!used[j] && rect_close(&rects[i], &roi->rects[j]))
+                match = j;
+        }
+        if (match < 0)
+            return false;
+        used[match] = true;
+    }
+    return true;
+}
+
+static void roi_apply(venc_roi_t* roi, const RECT_S* rects, int count, int qp)
+{
+    // Only touch slots that are or were enabled
+    int slots = count > roi->count ? count : roi->count;
+
+    for (int i = 0; i < slots; i++) {
+        VENC_ROI_ATTR_S attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.u32Index = i;
+        attr.bEnable = i < count ? RK_TRUE : RK_FALSE;
+        attr.bAbsQp = RK_FALSE;
+        attr.s32Qp = qp;
+        attr.bIntra = RK_FALSE;
+        attr.stRect = i < count ? rects[i] : roi->rects[i];
+
+        roi->stats.set_calls++;
+        if (RK_MPI_VENC_SetRoiAttr(roi->chn, &attr) != RK_SUCCESS)
+            roi->stats.errors++;
+    }
+
+    if (count > 0)
+        memcpy(roi->rects, rects, sizeof(RECT_S) * count);
+    roi->count = count;
+    roi->qp = qp;
+    roi->stats.updates++;
+    roi->stats.active = count;
+}
+
+int venc_roi_update(venc_roi_t* roi, const mavlink_target_t* targets, int count, int qp)
+{
+    roi->stats.frames++;
+
+    if (qp == 0)
+        count = 0;
+
+    // Most confident targets first; selection over at most a few dozen
+    int order[VENC_ROI_MAX];
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        int j;
+        if (n < VENC_ROI_MAX)
+            j = n++;
+        else if (targets[i].confidence > targets[order[VENC_ROI_MAX - 1]].confidence)
+            j = VENC_ROI_MAX - 1;
+        else
+            continue;
+        while (j > 0 && targets[order[j - 1]].confidence < targets[i].confidence) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    if (n == 0) {
+        // Ride out short detection gaps instead of flickering the map
+        if (roi->count == 0 || (++roi->idle_frames < VENC_ROI_HOLD_FRAMES && qp != 0))
+            return 0;
+        roi_apply(roi, NULL, 0, roi->qp);
+        return 1;
+    }
+    roi->idle_frames = 0;
+
+    RECT_S rects[VENC_ROI_MAX];
+    for (int i = 0; i < n; i++)
+        rects[i] = roi_rect_for(roi, &targets[order[i]]);
+
+    if (qp == roi->qp && regions_unchanged(roi, rects, n))
+        return 0;
+
+    roi_apply(roi, rects, n, qp);
+    return 1;
+}
@@ -0,0 +1,307 @@
+#include "venc_sink.h"
+#include "luckfox_mpi.h"
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void venc_sink_init(venc_sink_t* sink, int chn,
+                    rtsp_demo_handle rtsp_demo,
+                    rtsp_session_handle rtsp_session,
+                    int event_period_ms)
+{
+    memset(sink, 0, sizeof(*sink));
+    sink->chn = chn;
+    sink->rtsp_demo = rtsp_demo;
+    sink->rtsp_session = rtsp_session;
+    sink->event_period_ms = event_period_ms > 0 ? event_period_ms : 10;
+    pthread_mutex_init(&sink->stats_lock, NULL);
+}
+
+int venc_sink_add_consumer(venc_sink_t* sink, venc_sink_consumer_fn fn, void* user)
+{
+    if (sink->consumer_count >= VENC_SINK_MAX_CONSUMERS) {
+        fprintf(stderr, "venc_sink: too many consumers\n");
+        return -1;
+    }
+    sink->consumers[sink->consumer_count] = fn;
+    sink->consumer_user[sink->consumer_count] = user;
+    sink->consumer_count++;
+    return 0;
+}
+
+void venc_sink_set_prefix(venc_sink_t* sink, venc_sink_prefix_fn fn, void* user)
+{
+    sink->prefix = fn;
+    sink->prefix_user = user;
+}
+
+void venc_sink_set_codec(venc_sink_t* sink, bool hevc)
+{
+    sink->hevc = hevc;
+}
+
+int venc_sink_parameter_sets(const uint8_t* data, uint32_t len, bool hevc,
+                             uint8_t* sets, size_t size, bool* key)
+{
+    size_t sets_len = 0;
+    if (key)
+        *key = false;
+
+    size_t i = 0;
+    while (i + 3 < len) {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) {
+            i++;
+            continue;
+        }
+        size_t start = i + 3;
+        size_t end = start;
+        while (end + 2 < len && !(data[end] == 0 && data[end + 1] == 0 &&
+                                  (data[end + 2] == 1 || data[end + 2] == 0)))
+            end++;
+        if (end + 2 >= len)
+            end = len;
+        if (start >= end)
+            break;
+
+        int type;
+        bool param, vcl, irap;
+        if (hevc) {
+            type = (data[start] >> 1) & 0x3F;
+            param = type >= 32 && type <= 34;
+            vcl = type < 32;
+            irap = type >= 16 && type <= 21;
+        } else {
+            type = data[start] & 0x1F;
+            param = type == 7 || type == 8;
+            vcl = type >= 1 && type <= 5;
+            irap = type == 5;
+        }
+        if (vcl) {
+            if (key)
+                *key = irap;
+            break;
+        }
+        if (param) {
+            if (sets_len + 4 + (end - start) > size)
+                return -1;
+            sets[sets_len++] = 0;
+            sets[sets_len++] = 0;
+            sets[sets_len++] = 0;
+            sets[sets_len++] = 1;
+            memcpy(sets + sets_len, data + start, end - start);
+            sets_len += end - start;
+        }
+        i = end;
+    }
+    return (int)sets_len;
+}
+
+// Hand the parameter sets in front of the frame's first slice to the RTSP
+// session when they differ from the last ones
+static void venc_sink_update_codec_data(venc_sink_t* sink, const uint8_t* data, uint32_t len)
+{
+    uint8_t sets[VENC_SINK_CODEC_DATA_MAX];
+    int sets_len = venc_sink_parameter_sets(data, len, sink->hevc, sets, sizeof(sets), NULL);
+
+    if (sets_len <= 0 ||
+        ((size_t)sets_len == sink->codec_data_len && memcmp(sets, sink->codec_data, sets_len) == 0))
+        return;
+
+    memcpy(sink->codec_data, sets, sets_len);
+    sink->codec_data_len = sets_len;
+    rtsp_set_video(sink->rtsp_session,
+                   sink->hevc ? RTSP_CODEC_ID_VIDEO_H265 : RTSP_CODEC_ID_VIDEO_H264,
+                   sink->codec_data, (int)sink->codec_data_len);
+    pthread_mutex_lock(&sink->stats_lock);
+    sink->stats.codec_data_updates++;
+    pthread_mutex_unlock(&sink->stats_lock);
+    printf("venc_sink: %s parameter sets updated (%zu bytes)\n",
+           sink->hevc ? "H.265" : "H.264", sink->codec_data_len);
+}
+
+// Copy the prefix and the packet into the scratch buffer; falls back to
+// the bare packet when there is nothing to prepend
+static const uint8_t* venc_sink_apply_prefix(venc_sink_t* sink, const VENC_PACK_S* pack,
+                                             const uint8_t* data, uint32_t* len)
+{
+    size_t need = VENC_SINK_PREFIX_MAX + *len;
+    if (need > sink->scratch_size) {
+        uint8_t* grown = (uint8_t*)realloc(sink->scratch, need);
+        if (!grown)
+            return data;
+        sink->scratch = grown;
+        sink->scratch_size = need;
+    }
+
+    int n = sink->prefix(pack->u64PTS, sink->scratch, VENC_SINK_PREFIX_MAX, sink->prefix_user);
+    if (n <= 0 || n > VENC_SINK_PREFIX_MAX)
+        return data;
+
+    memcpy(sink->scratch + n, data, *len);
+    *len += n;
+    return sink->scratch;
+}
+
+// Slice and frame timing, taken after the packet was handed to RTSP;
+// called with stats_lock held
+static void venc_sink_time_packet(venc_sink_t* sink, const VENC_PACK_S* pack)
+{
+    RK_U64 now = TEST_COMM_GetNowUs();
+    if (now < pack->u64PTS)
+        return;
+
+    if (sink->frame_packets == 0) {
+        uint32_t first = (uint32_t)(now - pack->u64PTS);
+        sink->frame_first_us = now;
+        sink->stats.first_slice_sum_us += first;
+        sink->stats.first_slice_last_us = first;
+    } else {
+        uint32_t gap = (uint32_t)(now - sink->frame_last_us);
+        if (gap > sink->stats.slice_gap_max_us)
+            sink->stats.slice_gap_max_us = gap;
+    }
+    sink->frame_last_us = now;
+    sink->frame_packets++;
+
+    if (!pack->bFrameEnd)
+        return;
+
+    uint32_t latency = (uint32_t)(now - pack->u64PTS);
+    sink->stats.latency_frames++;
+    sink->stats.latency_sum_us += latency;
+    sink->stats.latency_last_us = latency;
+    if (latency > sink->stats.latency_max_us)
+        sink->stats.latency_max_us = latency;
+
+    if (sink->frame_packets > 1) {
+        sink->stats.sliced_frames++;
+        sink->stats.slices += sink->frame_packets;
+        sink->stats.slice_span_sum_us += now - sink->frame_first_us;
+    }
+    sink->stats.slices_last = sink->frame_packets;
+    sink->frame_packets = 0;
+}
+
+static void venc_sink_deliver(venc_sink_t* sink, VENC_STREAM_S* stream)
+{
+    // One pack per GetStream with the single-pack stream used here
+    RK_U32 count = stream->u32PackCount ? stream->u32PackCount : 1;
+
+    for (RK_U32 i = 0; i < count; i++) {
+        VENC_PACK_S* pack = &stream->pstPack[i];
+        const uint8_t* data = (const uint8_t*)RK_MPI_MB_Handle2VirAddr(pack->pMbBlk);
+        uint32_t len = pack->u32Len;
+
+        if (sink->rtsp_session && !sink->mid_frame)
+            venc_sink_update_codec_data(sink, data, len);
+        if (sink->prefix && !sink->mid_frame)
+            data = venc_sink_apply_prefix(sink, pack, data, &len);
+        sink->mid_frame = !pack->bFrameEnd;
+
+        if (sink->rtsp_session)
+            rtsp_tx_video(sink->rtsp_session, data, len, pack->u64PTS);
+
+        for (int c = 0; c < sink->consumer_count; c++)
+            sink->consumers[c](pack, data, len, sink->consumer_user[c]);
+
+        pthread_mutex_lock(&sink->stats_lock);
+        sink->stats.packets++;
+        sink->stats.bytes += pack->u32Len;
+
+        // PTS carries the VI capture time on the same monotonic clock
+        if (pack->u64PTS)
+            venc_sink_time_packet(sink, pack);
+        pthread_mutex_unlock(&sink->stats_lock);
+    }
+}
+
+static void* venc_sink_thread(void* arg)
+{
+    venc_sink_t* sink = (venc_sink_t*)arg;
+
+    VENC_STREAM_S stream;
+    VENC_PACK_S pack;
+    memset(&stream, 0, sizeof(stream));
+    stream.pstPack = &pack;
+
+    struct pollfd pfd;
+    pfd.fd = RK_MPI_VENC_GetFd(sink->chn);
+    pfd.events = POLLIN;
+    if (pfd.fd < 0)
+        printf("venc_sink: no poll fd for chn %d, falling back to timed GetStream\n", sink->chn);
+
+    RK_U64 last_event = TEST_COMM_GetNowUs();
+    RK_U64 period_us = (RK_U64)sink->event_period_ms * 1000;
+
+    while (sink->running) {
+        bool ready;
+        if (pfd.fd >= 0) {
+            pfd.revents = 0;
+            ready = poll(&pfd, 1, sink->event_period_ms) > 0 && (pfd.revents & POLLIN);
+        } else {
+            ready = true;
+        }
+
+        if (ready) {
+            // Drain everything the encoder has completed so far; the first
+            // GetStream waits only in the no-fd fallback. Inside a sliced
+            // frame the next slice is waited for directly.
+            RK_S32 timeout = pfd.fd >= 0 ? 0 : sink->event_period_ms;
+            while (RK_MPI_VENC_GetStream(sink->chn, &stream, timeout) == RK_SUCCESS) {
+                venc_sink_deliver(sink, &stream);
+                RK_MPI_VENC_ReleaseStream(sink->chn, &stream);
+                timeout = sink->mid_frame ? VENC_SINK_SLICE_WAIT_MS : 0;
+            }
+            pthread_mutex_lock(&sink->stats_lock);
+            sink->stats.wakeups++;
+            pthread_mutex_unlock(&sink->stats_lock);
+        }
+
+        // Service RTSP handshakes and RTCP regardless of encoder activity
+        RK_U64 now = TEST_COMM_GetNowUs();
+        if (sink->rtsp_demo && (ready || now - last_event >= period_us)) {
+            rtsp_do_event(sink->rtsp_demo);
+            pthread_mutex_lock(&sink->stats_lock);
+            sink->stats.rtsp_events++;
+            pthread_mutex_unlock(&sink->stats_lock);
+            last_event = now;
+        }
+    }
+
+    if (pfd.fd >= 0)
+        RK_MPI_VENC_CloseFd(sink->chn);
+
+    return NULL;
+}
+
+int venc_sink_start(venc_sink_t* sink)
+{
+    sink->running = 1;
+    if (pthread_create(&sink->thread, NULL, venc_sink_thread, sink) != 0) {
+        perror("venc_sink: pthread_create");
+        sink->running = 0;
+        return -1;
+    }
+    printf("venc_sink: draining VENC chn %d\n", sink->chn);
+    return 0;
+}
+
+void venc_sink_stop(venc_sink_t* sink)
+{
+    if (!sink->running)
+        return;
+    sink->running = 0;
+    pthread_join(sink->thread, NULL);
+
+    free(sink->scratch);
+    sink->scratch = NULL;
+    sink->scratch_size = 0;
+}
+
+void venc_sink_get_stats(venc_sink_t* sink, venc_sink_stats_t* stats)
+{
+    pthread_mutex_lock(&sink->stats_lock);
+    *stats = sink->stats;
+    pthread_mutex_unlock(&sink->stats_lock);
+}